@@ -25,7 +25,218 @@
 #include "qgsvectorfilewriter.h"
 #include "qgsvectordataprovider.h"
 #include "qgsdistancearea.h"
+#include "qgsgeoscontext.h"
 #include <QProgressDialog>
+#include <QtConcurrentMap>
+
+// number of geometries that are unioned together as one (parallel) batch of the cascaded union
+#define CASCADED_UNION_BATCH_SIZE 64
+
+/**Unions geometries in a cascade instead of adding them one by one to an ever growing result.
+  The geometries are collected in batches which are reduced pairwise as a balanced tree, the pairs of
+  a tree level are unioned in parallel. The batch results are merged like the digits of a binary counter,
+  so only about log2(n) partial results are kept in memory and each union combines two parts of similar
+  size. If the geometries are added in spatial order, neighbours are merged first.
+  The pairs are only unioned in parallel with the reentrant GEOS API, otherwise in the calling thread.*/
+class QgsCascadedUnion
+{
+  public:
+    QgsCascadedUnion() {}
+    ~QgsCascadedUnion()
+    {
+      qDeleteAll( mBatch );
+      qDeleteAll( mLevels );
+    }
+
+    /**Adds a geometry to the union. Takes ownership of the geometry*/
+    void addGeometry( QgsGeometry* geometry )
+    {
+      if ( !geometry )
+      {
+        return;
+      }
+      //convert in this thread, the workers only use the GEOS geometry
+      if ( !geometry->asGeos() )
+      {
+        QgsDebugMsg( "invalid geometry, skipping" );
+        delete geometry;
+        return;
+      }
+      mBatch << geometry;
+      if ( mBatch.size() >= CASCADED_UNION_BATCH_SIZE )
+      {
+        reduceBatch();
+      }
+    }
+
+    /**Returns the union of the added geometries (or 0 if there are none) and resets the union.
+      The caller takes ownership of the geometry*/
+    QgsGeometry* result()
+    {
+      reduceBatch();
+      QgsGeometry* unionGeometry = 0;
+      for ( int i = 0; i < mLevels.size(); ++i )
+      {
+        unionGeometry = unionAndDelete( qMakePair( mLevels[i], unionGeometry ) );
+      }
+      mLevels.clear();
+      return unionGeometry;
+    }
+
+  private:
+    typedef QPair<QgsGeometry*, QgsGeometry*> GeometryPair;
+
+    void reduceBatch()
+    {
+      QList<QgsGeometry*> parts = mBatch;
+      mBatch.clear();
+      while ( parts.size() > 1 )
+      {
+        QList<GeometryPair> pairs;
+        for ( int i = 0; i < parts.size(); i += 2 )
+        {
+          pairs << qMakePair( parts[i], i + 1 < parts.size() ? parts[i + 1] : ( QgsGeometry* ) 0 );
+        }
+#ifdef HAVE_GEOS_CONTEXT
+        parts = QtConcurrent::blockingMapped< QList<QgsGeometry*> >( pairs, unionPair );
+#else
+        parts.clear();
+        for ( int i = 0; i < pairs.size(); ++i )
+        {
+          parts << unionPair( pairs[i] );
+        }
+#endif
+        //the input geometries are deleted in this thread
+        for ( int i = 0; i < pairs.size(); ++i )
+        {
+          deleteUnioned( pairs[i], parts[i] );
+        }
+      }
+      if ( parts.isEmpty() )
+      {
+        return;
+      }
+
+      //add the batch result as carry to the partial results
+      QgsGeometry* carry = parts[0];
+      for ( int level = 0; carry; ++level )
+      {
+        if ( level == mLevels.size() )
+        {
+          mLevels << 0;
+        }
+        if ( !mLevels[level] )
+        {
+          mLevels[level] = carry;
+          carry = 0;
+        }
+        else
+        {
+          carry = unionAndDelete( qMakePair( mLevels[level], carry ) );
+          mLevels[level] = 0;
+        }
+      }
+    }
+
+    /**Unions the two geometries (either of them may be 0). Returns one of them if the other is 0 or
+      the union failed. Doesn't delete the geometries, runs in worker threads with HAVE_GEOS_CONTEXT*/
+    static QgsGeometry* unionPair( const GeometryPair& pair )
+    {
+      if ( !pair.second )
+      {
+        return pair.first;
+      }
+      if ( !pair.first )
+      {
+        return pair.second;
+      }
+
+#ifdef HAVE_GEOS_CONTEXT
+      //the GEOS geometries exist already (addGeometry, union results), asGeos doesn't convert
+      GEOSContextHandle_t context = QgsGeosContext::threadContext();
+      const GEOSGeometry* first = pair.first->asGeos();
+      const GEOSGeometry* second = pair.second->asGeos();
+      GEOSGeometry* unionGeos = GEOSUnion_r( context, first, second );
+      if ( unionGeos && GEOSGeomTypeId_r( context, first ) == GEOS_LINESTRING
+           && GEOSGeomTypeId_r( context, second ) == GEOS_LINESTRING )
+      {
+        GEOSGeometry* mergedGeos = GEOSLineMerge_r( context, unionGeos );
+        if ( mergedGeos )
+        {
+          GEOSGeom_destroy_r( context, unionGeos );
+          unionGeos = mergedGeos;
+        }
+      }
+      QgsGeometry* unionGeometry = 0;
+      if ( unionGeos )
+      {
+        unionGeometry = new QgsGeometry();
+        unionGeometry->fromGeos( unionGeos );
+      }
+#else
+      QgsGeometry* unionGeometry = pair.first->combine( pair.second );
+#endif
+      if ( !unionGeometry )
+      {
+        QgsDebugMsg( "union failed, skipping geometry" );
+        return pair.first;
+      }
+      return unionGeometry;
+    }
+
+    /**Deletes the geometries of the pair that are not the union result*/
+    static void deleteUnioned( const GeometryPair& pair, QgsGeometry* unionGeometry )
+    {
+      if ( pair.first != unionGeometry )
+      {
+        delete pair.first;
+      }
+      if ( pair.second != unionGeometry )
+      {
+        delete pair.second;
+      }
+    }
+
+    /**Unions the two geometries in this thread and deletes them*/
+    static QgsGeometry* unionAndDelete( const GeometryPair& pair )
+    {
+      QgsGeometry* unionGeometry = unionPair( pair );
+      deleteUnioned( pair, unionGeometry );
+      return unionGeometry;
+    }
+
+    QList<QgsGeometry*> mBatch;
+    /**Partial results, mLevels[i] is the union of 2^i batches (or 0)*/
+    QList<QgsGeometry*> mLevels;
+};
+
+/**Position of the geometry center on a Z-order curve through the extent. Sorting by this key keeps
+  features that are close to each other close in the sequence*/
+static quint32 zOrderKey( QgsGeometry* geometry, const QgsRectangle& extent )
+{
+  if ( !geometry || extent.width() <= 0 || extent.height() <= 0 )
+  {
+    return 0;
+  }
+
+  QgsPoint center = geometry->boundingBox().center();
+  quint32 x = ( quint32 )( qBound( 0.0, ( center.x() - extent.xMinimum() ) / extent.width(), 1.0 ) * 65535 );
+  quint32 y = ( quint32 )( qBound( 0.0, ( center.y() - extent.yMinimum() ) / extent.height(), 1.0 ) * 65535 );
+
+  quint32 key = 0;
+  for ( int i = 0; i < 16; ++i )
+  {
+    key |= (( x >> i ) & 1 ) << ( 2 * i );
+    key |= (( y >> i ) & 1 ) << ( 2 * i + 1 );
+  }
+  return key;
+}
+
+/**Orders the geometries of a dissolve group by their Z-order key only, qStableSort keeps the read order of equal keys*/
+static bool zOrderLessThan( const QPair<quint32, QgsGeometry*>& first, const QPair<quint32, QgsGeometry*>& second )
+{
+  return first.first < second.first;
+}
 
 bool QgsGeometryAnalyzer::simplify( QgsVectorLayer* layer, const QString& shapefileName,
                                     double tolerance, bool onlySelectedFeatures, QProgressDialog* p )
@@ -613,7 +824,15 @@ bool QgsGeometryAnalyzer::dissolve( QgsVectorLayer* layer, const QString& shapef
 
   QgsVectorFileWriter vWriter( shapefileName, dp->encoding(), dp->fields(), outputType, &crs );
   QgsFeature currentFeature;
-  QMultiMap<QString, int> map;
+
+  //group the geometries by the dissolve attribute, each group keeps the attributes of its first feature.
+  //Within a group, the geometries are sorted along a Z-order curve so that the cascaded union merges
+  //neighbouring features first. The geometries are kept from this pass, a group holds them for the
+  //union anyway, and the features are not fetched again by id
+  QgsRectangle layerExtent = layer->extent();
+  QMap<QString, QList< QPair<quint32, QgsGeometry*> > > groups;
+  QMap<QString, QgsAttributeMap> groupAttributes;
+  int nFeatures = 0;
 
   if ( onlySelectedFeatures )
   {
@@ -626,7 +845,8 @@ bool QgsGeometryAnalyzer::dissolve( QgsVectorLayer* layer, const QString& shapef
       {
         continue;
       }
-      map.insert( currentFeature.attributeMap()[ uniqueIdField ].toString(), currentFeature.id() );
+      addDissolveGeometry( currentFeature, useField, uniqueIdField, layerExtent, groups, groupAttributes );
+      ++nFeatures;
     }
   }
   else
@@ -634,113 +854,91 @@ bool QgsGeometryAnalyzer::dissolve( QgsVectorLayer* layer, const QString& shapef
     layer->select( layer->pendingAllAttributesList(), QgsRectangle(), true, false );
     while ( layer->nextFeature( currentFeature ) )
     {
-      map.insert( currentFeature.attributeMap()[ uniqueIdField ].toString(), currentFeature.id() );
+      addDissolveGeometry( currentFeature, useField, uniqueIdField, layerExtent, groups, groupAttributes );
+      ++nFeatures;
     }
   }
 
-  QgsGeometry *dissolveGeometry = 0; //dissolve geometry
-  QMultiMap<QString, int>::const_iterator jt = map.constBegin();
-  QgsFeature outputFeature;
-  while ( jt != map.constEnd() )
+  if ( p )
   {
-    QString currentKey = jt.key();
-    int processedFeatures = 0;
-    bool first = true;
-    //take only selection
-    if ( onlySelectedFeatures )
+    p->setMaximum( nFeatures );
+  }
+
+  int processedFeatures = 0;
+  bool canceled = false;
+  QMap<QString, QList< QPair<quint32, QgsGeometry*> > >::iterator jt = groups.begin();
+  for ( ; jt != groups.end(); ++jt )
+  {
+    QList< QPair<quint32, QgsGeometry*> >& geometries = jt.value();
+    if ( canceled )
     {
-      //use QgsVectorLayer::featureAtId
-      const QgsFeatureIds selection = layer->selectedFeaturesIds();
-      if ( p )
-      {
-        p->setMaximum( selection.size() );
-      }
-      while ( jt != map.constEnd() && ( jt.key() == currentKey || !useField ) )
+      for ( int i = 0; i < geometries.size(); ++i )
       {
-        if ( p && p->wasCanceled() )
-        {
-          break;
-        }
-        if ( selection.contains( jt.value() ) )
-        {
-          if ( p )
-          {
-            p->setValue( processedFeatures );
-          }
-          if ( !layer->featureAtId( jt.value(), currentFeature, true, true ) )
-          {
-            continue;
-          }
-          if ( first )
-          {
-            outputFeature.setAttributeMap( currentFeature.attributeMap() );
-            first = false;
-          }
-          dissolveFeature( currentFeature, processedFeatures, &dissolveGeometry );
-          ++processedFeatures;
-        }
-        ++jt;
+        delete geometries[i].second;
       }
+      continue;
     }
-    //take all features
-    else
+    qStableSort( geometries.begin(), geometries.end(), zOrderLessThan );
+
+    //the union takes the geometries
+    QgsCascadedUnion dissolveUnion;
+    for ( int i = 0; i < geometries.size(); ++i )
     {
-      int featureCount = layer->featureCount();
-      if ( p )
+      if ( p && !canceled )
       {
-        p->setMaximum( featureCount );
+        p->setValue( processedFeatures );
+        canceled = p->wasCanceled();
       }
-      while ( jt != map.constEnd() && ( jt.key() == currentKey || !useField ) )
-      {
-        if ( p )
-        {
-          p->setValue( processedFeatures );
-        }
+      ++processedFeatures;
 
-        if ( p && p->wasCanceled() )
-        {
-          break;
-        }
-        if ( !layer->featureAtId( jt.value(), currentFeature, true, true ) )
-        {
-          continue;
-        }
-        {
-          outputFeature.setAttributeMap( currentFeature.attributeMap() );
-          first = false;
-        }
-        dissolveFeature( currentFeature, processedFeatures, &dissolveGeometry );
-        ++processedFeatures;
-        ++jt;
+      if ( canceled )
+      {
+        delete geometries[i].second;
+        continue;
       }
+      dissolveUnion.addGeometry( geometries[i].second );
+    }
+    geometries.clear();
+
+    if ( canceled )
+    {
+      continue;
+    }
+
+    QgsGeometry* dissolveGeometry = dissolveUnion.result();
+    if ( !dissolveGeometry )
+    {
+      continue;
     }
+    QgsFeature outputFeature;
+    outputFeature.setAttributeMap( groupAttributes.value( jt.key() ) );
     outputFeature.setGeometry( dissolveGeometry );
     vWriter.addFeature( outputFeature );
   }
+
+  if ( p )
+  {
+    p->setValue( nFeatures );
+  }
   return true;
 }
 
-void QgsGeometryAnalyzer::dissolveFeature( QgsFeature& f, int nProcessedFeatures, QgsGeometry** dissolveGeometry )
+void QgsGeometryAnalyzer::addDissolveGeometry( QgsFeature& f, bool useField, int uniqueIdField, const QgsRectangle& extent,
+    QMap<QString, QList< QPair<quint32, QgsGeometry*> > >& groups,
+    QMap<QString, QgsAttributeMap>& groupAttributes )
 {
-  QgsGeometry* featureGeometry = f.geometry();
-
-  if ( !featureGeometry )
+  QString key = useField ? f.attributeMap()[ uniqueIdField ].toString() : QString();
+  if ( !groupAttributes.contains( key ) )
   {
-    return;
+    groupAttributes.insert( key, f.attributeMap() );
   }
 
-  if ( nProcessedFeatures == 0 )
-  {
-    int geomSize = featureGeometry->wkbSize();
-    *dissolveGeometry = new QgsGeometry();
-    unsigned char* wkb = new unsigned char[geomSize];
-    memcpy( wkb, featureGeometry->asWkb(), geomSize );
-    ( *dissolveGeometry )->fromWkb( wkb, geomSize );
-  }
-  else
+  QgsGeometry* featureGeometry = f.geometry();
+  if ( !featureGeometry )
   {
-    *dissolveGeometry = ( *dissolveGeometry )->combine( featureGeometry );
+    return;
   }
+  groups[ key ] << qMakePair( zOrderKey( featureGeometry, extent ), new QgsGeometry( *featureGeometry ) );
 }
 
 bool QgsGeometryAnalyzer::buffer( QgsVectorLayer* layer, const QString& shapefileName, double bufferDistance,
@@ -766,7 +964,7 @@ bool QgsGeometryAnalyzer::buffer( QgsVectorLayer* layer, const QString& shapefil
 
   QgsVectorFileWriter vWriter( shapefileName, dp->encoding(), dp->fields(), outputType, &crs );
   QgsFeature currentFeature;
-  QgsGeometry *dissolveGeometry = 0; //dissolve geometry (if dissolve enabled)
+  QgsCascadedUnion dissolveUnion; //union of the buffers (if dissolve enabled)
 
   //take only selection
   if ( onlySelectedFeatures )
@@ -795,7 +993,7 @@ bool QgsGeometryAnalyzer::buffer( QgsVectorLayer* layer, const QString& shapefil
       {
         continue;
       }
-      bufferFeature( currentFeature, processedFeatures, &vWriter, dissolve, &dissolveGeometry, bufferDistance, bufferDistanceField );
+      bufferFeature( currentFeature, &vWriter, dissolve ? &dissolveUnion : 0, bufferDistance, bufferDistanceField );
       ++processedFeatures;
     }
 
@@ -827,7 +1025,7 @@ bool QgsGeometryAnalyzer::buffer( QgsVectorLayer* layer, const QString& shapefil
       {
         break;
       }
-      bufferFeature( currentFeature, processedFeatures, &vWriter, dissolve, &dissolveGeometry, bufferDistance, bufferDistanceField );
+      bufferFeature( currentFeature, &vWriter, dissolve ? &dissolveUnion : 0, bufferDistance, bufferDistanceField );
       ++processedFeatures;
     }
     if ( p )
@@ -839,6 +1037,7 @@ bool QgsGeometryAnalyzer::buffer( QgsVectorLayer* layer, const QString& shapefil
   if ( dissolve )
   {
     QgsFeature dissolveFeature;
+    QgsGeometry* dissolveGeometry = dissolveUnion.result();
     if ( !dissolveGeometry )
     {
       QgsDebugMsg( "no dissolved geometry - should not happen" );
@@ -850,12 +1049,11 @@ bool QgsGeometryAnalyzer::buffer( QgsVectorLayer* layer, const QString& shapefil
   return true;
 }
 
-void QgsGeometryAnalyzer::bufferFeature( QgsFeature& f, int nProcessedFeatures, QgsVectorFileWriter* vfw, bool dissolve,
-    QgsGeometry** dissolveGeometry, double bufferDistance, int bufferDistanceField )
+void QgsGeometryAnalyzer::bufferFeature( QgsFeature& f, QgsVectorFileWriter* vfw, QgsCascadedUnion* dissolveUnion,
+    double bufferDistance, int bufferDistanceField )
 {
   double currentBufferDistance;
   QgsGeometry* featureGeometry = f.geometry();
-  QgsGeometry* tmpGeometry = 0;
   QgsGeometry* bufferGeometry = 0;
 
   if ( !featureGeometry )
@@ -874,19 +1072,9 @@ void QgsGeometryAnalyzer::bufferFeature( QgsFeature& f, int nProcessedFeatures,
   }
   bufferGeometry = featureGeometry->buffer( currentBufferDistance, 5 );
 
-  if ( dissolve )
+  if ( dissolveUnion )
   {
-    if ( nProcessedFeatures == 0 )
-    {
-      *dissolveGeometry = bufferGeometry;
-    }
-    else
-    {
-      tmpGeometry = *dissolveGeometry;
-      *dissolveGeometry = ( *dissolveGeometry )->combine( bufferGeometry );
-      delete tmpGeometry;
-      delete bufferGeometry;
-    }
+    dissolveUnion->addGeometry( bufferGeometry );
   }
   else //dissolve
   {
@@ -26,6 +26,7 @@
 #include "qgsdistancearea.h"
 
 class QgsVectorFileWriter;
+class QgsCascadedUnion;
 class QProgressDialog;
 
 
@@ -108,13 +109,17 @@ class ANALYSIS_EXPORT QgsGeometryAnalyzer
     void simplifyFeature( QgsFeature& f, QgsVectorFileWriter* vfw, double tolerance );
     /**Helper function to get the cetroid of an individual feature*/
     void centroidFeature( QgsFeature& f, QgsVectorFileWriter* vfw );
-    /**Helper function to buffer an individual feature*/
-    void bufferFeature( QgsFeature& f, int nProcessedFeatures, QgsVectorFileWriter* vfw, bool dissolve, QgsGeometry** dissolveGeometry,
+    /**Helper function to buffer an individual feature. If dissolveUnion is not 0, the buffer is added to it
+      instead of being written*/
+    void bufferFeature( QgsFeature& f, QgsVectorFileWriter* vfw, QgsCascadedUnion* dissolveUnion,
                         double bufferDistance, int bufferDistanceField );
     /**Helper function to get the convex hull of feature(s)*/
     void convexFeature( QgsFeature& f, int nProcessedFeatures, QgsGeometry** dissolveGeometry );
-    /**Helper function to dissolve feature(s)*/
-    void dissolveFeature( QgsFeature& f, int nProcessedFeatures, QgsGeometry** dissolveGeometry );
+    /**Helper function to dissolve feature(s): adds a copy of the feature geometry to the group of its dissolve
+      attribute (with its Z-order key) and keeps the attributes of the first feature of the group*/
+    void addDissolveGeometry( QgsFeature& f, bool useField, int uniqueIdField, const QgsRectangle& extent,
+                              QMap<QString, QList< QPair<quint32, QgsGeometry*> > >& groups,
+                              QMap<QString, QgsAttributeMap>& groupAttributes );
 
 };
 #endif //QGSVECTORANALYZER
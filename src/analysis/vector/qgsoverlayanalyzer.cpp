@@ -25,159 +25,545 @@
 #include "qgsvectorfilewriter.h"
 #include "qgsvectordataprovider.h"
 #include "qgsdistancearea.h"
+#include "qgsgeoscontext.h"
 #include <QProgressDialog>
+#include <QtConcurrentMap>
 
-bool QgsOverlayAnalyzer::intersection( QgsVectorLayer* layerA, QgsVectorLayer* layerB,
-                                       const QString& shapefileName, bool onlySelectedFeatures,
-                                       QProgressDialog* p )
+// number of input features that are overlaid together (in parallel) before their results are written
+#define OVERLAY_CHUNK_SIZE 256
+
+/**An input feature with the overlay features its bounding box intersects. The jobs of a chunk are
+  processed in worker threads (with the reentrant GEOS API), the overlay features are shared by the
+  jobs and only read (their lazily computed GEOS envelope is computed before, see cacheEnvelope)*/
+struct QgsOverlayAnalyzer::OverlayJob
 {
-  if ( !layerA && !layerB )
+  QgsFeature feature;
+  QList<QgsFeature*> candidates;
+  int outputs;
+  bool reversed;
+  int nFieldsA;
+  QList<QgsFeature*> results;
+};
+
+/**Attributes of an output feature. The attributes of the second layer follow the nFieldsA attributes of the first one*/
+static QgsAttributeMap outputAttributes( const QgsAttributeMap& inputAttributes, const QgsAttributeMap* overlayAttributes,
+    bool reversed, int nFieldsA )
+{
+  const QgsAttributeMap* first = reversed ? overlayAttributes : &inputAttributes;
+  const QgsAttributeMap* second = reversed ? &inputAttributes : overlayAttributes;
+
+  QgsAttributeMap attributes;
+  if ( first )
   {
-    return false;
+    attributes = *first;
   }
-
-  QgsVectorDataProvider* dpA = layerA->dataProvider();
-  QgsVectorDataProvider* dpB = layerB->dataProvider();
-  if ( !dpA && !dpB )
+  if ( second )
   {
-    return false;
+    QgsAttributeMap::const_iterator it = second->constBegin();
+    for ( ; it != second->constEnd(); ++it )
+    {
+      attributes.insert( nFieldsA + it.key(), it.value() );
+    }
   }
+  return attributes;
+}
 
-  QGis::WkbType outputType = dpA->geometryType();
-  const QgsCoordinateReferenceSystem crs = layerA->crs();
-  QgsFieldMap fieldsA = dpA->fields();
-  QgsFieldMap fieldsB = dpB->fields();
-  combineFieldLists( fieldsA, fieldsB );
+/**GEOS operations of the overlay jobs. With the reentrant GEOS API they use the context of the worker
+  thread, otherwise the global handle (the jobs are processed in the calling thread then).
+  The input geometry is prepared for the intersects tests if GEOS supports it*/
+class QgsOverlayGeos
+{
+  public:
+    QgsOverlayGeos( GEOSGeometry* geometry, bool prepare )
+        : mGeometry( geometry )
+#ifdef HAVE_GEOS_CONTEXT
+        , mContext( QgsGeosContext::threadContext() )
+        , mPrepared( 0 )
+#endif
+    {
+#ifdef HAVE_GEOS_CONTEXT
+      if ( prepare )
+      {
+        mPrepared = GEOSPrepare_r( mContext, mGeometry );
+      }
+#else
+      Q_UNUSED( prepare );
+#endif
+    }
 
-  QgsVectorFileWriter vWriter( shapefileName, dpA->encoding(), fieldsA, outputType, &crs );
-  QgsFeature currentFeature;
-  QgsSpatialIndex index;
+    ~QgsOverlayGeos()
+    {
+#ifdef HAVE_GEOS_CONTEXT
+      if ( mPrepared )
+      {
+        GEOSPreparedGeom_destroy_r( mContext, mPrepared );
+      }
+#endif
+    }
 
-  //take only selection
-  if ( onlySelectedFeatures )
-  {
-    const QgsFeatureIds selectionB = layerB->selectedFeaturesIds();
-    QgsFeatureIds::const_iterator it = selectionB.constBegin();
-    for ( ; it != selectionB.constEnd(); ++it )
+    /**True if the input geometry intersects the other geometry*/
+    bool intersects( GEOSGeometry* other )
     {
-      if ( !layerB->featureAtId( *it, currentFeature, true, true ) )
+#ifdef HAVE_GEOS_CONTEXT
+      if ( mPrepared )
       {
-        continue;
+        return GEOSPreparedIntersects_r( mContext, mPrepared, other ) == 1;
       }
-      index.insertFeature( currentFeature );
+      return GEOSIntersects_r( mContext, mGeometry, other ) == 1;
+#else
+      return GEOSIntersects( mGeometry, other ) == 1;
+#endif
     }
-    //use QgsVectorLayer::featureAtId
-    const QgsFeatureIds selectionA = layerA->selectedFeaturesIds();
-    if ( p )
+
+    GEOSGeometry* intersection( GEOSGeometry* other )
+    {
+#ifdef HAVE_GEOS_CONTEXT
+      return GEOSIntersection_r( mContext, mGeometry, other );
+#else
+      return GEOSIntersection( mGeometry, other );
+#endif
+    }
+
+    GEOSGeometry* difference( GEOSGeometry* other )
+    {
+#ifdef HAVE_GEOS_CONTEXT
+      return GEOSDifference_r( mContext, mGeometry, other );
+#else
+      return GEOSDifference( mGeometry, other );
+#endif
+    }
+
+    /**Copy of the input geometry*/
+    GEOSGeometry* clone( GEOSGeometry* geometry )
+    {
+#ifdef HAVE_GEOS_CONTEXT
+      return GEOSGeom_clone_r( mContext, geometry );
+#else
+      return GEOSGeom_clone( geometry );
+#endif
+    }
+
+    GEOSGeometry* unionGeometry( GEOSGeometry* first, GEOSGeometry* second )
+    {
+#ifdef HAVE_GEOS_CONTEXT
+      return GEOSUnion_r( mContext, first, second );
+#else
+      return GEOSUnion( first, second );
+#endif
+    }
+
+    bool isEmpty( GEOSGeometry* geometry )
+    {
+#ifdef HAVE_GEOS_CONTEXT
+      return GEOSisEmpty_r( mContext, geometry ) != 0;
+#else
+      return GEOSisEmpty( geometry ) != 0;
+#endif
+    }
+
+    void destroy( GEOSGeometry* geometry )
     {
-      p->setMaximum( selectionA.size() );
+#ifdef HAVE_GEOS_CONTEXT
+      GEOSGeom_destroy_r( mContext, geometry );
+#else
+      GEOSGeom_destroy( geometry );
+#endif
     }
-    QgsFeature currentFeature;
-    int processedFeatures = 0;
-    it = selectionA.constBegin();
-    for ( ; it != selectionA.constEnd(); ++it )
+
+  private:
+    GEOSGeometry* mGeometry;
+#ifdef HAVE_GEOS_CONTEXT
+    GEOSContextHandle_t mContext;
+    const GEOSPreparedGeometry* mPrepared;
+#endif
+};
+
+/**GEOS computes the envelope of a geometry on first use and caches it without a lock. The envelope of
+  the overlay features shared by the jobs of a chunk is computed in the calling thread, before the
+  worker threads use them*/
+static void cacheEnvelope( GEOSGeometry* geometry )
+{
+#ifdef HAVE_GEOS_CONTEXT
+  GEOSContextHandle_t context = QgsGeosContext::threadContext();
+  GEOSGeometry* envelope = GEOSEnvelope_r( context, geometry );
+  if ( envelope )
+  {
+    GEOSGeom_destroy_r( context, envelope );
+  }
+#else
+  Q_UNUSED( geometry );
+#endif
+}
+
+/**Creates an output feature (or returns 0 and destroys the geometry if it is empty)*/
+static QgsFeature* outputFeature( QgsOverlayGeos& overlayGeos, GEOSGeometry* geos, const QgsAttributeMap& attributes )
+{
+  if ( !geos )
+  {
+    return 0;
+  }
+  if ( overlayGeos.isEmpty( geos ) )
+  {
+    overlayGeos.destroy( geos );
+    return 0;
+  }
+
+  //fromGeos only takes the GEOS geometry, the WKB is created when the feature is written
+  QgsGeometry* geometry = new QgsGeometry();
+  geometry->fromGeos( geos );
+  QgsFeature* feature = new QgsFeature();
+  feature->setGeometry( geometry );
+  feature->setAttributeMap( attributes );
+  return feature;
+}
+
+/**Union of the geometries of the features (or 0 if there are none), the caller destroys it*/
+static GEOSGeometry* unionGeometry( QgsOverlayGeos& overlayGeos, const QList<QgsFeature*>& features )
+{
+  GEOSGeometry* unionGeos = 0;
+  QList<QgsFeature*>::const_iterator it = features.constBegin();
+  for ( ; it != features.constEnd(); ++it )
+  {
+    GEOSGeometry* geos = ( *it )->geometry()->asGeos();
+    if ( !unionGeos )
+    {
+      unionGeos = overlayGeos.clone( geos );
+      continue;
+    }
+    GEOSGeometry* combined = overlayGeos.unionGeometry( unionGeos, geos );
+    if ( combined )
     {
-      if ( p )
+      overlayGeos.destroy( unionGeos );
+      unionGeos = combined;
+    }
+  }
+  return unionGeos;
+}
+
+void QgsOverlayAnalyzer::processOverlayJob( OverlayJob& job )
+{
+  //the geometries were converted to GEOS in the calling thread, asGeos() only returns them
+  QgsGeometry* featureGeometry = job.feature.geometry();
+  GEOSGeometry* geos = featureGeometry ? featureGeometry->asGeos() : 0;
+  if ( !geos )
+  {
+    return;
+  }
+
+  try // the global GEOS handle throws exceptions on error
+  {
+    //exact test of the index candidates, the input geometry is prepared once for all of them
+    QgsOverlayGeos overlayGeos( geos, !job.candidates.isEmpty() );
+    QList<QgsFeature*> overlapping;
+    QList<QgsFeature*>::const_iterator it = job.candidates.constBegin();
+    for ( ; it != job.candidates.constEnd(); ++it )
+    {
+      if ( overlayGeos.intersects(( *it )->geometry()->asGeos() ) )
       {
-        p->setValue( processedFeatures );
+        overlapping << *it;
       }
+    }
+
+    const QgsAttributeMap& attributes = job.feature.attributeMap();
+    QgsFeature* feature;
 
-      if ( p && p->wasCanceled() )
+    if ( job.outputs & IntersectionOutput )
+    {
+      for ( it = overlapping.constBegin(); it != overlapping.constEnd(); ++it )
       {
-        break;
+        feature = outputFeature( overlayGeos, overlayGeos.intersection(( *it )->geometry()->asGeos() ),
+                                 outputAttributes( attributes, &( *it )->attributeMap(), job.reversed, job.nFieldsA ) );
+        if ( feature )
+        {
+          job.results << feature;
+        }
+      }
+    }
+
+    if ( !( job.outputs & ( ClipOutput | DifferenceOutput ) ) )
+    {
+      return;
+    }
+
+    GEOSGeometry* overlayGeometry = unionGeometry( overlayGeos, overlapping );
+    QgsAttributeMap inputAttributes = outputAttributes( attributes, 0, job.reversed, job.nFieldsA );
+
+    if (( job.outputs & ClipOutput ) && overlayGeometry )
+    {
+      feature = outputFeature( overlayGeos, overlayGeos.intersection( overlayGeometry ), inputAttributes );
+      if ( feature )
+      {
+        job.results << feature;
       }
-      if ( !layerA->featureAtId( *it, currentFeature, true, true ) )
+    }
+
+    if ( job.outputs & DifferenceOutput )
+    {
+      GEOSGeometry* difference = overlayGeometry ? overlayGeos.difference( overlayGeometry ) : overlayGeos.clone( geos );
+      feature = outputFeature( overlayGeos, difference, inputAttributes );
+      if ( feature )
       {
-        continue;
+        job.results << feature;
       }
-      intersectFeature( currentFeature, &vWriter, layerB, &index );
-      ++processedFeatures;
     }
 
-    if ( p )
+    if ( overlayGeometry )
     {
-      p->setValue( selectionA.size() );
+      overlayGeos.destroy( overlayGeometry );
     }
   }
-  //take all features
-  else
+  catch ( ... )
   {
-    layerB->select( layerB->pendingAllAttributesList(), QgsRectangle(), true, false );
-    while ( layerB->nextFeature( currentFeature ) )
+    QgsDebugMsg( QString( "overlay of feature %1 failed" ).arg( job.feature.id() ) );
+  }
+}
+
+bool QgsOverlayAnalyzer::overlayLayers( QgsVectorLayer* inputLayer, QgsVectorLayer* overlayLayer, int outputs, bool reversed,
+                                        int nFieldsA, QgsVectorFileWriter* vfw, bool onlySelectedFeatures,
+                                        QProgressDialog* p, int& nProcessed )
+{
+  QgsFeature currentFeature;
+
+  //index the bounding boxes of all overlay features at once
+  QMap<int, QgsRectangle> rects;
+  if ( onlySelectedFeatures )
+  {
+    const QgsFeatureIds selection = overlayLayer->selectedFeaturesIds();
+    QgsFeatureIds::const_iterator it = selection.constBegin();
+    for ( ; it != selection.constEnd(); ++it )
     {
-      index.insertFeature( currentFeature );
+      if ( overlayLayer->featureAtId( *it, currentFeature, true, false ) && currentFeature.geometry() )
+      {
+        rects.insert( currentFeature.id(), currentFeature.geometry()->boundingBox() );
+      }
     }
-    QgsFeature currentFeature;
-    layerA->select( layerA->pendingAllAttributesList(), QgsRectangle(), true, false );
-
-    int featureCount = layerA->featureCount();
-    if ( p )
+  }
+  else
+  {
+    overlayLayer->select( QgsAttributeList(), QgsRectangle(), true, false );
+    while ( overlayLayer->nextFeature( currentFeature ) )
     {
-      p->setMaximum( featureCount );
+      if ( currentFeature.geometry() )
+      {
+        rects.insert( currentFeature.id(), currentFeature.geometry()->boundingBox() );
+      }
     }
-    int processedFeatures = 0;
+  }
+  QgsSpatialIndex index;
+  index.bulkLoad( rects );
+  rects.clear();
 
-    while ( layerA->nextFeature( currentFeature ) )
+  QgsFeatureIds selection;
+  QgsFeatureIds::const_iterator selectionIt;
+  if ( onlySelectedFeatures )
+  {
+    //use QgsVectorLayer::featureAtId
+    selection = inputLayer->selectedFeaturesIds();
+    selectionIt = selection.constBegin();
+  }
+  else
+  {
+    inputLayer->select( inputLayer->pendingAllAttributesList(), QgsRectangle(), true, false );
+  }
+
+  bool atEnd = false;
+  while ( !atEnd )
+  {
+    //collect a chunk of input features with their candidates. Each overlay feature is fetched once per chunk
+    //and converted to GEOS here, so that the worker threads only read it
+    QList<OverlayJob> jobs;
+    QMap<int, QgsFeature*> overlayFeatures;
+    while ( jobs.size() < OVERLAY_CHUNK_SIZE )
     {
-      if ( p )
+      if ( onlySelectedFeatures )
       {
-        p->setValue( processedFeatures );
+        if ( selectionIt == selection.constEnd() )
+        {
+          atEnd = true;
+          break;
+        }
+        if ( !inputLayer->featureAtId( *selectionIt++, currentFeature, true, true ) )
+        {
+          continue;
+        }
       }
-      if ( p && p->wasCanceled() )
+      else if ( !inputLayer->nextFeature( currentFeature ) )
       {
+        atEnd = true;
         break;
       }
-      intersectFeature( currentFeature, &vWriter, layerB, &index );
-      ++processedFeatures;
+
+      OverlayJob job;
+      job.feature = currentFeature;
+      job.outputs = outputs;
+      job.reversed = reversed;
+      job.nFieldsA = nFieldsA;
+
+      if ( currentFeature.geometry() )
+      {
+        QList<int> ids = index.intersects( currentFeature.geometry()->boundingBox() );
+        QList<int>::const_iterator idIt = ids.constBegin();
+        for ( ; idIt != ids.constEnd(); ++idIt )
+        {
+          QMap<int, QgsFeature*>::const_iterator featureIt = overlayFeatures.find( *idIt );
+          if ( featureIt == overlayFeatures.constEnd() )
+          {
+            QgsFeature* overlayFeature = new QgsFeature();
+            if ( !overlayLayer->featureAtId( *idIt, *overlayFeature, true, true )
+                 || !overlayFeature->geometry() || !overlayFeature->geometry()->asGeos() )
+            {
+              delete overlayFeature;
+              overlayFeature = 0;
+            }
+            else
+            {
+              cacheEnvelope( overlayFeature->geometry()->asGeos() );
+            }
+            featureIt = overlayFeatures.insert( *idIt, overlayFeature );
+          }
+          if ( featureIt.value() )
+          {
+            job.candidates << featureIt.value();
+          }
+        }
+      }
+      jobs << job;
+      //the copy of the feature in the job is converted here, the workers only use GEOS geometries
+      if ( jobs.last().feature.geometry() )
+      {
+        jobs.last().feature.geometry()->asGeos();
+      }
+    }
+
+#ifdef HAVE_GEOS_CONTEXT
+    QtConcurrent::blockingMap( jobs, processOverlayJob );
+#else
+    //the GEOS API without context must only be used from one thread
+    QList<OverlayJob>::iterator processIt = jobs.begin();
+    for ( ; processIt != jobs.end(); ++processIt )
+    {
+      processOverlayJob( *processIt );
+    }
+#endif
+
+    //write the results in input order
+    QList<OverlayJob>::iterator jobIt = jobs.begin();
+    for ( ; jobIt != jobs.end(); ++jobIt )
+    {
+      QList<QgsFeature*>::const_iterator resultIt = jobIt->results.constBegin();
+      for ( ; resultIt != jobIt->results.constEnd(); ++resultIt )
+      {
+        if ( vfw )
+        {
+          vfw->addFeature( **resultIt );
+        }
+      }
+      qDeleteAll( jobIt->results );
     }
+    qDeleteAll( overlayFeatures );
+
+    nProcessed += jobs.size();
     if ( p )
     {
-      p->setValue( featureCount );
+      p->setValue( nProcessed );
+      if ( p->wasCanceled() )
+      {
+        return false;
+      }
     }
   }
   return true;
 }
 
-void QgsOverlayAnalyzer::intersectFeature( QgsFeature& f, QgsVectorFileWriter* vfw,
-    QgsVectorLayer* vl, QgsSpatialIndex* index )
+bool QgsOverlayAnalyzer::overlay( QgsVectorLayer* layerA, QgsVectorLayer* layerB, int outputs, int reverseOutputs,
+                                  bool combineFields, const QString& shapefileName, bool onlySelectedFeatures,
+                                  QProgressDialog* p )
 {
-  QgsGeometry* featureGeometry = f.geometry();
-  QgsGeometry* intersectGeometry = 0;
-  QgsFeature overlayFeature;
+  if ( !layerA || !layerB )
+  {
+    return false;
+  }
 
-  if ( !featureGeometry )
+  QgsVectorDataProvider* dpA = layerA->dataProvider();
+  QgsVectorDataProvider* dpB = layerB->dataProvider();
+  if ( !dpA || !dpB )
   {
-    return;
+    return false;
   }
 
-  QList<int> intersects;
-  intersects = index->intersects( featureGeometry->boundingBox() );
-  QList<int>::const_iterator it = intersects.constBegin();
-  QgsFeature outFeature;
-  for ( ; it != intersects.constEnd(); ++it )
+  QGis::WkbType outputType = dpA->geometryType();
+  const QgsCoordinateReferenceSystem crs = layerA->crs();
+  QgsFieldMap fieldsA = dpA->fields();
+  int nFieldsA = fieldsA.size();
+  if ( combineFields )
   {
-    if ( !vl->featureAtId( *it, overlayFeature, true, true ) )
-    {
-      continue;
-    }
+    QgsFieldMap fieldsB = dpB->fields();
+    combineFieldLists( fieldsA, fieldsB );
+  }
+
+  QgsVectorFileWriter* vWriter = new QgsVectorFileWriter( shapefileName, dpA->encoding(), fieldsA, outputType, &crs );
 
-    if ( featureGeometry->intersects( overlayFeature.geometry() ) )
+  if ( p )
+  {
+    int nFeatures = onlySelectedFeatures ? layerA->selectedFeatureCount() : layerA->featureCount();
+    if ( reverseOutputs )
     {
-      intersectGeometry = featureGeometry->intersection( overlayFeature.geometry() );
+      nFeatures += onlySelectedFeatures ? layerB->selectedFeatureCount() : layerB->featureCount();
+    }
+    p->setMaximum( nFeatures );
+  }
 
-      outFeature.setGeometry( intersectGeometry );
-      QgsAttributeMap attributeMapA = f.attributeMap();
-      QgsAttributeMap attributeMapB = overlayFeature.attributeMap();
-      combineAttributeMaps( attributeMapA, attributeMapB );
-      outFeature.setAttributeMap( attributeMapA );
+  int nProcessed = 0;
+  bool finished = overlayLayers( layerA, layerB, outputs, false, nFieldsA, vWriter, onlySelectedFeatures, p, nProcessed );
+  if ( finished && reverseOutputs )
+  {
+    finished = overlayLayers( layerB, layerA, reverseOutputs, true, nFieldsA, vWriter, onlySelectedFeatures, p, nProcessed );
+  }
+  delete vWriter;
 
-      //add it to vector file writer
-      if ( vfw )
-      {
-        vfw->addFeature( outFeature );
-      }
-    }
+  if ( !finished )
+  {
+    //canceled, don't leave an incomplete result behind
+    QgsVectorFileWriter::deleteShapeFile( shapefileName );
+    return false;
   }
+  return true;
+}
+
+bool QgsOverlayAnalyzer::intersection( QgsVectorLayer* layerA, QgsVectorLayer* layerB,
+                                       const QString& shapefileName, bool onlySelectedFeatures,
+                                       QProgressDialog* p )
+{
+  return overlay( layerA, layerB, IntersectionOutput, 0, true, shapefileName, onlySelectedFeatures, p );
+}
+
+bool QgsOverlayAnalyzer::combine( QgsVectorLayer* layerA, QgsVectorLayer* layerB,
+                                  const QString& shapefileName, bool onlySelectedFeatures,
+                                  QProgressDialog* p )
+{
+  return overlay( layerA, layerB, IntersectionOutput | DifferenceOutput, DifferenceOutput, true,
+                  shapefileName, onlySelectedFeatures, p );
+}
+
+bool QgsOverlayAnalyzer::clip( QgsVectorLayer* layerA, QgsVectorLayer* layerB,
+                               const QString& shapefileName, bool onlySelectedFeatures,
+                               QProgressDialog* p )
+{
+  return overlay( layerA, layerB, ClipOutput, 0, false, shapefileName, onlySelectedFeatures, p );
+}
+
+bool QgsOverlayAnalyzer::difference( QgsVectorLayer* layerA, QgsVectorLayer* layerB,
+                                     const QString& shapefileName, bool onlySelectedFeatures,
+                                     QProgressDialog* p )
+{
+  return overlay( layerA, layerB, DifferenceOutput, 0, false, shapefileName, onlySelectedFeatures, p );
+}
+
+bool QgsOverlayAnalyzer::symDifference( QgsVectorLayer* layerA, QgsVectorLayer* layerB,
+                                        const QString& shapefileName, bool onlySelectedFeatures,
+                                        QProgressDialog* p )
+{
+  return overlay( layerA, layerB, DifferenceOutput, DifferenceOutput, true, shapefileName, onlySelectedFeatures, p );
 }
 
 void QgsOverlayAnalyzer::combineFieldLists( QgsFieldMap& fieldListA, QgsFieldMap fieldListB )
@@ -199,7 +585,7 @@ void QgsOverlayAnalyzer::combineFieldLists( QgsFieldMap& fieldListA, QgsFieldMap
     while ( names.contains( field.name() ) )
     {
       QString name = field.name();
-      name.append( "_" ).append( QString( count ) );
+      name.append( "_" ).append( QString::number( count ) );
       field = QgsField( name, field.type() );
       ++count;
     }
@@ -209,18 +595,3 @@ void QgsOverlayAnalyzer::combineFieldLists( QgsFieldMap& fieldListA, QgsFieldMap
     ++i;
   }
 }
-
-void QgsOverlayAnalyzer::combineAttributeMaps( QgsAttributeMap& attributeMapA, QgsAttributeMap attributeMapB )
-{
-  QMap<int, QVariant>::const_iterator i = attributeMapB.constBegin();
-  QVariant attribute;
-  int fcount = attributeMapA.size();
-  while ( i != attributeMapB.constEnd() )
-  {
-    attribute = i.value();
-    attributeMapA.insert( fcount, attribute );
-    ++i;
-    ++fcount;
-  }
-}
-
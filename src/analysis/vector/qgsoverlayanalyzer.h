@@ -49,14 +49,13 @@ class ANALYSIS_EXPORT QgsOverlayAnalyzer
                        const QString& shapefileName, bool onlySelectedFeatures = false, \
                        QProgressDialog* p = 0 );
 
-#if 0
     /**Perform a union of two input vector layers and write output to a new shape file
       @param layerA input vector layer
       @param layerB input vector layer
       @param shapefileName path to the output shp
       @param onlySelectedFeatures if true, only selected features are considered, else all the features
       @param p progress dialog (or 0 if no progress dialog is to be shown)
-      @note: added in version 1.4*/
+      @note: added in version 1.7*/
     bool combine( QgsVectorLayer* layerA, QgsVectorLayer* layerB,
                   const QString& shapefileName, bool onlySelectedFeatures = false,
                   QProgressDialog* p = 0 );
@@ -68,7 +67,7 @@ class ANALYSIS_EXPORT QgsOverlayAnalyzer
       @param shapefileName path to the output shp
       @param onlySelectedFeatures if true, only selected features are considered, else all the features
       @param p progress dialog (or 0 if no progress dialog is to be shown)
-      @note: added in version 1.4*/
+      @note: added in version 1.7*/
     bool clip( QgsVectorLayer* layerA, QgsVectorLayer* layerB,
                const QString& shapefileName, bool onlySelectedFeatures = false,
                QProgressDialog* p = 0 );
@@ -80,7 +79,7 @@ class ANALYSIS_EXPORT QgsOverlayAnalyzer
       @param shapefileName path to the output shp
       @param onlySelectedFeatures if true, only selected features are considered, else all the features
       @param p progress dialog (or 0 if no progress dialog is to be shown)
-      @note: added in version 1.4*/
+      @note: added in version 1.7*/
     bool difference( QgsVectorLayer* layerA, QgsVectorLayer* layerB,
                      const QString& shapefileName, bool onlySelectedFeatures = false,
                      QProgressDialog* p = 0 );
@@ -92,16 +91,44 @@ class ANALYSIS_EXPORT QgsOverlayAnalyzer
       @param shapefileName path to the output shp
       @param onlySelectedFeatures if true, only selected features are considered, else all the features
       @param p progress dialog (or 0 if no progress dialog is to be shown)
-      @note: added in version 1.4*/
+      @note: added in version 1.7*/
     bool symDifference( QgsVectorLayer* layerA, QgsVectorLayer* layerB,
                         const QString& shapefileName, bool onlySelectedFeatures = false,
                         QProgressDialog* p = 0 );
-#endif
 
   private:
 
+    /**Output of an overlay pass for each input feature*/
+    enum OverlayOutput
+    {
+      IntersectionOutput = 1, //!< intersections with each overlapping overlay feature (attributes of both)
+      ClipOutput = 2,         //!< intersection with all overlapping overlay features (input attributes)
+      DifferenceOutput = 4    //!< part not covered by any overlay feature
+    };
+
+    struct OverlayJob;
+
+    /**Computes the outputs of one input feature (called in worker threads)*/
+    static void processOverlayJob( OverlayJob& job );
+
+    /**Overlays the (selected) features of inputLayer with the (selected) features of overlayLayer and writes
+      the outputs to vfw. The overlay features are indexed at once, the input features are processed in chunks
+      in parallel and the results are written in input order.
+      @param reversed the input layer is the second layer of the operation (its attributes follow those of the first layer)
+      @param nFieldsA number of fields of the first layer
+      @param nProcessed number of features processed in previous passes (for progress dialog)
+      @return false if canceled*/
+    bool overlayLayers( QgsVectorLayer* inputLayer, QgsVectorLayer* overlayLayer, int outputs, bool reversed, int nFieldsA,
+                        QgsVectorFileWriter* vfw, bool onlySelectedFeatures, QProgressDialog* p, int& nProcessed );
+
+    /**Common implementation of the overlay operations
+      @param outputs outputs of the first layer overlaid with the second (OverlayOutput flags)
+      @param reverseOutputs outputs of the second layer overlaid with the first (0 for no second pass)
+      @param combineFields if true, the output contains the fields of both layers, else only those of the first layer
+      @return false if the layers are invalid or the operation was canceled (the output file is removed then)*/
+    bool overlay( QgsVectorLayer* layerA, QgsVectorLayer* layerB, int outputs, int reverseOutputs, bool combineFields,
+                  const QString& shapefileName, bool onlySelectedFeatures, QProgressDialog* p );
+
     void combineFieldLists( QgsFieldMap& fieldListA, QgsFieldMap fieldListB );
-    void intersectFeature( QgsFeature& f, QgsVectorFileWriter* vfw, QgsVectorLayer* dp, QgsSpatialIndex* index );
-    void combineAttributeMaps( QgsAttributeMap& attributeMapA, QgsAttributeMap attributeMapB );
 };
 #endif //QGSVECTORANALYZER
@@ -46,9 +46,16 @@
 #include "qgscontexthelp.h"
 #include "qgscursors.h"
 
+#include "cpl_string.h"
+#include "gdal.h"
+
+
 #include <QCloseEvent>
+#include <QCoreApplication>
 #include <QCheckBox>
 #include <QDesktopWidget>
+#include <QDir>
+#include <QFile>
 #include <QFileDialog>
 #include <QFileInfo>
 #include <QIcon>
@@ -60,6 +67,7 @@
 #include <QPainter>
 #include <QPixmap>
 #include <QPrintDialog>
+#include <QProgressDialog>
 #include <QSettings>
 #include <QSizeGrip>
 #include <QSvgGenerator>
@@ -67,6 +75,11 @@
 #include <QToolButton>
 #include <QUndoView>
 
+//maximum size of the stripes rendered by the image export (in bytes). Each stripe renders the
+//composer maps it intersects with their whole extent, so the stripes are kept few and large:
+//images up to this size (about 8000 x 8000 pixels) are rendered in one piece
+#define EXPORT_STRIPE_BYTES ( 256 * 1024 * 1024 )
+
 
 
 
@@ -471,15 +484,14 @@ void QgsComposer::on_mActionRefreshView_triggered()
     return;
   }
 
-  //refresh preview of all composer maps
+  //refresh preview of all composer maps, the layer data may have changed
   QMap<QgsComposerItem*, QWidget*>::iterator it = mItemWidgetMap.begin();
   for ( ; it != mItemWidgetMap.end(); ++it )
   {
     QgsComposerMap* map = dynamic_cast<QgsComposerMap*>( it.key() );
     if ( map && !map->isDrawing() )
     {
-      map->cache();
-      map->update();
+      map->updateCachedImage();
     }
   }
 
@@ -628,21 +640,7 @@ void QgsComposer::on_mActionExportAsImage_triggered()
   int width = ( int )( mComposition->printResolution() * mComposition->paperWidth() / 25.4 );
   int height = ( int )( mComposition-> printResolution() * mComposition->paperHeight() / 25.4 );
 
-  int memuse = width * height * 3 / 1000000;  // pixmap + image
   QgsDebugMsg( QString( "Image %1x%2" ).arg( width ).arg( height ) );
-  QgsDebugMsg( QString( "memuse = %1" ).arg( memuse ) );
-
-  if ( memuse > 200 )   // about 4500x4500
-  {
-    int answer = QMessageBox::warning( 0, tr( "Big image" ),
-                                       tr( "To create image %1x%2 requires about %3 MB of memory. Proceed?" )
-                                       .arg( width ).arg( height ).arg( memuse ),
-                                       QMessageBox::Ok | QMessageBox::Cancel,  QMessageBox::Ok );
-
-    raise();
-    if ( answer == QMessageBox::Cancel )
-      return;
-  }
 
   // Get file and format (stolen from qgisapp.cpp but modified significantely)
 
@@ -732,6 +730,37 @@ void QgsComposer::on_mActionExportAsImage_triggered()
   if ( myOutputFileNameQString == "" )
     return;
 
+  //formats GDAL can write are rendered in stripes, so the memory use doesn't depend on the image size
+  QString gdalDriverName = gdalDriverForImageFormat( myFilterMap[myFilterString] );
+  if ( !gdalDriverName.isEmpty() )
+  {
+    mComposition->setPlotStyle( QgsComposition::Print );
+    mView->setPaintingEnabled( false );
+    ExportResult exported = exportImageInStripes( myOutputFileNameQString, gdalDriverName, width, height );
+    mComposition->setPlotStyle( QgsComposition::Preview );
+    mView->setPaintingEnabled( true );
+    if ( exported != ExportFailed )
+    {
+      return;
+    }
+    QgsDebugMsg( "striped export failed, trying to export the image in one piece" );
+  }
+
+  int memuse = width * height * 3 / 1000000;  // pixmap + image
+  QgsDebugMsg( QString( "memuse = %1" ).arg( memuse ) );
+
+  if ( memuse > 200 )   // about 4500x4500
+  {
+    int answer = QMessageBox::warning( 0, tr( "Big image" ),
+                                       tr( "To create image %1x%2 requires about %3 MB of memory. Proceed?" )
+                                       .arg( width ).arg( height ).arg( memuse ),
+                                       QMessageBox::Ok | QMessageBox::Cancel,  QMessageBox::Ok );
+
+    raise();
+    if ( answer == QMessageBox::Cancel )
+      return;
+  }
+
   QImage image( QSize( width, height ), QImage::Format_ARGB32 );
   if ( image.isNull() )
   {
@@ -759,6 +788,199 @@ void QgsComposer::on_mActionExportAsImage_triggered()
 }
 
 
+QString QgsComposer::gdalDriverForImageFormat( const QString& format ) const
+{
+  QString lowerFormat = format.toLower();
+  if ( lowerFormat == "tif" || lowerFormat == "tiff" )
+  {
+    return "GTiff";
+  }
+  else if ( lowerFormat == "png" )
+  {
+    return "PNG";
+  }
+  else if ( lowerFormat == "jpg" || lowerFormat == "jpeg" )
+  {
+    return "JPEG";
+  }
+  else if ( lowerFormat == "bmp" )
+  {
+    return "BMP";
+  }
+  return QString();
+}
+
+QgsComposer::ExportResult QgsComposer::exportImageInStripes( const QString& fileName, const QString& driverName, int width, int height )
+{
+  if ( width <= 0 || height <= 0 )
+  {
+    return ExportFailed;
+  }
+
+  GDALAllRegister();
+  GDALDriverH gtiffDriver = GDALGetDriverByName( "GTiff" );
+  GDALDriverH outputDriver = GDALGetDriverByName( driverName.toLocal8Bit().data() );
+  if ( !gtiffDriver || !outputDriver )
+  {
+    return ExportFailed;
+  }
+
+  //GeoTIFF is written directly. The other formats only support CreateCopy and are copied from a temporary GeoTIFF
+  bool directWrite = ( driverName == "GTiff" );
+  bool alpha = ( driverName == "GTiff" || driverName == "PNG" );
+  int nBands = alpha ? 4 : 3;
+  QString stripeFileName = directWrite ? fileName : QDir::temp().filePath( QString( "qgis_composer_export_%1.tif" ).arg( QCoreApplication::applicationPid() ) );
+
+  char** createOptions = 0;
+  createOptions = CSLSetNameValue( createOptions, "BIGTIFF", "IF_SAFER" );
+  createOptions = CSLSetNameValue( createOptions, "PHOTOMETRIC", "RGB" );
+  if ( alpha )
+  {
+    createOptions = CSLSetNameValue( createOptions, "ALPHA", "YES" );
+  }
+  if ( !directWrite )
+  {
+    createOptions = CSLSetNameValue( createOptions, "COMPRESS", "LZW" );
+  }
+  GDALDatasetH stripeDataset = GDALCreate( gtiffDriver, stripeFileName.toLocal8Bit().data(), width, height, nBands, GDT_Byte, createOptions );
+  CSLDestroy( createOptions );
+  if ( !stripeDataset )
+  {
+    QgsDebugMsg( "could not create " + stripeFileName );
+    return ExportFailed;
+  }
+
+  //georeference with the largest (not rotated) composer map
+  double geoTransform[6];
+  bool georeferenced = worldFileParameters( width, geoTransform );
+  if ( georeferenced )
+  {
+    GDALSetGeoTransform( stripeDataset, geoTransform );
+  }
+
+  //ARGB32 pixels are stored as 32 bit integers, the byte order in memory depends on the platform
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+  int bandMap[4] = { 3, 2, 1, 4 }; //B, G, R, A
+  int firstByte = 0;
+#else
+  int bandMap[4] = { 4, 1, 2, 3 }; //A, R, G, B
+  int firstByte = alpha ? 0 : 1;
+#endif
+
+  //as few stripes of at most EXPORT_STRIPE_BYTES as possible, all of the same height. The page is rendered
+  //for each stripe with a clip: the maps are not rendered for the part of the page only, labels placed
+  //for a partial extent would differ between the stripes
+  int maxStripeHeight = qBound( 1, EXPORT_STRIPE_BYTES / ( width * 4 ), height );
+  int nStripes = ( height + maxStripeHeight - 1 ) / maxStripeHeight;
+  int stripeHeight = ( height + nStripes - 1 ) / nStripes;
+  double mmPerPixel = mComposition->paperHeight() / height;
+
+  QProgressDialog progress( tr( "Rendering image..." ), tr( "Abort" ), 0, nStripes, this );
+  progress.setWindowModality( Qt::WindowModal );
+
+  QImage stripe( width, stripeHeight, QImage::Format_ARGB32 );
+  stripe.setDotsPerMeterX( mComposition->printResolution() / 25.4 * 1000 );
+  stripe.setDotsPerMeterY( mComposition->printResolution() / 25.4 * 1000 );
+
+  bool success = !stripe.isNull();
+  bool canceled = false;
+  for ( int i = 0; i < nStripes && success; ++i )
+  {
+    progress.setValue( i );
+    if ( progress.wasCanceled() )
+    {
+      success = false;
+      canceled = true;
+      break;
+    }
+
+    int top = i * stripeHeight;
+    int rows = qMin( stripeHeight, height - top );
+
+    stripe.fill( 0 );
+    QPainter p( &stripe );
+    QRectF sourceArea( 0, top * mmPerPixel, mComposition->paperWidth(), rows * mmPerPixel );
+    QRectF targetArea( 0, 0, width, rows );
+    mComposition->render( &p, targetArea, sourceArea, Qt::IgnoreAspectRatio );
+    p.end();
+
+    CPLErr err = GDALDatasetRasterIO( stripeDataset, GF_Write, 0, top, width, rows, stripe.bits() + firstByte, width, rows, GDT_Byte,
+                                      nBands, bandMap + firstByte, 4, stripe.bytesPerLine(), 1 );
+    if ( err != CE_None )
+    {
+      QgsDebugMsg( QString( "writing stripe %1 failed: %2" ).arg( i ).arg( CPLGetLastErrorMsg() ) );
+      success = false;
+    }
+  }
+  progress.setValue( nStripes );
+
+  if ( directWrite )
+  {
+    GDALClose( stripeDataset );
+    if ( !success )
+    {
+      QFile::remove( fileName );
+    }
+    return canceled ? ExportCanceled : ( success ? ExportSucceeded : ExportFailed );
+  }
+
+  if ( success )
+  {
+    char** copyOptions = 0;
+    if ( georeferenced )
+    {
+      copyOptions = CSLSetNameValue( copyOptions, "WORLDFILE", "YES" );
+    }
+    GDALDatasetH outputDataset = GDALCreateCopy( outputDriver, fileName.toLocal8Bit().data(), stripeDataset, FALSE, copyOptions, NULL, NULL );
+    CSLDestroy( copyOptions );
+    success = ( outputDataset != 0 );
+    if ( outputDataset )
+    {
+      GDALClose( outputDataset );
+    }
+  }
+  GDALClose( stripeDataset );
+  GDALDeleteDataset( gtiffDriver, stripeFileName.toLocal8Bit().data() );
+  return canceled ? ExportCanceled : ( success ? ExportSucceeded : ExportFailed );
+}
+
+bool QgsComposer::worldFileParameters( int width, double* geoTransform ) const
+{
+  const QgsComposerMap* mainMap = 0;
+  double mainMapArea = 0;
+  QList<const QgsComposerMap*> maps = mComposition->composerMapItems();
+  QList<const QgsComposerMap*>::const_iterator mapIt = maps.constBegin();
+  for ( ; mapIt != maps.constEnd(); ++mapIt )
+  {
+    double area = ( *mapIt )->rect().width() * ( *mapIt )->rect().height();
+    if ( area > mainMapArea )
+    {
+      mainMap = *mapIt;
+      mainMapArea = area;
+    }
+  }
+
+  if ( !mainMap || qAbs( mainMap->rotation() ) > 0.000001 || mainMapArea <= 0 )
+  {
+    return false;
+  }
+
+  //map item position on the page (mm) and the extent it shows
+  QRectF mapRect = mainMap->mapRectToScene( mainMap->rect() );
+  QgsRectangle mapExtent = mainMap->extent();
+  double pixelsPerMM = width / mComposition->paperWidth();
+  double xRes = mapExtent.width() / ( mapRect.width() * pixelsPerMM );
+  double yRes = mapExtent.height() / ( mapRect.height() * pixelsPerMM );
+
+  geoTransform[0] = mapExtent.xMinimum() - mapRect.left() * pixelsPerMM * xRes;
+  geoTransform[1] = xRes;
+  geoTransform[2] = 0;
+  geoTransform[3] = mapExtent.yMaximum() + mapRect.top() * pixelsPerMM * yRes;
+  geoTransform[4] = 0;
+  geoTransform[5] = -yRes;
+  return true;
+}
+
 void QgsComposer::on_mActionExportAsSVG_triggered()
 {
   if ( containsWMSLayer() )
@@ -278,6 +278,28 @@ class QgsComposer: public QMainWindow, private Ui::QgsComposerBase
     //! Print to a printer object
     void print( QPrinter &printer );
 
+    //! Result of an image export
+    enum ExportResult
+    {
+      ExportSucceeded,
+      ExportFailed,
+      ExportCanceled
+    };
+
+    //! Returns the name of the GDAL driver for an image format (or an empty string if the format is not written with GDAL)
+    QString gdalDriverForImageFormat( const QString& format ) const;
+
+    /**Renders the composition in horizontal stripes and writes them with GDAL, so the memory
+      use does not depend on the image size. A composer map is rendered with its whole extent for
+      every stripe it intersects, this is why the stripes are large. Formats other than GeoTIFF
+      are copied from a temporary GeoTIFF. The image is georeferenced with the largest composer map
+      @return ExportCanceled if the user aborted the export, no file is written then*/
+    ExportResult exportImageInStripes( const QString& fileName, const QString& driverName, int width, int height );
+
+    /**Calculates the GDAL geotransform of the exported page from the largest composer map
+      @return false if there is no map or the map is rotated*/
+    bool worldFileParameters( int width, double* geoTransform ) const;
+
     //! Writes state under DOM element
     void writeXML( QDomNode& parentNode, QDomDocument& doc );
 
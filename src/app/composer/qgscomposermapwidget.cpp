@@ -464,9 +464,8 @@ void QgsComposerMapWidget::on_mUpdatePreviewButton_clicked()
 
   mUpdatePreviewButton->setEnabled( false ); //prevent crashes because of many button clicks
 
-  mComposerMap->setCacheUpdated( false );
-  mComposerMap->cache();
-  mComposerMap->update();
+  //render the preview tiles again, layer contents may have changed
+  mComposerMap->updateCachedImage();
 
   mUpdatePreviewButton->setEnabled( true );
 }
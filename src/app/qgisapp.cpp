@@ -4147,7 +4147,12 @@ void QgisApp::saveEdits( QgsMapLayer *layer )
   if ( !vlayer || !vlayer->isEditable() || !vlayer->isModified() )
     return;
 
-  if ( !vlayer->commitChanges() )
+  // large commits report their progress in the status bar
+  connect( vlayer, SIGNAL( commitProgress( int, int ) ), this, SLOT( showProgress( int, int ) ) );
+  bool committed = vlayer->commitChanges();
+  disconnect( vlayer, SIGNAL( commitProgress( int, int ) ), this, SLOT( showProgress( int, int ) ) );
+
+  if ( !committed )
   {
     QMessageBox::information( 0,
                               tr( "Error" ),
@@ -4229,7 +4234,11 @@ bool QgisApp::toggleEditing( QgsMapLayer *layer, bool allowCancel )
         break;
 
       case QMessageBox::Save:
-        if ( !vlayer->commitChanges() )
+      {
+        connect( vlayer, SIGNAL( commitProgress( int, int ) ), this, SLOT( showProgress( int, int ) ) );
+        bool committed = vlayer->commitChanges();
+        disconnect( vlayer, SIGNAL( commitProgress( int, int ) ), this, SLOT( showProgress( int, int ) ) );
+        if ( !committed )
         {
           QMessageBox::information( 0,
                                     tr( "Error" ),
@@ -4242,6 +4251,7 @@ bool QgisApp::toggleEditing( QgsMapLayer *layer, bool allowCancel )
           res = false;
         }
         break;
+      }
 
       case QMessageBox::Discard:
         if ( !vlayer->rollBack() )
@@ -63,7 +63,8 @@ QgsRasterLayerProperties::QgsRasterLayerProperties( QgsMapLayer* lyr, QgsMapCanv
     : QDialog( parent, fl ),
     // Constant that signals property not used.
     TRSTRING_NOT_SET( tr( "Not Set" ) ),
-    mRasterLayer( qobject_cast<QgsRasterLayer *>( lyr ) )
+    mRasterLayer( qobject_cast<QgsRasterLayer *>( lyr ) ),
+    mBuildingPyramids( false )
 {
   ignoreSpinBoxEvent = false; //Short circuit signal loop between min max field and stdDev spin box
   mGrayMinimumMaximumEstimated = true;
@@ -1516,6 +1517,12 @@ void QgsRasterLayerProperties::apply()
 
 void QgsRasterLayerProperties::on_buttonBuildPyramids_clicked()
 {
+  // the button cancels while the pyramids are built
+  if ( mBuildingPyramids )
+  {
+    mRasterLayer->cancelBuildPyramids();
+    return;
+  }
 
   connect( mRasterLayer, SIGNAL( progressUpdate( int ) ), mPyramidProgress, SLOT( setValue( int ) ) );
   //
@@ -1534,12 +1541,18 @@ void QgsRasterLayerProperties::on_buttonBuildPyramids_clicked()
   //
 
   // let the user know we're going to possibly be taking a while
-  QApplication::setOverrideCursor( Qt::WaitCursor );
+  // (the application stays responsive, the pyramids are built in the background)
+  QApplication::setOverrideCursor( Qt::BusyCursor );
+  mBuildingPyramids = true;
+  QString myBuildText = buttonBuildPyramids->text();
+  buttonBuildPyramids->setText( tr( "Cancel" ) );
   bool myBuildInternalFlag = cbxInternalPyramids->isChecked();
   QString res = mRasterLayer->buildPyramids(
                   myPyramidList,
                   cboResamplingMethod->currentText(),
                   myBuildInternalFlag );
+  buttonBuildPyramids->setText( myBuildText );
+  mBuildingPyramids = false;
   QApplication::restoreOverrideCursor();
   mPyramidProgress->setValue( 0 );
   buttonBuildPyramids->setEnabled( false );
@@ -1572,6 +1585,17 @@ void QgsRasterLayerProperties::on_buttonBuildPyramids_clicked()
       QMessageBox::warning( this, tr( "Building pyramids failed." ),
                             tr( "Building pyramid overviews is not supported on this type of raster." ) );
     }
+    else if ( res == "CANCELED" )
+    {
+      QMessageBox::information( this, tr( "Building pyramids canceled" ),
+                                tr( "Building pyramids was canceled. The pyramids that existed before have been restored." ) );
+    }
+    else if ( res == "CANCELED_INCOMPLETE" )
+    {
+      QMessageBox::warning( this, tr( "Building pyramids canceled" ),
+                            tr( "Building pyramids was canceled, but the partially built pyramids could not be "
+                                "removed. Build the pyramids again or remove the overview file." ) );
+    }
 
   }
 
@@ -181,6 +181,9 @@ class QgsRasterLayerProperties : public QDialog, private Ui::QgsRasterLayerPrope
     /** \brief Pointer to the raster layer that this property dilog changes the behaviour of. */
     QgsRasterLayer * mRasterLayer;
 
+    /** \brief True while pyramids are built, the build button then cancels */
+    bool mBuildingPyramids;
+
     /** \brief If the underlying raster layer doesn't have a provider
 
         This variable is used to determine if various parts of the Properties UI are
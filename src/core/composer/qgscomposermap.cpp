@@ -32,18 +32,28 @@
 #include "qgslabel.h"
 #include "qgslabelattributes.h"
 
+#include <QDomDocument>
 #include <QGraphicsScene>
 #include <QGraphicsView>
 #include <QPainter>
 #include <QSettings>
+#include <QTimer>
 #include <iostream>
 #include <cmath>
 
+//edge length of the preview tiles in pixels
+#define PREVIEW_TILE_SIZE 256
+//missing tiles are rendered in blocks of up to PREVIEW_METATILE_SIZE x PREVIEW_METATILE_SIZE tiles
+#define PREVIEW_METATILE_SIZE 8
+//memory for tiles outside the current view (in bytes)
+#define DEFAULT_PREVIEW_TILE_CACHE_SIZE ( 32 * 1024 * 1024 )
+
 QgsComposerMap::QgsComposerMap( QgsComposition *composition, int x, int y, int width, int height )
     : QgsComposerItem( x, y, width, height, composition ), mKeepLayerSet( false ), mGridEnabled( false ), mGridStyle( Solid ), \
     mGridIntervalX( 0.0 ), mGridIntervalY( 0.0 ), mGridOffsetX( 0.0 ), mGridOffsetY( 0.0 ), mGridAnnotationPrecision( 3 ), mShowGridAnnotation( false ), \
     mGridAnnotationPosition( OutsideMapFrame ), mAnnotationFrameDistance( 1.0 ), mGridAnnotationDirection( Horizontal ),
-    mCrossLength( 3 ), mMapCanvas( 0 ), mDrawCanvasItems( true )
+    mCrossLength( 3 ), mMapCanvas( 0 ), mDrawCanvasItems( true ), mPreviewTiles( DEFAULT_PREVIEW_TILE_CACHE_SIZE ),
+    mPreviewLevel( 0 ), mPreviewRenderScheduled( false )
 {
   mComposition = composition;
 
@@ -88,7 +98,8 @@ QgsComposerMap::QgsComposerMap( QgsComposition *composition )
     : QgsComposerItem( 0, 0, 10, 10, composition ), mKeepLayerSet( false ), mGridEnabled( false ), mGridStyle( Solid ), \
     mGridIntervalX( 0.0 ), mGridIntervalY( 0.0 ), mGridOffsetX( 0.0 ), mGridOffsetY( 0.0 ), mGridAnnotationPrecision( 3 ), mShowGridAnnotation( false ), \
     mGridAnnotationPosition( OutsideMapFrame ), mAnnotationFrameDistance( 1.0 ), mGridAnnotationDirection( Horizontal ), mCrossLength( 3 ),
-    mMapCanvas( 0 ), mDrawCanvasItems( true )
+    mMapCanvas( 0 ), mDrawCanvasItems( true ), mPreviewTiles( DEFAULT_PREVIEW_TILE_CACHE_SIZE ),
+    mPreviewLevel( 0 ), mPreviewRenderScheduled( false )
 {
   //Offset
   mXOffset = 0.0;
@@ -99,6 +110,8 @@ QgsComposerMap::QgsComposerMap( QgsComposition *composition )
   mComposition = composition;
   mMapRenderer = mComposition->mapRenderer();
   mId = mComposition->composerMapItems().size();
+  mCacheUpdated = false;
+  mDrawing = false;
   mPreviewMode = QgsComposerMap::Rectangle;
   mCurrentRectangle = rect();
 
@@ -192,8 +205,6 @@ void QgsComposerMap::cache( void )
     return;
   }
 
-  mDrawing = true;
-
   //in case of rotation, we need to request a larger rectangle and create a larger cache image
   QgsRectangle requestExtent;
   requestedExtent( requestExtent );
@@ -217,20 +228,230 @@ void QgsComposerMap::cache( void )
     h = 5000;
   }
 
+  if ( w <= 0 || h <= 0 )
+  {
+    return;
+  }
+
+  //tiles rendered with other layers or another projection cannot be reused
+  QString signature = previewTileSignature();
+  if ( signature != mPreviewTileSignature )
+  {
+    mPreviewTiles.clear();
+    mPreviewTileSignature = signature;
+  }
+
+  //tiles are rendered at the power of two resolution closest to the requested one
+  double mapUnitsPerPixel = requestExtent.width() / w;
+  mPreviewLevel = qRound( log( mapUnitsPerPixel ) / log( 2.0 ) );
+  mPreviewExtent = requestExtent;
   mCacheImage = QImage( w, h,  QImage::Format_ARGB32 );
-  mCacheImage.fill( brush().color().rgb() ); //consider the item background brush
-  double mapUnitsPerPixel = mExtent.width() / w;
 
-  // WARNING: ymax in QgsMapToPixel is device height!!!
-  QgsMapToPixel transform( mapUnitsPerPixel, h, requestExtent.yMinimum(), requestExtent.xMinimum() );
+  int minCol, maxCol, minRow, maxRow;
+  previewTileRange( mPreviewLevel, minCol, maxCol, minRow, maxRow );
 
-  QPainter p( &mCacheImage );
+  //keep at least the tiles of the whole view in memory
+  int viewCost = ( maxCol - minCol + 1 ) * ( maxRow - minRow + 1 ) * PREVIEW_TILE_SIZE * PREVIEW_TILE_SIZE * 4;
+  if ( mPreviewTiles.maxCost() < viewCost + DEFAULT_PREVIEW_TILE_CACHE_SIZE )
+  {
+    mPreviewTiles.setMaxCost( viewCost + DEFAULT_PREVIEW_TILE_CACHE_SIZE );
+  }
 
-  draw( &p, requestExtent, QSizeF( w, h ), mCacheImage.logicalDpiX() );
-  p.end();
+  //only the exposed tiles need to be rendered
+  mPendingPreviewTiles.clear();
+  for ( int row = maxRow; row >= minRow; --row )
+  {
+    for ( int col = minCol; col <= maxCol; ++col )
+    {
+      if ( !mPreviewTiles.contains( previewTileKey( mPreviewLevel, col, row ) ) )
+      {
+        mPendingPreviewTiles.append( QPoint( col, row ) );
+      }
+    }
+  }
+
+  composePreviewImage();
   mCacheUpdated = true;
 
+  if ( !mPendingPreviewTiles.isEmpty() && !mPreviewRenderScheduled )
+  {
+    mPreviewRenderScheduled = true;
+    QTimer::singleShot( 0, this, SLOT( renderPendingPreviewTiles() ) );
+  }
+}
+
+void QgsComposerMap::renderPendingPreviewTiles()
+{
+  mPreviewRenderScheduled = false;
+
+  if ( mPreviewMode == Rectangle || mPendingPreviewTiles.isEmpty() )
+  {
+    mPendingPreviewTiles.clear();
+    return;
+  }
+
+  if ( mDrawing ) //try again when the current rendering is finished
+  {
+    mPreviewRenderScheduled = true;
+    QTimer::singleShot( 0, this, SLOT( renderPendingPreviewTiles() ) );
+    return;
+  }
+
+  mDrawing = true;
+
+  //render the pending tiles of one metatile in one go. This is faster than rendering the tiles one by one
+  //and avoids labels cut at the tile borders inside the metatile
+  QPoint firstTile = mPendingPreviewTiles.first();
+  int blockCol = ( int ) floor( firstTile.x() / ( double ) PREVIEW_METATILE_SIZE );
+  int blockRow = ( int ) floor( firstTile.y() / ( double ) PREVIEW_METATILE_SIZE );
+  int minCol = firstTile.x(), maxCol = firstTile.x(), minRow = firstTile.y(), maxRow = firstTile.y();
+
+  QList<QPoint>::iterator tileIt = mPendingPreviewTiles.begin();
+  while ( tileIt != mPendingPreviewTiles.end() )
+  {
+    if (( int ) floor( tileIt->x() / ( double ) PREVIEW_METATILE_SIZE ) == blockCol &&
+        ( int ) floor( tileIt->y() / ( double ) PREVIEW_METATILE_SIZE ) == blockRow )
+    {
+      minCol = qMin( minCol, tileIt->x() );
+      maxCol = qMax( maxCol, tileIt->x() );
+      minRow = qMin( minRow, tileIt->y() );
+      maxRow = qMax( maxRow, tileIt->y() );
+      tileIt = mPendingPreviewTiles.erase( tileIt );
+    }
+    else
+    {
+      ++tileIt;
+    }
+  }
+
+  int nCols = maxCol - minCol + 1;
+  int nRows = maxRow - minRow + 1;
+  double tileSize = previewTileSize( mPreviewLevel );
+  QgsRectangle metaTileExtent( minCol * tileSize, minRow * tileSize, ( maxCol + 1 ) * tileSize, ( maxRow + 1 ) * tileSize );
+
+  QImage metaTile( nCols * PREVIEW_TILE_SIZE, nRows * PREVIEW_TILE_SIZE, QImage::Format_ARGB32_Premultiplied );
+  metaTile.fill( 0 );
+
+  //the tiles are scaled by the ratio of tile and preview resolution when composed. Adapt the dpi such that
+  //symbols and labels get the same size as in a preview rendered in one piece
+  double previewMapUnitsPerPixel = mPreviewExtent.width() / mCacheImage.width();
+  double dpi = mCacheImage.logicalDpiX() * previewMapUnitsPerPixel / ( tileSize / PREVIEW_TILE_SIZE );
+
+  QPainter p( &metaTile );
+  draw( &p, metaTileExtent, QSizeF( metaTile.width(), metaTile.height() ), dpi );
+  p.end();
+
+  for ( int row = minRow; row <= maxRow; ++row )
+  {
+    for ( int col = minCol; col <= maxCol; ++col )
+    {
+      QImage* tile = new QImage( metaTile.copy(( col - minCol ) * PREVIEW_TILE_SIZE, ( maxRow - row ) * PREVIEW_TILE_SIZE,
+                                 PREVIEW_TILE_SIZE, PREVIEW_TILE_SIZE ) );
+      mPreviewTiles.insert( previewTileKey( mPreviewLevel, col, row ), tile, tile->bytesPerLine() * tile->height() );
+    }
+  }
+
+  composePreviewImage();
   mDrawing = false;
+  QGraphicsRectItem::update();
+
+  if ( !mPendingPreviewTiles.isEmpty() )
+  {
+    mPreviewRenderScheduled = true;
+    QTimer::singleShot( 0, this, SLOT( renderPendingPreviewTiles() ) );
+  }
+}
+
+void QgsComposerMap::composePreviewImage()
+{
+  mCacheImage.fill( brush().color().rgb() ); //consider the item background brush
+
+  QPainter p( &mCacheImage );
+  p.setRenderHint( QPainter::SmoothPixmapTransform );
+
+  //tiles of the neighbouring levels are placeholders until the tiles of the current level are rendered
+  int levels[] = { mPreviewLevel + 2, mPreviewLevel + 1, mPreviewLevel - 1, mPreviewLevel };
+  for ( int i = 0; i < 4; ++i )
+  {
+    int minCol, maxCol, minRow, maxRow;
+    previewTileRange( levels[i], minCol, maxCol, minRow, maxRow );
+    double tileSize = previewTileSize( levels[i] );
+    double xMapUnitsPerPixel = mPreviewExtent.width() / mCacheImage.width();
+    double yMapUnitsPerPixel = mPreviewExtent.height() / mCacheImage.height();
+
+    for ( int row = minRow; row <= maxRow; ++row )
+    {
+      for ( int col = minCol; col <= maxCol; ++col )
+      {
+        QImage* tile = mPreviewTiles.object( previewTileKey( levels[i], col, row ) );
+        if ( !tile )
+        {
+          continue;
+        }
+        QRectF target(( col * tileSize - mPreviewExtent.xMinimum() ) / xMapUnitsPerPixel,
+                      ( mPreviewExtent.yMaximum() - ( row + 1 ) * tileSize ) / yMapUnitsPerPixel,
+                      tileSize / xMapUnitsPerPixel, tileSize / yMapUnitsPerPixel );
+        p.drawImage( target, *tile );
+      }
+    }
+  }
+  p.end();
+}
+
+void QgsComposerMap::previewTileRange( int level, int& minCol, int& maxCol, int& minRow, int& maxRow ) const
+{
+  double tileSize = previewTileSize( level );
+  minCol = ( int ) floor( mPreviewExtent.xMinimum() / tileSize );
+  maxCol = ( int ) floor( mPreviewExtent.xMaximum() / tileSize );
+  minRow = ( int ) floor( mPreviewExtent.yMinimum() / tileSize );
+  maxRow = ( int ) floor( mPreviewExtent.yMaximum() / tileSize );
+}
+
+double QgsComposerMap::previewTileSize( int level ) const
+{
+  return ldexp(( double ) PREVIEW_TILE_SIZE, level );
+}
+
+QString QgsComposerMap::previewTileKey( int level, int col, int row ) const
+{
+  return QString( "%1/%2/%3" ).arg( level ).arg( col ).arg( row );
+}
+
+QString QgsComposerMap::previewTileSignature() const
+{
+  if ( !mMapRenderer )
+  {
+    return QString();
+  }
+
+  QStringList layers = mKeepLayerSet ? mLayerSet : mMapRenderer->layerSet();
+
+  //style changes of the layers (renderer, labeling, transparency)
+  QDomDocument styleDoc;
+  QDomElement styleElem = styleDoc.createElement( "maplayers" );
+  styleDoc.appendChild( styleElem );
+  QStringList::const_iterator layerIt = layers.constBegin();
+  for ( ; layerIt != layers.constEnd(); ++layerIt )
+  {
+    QgsMapLayer* layer = QgsMapLayerRegistry::instance()->mapLayer( *layerIt );
+    if ( layer )
+    {
+      QDomElement layerElem = styleDoc.createElement( "maplayer" );
+      styleElem.appendChild( layerElem );
+      QString errorMessage;
+      layer->writeSymbology( layerElem, styleDoc, errorMessage );
+      layerElem.setAttribute( "transparency", layer->getTransparency() );
+    }
+  }
+
+  return QString( "%1|%2|%3|%4" ).arg( layers.join( "," ) ).arg( mMapRenderer->destinationCrs().srsid() )
+         .arg( mMapRenderer->hasCrsTransformEnabled() ).arg( qHash( styleDoc.toString() ) );
+}
+
+void QgsComposerMap::clearPreviewTiles()
+{
+  mPreviewTiles.clear();
+  mPendingPreviewTiles.clear();
 }
 
 void QgsComposerMap::paint( QPainter* painter, const QStyleOptionGraphicsItem* itemStyle, QWidget* pWidget )
@@ -358,6 +579,7 @@ void QgsComposerMap::paint( QPainter* painter, const QStyleOptionGraphicsItem* i
 void QgsComposerMap::updateCachedImage( void )
 {
   syncLayerSet(); //layer list may have changed
+  clearPreviewTiles(); //layer contents may have changed
   mCacheUpdated = false;
   cache();
   QGraphicsRectItem::update();
@@ -367,7 +589,11 @@ void QgsComposerMap::renderModeUpdateCachedImage()
 {
   if ( mPreviewMode == Render )
   {
-    updateCachedImage();
+    //the view zoom only changes the resolution of the preview, the cached tiles are still valid
+    syncLayerSet();
+    mCacheUpdated = false;
+    cache();
+    QGraphicsRectItem::update();
   }
 }
 
@@ -20,7 +20,9 @@
 //#include "ui_qgscomposermapbase.h"
 #include "qgscomposeritem.h"
 #include "qgsrectangle.h"
+#include <QCache>
 #include <QGraphicsRectItem>
+#include <QPoint>
 
 class QgsComposition;
 class QgsMapRenderer;
@@ -90,7 +92,8 @@ class CORE_EXPORT QgsComposerMap : public QgsComposerItem
     /** \brief Reimplementation of QCanvasItem::paint - draw on canvas */
     void paint( QPainter* painter, const QStyleOptionGraphicsItem* itemStyle, QWidget* pWidget );
 
-    /** \brief Create cache image */
+    /** \brief Create cache image. The preview is composed of tiles that are kept across extent and size changes.
+      Tiles that are not cached yet are rendered block by block from the event loop*/
     void cache( void );
 
     /** \brief Get identification number*/
@@ -269,9 +272,13 @@ class CORE_EXPORT QgsComposerMap : public QgsComposerItem
 
     /**Called if map canvas has changed*/
     void updateCachedImage( );
-    /**Call updateCachedImage if item is in render mode*/
+    /**Renders the preview for the current view zoom if item is in render mode. Unlike updateCachedImage the cached tiles are kept*/
     void renderModeUpdateCachedImage();
 
+  private slots:
+    /**Renders the next block of preview tiles that are not in the tile cache yet and updates the preview image*/
+    void renderPendingPreviewTiles();
+
   private:
 
     /**Enum for different frame borders*/
@@ -361,6 +368,20 @@ class CORE_EXPORT QgsComposerMap : public QgsComposerItem
     /**True if annotation items, rubber band, etc. from the main canvas should be displayed*/
     bool mDrawCanvasItems;
 
+    /**Rendered preview tiles. Key is "level/column/row", cost is the size of the image in bytes. The tiles of
+      a level have an edge length of 256 * 2^level map units and are aligned at the origin of the map coordinates*/
+    QCache<QString, QImage> mPreviewTiles;
+    /**Layers and projection the preview tiles were rendered with*/
+    QString mPreviewTileSignature;
+    /**Tile level of the current preview image*/
+    int mPreviewLevel;
+    /**Map extent of the current preview image*/
+    QgsRectangle mPreviewExtent;
+    /**Tiles (column/row) of the current preview that still need to be rendered*/
+    QList<QPoint> mPendingPreviewTiles;
+    /**True if renderPendingPreviewTiles() is already scheduled*/
+    bool mPreviewRenderScheduled;
+
     /**Draws the map grid*/
     void drawGrid( QPainter* p );
     /**Draw coordinates for mGridAnnotationType Coordinate
@@ -406,6 +427,18 @@ class CORE_EXPORT QgsComposerMap : public QgsComposerItem
     void drawCanvasItems( QPainter* painter, const QStyleOptionGraphicsItem* itemStyle );
     void drawCanvasItem( QGraphicsItem* item, QPainter* painter, const QStyleOptionGraphicsItem* itemStyle );
     QPointF composerMapPosForItem( const QGraphicsItem* item ) const;
+
+    /**Draws the cached tiles of the current preview extent into mCacheImage*/
+    void composePreviewImage();
+    /**Returns the range of tiles of a level that cover the current preview extent*/
+    void previewTileRange( int level, int& minCol, int& maxCol, int& minRow, int& maxRow ) const;
+    /**Edge length of the tiles of a level in map units*/
+    double previewTileSize( int level ) const;
+    QString previewTileKey( int level, int col, int row ) const;
+    /**Returns a string that changes if the tiles need to be rendered again (layer set, projection, layer styles)*/
+    QString previewTileSignature() const;
+    /**Removes all preview tiles, e.g. because layer contents or styles have changed*/
+    void clearPreviewTiles();
 };
 
 #endif
@@ -34,6 +34,8 @@
 //#define _VERBOSE_
 //#define _EXPORT_MAP_
 #include <QTime>
+#include <QVector>
+#include <QtConcurrentMap>
 
 #define _CRT_SECURE_NO_DEPRECATE
 
@@ -196,11 +198,37 @@ namespace pal
   }
 
 
+  /**
+   * Candidates generation for one feature part
+   */
+  typedef struct _candidateJob
+  {
+    FeaturePart *part;
+    double scale;
+    double *bbox_min;
+    double *bbox_max;
+    LabelPosition **lPos;
+    int nblp;
+  } CandidateJob;
+
+#ifndef _EXPORT_MAP_
+  /*
+   * Run by the thread pool: feature parts only read their own geometry and
+   * the layer settings, the candidates are indexed later on in a fixed order
+   */
+  void generateCandidates( CandidateJob &job )
+  {
+    job.lPos = NULL;
+    job.nblp = job.part->setPosition( job.scale, &job.lPos, job.bbox_min, job.bbox_max, job.part, NULL );
+  }
+#endif
+
   typedef struct _featCbackCtx
   {
     Layer *layer;
     double scale;
     LinkedList<Feats*> *fFeats;
+    QVector<CandidateJob> *jobs;
     RTree<PointSet*, double, 2, double> *obstacles;
     RTree<LabelPosition*, double, 2, double> *candidates;
     double priority;
@@ -213,6 +241,32 @@ namespace pal
 
 
 
+  /*
+   * Index the generated candidates of a feature part and add it to fFeats
+   */
+  void addFeatCandidates( FeatCallBackCtx *context, CandidateJob &job )
+  {
+    if ( job.nblp > 0 )
+    {
+      for ( int i = 0; i < job.nblp; i++ )
+        job.lPos[i]->insertIntoIndex( context->candidates );
+
+      // valid features are added to fFeats
+      Feats *ft = new Feats();
+      ft->feature = job.part;
+      ft->shape = NULL;
+      ft->nblp = job.nblp;
+      ft->lPos = job.lPos;
+      ft->priority = context->priority;
+      context->fFeats->push_back( ft );
+    }
+    else
+    {
+      // Others are deleted
+      delete[] job.lPos;
+    }
+  }
+
   /*
    * Callback function
    *
@@ -269,30 +323,21 @@ namespace pal
       }
     }
 
-    // generate candidates for the feature part
-    LabelPosition** lPos = NULL;
-    int nblp = ft_ptr->setPosition( context->scale, &lPos, context->bbox_min, context->bbox_max, ft_ptr, context->candidates
+    CandidateJob job;
+    job.part = ft_ptr;
+    job.scale = context->scale;
+    job.bbox_min = context->bbox_min;
+    job.bbox_max = context->bbox_max;
+
 #ifdef _EXPORT_MAP_
-                                    , *context->svgmap
+    // generate candidates for the feature part (svg output can't be shared by threads)
+    job.lPos = NULL;
+    job.nblp = ft_ptr->setPosition( context->scale, &job.lPos, context->bbox_min, context->bbox_max, ft_ptr, NULL, *context->svgmap );
+    addFeatCandidates( context, job );
+#else
+    // candidates are generated for all the layer's feature parts at once
+    context->jobs->append( job );
 #endif
-                                  );
-
-    if ( nblp > 0 )
-    {
-      // valid features are added to fFeats
-      Feats *ft = new Feats();
-      ft->feature = ft_ptr;
-      ft->shape = NULL;
-      ft->nblp = nblp;
-      ft->lPos = lPos;
-      ft->priority = context->priority;
-      context->fFeats->push_back( ft );
-    }
-    else
-    {
-      // Others are deleted
-      delete[] lPos;
-    }
 
     return true;
   }
@@ -300,6 +345,7 @@ namespace pal
 
 
 
+
   typedef struct _filterContext
   {
     RTree<LabelPosition*, double, 2, double> *cdtsIndex;
@@ -371,8 +417,11 @@ namespace pal
 
     LinkedList<Feats*> *fFeats = new LinkedList<Feats*> ( ptrFeatsCompare );
 
+    QVector<CandidateJob> jobs;
+
     FeatCallBackCtx *context = new FeatCallBackCtx();
     context->fFeats = fFeats;
+    context->jobs = &jobs;
     context->scale = scale;
     context->obstacles = obstacles;
     context->candidates = prob->candidates;
@@ -432,6 +481,15 @@ namespace pal
 
             context->layer->modMutex->lock();
             context->layer->rtree->Search( amin, amax, extractFeatCallback, ( void* ) context );
+
+#ifndef _EXPORT_MAP_
+            // generate candidates on the thread pool, then index them in extraction
+            // order so that the problem doesn't depend on thread scheduling
+            QtConcurrent::blockingMap( *context->jobs, generateCandidates );
+            for ( j = 0; j < context->jobs->size(); j++ )
+              addFeatCandidates( context, ( *context->jobs )[j] );
+            context->jobs->clear();
+#endif
             context->layer->modMutex->unlock();
 
 #ifdef _EXPORT_MAP_
@@ -753,12 +811,7 @@ namespace pal
 #endif
 
     // search a solution
-    if ( searchMethod == FALP )
-      prob->init_sol_falp();
-    else if ( searchMethod == CHAIN )
-      prob->chain_search();
-    else
-      prob->popmusic();
+    prob->solve();
 
     std::cout << "PAL SEARCH (" << searchMethod << "): " << t.elapsed() / 1000.0 << " s" << std::endl;
     t.restart();
@@ -828,13 +881,7 @@ namespace pal
       return new std::list<LabelPosition*>();
 
     prob->reduce();
-
-    if ( searchMethod == FALP )
-      prob->init_sol_falp();
-    else if ( searchMethod == CHAIN )
-      prob->chain_search();
-    else
-      prob->popmusic();
+    prob->solve();
 
     return prob->getSolution( displayAll );
   }
@@ -45,6 +45,9 @@
 #include <list>
 #include <limits.h> //for INT_MAX
 
+#include <QList>
+#include <QtConcurrentMap>
+
 #include <pal/pal.h>
 #include <pal/palstat.h>
 #include <pal/layer.h>
@@ -73,7 +76,7 @@ namespace pal
     }
   }
 
-  Problem::Problem() : nblp( 0 ), all_nblp( 0 ), nbft( 0 ), displayAll( 0 ), labelpositions( NULL ), featStartId( NULL ), featNbLp( NULL ), inactiveCost( NULL ), sol( NULL )
+  Problem::Problem() : nbLabelledLayers( 0 ), labelledLayersName( NULL ), nblp( 0 ), all_nblp( 0 ), nbft( 0 ), displayAll( 0 ), labelpositions( NULL ), featStartId( NULL ), featNbLp( NULL ), inactiveCost( NULL ), sol( NULL ), nbOverlap( 0 ), ownsCandidates( true )
   {
     bbox[0] = 0;
     bbox[1] = 0;
@@ -109,8 +112,11 @@ namespace pal
 
     delete[] labelledLayersName;
 
-    for ( i = 0; i < all_nblp; i++ )
-      delete labelpositions[i];
+    if ( ownsCandidates )
+    {
+      for ( i = 0; i < all_nblp; i++ )
+        delete labelpositions[i];
+    }
 
     if ( labelpositions )
       delete[] labelpositions;
@@ -229,6 +235,231 @@ namespace pal
     delete[] ok;
   }
 
+  typedef struct
+  {
+    LabelPosition *lp;
+    int *parent;
+  } ComponentContext;
+
+  inline int findComponent( int *parent, int i )
+  {
+    while ( parent[i] != i )
+    {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  }
+
+  bool componentCallback( LabelPosition *lp, void *ctx )
+  {
+    ComponentContext *context = ( ComponentContext* ) ctx;
+    LabelPosition *lp2 = context->lp;
+
+    if ( lp2->isInConflict( lp ) )
+    {
+      int r1 = findComponent( context->parent, lp->getProblemFeatureId() );
+      int r2 = findComponent( context->parent, lp2->getProblemFeatureId() );
+
+      // the root of a component is always its smallest feature id
+      if ( r1 < r2 )
+        context->parent[r2] = r1;
+      else if ( r2 < r1 )
+        context->parent[r1] = r2;
+    }
+    return true;
+  }
+
+  void Problem::search()
+  {
+    if ( pal->searchMethod == FALP )
+      init_sol_falp();
+    else if ( pal->searchMethod == CHAIN )
+      chain_search();
+    else
+      popmusic();
+  }
+
+  void Problem::solveSubProblem( Problem* &sub )
+  {
+    sub->search();
+  }
+
+  void Problem::solve()
+  {
+    if ( nbft == 0 )
+      return;
+
+    int i, j;
+    int root;
+    double amin[2];
+    double amax[2];
+
+    // link features which have conflicting candidates
+    int *parent = new int[nbft];
+    for ( i = 0; i < nbft; i++ )
+      parent[i] = i;
+
+    ComponentContext context;
+    context.parent = parent;
+
+    for ( i = 0; i < nbft; i++ )
+    {
+      for ( j = 0; j < featNbLp[i]; j++ )
+      {
+        context.lp = labelpositions[featStartId[i] + j];
+        context.lp->getBoundingBox( amin, amax );
+        candidates->Search( amin, amax, componentCallback, ( void* ) &context );
+      }
+    }
+
+    int nbComponents = 0;
+    int *compSize = new int[nbft];
+    memset( compSize, 0, sizeof( int ) *nbft );
+    for ( i = 0; i < nbft; i++ )
+    {
+      if ( compSize[findComponent( parent, i )]++ == 0 )
+        nbComponents++;
+    }
+
+    if ( nbComponents == 1 )
+    {
+      delete[] parent;
+      delete[] compSize;
+      search();
+      return;
+    }
+
+    // features of each component, components ordered by their first feature
+    int *compStart = new int[nbft];
+    int *compPos = new int[nbft];
+    int *compFeats = new int[nbft];
+    int start = 0;
+    for ( i = 0; i < nbft; i++ )
+    {
+      if ( compSize[i] > 0 )
+      {
+        compStart[i] = compPos[i] = start;
+        start += compSize[i];
+      }
+    }
+    for ( i = 0; i < nbft; i++ )
+    {
+      root = findComponent( parent, i );
+      compFeats[compPos[root]++] = i;
+    }
+
+    init_sol_empty();
+
+    QList<Problem*> subs;
+    QList<int*> subFeats;
+    for ( i = 0; i < nbft; i++ )
+    {
+      if ( compSize[i] == 1 )
+      {
+        // nothing can overlap the best candidate of an isolated feature
+        sol->s[i] = featStartId[i];
+      }
+      else if ( compSize[i] > 1 )
+      {
+        subs.append( subProblem( compFeats + compStart[i], compSize[i] ) );
+        subFeats.append( compFeats + compStart[i] );
+      }
+    }
+
+    // sub-problems share no candidates, so they can be solved in parallel
+    QtConcurrent::blockingMap( subs, solveSubProblem );
+
+    for ( i = 0; i < subs.size(); i++ )
+    {
+      mergeSubProblem( subs[i], subFeats[i] );
+      delete subs[i];
+    }
+
+    for ( i = 0; i < nbft; i++ )
+    {
+      if ( sol->s[i] != -1 )
+        labelpositions[sol->s[i]]->insertIntoIndex( candidates_sol );
+    }
+    solution_cost();
+
+#ifdef _VERBOSE_
+    std::cout << "problem split into " << nbComponents << " components (" << subs.size() << " to solve)" << std::endl;
+#endif
+
+    delete[] parent;
+    delete[] compSize;
+    delete[] compStart;
+    delete[] compPos;
+    delete[] compFeats;
+  }
+
+  Problem *Problem::subProblem( int *feats, int nbFeats )
+  {
+    int i, j;
+    int f;
+    int idlp;
+    double nbOverlaps = 0;
+    LabelPosition *lp;
+
+    Problem *sub = new Problem();
+    sub->ownsCandidates = false;
+    sub->pal = pal;
+    sub->scale = scale;
+    sub->displayAll = displayAll;
+    for ( i = 0; i < 4; i++ )
+      sub->bbox[i] = bbox[i];
+
+    sub->nbft = nbFeats;
+    sub->featStartId = new int[nbFeats];
+    sub->featNbLp = new int[nbFeats];
+    sub->inactiveCost = new double[nbFeats];
+
+    for ( i = 0; i < nbFeats; i++ )
+      sub->nblp += featNbLp[feats[i]];
+    sub->all_nblp = sub->nblp;
+    sub->labelpositions = new LabelPosition*[sub->nblp];
+
+    idlp = 0;
+    for ( i = 0; i < nbFeats; i++ )
+    {
+      f = feats[i];
+      sub->featStartId[i] = idlp;
+      sub->featNbLp[i] = featNbLp[f];
+      sub->inactiveCost[i] = inactiveCost[f];
+
+      // only active candidates, those removed by reduce() are not indexed anymore
+      for ( j = 0; j < featNbLp[f]; j++, idlp++ )
+      {
+        lp = labelpositions[featStartId[f] + j];
+        lp->setProblemIds( i, idlp );
+        lp->insertIntoIndex( sub->candidates );
+        sub->labelpositions[idlp] = lp;
+        nbOverlaps += lp->getNumOverlaps();
+      }
+    }
+    sub->nbOverlap = nbOverlaps / 2;
+
+    return sub;
+  }
+
+  void Problem::mergeSubProblem( Problem *sub, int *feats )
+  {
+    int i, j;
+    int f;
+    int label;
+
+    for ( i = 0; i < sub->nbft; i++ )
+    {
+      f = feats[i];
+      label = sub->sol->s[i];
+      sol->s[f] = ( label == -1 ? -1 : featStartId[f] + label - sub->featStartId[i] );
+
+      for ( j = 0; j < featNbLp[f]; j++ )
+        labelpositions[featStartId[f] + j]->setProblemIds( f, featStartId[f] + j );
+    }
+  }
+
   /**
    * \brief Basic initial solution : every feature to -1
    */
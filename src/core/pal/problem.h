@@ -167,9 +167,37 @@ namespace pal
 
       Pal *pal;
 
+      /**
+       * false for sub-problems which only borrow the candidates of their parent problem
+       */
+      bool ownsCandidates;
+
       void solution_cost();
       void check_solution();
 
+      /**
+       * \brief run the pal's search method on the whole problem
+       */
+      void search();
+
+      /**
+       * \brief search method run by the thread pool for each sub-problem
+       */
+      static void solveSubProblem( Problem* &sub );
+
+      /**
+       * \brief build an independent problem with the active candidates of some features
+       * Candidates get problem ids of the sub-problem until mergeSubProblem() is called.
+       * \param feats ids of the features in this problem
+       * \param nbFeats number of features
+       */
+      Problem *subProblem( int *feats, int nbFeats );
+
+      /**
+       * \brief copy solution of a solved sub-problem back and restore candidates' ids
+       */
+      void mergeSubProblem( Problem *sub, int *feats );
+
     public:
       Problem();
 
@@ -189,6 +217,17 @@ namespace pal
 
       void reduce();
 
+      /**
+       * \brief solve the problem with the pal's search method
+       *
+       * Features whose candidates don't conflict with each other can be placed
+       * independently: the conflict graph is split into connected components which
+       * are solved concurrently and merged back into the solution. Components are
+       * solved in a fixed order so the result does not depend on thread scheduling.
+       * Call reduce() first.
+       */
+      void solve();
+
 
       void post_optimization();
 
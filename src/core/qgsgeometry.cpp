@@ -140,6 +140,75 @@ static GEOSInit geosinit;
 #define GEOSCoordSeq_getX(cs,i,x) GEOSCoordSeq_getX( (GEOSCoordSequence *)cs, i, x )
 #define GEOSCoordSeq_getY(cs,i,y) GEOSCoordSeq_getY( (GEOSCoordSequence *)cs, i, y )
 
+/**
+ * Create a coordinate sequence straight from the points of a WKB linestring or ring
+ * (no intermediate QgsPolyline). ptr points to the first coordinate and is advanced
+ * past the last one. If closeRing is set and the first and last points differ, the
+ * first point is appended to close the ring.
+ */
+static GEOSCoordSequence *createGeosCoordSequence( unsigned char *&ptr, int nPoints, bool hasZValue, bool closeRing )
+{
+  int stride = ( hasZValue ? 3 : 2 ) * sizeof( double );
+  double x0 = 0.0, y0 = 0.0, x = 0.0, y = 0.0;
+
+  if ( closeRing && nPoints > 0 )
+  {
+    memcpy( &x0, ptr, sizeof( double ) );
+    memcpy( &y0, ptr + sizeof( double ), sizeof( double ) );
+    memcpy( &x, ptr + ( nPoints - 1 ) * stride, sizeof( double ) );
+    memcpy( &y, ptr + ( nPoints - 1 ) * stride + sizeof( double ), sizeof( double ) );
+    closeRing = x != x0 || y != y0;
+  }
+  else
+  {
+    closeRing = false;
+  }
+
+  GEOSCoordSequence *coord = GEOSCoordSeq_create( nPoints + ( closeRing ? 1 : 0 ), 2 );
+  if ( !coord )
+    return 0;
+
+  for ( int i = 0; i < nPoints; ++i, ptr += stride )
+  {
+    memcpy( &x, ptr, sizeof( double ) );
+    memcpy( &y, ptr + sizeof( double ), sizeof( double ) );
+    GEOSCoordSeq_setX( coord, i, x );
+    GEOSCoordSeq_setY( coord, i, y );
+  }
+
+  if ( closeRing )
+  {
+    GEOSCoordSeq_setX( coord, nPoints, x0 );
+    GEOSCoordSeq_setY( coord, nPoints, y0 );
+  }
+
+  return coord;
+}
+
+/**
+ * Write the points of a GEOS coordinate sequence as WKB (number of points followed by
+ * x/y pairs). Returns the position after the last coordinate.
+ */
+static unsigned char *writeGeosCoordSequence( const GEOSCoordSequence *cs, unsigned char *ptr )
+{
+  unsigned int nPoints = 0;
+  if ( cs )
+    GEOSCoordSeq_getSize( cs, &nPoints );
+
+  memcpy( ptr, &nPoints, sizeof( int ) );
+  ptr += sizeof( int );
+
+  for ( unsigned int i = 0; i < nPoints; ++i )
+  {
+    GEOSCoordSeq_getX( cs, i, ( double * ) ptr );
+    ptr += sizeof( double );
+    GEOSCoordSeq_getY( cs, i, ( double * ) ptr );
+    ptr += sizeof( double );
+  }
+
+  return ptr;
+}
+
 static GEOSGeometry *createGeosCollection( int typeId, QVector<GEOSGeometry*> geoms );
 
 static GEOSGeometry *cloneGeosGeom( const GEOSGeometry *geom )
@@ -199,8 +268,8 @@ QgsGeometry::QgsGeometry( QgsGeometry const & rhs )
     memcpy( mGeometry, rhs.mGeometry, mGeometrySize );
   }
 
-  // deep-copy the GEOS Geometry if appropriate
-  if ( rhs.mGeos )
+  // deep-copy the GEOS Geometry if appropriate (a stale one is rebuilt from WKB on demand)
+  if ( rhs.mGeos && !rhs.mDirtyGeos )
   {
     mGeos = GEOSGeom_clone( rhs.mGeos );
   }
@@ -537,8 +606,9 @@ QgsGeometry & QgsGeometry::operator=( QgsGeometry const & rhs )
   mGeometrySize    = rhs.mGeometrySize;
 
   // deep-copy the GEOS Geometry if appropriate
-  GEOSGeom_destroy( mGeos );
-  mGeos = rhs.mGeos ? GEOSGeom_clone( rhs.mGeos ) : 0;
+  if ( mGeos )
+    GEOSGeom_destroy( mGeos );
+  mGeos = rhs.mGeos && !rhs.mDirtyGeos ? GEOSGeom_clone( rhs.mGeos ) : 0;
 
   mDirtyGeos = rhs.mDirtyGeos;
   mDirtyWkb  = rhs.mDirtyWkb;
@@ -610,6 +680,29 @@ GEOSGeometry* QgsGeometry::asGeos()
 
 QGis::WkbType QgsGeometry::wkbType()
 {
+  if ( mDirtyWkb && mGeos )
+  {
+    // results of GEOS operations: take the type from GEOS instead of
+    // converting the whole geometry to WKB (which exportGeosToWkb writes as 2D)
+    switch ( GEOSGeomTypeId( mGeos ) )
+    {
+      case GEOS_POINT:
+        return QGis::WKBPoint;
+      case GEOS_LINESTRING:
+        return QGis::WKBLineString;
+      case GEOS_POLYGON:
+        return QGis::WKBPolygon;
+      case GEOS_MULTIPOINT:
+        return QGis::WKBMultiPoint;
+      case GEOS_MULTILINESTRING:
+        return QGis::WKBMultiLineString;
+      case GEOS_MULTIPOLYGON:
+        return QGis::WKBMultiPolygon;
+      default:
+        break;
+    }
+  }
+
   unsigned char *geom = asWkb(); // ensure that wkb representation exists
   if ( geom )
   {
@@ -626,12 +719,6 @@ QGis::WkbType QgsGeometry::wkbType()
 
 QGis::GeometryType QgsGeometry::type()
 {
-  if ( mDirtyWkb )
-  {
-    // convert from GEOS
-    exportGeosToWkb();
-  }
-
   QGis::WkbType type = wkbType();
   if ( type == QGis::WKBPoint || type == QGis::WKBPoint25D ||
        type == QGis::WKBMultiPoint || type == QGis::WKBMultiPoint25D )
@@ -648,12 +735,6 @@ QGis::GeometryType QgsGeometry::type()
 
 bool QgsGeometry::isMultipart()
 {
-  if ( mDirtyWkb )
-  {
-    // convert from GEOS
-    exportGeosToWkb();
-  }
-
   QGis::WkbType type = wkbType();
   if ( type == QGis::WKBMultiPoint ||
        type == QGis::WKBMultiPoint25D ||
@@ -4250,26 +4331,11 @@ bool QgsGeometry::exportWkbToGeos()
       {
         QgsDebugMsgLevel( "Linestring found", 3 );
 
-        QgsPolyline sequence;
-
         ptr = mGeometry + 5;
         nPoints = ( int * ) ptr;
         ptr = mGeometry + 1 + 2 * sizeof( int );
-        for ( idx = 0; idx < *nPoints; idx++ )
-        {
-          x = ( double * ) ptr;
-          ptr += sizeof( double );
-          y = ( double * ) ptr;
-          ptr += sizeof( double );
-          if ( hasZValue )
-          {
-            ptr += sizeof( double );
-          }
-
-          sequence << QgsPoint( *x, *y );
-        }
+        mGeos = GEOSGeom_createLineString( createGeosCoordSequence( ptr, *nPoints, hasZValue, false ) );
         mDirtyGeos = false;
-        mGeos = createGeosLineString( sequence );
         break;
       }
 
@@ -4278,29 +4344,15 @@ bool QgsGeometry::exportWkbToGeos()
       case QGis::WKBMultiLineString:
       {
         QVector<GEOSGeometry*> lines;
-        numLineStrings = ( int )( mGeometry[5] );
+        memcpy( &numLineStrings, mGeometry + 5, sizeof( int ) );
         ptr = ( mGeometry + 9 );
         for ( jdx = 0; jdx < numLineStrings; jdx++ )
         {
-          QgsPolyline sequence;
-
           // each of these is a wbklinestring so must handle as such
           ptr += 5;   // skip type since we know its 2
           nPoints = ( int * ) ptr;
           ptr += sizeof( int );
-          for ( idx = 0; idx < *nPoints; idx++ )
-          {
-            x = ( double * ) ptr;
-            ptr += sizeof( double );
-            y = ( double * ) ptr;
-            ptr += sizeof( double );
-            if ( hasZValue )
-            {
-              ptr += sizeof( double );
-            }
-            sequence << QgsPoint( *x, *y );
-          }
-          lines << createGeosLineString( sequence );
+          lines << GEOSGeom_createLineString( createGeosCoordSequence( ptr, *nPoints, hasZValue, false ) );
         }
         mGeos = createGeosCollection( GEOS_MULTILINESTRING, lines );
         mDirtyGeos = false;
@@ -4321,28 +4373,10 @@ bool QgsGeometry::exportWkbToGeos()
 
         for ( idx = 0; idx < *numRings; idx++ )
         {
-          //QgsDebugMsg("Ring nr: "+QString::number(idx));
-
-          QgsPolyline sequence;
-
           // get number of points in the ring
           nPoints = ( int * ) ptr;
           ptr += 4;
-          for ( jdx = 0; jdx < *nPoints; jdx++ )
-          {
-            // add points to a point array for drawing the polygon
-            x = ( double * ) ptr;
-            ptr += sizeof( double );
-            y = ( double * ) ptr;
-            ptr += sizeof( double );
-            if ( hasZValue )
-            {
-              ptr += sizeof( double );
-            }
-            sequence << QgsPoint( *x, *y );
-          }
-
-          rings << createGeosLinearRing( sequence );
+          rings << GEOSGeom_createLinearRing( createGeosCoordSequence( ptr, *nPoints, hasZValue, true ) );
         }
         mGeos = createGeosPolygon( rings );
         mDirtyGeos = false;
@@ -4363,7 +4397,6 @@ bool QgsGeometry::exportWkbToGeos()
         ptr = mGeometry + 9;
         for ( kdx = 0; kdx < *numPolygons; kdx++ )
         {
-          //QgsDebugMsg("Polygon nr: "+QString::number(kdx));
           QVector<GEOSGeometry*> rings;
 
           //skip the endian and mGeometry type info and
@@ -4373,28 +4406,10 @@ bool QgsGeometry::exportWkbToGeos()
           ptr += 4;
           for ( idx = 0; idx < *numRings; idx++ )
           {
-            //QgsDebugMsg("Ring nr: "+QString::number(idx));
-
-            QgsPolyline sequence;
-
             // get number of points in the ring
             nPoints = ( int * ) ptr;
             ptr += 4;
-            for ( jdx = 0; jdx < *nPoints; jdx++ )
-            {
-              // add points to a point array for drawing the polygon
-              x = ( double * ) ptr;
-              ptr += sizeof( double );
-              y = ( double * ) ptr;
-              ptr += sizeof( double );
-              if ( hasZValue )
-              {
-                ptr += sizeof( double );
-              }
-              sequence << QgsPoint( *x, *y );
-            }
-
-            rings << createGeosLinearRing( sequence );
+            rings << GEOSGeom_createLinearRing( createGeosCoordSequence( ptr, *nPoints, hasZValue, true ) );
           }
 
           polygons << createGeosPolygon( rings );
@@ -4496,23 +4511,8 @@ bool QgsGeometry::exportGeosToWkb()
       memcpy( ptr, &wkbType, 4 );
       ptr += 4;
 
-      // assign numPoints
-      memcpy( ptr, &numPoints, 4 );
-      ptr += 4;
-
-      const GEOSCoordSequence *sequence = GEOSGeom_getCoordSeq( mGeos );
-
-      // assign points
-      for ( unsigned int n = 0; n < numPoints; n++ )
-      {
-        // assign x
-        GEOSCoordSeq_getX( sequence, n, ( double * )ptr );
-        ptr += sizeof( double );
-
-        // assign y
-        GEOSCoordSeq_getY( sequence, n, ( double * )ptr );
-        ptr += sizeof( double );
-      }
+      // assign numPoints and points
+      writeGeosCoordSequence( cs, ptr );
 
       mDirtyWkb = false;
       return true;
@@ -4529,7 +4529,6 @@ bool QgsGeometry::exportGeosToWkb()
     case GEOS_POLYGON:               // a polygon
     {
       int geometrySize;
-      unsigned int nPointsInRing = 0;
 
       //first calculate the geometry size
       geometrySize = 1 + 2 * sizeof( int ); //endian, type, number of rings
@@ -4565,44 +4564,18 @@ bool QgsGeometry::exportGeosToWkb()
       position += sizeof( int );
 
       //exterior ring first
+      unsigned char *ptr = &mGeometry[position];
       theRing = GEOSGetExteriorRing( mGeos );
       if ( theRing )
       {
-        nPointsInRing = getNumGeosPoints( theRing );
-        memcpy( &mGeometry[position], &nPointsInRing, sizeof( int ) );
-        position += sizeof( int );
-
-        const GEOSCoordSequence *cs = GEOSGeom_getCoordSeq( theRing );
-        unsigned int n;
-        GEOSCoordSeq_getSize( cs, &n );
-
-        for ( unsigned int j = 0; j < n; ++j )
-        {
-          GEOSCoordSeq_getX( cs, j, ( double * )&mGeometry[position] );
-          position += sizeof( double );
-          GEOSCoordSeq_getY( cs, j, ( double * )&mGeometry[position] );
-          position += sizeof( double );
-        }
+        ptr = writeGeosCoordSequence( GEOSGeom_getCoordSeq( theRing ), ptr );
       }
 
       //interior rings after
       for ( int i = 0; i < GEOSGetNumInteriorRings( mGeos ); i++ )
       {
         theRing = GEOSGetInteriorRingN( mGeos, i );
-
-        const GEOSCoordSequence *cs = GEOSGeom_getCoordSeq( theRing );
-        GEOSCoordSeq_getSize( cs, &nPointsInRing );
-
-        memcpy( &mGeometry[position], &nPointsInRing, sizeof( int ) );
-        position += sizeof( int );
-
-        for ( unsigned int j = 0; j < nPointsInRing; j++ )
-        {
-          GEOSCoordSeq_getX( cs, j, ( double * )&mGeometry[position] );
-          position += sizeof( double );
-          GEOSCoordSeq_getY( cs, j, ( double * )&mGeometry[position] );
-          position += sizeof( double );
-        }
+        ptr = writeGeosCoordSequence( GEOSGeom_getCoordSeq( theRing ), ptr );
       }
       mDirtyWkb = false;
       return true;
@@ -4680,8 +4653,6 @@ bool QgsGeometry::exportGeosToWkb()
 
       //loop over lines
       int lineType = QGis::WKBLineString;
-      const GEOSCoordSequence *cs = 0;
-      unsigned int lineSize;
 
       for ( int i = 0; i < GEOSGetNumGeometries( mGeos ); i++ )
       {
@@ -4691,21 +4662,9 @@ bool QgsGeometry::exportGeosToWkb()
         memcpy( &mGeometry[wkbPosition], &lineType, sizeof( int ) );
         wkbPosition += sizeof( int );
 
-        cs = GEOSGeom_getCoordSeq( GEOSGetGeometryN( mGeos, i ) );
-
-        //line size
-        GEOSCoordSeq_getSize( cs, &lineSize );
-        memcpy( &mGeometry[wkbPosition], &lineSize, sizeof( int ) );
-        wkbPosition += sizeof( int );
-
-        //vertex coordinates
-        for ( unsigned int j = 0; j < lineSize; ++j )
-        {
-          GEOSCoordSeq_getX( cs, j, ( double* )&mGeometry[wkbPosition] );
-          wkbPosition += sizeof( double );
-          GEOSCoordSeq_getY( cs, j, ( double* )&mGeometry[wkbPosition] );
-          wkbPosition += sizeof( double );
-        }
+        //line size and vertex coordinates
+        unsigned char *end = writeGeosCoordSequence( GEOSGeom_getCoordSeq( GEOSGetGeometryN( mGeos, i ) ), &mGeometry[wkbPosition] );
+        wkbPosition = end - mGeometry;
       }
       mDirtyWkb = false;
       return true;
@@ -4760,37 +4719,14 @@ bool QgsGeometry::exportGeosToWkb()
         wkbPosition += sizeof( int );
 
         //exterior ring
-        const GEOSGeometry *theRing = GEOSGetExteriorRing( thePoly );
-        int nPointsInRing = getNumGeosPoints( theRing );
-        memcpy( &mGeometry[wkbPosition], &nPointsInRing, sizeof( int ) );
-        wkbPosition += sizeof( int );
-        const GEOSCoordSequence *cs = GEOSGeom_getCoordSeq( theRing );
-
-        for ( int k = 0; k < nPointsInRing; ++k )
-        {
-          GEOSCoordSeq_getX( cs, k, ( double * )&mGeometry[wkbPosition] );
-          wkbPosition += sizeof( double );
-          GEOSCoordSeq_getY( cs, k, ( double * )&mGeometry[wkbPosition] );
-          wkbPosition += sizeof( double );
-        }
+        unsigned char *ptr = writeGeosCoordSequence( GEOSGeom_getCoordSeq( GEOSGetExteriorRing( thePoly ) ), &mGeometry[wkbPosition] );
 
         //interior rings
         for ( int j = 0; j < GEOSGetNumInteriorRings( thePoly ); j++ )
         {
-          theRing = GEOSGetInteriorRingN( thePoly, j );
-          nPointsInRing = getNumGeosPoints( theRing );
-          memcpy( &mGeometry[wkbPosition], &nPointsInRing, sizeof( int ) );
-          wkbPosition += sizeof( int );
-          const GEOSCoordSequence *cs = GEOSGeom_getCoordSeq( theRing );
-
-          for ( int k = 0; k < nPointsInRing; ++k )
-          {
-            GEOSCoordSeq_getX( cs, k, ( double * )&mGeometry[wkbPosition] );
-            wkbPosition += sizeof( double );
-            GEOSCoordSeq_getY( cs, k, ( double * )&mGeometry[wkbPosition] );
-            wkbPosition += sizeof( double );
-          }
+          ptr = writeGeosCoordSequence( GEOSGeom_getCoordSeq( GEOSGetInteriorRingN( thePoly, j ) ), ptr );
         }
+        wkbPosition = ptr - mGeometry;
       }
       mDirtyWkb = false;
       return true;
@@ -5954,10 +5890,7 @@ QgsMultiPolygon QgsGeometry::asMultiPolygon()
 
 double QgsGeometry::area()
 {
-  if ( !mGeos )
-  {
-    exportWkbToGeos();
-  }
+  exportWkbToGeos();
 
   double area;
 
@@ -5973,10 +5906,7 @@ double QgsGeometry::area()
 
 double QgsGeometry::length()
 {
-  if ( !mGeos )
-  {
-    exportWkbToGeos();
-  }
+  exportWkbToGeos();
 
   double length;
 
@@ -5991,10 +5921,7 @@ double QgsGeometry::length()
 }
 double QgsGeometry::distance( QgsGeometry& geom )
 {
-  if ( !mGeos )
-  {
-    exportWkbToGeos();
-  }
+  exportWkbToGeos();
 
   if ( !geom.mGeos )
   {
@@ -6018,10 +5945,7 @@ double QgsGeometry::distance( QgsGeometry& geom )
 
 QgsGeometry* QgsGeometry::buffer( double distance, int segments )
 {
-  if ( !mGeos )
-  {
-    exportWkbToGeos();
-  }
+  exportWkbToGeos();
   if ( !mGeos )
   {
     return 0;
@@ -6036,10 +5960,7 @@ QgsGeometry* QgsGeometry::buffer( double distance, int segments )
 
 QgsGeometry* QgsGeometry::simplify( double tolerance )
 {
-  if ( !mGeos )
-  {
-    exportWkbToGeos();
-  }
+  exportWkbToGeos();
   if ( !mGeos )
   {
     return 0;
@@ -6053,10 +5974,7 @@ QgsGeometry* QgsGeometry::simplify( double tolerance )
 
 QgsGeometry* QgsGeometry::centroid()
 {
-  if ( !mGeos )
-  {
-    exportWkbToGeos();
-  }
+  exportWkbToGeos();
   if ( !mGeos )
   {
     return 0;
@@ -6070,10 +5988,7 @@ QgsGeometry* QgsGeometry::centroid()
 
 QgsGeometry* QgsGeometry::convexHull()
 {
-  if ( !mGeos )
-  {
-    exportWkbToGeos();
-  }
+  exportWkbToGeos();
   if ( !mGeos )
   {
     return 0;
@@ -6092,14 +6007,8 @@ QgsGeometry* QgsGeometry::intersection( QgsGeometry* geometry )
   {
     return NULL;
   }
-  if ( !mGeos )
-  {
-    exportWkbToGeos();
-  }
-  if ( !geometry->mGeos )
-  {
-    geometry->exportWkbToGeos();
-  }
+  exportWkbToGeos();
+  geometry->exportWkbToGeos();
   if ( !mGeos || !geometry->mGeos )
   {
     return 0;
@@ -6118,14 +6027,8 @@ QgsGeometry* QgsGeometry::combine( QgsGeometry* geometry )
   {
     return NULL;
   }
-  if ( !mGeos )
-  {
-    exportWkbToGeos();
-  }
-  if ( !geometry->mGeos )
-  {
-    geometry->exportWkbToGeos();
-  }
+  exportWkbToGeos();
+  geometry->exportWkbToGeos();
   if ( !mGeos || !geometry->mGeos )
   {
     return 0;
@@ -6134,10 +6037,7 @@ QgsGeometry* QgsGeometry::combine( QgsGeometry* geometry )
   try
   {
     GEOSGeometry* unionGeom = GEOSUnion( mGeos, geometry->mGeos );
-    QGis::WkbType thisGeomType = wkbType();
-    QGis::WkbType otherGeomType = geometry->wkbType();
-    if (( thisGeomType == QGis::WKBLineString || thisGeomType == QGis::WKBLineString25D ) \
-        && ( otherGeomType == QGis::WKBLineString || otherGeomType == QGis::WKBLineString25D ) )
+    if ( GEOSGeomTypeId( mGeos ) == GEOS_LINESTRING && GEOSGeomTypeId( geometry->mGeos ) == GEOS_LINESTRING )
     {
       GEOSGeometry* mergedGeom = GEOSLineMerge( unionGeom );
       if ( mergedGeom )
@@ -6157,14 +6057,8 @@ QgsGeometry* QgsGeometry::difference( QgsGeometry* geometry )
   {
     return NULL;
   }
-  if ( !mGeos )
-  {
-    exportWkbToGeos();
-  }
-  if ( !geometry->mGeos )
-  {
-    geometry->exportWkbToGeos();
-  }
+  exportWkbToGeos();
+  geometry->exportWkbToGeos();
   if ( !mGeos || !geometry->mGeos )
   {
     return 0;
@@ -6183,14 +6077,8 @@ QgsGeometry* QgsGeometry::symDifference( QgsGeometry* geometry )
   {
     return NULL;
   }
-  if ( !mGeos )
-  {
-    exportWkbToGeos();
-  }
-  if ( !geometry->mGeos )
-  {
-    geometry->exportWkbToGeos();
-  }
+  exportWkbToGeos();
+  geometry->exportWkbToGeos();
   if ( !mGeos || !geometry->mGeos )
   {
     return 0;
@@ -6205,12 +6093,9 @@ QgsGeometry* QgsGeometry::symDifference( QgsGeometry* geometry )
 
 QList<QgsGeometry*> QgsGeometry::asGeometryCollection()
 {
+  exportWkbToGeos();
   if ( !mGeos )
-  {
-    exportWkbToGeos();
-    if ( !mGeos )
-      return QList<QgsGeometry*>();
-  }
+    return QList<QgsGeometry*>();
 
   int type = GEOSGeomTypeId( mGeos );
   QgsDebugMsg( "geom type: " + QString::number( type ) );
@@ -0,0 +1,80 @@
+/***************************************************************************
+    qgsgeoscontext.cpp - GEOS context handle for worker threads
+                             -------------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsgeoscontext.h"
+#include "qgslogger.h"
+
+#include <QThreadStorage>
+
+#include <cstdarg>
+#include <cstdio>
+
+#ifdef HAVE_GEOS_CONTEXT
+
+static void logGEOSError( const char *fmt, ... )
+{
+  va_list ap;
+  char buffer[1024];
+
+  va_start( ap, fmt );
+  vsnprintf( buffer, sizeof buffer, fmt, ap );
+  va_end( ap );
+
+  QgsDebugMsg( QString( "GEOS error encountered: %1" ).arg( QString::fromUtf8( buffer ) ) );
+}
+
+static void logGEOSNotice( const char *fmt, ... )
+{
+#if defined(QGISDEBUG)
+  va_list ap;
+  char buffer[1024];
+
+  va_start( ap, fmt );
+  vsnprintf( buffer, sizeof buffer, fmt, ap );
+  va_end( ap );
+
+  QgsDebugMsg( QString( "GEOS notice: %1" ).arg( QString::fromUtf8( buffer ) ) );
+#else
+  Q_UNUSED( fmt );
+#endif
+}
+
+class QgsGeosThreadContext
+{
+  public:
+    QgsGeosThreadContext()
+    {
+      mHandle = initGEOS_r( logGEOSNotice, logGEOSError );
+    }
+
+    ~QgsGeosThreadContext()
+    {
+      finishGEOS_r( mHandle );
+    }
+
+    GEOSContextHandle_t mHandle;
+};
+
+static QThreadStorage<QgsGeosThreadContext*> geosThreadContexts;
+
+GEOSContextHandle_t QgsGeosContext::threadContext()
+{
+  if ( !geosThreadContexts.hasLocalData() )
+  {
+    geosThreadContexts.setLocalData( new QgsGeosThreadContext() );
+  }
+  return geosThreadContexts.localData()->mHandle;
+}
+
+#endif // HAVE_GEOS_CONTEXT
@@ -0,0 +1,48 @@
+/***************************************************************************
+    qgsgeoscontext.h - GEOS context handle for worker threads
+                             -------------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSGEOSCONTEXT_H
+#define QGSGEOSCONTEXT_H
+
+#include <geos_c.h>
+
+// the reentrant GEOS API (and prepared geometries) are available since GEOS 3.1
+#if defined(GEOS_VERSION_MAJOR) && defined(GEOS_VERSION_MINOR) && \
+    ((GEOS_VERSION_MAJOR>3) || ((GEOS_VERSION_MAJOR==3) && (GEOS_VERSION_MINOR>=1)))
+#define HAVE_GEOS_CONTEXT
+#endif
+
+#ifdef HAVE_GEOS_CONTEXT
+
+/** \ingroup core
+  GEOS context of the calling thread for the reentrant GEOS API (the functions with the _r suffix).
+
+  The GEOS functions without context, and so QgsGeometry, share one global handle and error
+  handler and must only be used from one thread. Code that runs GEOS operations in worker threads
+  converts the geometries on the calling thread (QgsGeometry::asGeos) and then only uses the _r
+  functions with this context in the workers. GEOS errors are logged, the functions return their
+  error value.
+  @note added in 1.7
+  */
+class CORE_EXPORT QgsGeosContext
+{
+  public:
+    /** Returns the context of the calling thread. It is created on first use and
+      finished when the thread ends */
+    static GEOSContextHandle_t threadContext();
+};
+
+#endif // HAVE_GEOS_CONTEXT
+
+#endif // QGSGEOSCONTEXT_H
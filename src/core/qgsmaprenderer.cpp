@@ -58,6 +58,7 @@ QgsMapRenderer::QgsMapRenderer()
   mOutputUnits = QgsMapRenderer::Millimeters;
 
   mLabelingEngine = NULL;
+  mLabelingRenderTime = 0;
 }
 
 QgsMapRenderer::~QgsMapRenderer()
@@ -265,6 +266,9 @@ void QgsMapRenderer::render( QPainter* painter )
   if ( mOverview )
     mRenderContext.setDrawEditingInformation( !mOverview );
 
+  mLayerRenderTimes.clear();
+  mLabelingRenderTime = 0;
+
   mRenderContext.setPainter( painter );
   mRenderContext.setCoordinateTransform( 0 );
   //this flag is only for stopping during the current rendering progress,
@@ -487,6 +491,8 @@ void QgsMapRenderer::render( QPainter* painter )
         mRenderContext.painter()->scale( 1.0 / rasterScaleFactor, 1.0 / rasterScaleFactor );
       }
 
+      QTime layerTime;
+      layerTime.start();
 
       if ( !ml->draw( mRenderContext ) )
       {
@@ -506,6 +512,8 @@ void QgsMapRenderer::render( QPainter* painter )
         }
       }
 
+      mLayerRenderTimes.append( qMakePair( layerId, layerTime.elapsed() ) );
+
       if ( scaleRaster )
       {
         mRenderContext.setMapToPixel( bk_mapToPixel );
@@ -608,8 +616,11 @@ void QgsMapRenderer::render( QPainter* painter )
     mRenderContext.setExtent( mExtent );
     mRenderContext.setCoordinateTransform( NULL );
 
+    QTime labelingTime;
+    labelingTime.start();
     mLabelingEngine->drawLabeling( mRenderContext );
     mLabelingEngine->exit();
+    mLabelingRenderTime = labelingTime.elapsed();
   }
 
   QgsDebugMsg( "Rendering completed in (seconds): " + QString( "%1" ).arg( renderTime.elapsed() / 1000.0 ) );
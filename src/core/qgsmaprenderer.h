@@ -16,6 +16,7 @@
 #ifndef QGSMAPRENDER_H
 #define QGSMAPRENDER_H
 
+#include <QPair>
 #include <QSize>
 #include <QStringList>
 #include <QVector>
@@ -227,6 +228,15 @@ class CORE_EXPORT QgsMapRenderer : public QObject
     //! Added in QGIS v1.4
     void setLabelingEngine( QgsLabelingEngineInterface* iface );
 
+    /**Time (in milliseconds) used to draw each layer in the last call of render(). Pairs of layer id and
+      time in drawing order. Layers outside of their scale range or drawn from the render cache are not listed
+      @note added in 1.7*/
+    const QList< QPair<QString, int> >& layerRenderTimes() const { return mLayerRenderTimes; }
+
+    /**Time (in milliseconds) used by the labeling engine in the last call of render()
+      @note added in 1.7*/
+    int labelingRenderTime() const { return mLabelingRenderTime; }
+
   signals:
 
     void drawingProgress( int current, int total );
@@ -316,6 +326,12 @@ class CORE_EXPORT QgsMapRenderer : public QObject
 
     //! Labeling engine (NULL by default)
     QgsLabelingEngineInterface* mLabelingEngine;
+
+    //! draw times of the layers in the last render
+    QList< QPair<QString, int> > mLayerRenderTimes;
+
+    //! time used for labeling in the last render
+    int mLabelingRenderTime;
 };
 
 #endif
@@ -33,10 +33,14 @@
 #include <cmath>
 
 #include <QByteArray>
+#include <QCache>
 #include <QString>
 #include <QFontMetrics>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QTime>
 #include <QPainter>
+#include <QPainterPathStroker>
 
 #include "qgsdiagram.h"
 #include "qgsdiagramrendererv2.h"
@@ -51,6 +55,65 @@
 
 using namespace pal;
 
+// maximum number of path elements kept in the label path caches
+#define LABEL_PATH_CACHE_SIZE 500000
+
+// Glyph outlines of label texts. Shaping the text and extracting the outlines is expensive,
+// and the same texts (street names etc.) are drawn for many features and in every render
+// of the map, so the paths are kept in a process wide cache keyed by font and text.
+static QMutex sLabelPathCacheMutex;
+
+static QCache<QString, QPainterPath>& labelTextPathCache()
+{
+  static QCache<QString, QPainterPath> cache( LABEL_PATH_CACHE_SIZE );
+  return cache;
+}
+
+static QCache<QString, QPainterPath>& labelBufferPathCache()
+{
+  static QCache<QString, QPainterPath> cache( LABEL_PATH_CACHE_SIZE );
+  return cache;
+}
+
+static QPainterPath labelTextPath( const QFont& font, const QString& text )
+{
+  QString key = font.key() + "|" + text;
+
+  QMutexLocker locker( &sLabelPathCacheMutex );
+  QPainterPath* cached = labelTextPathCache().object( key );
+  if ( cached )
+    return *cached;
+
+  QPainterPath path;
+  path.addText( 0, 0, font, text );
+  labelTextPathCache().insert( key, new QPainterPath( path ), qMax( path.elementCount(), 1 ) );
+  return path;
+}
+
+// outline of the buffer around the text, i.e. the area covered by a pen of the given width
+static QPainterPath labelBufferPath( const QFont& font, const QString& text, double size )
+{
+  QString key = font.key() + "|" + QString::number( size ) + "|" + text;
+
+  {
+    QMutexLocker locker( &sLabelPathCacheMutex );
+    QPainterPath* cached = labelBufferPathCache().object( key );
+    if ( cached )
+      return *cached;
+  }
+
+  // same stroke as drawn by a default QPen (square cap, bevel join)
+  QPainterPathStroker stroker;
+  stroker.setWidth( size );
+  stroker.setCapStyle( Qt::SquareCap );
+  stroker.setJoinStyle( Qt::BevelJoin );
+  QPainterPath path = stroker.createStroke( labelTextPath( font, text ) );
+
+  QMutexLocker locker( &sLabelPathCacheMutex );
+  labelBufferPathCache().insert( key, new QPainterPath( path ), qMax( path.elementCount(), 1 ) );
+  return path;
+}
+
 
 class QgsPalGeometry : public PalGeometry
 {
@@ -659,6 +722,10 @@ QgsPalLabeling::QgsPalLabeling()
   mShowingAllLabels = false;
 
   mLabelSearchTree = new QgsLabelSearchTree();
+
+  mExtractTime = 0;
+  mSolveTime = 0;
+  mDrawTime = 0;
 }
 
 
@@ -947,6 +1014,10 @@ void QgsPalLabeling::drawLabeling( QgsRenderContext& context )
     mLabelSearchTree->clear();
   }
 
+  mExtractTime = 0;
+  mSolveTime = 0;
+  mDrawTime = 0;
+
   QTime t;
   t.start();
 
@@ -968,6 +1039,7 @@ void QgsPalLabeling::drawLabeling( QgsRenderContext& context )
     //mActiveLayers.clear(); // clean up
     return;
   }
+  mExtractTime = t.elapsed();
 
   const QgsMapToPixel* xform = mMapRenderer->coordinateTransform();
 
@@ -992,6 +1064,7 @@ void QgsPalLabeling::drawLabeling( QgsRenderContext& context )
 
   // find the solution
   labels = mPal->solveProblem( problem, mShowingAllLabels );
+  mSolveTime = t.elapsed() - mExtractTime;
 
   QgsDebugMsg( QString( "LABELING work:  %1 ms ... labels# %2" ).arg( t.elapsed() ).arg( labels->size() ) );
   t.restart();
@@ -1114,7 +1187,8 @@ void QgsPalLabeling::drawLabeling( QgsRenderContext& context )
     }
   }
 
-  QgsDebugMsg( QString( "LABELING draw:  %1 ms" ).arg( t.elapsed() ) );
+  mDrawTime = t.elapsed();
+  QgsDebugMsg( QString( "LABELING draw:  %1 ms" ).arg( mDrawTime ) );
 
   delete problem;
   delete labels;
@@ -1184,6 +1258,13 @@ QgsPalLabeling::Search QgsPalLabeling::searchMethod() const
   return mSearch;
 }
 
+void QgsPalLabeling::labelingTimes( int& extractTime, int& solveTime, int& drawTime ) const
+{
+  extractTime = mExtractTime;
+  solveTime = mSolveTime;
+  drawTime = mDrawTime;
+}
+
 void QgsPalLabeling::drawLabelCandidateRect( pal::LabelPosition* lp, QPainter* painter, const QgsMapToPixel* xform )
 {
   QgsPoint outPt = xform->transform( lp->getX(), lp->getY() );
@@ -1263,11 +1344,9 @@ void QgsPalLabeling::drawLabel( pal::LabelPosition* label, QPainter* painter, co
     else
     {
       // we're drawing real label
-      QPainterPath path;
-      path.addText( 0, 0, f, multiLineList.at( i ) );
       painter->setPen( Qt::NoPen );
       painter->setBrush( c );
-      painter->drawPath( path );
+      painter->drawPath( labelTextPath( f, multiLineList.at( i ) ) );
     }
     painter->restore();
 
@@ -1279,13 +1358,18 @@ void QgsPalLabeling::drawLabel( pal::LabelPosition* label, QPainter* painter, co
 
 void QgsPalLabeling::drawLabelBuffer( QPainter* p, QString text, const QFont& font, double size, QColor color )
 {
-  QPainterPath path;
-  path.addText( 0, 0, font, text );
-  QPen pen( color );
-  pen.setWidthF( size );
-  p->setPen( pen );
   p->setBrush( color );
-  p->drawPath( path );
+  if ( size > 0 )
+  {
+    // fill the pre-stroked outline instead of stroking the text with a wide pen
+    p->setPen( Qt::NoPen );
+    p->drawPath( labelBufferPath( font, text, size ) );
+  }
+  else
+  {
+    p->setPen( QPen( color ) ); // cosmetic pen
+  }
+  p->drawPath( labelTextPath( font, text ) );
 }
 
 QgsLabelingEngineInterface* QgsPalLabeling::clone()
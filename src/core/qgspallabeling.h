@@ -191,6 +191,11 @@ class CORE_EXPORT QgsPalLabeling : public QgsLabelingEngineInterface
     bool isShowingAllLabels() const { return mShowingAllLabels; }
     void setShowingAllLabels( bool showing ) { mShowingAllLabels = showing; }
 
+    /**Time (in milliseconds) used by the phases of the last drawLabeling() call:
+      building the candidates (extract), solving the problem and drawing the labels
+      @note added in 1.7*/
+    void labelingTimes( int& extractTime, int& solveTime, int& drawTime ) const;
+
     // implemented methods from labeling engine interface
 
     //! called when we're going to start with rendering
@@ -244,6 +249,9 @@ class CORE_EXPORT QgsPalLabeling : public QgsLabelingEngineInterface
     bool mShowingAllLabels; // whether to avoid collisions or not
 
     QgsLabelSearchTree* mLabelSearchTree;
+
+    // timing of the last labeling (ms)
+    int mExtractTime, mSolveTime, mDrawTime;
 };
 
 #endif // QGSPALLABELING_H
@@ -346,11 +346,24 @@ class CORE_EXPORT QgsRasterDataProvider : public QgsDataProvider
                                     bool theThoroughBandScanFlag = false
                                   ) {};
 
+    /** \brief Read band statistics stored with the dataset (e.g. by writeStatistics in a previous session).
+     * @return false if there are no stored statistics
+     * @note added in 1.7 */
+    virtual bool readStatistics( int theBandNo, QgsRasterBandStats & theBandStats ) { return false; }
+
+    /** \brief Store band statistics with the dataset, so they don't need to be calculated again
+     * @note added in 1.7 */
+    virtual void writeStatistics( int theBandNo, const QgsRasterBandStats & theBandStats ) {}
+
     /** \brief Create pyramid overviews */
     virtual QString buildPyramids( const QList<QgsRasterPyramid>  & thePyramidList,
                                    const QString &  theResamplingMethod = "NEAREST",
                                    bool theTryInternalFlag = false ) { return "FAILED_NOT_SUPPORTED"; };
 
+    /** \brief Stop a running buildPyramids() call, e.g. from a progress dialog
+     * @note added in 1.7 */
+    virtual void cancelBuildPyramids() {}
+
     /** \brief Accessor for ths raster layers pyramid list. A pyramid list defines the
      * POTENTIAL pyramids that can be in a raster. To know which of the pyramid layers
      * ACTUALLY exists you need to look at the existsFlag member in each struct stored in the
@@ -376,6 +376,14 @@ class CORE_EXPORT QgsVectorDataProvider : public QgsDataProvider
      */
     QStringList errors();
 
+  signals:
+    /**
+     * Emitted during long batches of edits (addFeatures(), deleteFeatures(),
+     * changeAttributeValues(), changeGeometryValues()) by providers which
+     * report their progress. The last signal has theProgress == theTotalSteps.
+     * @note added in 1.7
+     */
+    void editProgress( int theProgress, int theTotalSteps );
 
   protected:
     QVariant convertValue( QVariant::Type type, QString value );
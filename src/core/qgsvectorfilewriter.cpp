@@ -32,6 +32,11 @@
 #include <QTextStream>
 #include <QSet>
 #include <QMetaType>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
 
 #include <cassert>
 #include <cstdlib> // size_t
@@ -49,6 +54,11 @@
 #define TO8F(x)  QFile::encodeName( x ).constData()
 #endif
 
+// features per transaction used by writeAsVectorFormat
+#define WRITER_TRANSACTION_SIZE 10000
+// features read ahead of the writer thread by writeAsVectorFormat
+#define WRITER_QUEUE_SIZE 1000
+
 
 QgsVectorFileWriter::QgsVectorFileWriter(
   const QString &theVectorFileName,
@@ -63,7 +73,10 @@ QgsVectorFileWriter::QgsVectorFileWriter(
     : mDS( NULL )
     , mLayer( NULL )
     , mGeom( NULL )
+    , mFeature( NULL )
     , mError( NoError )
+    , mTransactionSize( 0 )
+    , mTransactionFeatures( -1 )
 {
   QString vectorFileName = theVectorFileName;
   QString fileEncoding = theFileEncoding;
@@ -374,10 +387,14 @@ QgsVectorFileWriter::QgsVectorFileWriter(
     }
 
     mAttrIdxToOgrIdx.insert( fldIt.key(), ogrIdx );
+    mFieldLayout << qMakePair( fldIt.key(), ogrIdx );
   }
 
   QgsDebugMsg( "Done creating fields" );
 
+  // feature which will be filled for each added feature
+  mFeature = OGR_F_Create( defn );
+
   mWkbType = geometryType;
   if ( mWkbType != QGis::WKBNoGeometry )
   {
@@ -404,12 +421,19 @@ QString QgsVectorFileWriter::errorMessage()
 
 bool QgsVectorFileWriter::addFeature( QgsFeature& feature )
 {
-  QgsAttributeMap::const_iterator it;
-
-  // create the feature
-  OGRFeatureH poFeature = OGR_F_Create( OGR_L_GetLayerDefn( mLayer ) );
+  if ( mTransactionSize > 0 && mTransactionFeatures < 0 )
+  {
+    if ( OGR_L_StartTransaction( mLayer ) == OGRERR_NONE )
+    {
+      mTransactionFeatures = 0;
+    }
+    else
+    {
+      QgsDebugMsg( QString( "Failed to start transaction (OGR error: %1)" ).arg( CPLGetLastErrorMsg() ) );
+    }
+  }
 
-  OGRErr err = OGR_F_SetFID( poFeature, feature.id() );
+  OGRErr err = OGR_F_SetFID( mFeature, feature.id() );
   if ( err != OGRERR_NONE )
   {
     QgsDebugMsg( QString( "Failed to set feature id to %1: %2 (OGR error: %3)" )
@@ -419,39 +443,38 @@ bool QgsVectorFileWriter::addFeature( QgsFeature& feature )
   }
 
   // attribute handling
-  QgsFieldMap::const_iterator fldIt;
-  for ( fldIt = mFields.begin(); fldIt != mFields.end(); ++fldIt )
+  const QgsAttributeMap& attributes = feature.attributeMap();
+  for ( int i = 0; i < mFieldLayout.size(); i++ )
   {
-    if ( !feature.attributeMap().contains( fldIt.key() ) )
-    {
-      QgsDebugMsg( QString( "no attribute for field %1" ).arg( fldIt.key() ) );
-      continue;
-    }
+    int attrIdx = mFieldLayout[i].first;
+    int ogrField = mFieldLayout[i].second;
 
-    if ( !mAttrIdxToOgrIdx.contains( fldIt.key() ) )
+    QgsAttributeMap::const_iterator it = attributes.constFind( attrIdx );
+    if ( it == attributes.constEnd() )
     {
-      QgsDebugMsg( QString( "no ogr field for field %1" ).arg( fldIt.key() ) );
+      QgsDebugMsg( QString( "no attribute for field %1" ).arg( attrIdx ) );
+      // the feature is reused, clear the value of the previous one
+      OGR_F_UnsetField( mFeature, ogrField );
       continue;
     }
 
-    const QVariant& attrValue = feature.attributeMap()[ fldIt.key()];
-    int ogrField = mAttrIdxToOgrIdx[ fldIt.key()];
+    const QVariant& attrValue = it.value();
 
     switch ( attrValue.type() )
     {
       case QVariant::Int:
-        OGR_F_SetFieldInteger( poFeature, ogrField, attrValue.toInt() );
+        OGR_F_SetFieldInteger( mFeature, ogrField, attrValue.toInt() );
         break;
       case QVariant::Double:
-        OGR_F_SetFieldDouble( poFeature, ogrField, attrValue.toDouble() );
+        OGR_F_SetFieldDouble( mFeature, ogrField, attrValue.toDouble() );
         break;
       case QVariant::LongLong:
       case QVariant::String:
-        OGR_F_SetFieldString( poFeature, ogrField, mCodec->fromUnicode( attrValue.toString() ).data() );
+        OGR_F_SetFieldString( mFeature, ogrField, mCodec->fromUnicode( attrValue.toString() ).data() );
         break;
       default:
         mErrorMessage = QObject::tr( "Invalid variant type for field %1[%2]: received %3 with type %4" )
-                        .arg( fldIt.value().name() )
+                        .arg( mFields[ attrIdx ].name() )
                         .arg( ogrField )
                         .arg( QMetaType::typeName( attrValue.type() ) )
                         .arg( attrValue.toString() );
@@ -465,79 +488,127 @@ bool QgsVectorFileWriter::addFeature( QgsFeature& feature )
   {
     // build geometry from WKB
     QgsGeometry *geom = feature.geometry();
-    if ( geom && geom->wkbType() != mWkbType )
+    if ( geom )
     {
-      // there's a problem when layer type is set as wkbtype Polygon
-      // although there are also features of type MultiPolygon
-      // (at least in OGR provider)
-      // If the feature's wkbtype is different from the layer's wkbtype,
-      // try to export it too.
-      //
-      // Btw. OGRGeometry must be exactly of the type of the geometry which it will receive
-      // i.e. Polygons can't be imported to OGRMultiPolygon
-
-      OGRGeometryH mGeom2 = createEmptyGeometry( geom->wkbType() );
-
-      if ( !mGeom2 )
-      {
-        QgsDebugMsg( QString( "Failed to create empty geometry for type %1 (OGR error: %2)" ).arg( geom->wkbType() ).arg( CPLGetLastErrorMsg() ) );
-        mErrorMessage = QObject::tr( "Feature geometry not imported (OGR error: %1)" )
-                        .arg( QString::fromUtf8( CPLGetLastErrorMsg() ) );
-        mError = ErrFeatureWriteFailed;
-        OGR_F_Destroy( poFeature );
-        return false;
-      }
+      OGRGeometryH ogrGeom = mGeom;
 
-      OGRErr err = OGR_G_ImportFromWkb( mGeom2, geom->asWkb(), geom->wkbSize() );
-      if ( err != OGRERR_NONE )
+      if ( geom->wkbType() != mWkbType )
       {
-        QgsDebugMsg( QString( "Failed to import geometry from WKB: %1 (OGR error: %2)" ).arg( err ).arg( CPLGetLastErrorMsg() ) );
-        mErrorMessage = QObject::tr( "Feature geometry not imported (OGR error: %1)" )
-                        .arg( QString::fromUtf8( CPLGetLastErrorMsg() ) );
-        mError = ErrFeatureWriteFailed;
-        OGR_F_Destroy( poFeature );
-        return false;
+        // there's a problem when layer type is set as wkbtype Polygon
+        // although there are also features of type MultiPolygon
+        // (at least in OGR provider)
+        // If the feature's wkbtype is different from the layer's wkbtype,
+        // try to export it too.
+        //
+        // Btw. OGRGeometry must be exactly of the type of the geometry which it will receive
+        // i.e. Polygons can't be imported to OGRMultiPolygon
+
+        ogrGeom = mOtherGeoms.value( geom->wkbType(), NULL );
+        if ( !ogrGeom )
+        {
+          ogrGeom = createEmptyGeometry( geom->wkbType() );
+          if ( !ogrGeom )
+          {
+            QgsDebugMsg( QString( "Failed to create empty geometry for type %1 (OGR error: %2)" ).arg( geom->wkbType() ).arg( CPLGetLastErrorMsg() ) );
+            mErrorMessage = QObject::tr( "Feature geometry not imported (OGR error: %1)" )
+                            .arg( QString::fromUtf8( CPLGetLastErrorMsg() ) );
+            mError = ErrFeatureWriteFailed;
+            return false;
+          }
+          mOtherGeoms.insert( geom->wkbType(), ogrGeom );
+        }
       }
 
-      // pass ownership to geometry
-      OGR_F_SetGeometryDirectly( poFeature, mGeom2 );
-    }
-    else if ( geom )
-    {
-      OGRErr err = OGR_G_ImportFromWkb( mGeom, geom->asWkb(), geom->wkbSize() );
+      OGRErr err = OGR_G_ImportFromWkb( ogrGeom, geom->asWkb(), geom->wkbSize() );
       if ( err != OGRERR_NONE )
       {
         QgsDebugMsg( QString( "Failed to import geometry from WKB: %1 (OGR error: %2)" ).arg( err ).arg( CPLGetLastErrorMsg() ) );
         mErrorMessage = QObject::tr( "Feature geometry not imported (OGR error: %1)" )
                         .arg( QString::fromUtf8( CPLGetLastErrorMsg() ) );
         mError = ErrFeatureWriteFailed;
-        OGR_F_Destroy( poFeature );
         return false;
       }
 
       // set geometry (ownership is not passed to OGR)
-      OGR_F_SetGeometry( poFeature, mGeom );
+      OGR_F_SetGeometry( mFeature, ogrGeom );
+    }
+    else
+    {
+      // the feature is reused, drop the geometry of the previous one
+      OGR_F_SetGeometry( mFeature, NULL );
     }
   }
 
   // put the created feature to layer
-  if ( OGR_L_CreateFeature( mLayer, poFeature ) != OGRERR_NONE )
+  if ( OGR_L_CreateFeature( mLayer, mFeature ) != OGRERR_NONE )
   {
     mErrorMessage = QObject::tr( "Feature creation error (OGR error: %1)" ).arg( QString::fromUtf8( CPLGetLastErrorMsg() ) );
     mError = ErrFeatureWriteFailed;
 
     QgsDebugMsg( mErrorMessage );
-    OGR_F_Destroy( poFeature );
     return false;
   }
 
-  OGR_F_Destroy( poFeature );
+  if ( mTransactionFeatures >= 0 && ++mTransactionFeatures >= mTransactionSize )
+  {
+    return commitTransaction();
+  }
+
+  return true;
+}
+
+void QgsVectorFileWriter::setTransactionSize( int features )
+{
+  if ( !mLayer || !OGR_L_TestCapability( mLayer, OLCTransactions ) )
+  {
+    QgsDebugMsg( "transactions not supported by the driver" );
+    features = 0;
+  }
+
+  mTransactionSize = features > 0 ? features : 0;
+
+  if ( mTransactionFeatures >= 0 && mTransactionFeatures >= mTransactionSize )
+    commitTransaction();
+}
+
+int QgsVectorFileWriter::transactionSize() const
+{
+  return mTransactionSize;
+}
+
+bool QgsVectorFileWriter::commitTransaction()
+{
+  if ( mTransactionFeatures < 0 )
+    return true;
+
+  mTransactionFeatures = -1;
+
+  if ( OGR_L_CommitTransaction( mLayer ) != OGRERR_NONE )
+  {
+    mErrorMessage = QObject::tr( "Transaction commit failed (OGR error: %1)" ).arg( QString::fromUtf8( CPLGetLastErrorMsg() ) );
+    mError = ErrFeatureWriteFailed;
+
+    QgsDebugMsg( mErrorMessage );
+    return false;
+  }
 
   return true;
 }
 
 QgsVectorFileWriter::~QgsVectorFileWriter()
 {
+  commitTransaction();
+
+  if ( mFeature )
+  {
+    OGR_F_Destroy( mFeature );
+  }
+
+  foreach( OGRGeometryH geom, mOtherGeoms )
+  {
+    OGR_G_DestroyGeometry( geom );
+  }
+
   if ( mGeom )
   {
     OGR_G_DestroyGeometry( mGeom );
@@ -550,6 +621,123 @@ QgsVectorFileWriter::~QgsVectorFileWriter()
 }
 
 
+/** Writes the features read by writeAsVectorFormat on a separate thread, so
+ * that reading and transforming the next features overlaps with OGR writing
+ * them. The queue is bounded to keep memory use flat for big layers.
+ */
+class QgsVectorFileWriterThread : public QThread
+{
+  public:
+    QgsVectorFileWriterThread( QgsVectorFileWriter* writer, int maxQueued )
+        : mWriter( writer )
+        , mMaxQueued( maxQueued )
+        , mFinished( false )
+        , mStopped( false )
+        , mCount( 0 )
+        , mErrors( 0 )
+    {}
+
+    //! queue a feature for writing, blocks while the queue is full.
+    //! Returns false if writing has been stopped
+    bool enqueue( const QgsFeature& feature )
+    {
+      QMutexLocker locker( &mMutex );
+      while ( mQueue.size() >= mMaxQueued && !mStopped )
+        mNotFull.wait( &mMutex );
+
+      if ( mStopped )
+        return false;
+
+      mQueue.enqueue( feature );
+      mNotEmpty.wakeOne();
+      return true;
+    }
+
+    //! write the queued features and end the thread
+    void finish()
+    {
+      QMutexLocker locker( &mMutex );
+      mFinished = true;
+      mNotEmpty.wakeOne();
+    }
+
+    //! drop the queued features and end the thread
+    void stop()
+    {
+      QMutexLocker locker( &mMutex );
+      mFinished = true;
+      mStopped = true;
+      mQueue.clear();
+      mNotEmpty.wakeOne();
+      mNotFull.wakeAll();
+    }
+
+    //! number of processed features (-1 if writing was stopped because of errors)
+    int count() const { return mCount; }
+    int errors() const { return mErrors; }
+    QString errorMessage() const { return mErrorMessage; }
+
+  protected:
+    void run()
+    {
+      forever
+      {
+        mMutex.lock();
+        while ( mQueue.isEmpty() && !mFinished )
+          mNotEmpty.wait( &mMutex );
+
+        if ( mQueue.isEmpty() || mStopped )
+        {
+          mMutex.unlock();
+          break;
+        }
+
+        // take everything queued so far
+        QQueue<QgsFeature> features = mQueue;
+        mQueue.clear();
+        mNotFull.wakeAll();
+        mMutex.unlock();
+
+        for ( int i = 0; i < features.size(); i++ )
+        {
+          if ( !mWriter->addFeature( features[i] ) )
+          {
+            if ( mWriter->hasError() != QgsVectorFileWriter::NoError )
+            {
+              if ( mErrorMessage.isEmpty() )
+              {
+                mErrorMessage = QObject::tr( "Feature write errors:" );
+              }
+              mErrorMessage += "\n" + mWriter->errorMessage();
+            }
+            mErrors++;
+
+            if ( mErrors > 1000 )
+            {
+              mErrorMessage += QObject::tr( "Stopping after %1 errors" ).arg( mErrors );
+              mCount = -1;
+              stop();
+              return;
+            }
+          }
+          mCount++;
+        }
+      }
+    }
+
+  private:
+    QgsVectorFileWriter* mWriter;
+    QQueue<QgsFeature> mQueue;
+    int mMaxQueued;
+    QMutex mMutex;
+    QWaitCondition mNotEmpty;
+    QWaitCondition mNotFull;
+    bool mFinished;
+    bool mStopped;
+    int mCount;
+    int mErrors;
+    QString mErrorMessage;
+};
 
 
 QgsVectorFileWriter::WriterError
@@ -629,7 +817,12 @@ QgsVectorFileWriter::writeAsVectorFormat( QgsVectorLayer* layer,
     shallTransform = false;
   }
 
-  int n = 0, errors = 0;
+  // group features into transactions (if the driver supports them) and let
+  // another thread write them while the next ones are read and transformed
+  writer->setTransactionSize( WRITER_TRANSACTION_SIZE );
+
+  QgsVectorFileWriterThread writerThread( writer, WRITER_QUEUE_SIZE );
+  writerThread.start();
 
   // write all features
   while ( layer->nextFeature( fet ) )
@@ -648,6 +841,9 @@ QgsVectorFileWriter::writeAsVectorFormat( QgsVectorLayer* layer,
       }
       catch ( QgsCsException &e )
       {
+        writerThread.stop();
+        writerThread.wait();
+
         delete ct;
         delete writer;
 
@@ -664,31 +860,21 @@ QgsVectorFileWriter::writeAsVectorFormat( QgsVectorLayer* layer,
     {
       fet.clearAttributeMap();
     }
-    if ( !writer->addFeature( fet ) )
+    if ( !writerThread.enqueue( fet ) )
     {
-      WriterError err = writer->hasError();
-      if ( err != NoError && errorMessage )
-      {
-        if ( errorMessage->isEmpty() )
-        {
-          *errorMessage = QObject::tr( "Feature write errors:" );
-        }
-        *errorMessage += "\n" + writer->errorMessage();
-      }
-      errors++;
+      // writing stopped after too many errors
+      break;
+    }
+  }
 
-      if ( errors > 1000 )
-      {
-        if ( errorMessage )
-        {
-          *errorMessage += QObject::tr( "Stopping after %1 errors" ).arg( errors );
-        }
+  writerThread.finish();
+  writerThread.wait();
 
-        n = -1;
-        break;
-      }
-    }
-    n++;
+  int n = writerThread.count();
+  int errors = writerThread.errors();
+  if ( errorMessage )
+  {
+    *errorMessage += writerThread.errorMessage();
   }
 
   delete writer;
@@ -23,10 +23,12 @@
 #include "qgsfield.h"
 
 #include <QPair>
+#include <QVector>
 
 typedef void *OGRDataSourceH;
 typedef void *OGRLayerH;
 typedef void *OGRGeometryH;
+typedef void *OGRFeatureH;
 
 class QTextCodec;
 
@@ -115,6 +117,19 @@ class CORE_EXPORT QgsVectorFileWriter
     /** add feature to the currently opened shapefile */
     bool addFeature( QgsFeature& feature );
 
+    /** Group added features into transactions of the given number of features
+     * if the OGR driver supports transactions (e.g. SQLite). 0 (default)
+     * writes each feature on its own. Pending features are committed
+     * by the destructor.
+     * @note added in 1.7
+     */
+    void setTransactionSize( int features );
+
+    /** number of features per transaction, 0 if transactions are not used
+     * @note added in 1.7
+     */
+    int transactionSize() const;
+
     /** close opened shapefile for writing */
     ~QgsVectorFileWriter();
 
@@ -128,10 +143,19 @@ class CORE_EXPORT QgsVectorFileWriter
 
     OGRGeometryH createEmptyGeometry( QGis::WkbType wkbType );
 
+    /** commit the running transaction (if any) */
+    bool commitTransaction();
+
     OGRDataSourceH mDS;
     OGRLayerH mLayer;
     OGRGeometryH mGeom;
 
+    /** feature reused for all added features */
+    OGRFeatureH mFeature;
+
+    /** geometries used to import features whose type differs from the layer's */
+    QMap<int, OGRGeometryH> mOtherGeoms;
+
     QgsFieldMap mFields;
 
     /** contains error value if construction was not successful */
@@ -146,6 +170,13 @@ class CORE_EXPORT QgsVectorFileWriter
     /** map attribute indizes to OGR field indexes */
     QMap<int, int> mAttrIdxToOgrIdx;
 
+    /** attribute index and OGR field index of the fields in field order */
+    QVector< QPair<int, int> > mFieldLayout;
+
+    int mTransactionSize;
+    /** features added in the running transaction, -1 if none is running */
+    int mTransactionFeatures;
+
   private:
     static bool driverMetadata( QString driverName, QString &longName, QString &trLongName, QString &glob, QString &ext );
 };
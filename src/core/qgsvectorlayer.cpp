@@ -720,6 +720,9 @@ void QgsVectorLayer::drawRendererV2( QgsRenderContext& rendererContext, bool lab
 
   mRendererV2->startRender( rendererContext, this );
 
+  // features with the same symbol are drawn together
+  mRendererV2->setBatchRendering( true );
+
 #ifndef Q_WS_MAC
   int featureCount = 0;
 #endif //Q_WS_MAC
@@ -737,6 +740,7 @@ void QgsVectorLayer::drawRendererV2( QgsRenderContext& rendererContext, bool lab
 #ifndef Q_WS_MAC //MH: disable this on Mac for now to avoid problems with resizing
       if ( mUpdateThreshold > 0 && 0 == featureCount % mUpdateThreshold )
       {
+        mRendererV2->flushBatch( rendererContext );
         emit screenUpdateRequested();
         // emit drawingProgress( featureCount, totalFeatures );
         qApp->processEvents();
@@ -784,6 +788,9 @@ void QgsVectorLayer::drawRendererV2( QgsRenderContext& rendererContext, bool lab
 #endif //Q_WS_MAC
   }
 
+  mRendererV2->flushBatch( rendererContext );
+  mRendererV2->setBatchRendering( false );
+
 #ifndef Q_WS_MAC
   QgsDebugMsg( QString( "Total features processed %1" ).arg( featureCount ) );
 #endif
@@ -2730,6 +2737,7 @@ bool QgsVectorLayer::setDataProvider( QString const & provider )
 
       // TODO: Check if the provider has the capability to send fullExtentCalculated
       connect( mDataProvider, SIGNAL( fullExtentCalculated() ), this, SLOT( updateExtents() ) );
+      connect( mDataProvider, SIGNAL( editProgress( int, int ) ), this, SIGNAL( commitProgress( int, int ) ) );
 
       // get the extent
       QgsRectangle mbr = mDataProvider->extent();
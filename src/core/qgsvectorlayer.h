@@ -735,6 +735,10 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
     void committedAttributeValuesChanges( const QString& layerId, const QgsChangedAttributesMap& changedAttributesValues );
     void committedGeometriesChanges( const QString& layerId, const QgsGeometryMap& changedGeometries );
 
+    /** Progress of the edits written to the data provider by commitChanges(), if the provider reports it
+      \note added in 1.7 */
+    void commitProgress( int theProgress, int theTotalSteps );
+
   private:                       // Private methods
 
     /** vector layers are not copyable */
@@ -37,6 +37,7 @@ class CORE_EXPORT QgsRasterBandStats
     {
       bandName = "";
       statsGathered = false;
+      statsEstimated = false;
       minimumValue = std::numeric_limits<double>::max();
       maximumValue = std::numeric_limits<double>::min();
       range = 0.0;
@@ -92,10 +93,15 @@ class CORE_EXPORT QgsRasterBandStats
      * is completely populated */
     bool statsGathered;
 
+    /** \brief A flag to indicate that the statistics were calculated from a sample
+     * of the cells (see QgsRasterLayer::bandStatistics)
+     * @note added in 1.7 */
+    bool statsEstimated;
+
     /** \brief The sum of all cells in the band. NO_DATA values are excluded. */
     double sum;
 
-    /** \brief The sum of the squares. Used to calculate standard deviation. */
+    /** \brief The sum of the squared deviations from the mean. Used to calculate standard deviation. */
     double sumOfSquares;
 };
 #endif
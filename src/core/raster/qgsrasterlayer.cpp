@@ -60,6 +60,7 @@ email                : tim at linfiniti.com
 #include <QSlider>
 #include <QSettings>
 #include <QTime>
+#include <QtConcurrentMap>
 
 // typedefs for provider plugin functions of interest
 typedef void buildsupportedrasterfilefilter_t( QString & theFileFiltersString );
@@ -79,6 +80,125 @@ typedef bool isvalidrasterfilename_t( QString const & theFileNameQString, QStrin
 // doubles can take for the current system.  (Yes, 20 was arbitrary.)
 #define TINY_VALUE  std::numeric_limits<double>::epsilon() * 20
 
+// number of blocks read before their statistics are calculated in parallel
+#define STATISTICS_BLOCK_BATCH_SIZE 16
+// number of cells read for approximate statistics. The standard error of the mean
+// is stdDev / sqrt( cells ), i.e. 0.1% of the standard deviation
+#define APPROXIMATE_STATISTICS_CELLS 1000000
+
+/** Partial statistics of some cells of a band. Uses Welford's update for single values and
+ * the pairwise update of Chan et al. for merging partial results, which is numerically stable
+ * (unlike the difference of sum of squares and squared sum) and needs only one pass */
+struct QgsRasterStatsAccumulator
+{
+  QgsRasterStatsAccumulator()
+      : count( 0 )
+      , mean( 0.0 )
+      , m2( 0.0 )
+      , minimum( std::numeric_limits<double>::max() )
+      , maximum( -std::numeric_limits<double>::max() )
+  {}
+
+  void add( double value )
+  {
+    ++count;
+    double delta = value - mean;
+    mean += delta / count;
+    m2 += delta * ( value - mean );
+    if ( value < minimum )
+      minimum = value;
+    if ( value > maximum )
+      maximum = value;
+  }
+
+  void merge( const QgsRasterStatsAccumulator& other )
+  {
+    if ( other.count == 0 )
+      return;
+    if ( count == 0 )
+    {
+      *this = other;
+      return;
+    }
+    qint64 n = count + other.count;
+    double delta = other.mean - mean;
+    mean += delta * other.count / n;
+    m2 += other.m2 + delta * delta * ( double ) count * ( double ) other.count / n;
+    count = n;
+    minimum = qMin( minimum, other.minimum );
+    maximum = qMax( maximum, other.maximum );
+  }
+
+  qint64 count;
+  double mean;
+  double m2; // sum of squared deviations from the mean
+  double minimum;
+  double maximum;
+};
+
+/** A block of band data and its partial statistics */
+struct QgsRasterStatsBlock
+{
+  void* data;
+  int dataType;
+  int width;  // valid columns
+  int height; // valid rows
+  int stride; // columns of data
+  bool validNoData;
+  double noData;
+  QgsRasterStatsAccumulator stats;
+};
+
+template <class T>
+static void accumulateStatsValues( const T* data, QgsRasterStatsBlock& block )
+{
+  for ( int iY = 0; iY < block.height; iY++ )
+  {
+    const T* row = data + iY * block.stride;
+    for ( int iX = 0; iX < block.width; iX++ )
+    {
+      double myValue = ( double ) row[iX];
+      if ( block.validNoData && ( qAbs( myValue - block.noData ) <= TINY_VALUE || myValue != myValue ) )
+      {
+        continue; // NULL
+      }
+      block.stats.add( myValue );
+    }
+  }
+}
+
+// called from several threads, must not touch the layer or the provider
+static void accumulateStatsBlock( QgsRasterStatsBlock& block )
+{
+  block.stats = QgsRasterStatsAccumulator();
+  switch ( block.dataType )
+  {
+    case QgsRasterDataProvider::Byte:
+      accumulateStatsValues(( const GByte * ) block.data, block );
+      break;
+    case QgsRasterDataProvider::UInt16:
+      accumulateStatsValues(( const GUInt16 * ) block.data, block );
+      break;
+    case QgsRasterDataProvider::Int16:
+      accumulateStatsValues(( const GInt16 * ) block.data, block );
+      break;
+    case QgsRasterDataProvider::UInt32:
+      accumulateStatsValues(( const GUInt32 * ) block.data, block );
+      break;
+    case QgsRasterDataProvider::Int32:
+      accumulateStatsValues(( const GInt32 * ) block.data, block );
+      break;
+    case QgsRasterDataProvider::Float32:
+      accumulateStatsValues(( const float * ) block.data, block );
+      break;
+    case QgsRasterDataProvider::Float64:
+      accumulateStatsValues(( const double * ) block.data, block );
+      break;
+    default:
+      break;
+  }
+}
+
 
 QgsRasterLayer::QgsRasterLayer(
   QString const & path,
@@ -312,10 +432,13 @@ int QgsRasterLayer::bandNumber( QString const & theBandName )
  * <li>myRasterBandStats.colorTable
  * </ul>
  *
+ * The cells are read once; statistics of the blocks are calculated in parallel and merged.
+ * Exact statistics are stored with the dataset by the provider and read from there next time.
+ *
  * @sa RasterBandStats
  * @note This is a cpu intensive and slow task!
  */
-const QgsRasterBandStats QgsRasterLayer::bandStatistics( int theBandNo )
+const QgsRasterBandStats QgsRasterLayer::bandStatistics( int theBandNo, bool theApproximateFlag )
 {
   QgsDebugMsg( "theBandNo = " + QString::number( theBandNo ) );
   QgsDebugMsg( "mRasterType = " + QString::number( mRasterType ) );
@@ -352,8 +475,19 @@ const QgsRasterBandStats QgsRasterLayer::bandStatistics( int theBandNo )
   myRasterBandStats.bandNumber = theBandNo;
 
   // don't bother with this if we already have stats
-  if ( myRasterBandStats.statsGathered )
+  if ( myRasterBandStats.statsGathered && ( theApproximateFlag || !myRasterBandStats.statsEstimated ) )
+  {
+    return myRasterBandStats;
+  }
+
+  // statistics stored with the dataset are only valid if they were calculated with the same no data value
+  bool myStoredStatsFlag = mValidNoDataValue == mDataProvider->isNoDataValueValid() &&
+                           ( !mValidNoDataValue || qAbs( mNoDataValue - mDataProvider->noDataValue() ) <= TINY_VALUE );
+  if ( myStoredStatsFlag && mDataProvider->readStatistics( theBandNo, myRasterBandStats ) )
   {
+    myRasterBandStats.statsGathered = true;
+    myRasterBandStats.statsEstimated = false;
+    mRasterStatsList[theBandNo - 1] = myRasterBandStats;
     return myRasterBandStats;
   }
   // only print message if we are actually gathering the stats
@@ -361,141 +495,95 @@ const QgsRasterBandStats QgsRasterLayer::bandStatistics( int theBandNo )
   qApp->processEvents();
   QgsDebugMsg( "stats for band " + QString::number( theBandNo ) );
 
-  myRasterBandStats.elementCount = 0; // because we'll be counting only VALID pixels later
-
   emit statusChanged( tr( "Calculating stats for %1" ).arg( name() ) );
   //reset the main app progress bar
   emit drawingProgress( 0, 0 );
 
   int myDataType = mDataProvider->dataType( theBandNo );
-
-  int  myNXBlocks, myNYBlocks, myXBlockSize, myYBlockSize;
-  myXBlockSize = mDataProvider->xBlockSize();
-  myYBlockSize = mDataProvider->yBlockSize();
-
-  myNXBlocks = ( mDataProvider->xSize() + myXBlockSize - 1 ) / myXBlockSize;
-  myNYBlocks = ( mDataProvider->ySize() + myYBlockSize - 1 ) / myYBlockSize;
-
-  void *myData = CPLMalloc( myXBlockSize * myYBlockSize * ( mDataProvider->dataTypeSize( theBandNo ) / 8 ) );
-
-  // unfortunately we need to make two passes through the data to calculate stddev
-  bool myFirstIterationFlag = true;
-
+  int myDataSize = mDataProvider->dataTypeSize( theBandNo ) / 8;
   int myBandXSize = mDataProvider->xSize();
   int myBandYSize = mDataProvider->ySize();
-  for ( int iYBlock = 0; iYBlock < myNYBlocks; iYBlock++ )
+
+  QgsRasterStatsBlock myBlockTemplate;
+  myBlockTemplate.data = 0;
+  myBlockTemplate.dataType = myDataType;
+  myBlockTemplate.validNoData = mValidNoDataValue;
+  myBlockTemplate.noData = mNoDataValue;
+
+  QgsRasterStatsAccumulator myStats;
+  bool myEstimatedFlag = theApproximateFlag && ( double ) myBandXSize * myBandYSize > APPROXIMATE_STATISTICS_CELLS;
+  if ( myEstimatedFlag )
+  {
+    // read the band at reduced resolution (the provider may use overviews for it)
+    double myFactor = sqrt(( double ) myBandXSize * myBandYSize / APPROXIMATE_STATISTICS_CELLS );
+    QgsRasterStatsBlock myBlock = myBlockTemplate;
+    myBlock.width = qMax( 1, ( int )( myBandXSize / myFactor ) );
+    myBlock.height = qMax( 1, ( int )( myBandYSize / myFactor ) );
+    myBlock.stride = myBlock.width;
+    myBlock.data = CPLMalloc( myBlock.width * myBlock.height * myDataSize );
+    mDataProvider->readBlock( theBandNo, mDataProvider->extent(), myBlock.width, myBlock.height, myBlock.data );
+    accumulateStatsBlock( myBlock );
+    CPLFree( myBlock.data );
+    myStats = myBlock.stats;
+  }
+  else
   {
-    emit drawingProgress( iYBlock, myNYBlocks * 2 );
+    int myXBlockSize = mDataProvider->xBlockSize();
+    int myYBlockSize = mDataProvider->yBlockSize();
+    int myNXBlocks = ( myBandXSize + myXBlockSize - 1 ) / myXBlockSize;
+    int myNYBlocks = ( myBandYSize + myYBlockSize - 1 ) / myYBlockSize;
+    int myNBlocks = myNXBlocks * myNYBlocks;
 
-    for ( int iXBlock = 0; iXBlock < myNXBlocks; iXBlock++ )
+    // the blocks are read one after the other (the provider is not thread safe), their
+    // statistics are calculated in parallel and merged in order
+    QVector<QgsRasterStatsBlock> myBatch( qMin( STATISTICS_BLOCK_BATCH_SIZE, myNBlocks ), myBlockTemplate );
+    for ( int i = 0; i < myBatch.size(); ++i )
     {
-      int  nXValid, nYValid;
-      mDataProvider->readBlock( theBandNo, iXBlock, iYBlock, myData );
-
-      // Compute the portion of the block that is valid
-      // for partial edge blocks.
-      if (( iXBlock + 1 ) * myXBlockSize > myBandXSize )
-        nXValid = myBandXSize - iXBlock * myXBlockSize;
-      else
-        nXValid = myXBlockSize;
+      myBatch[i].data = CPLMalloc( myXBlockSize * myYBlockSize * myDataSize );
+      myBatch[i].stride = myXBlockSize;
+    }
 
-      if (( iYBlock + 1 ) * myYBlockSize > myBandYSize )
-        nYValid = myBandYSize - iYBlock * myYBlockSize;
-      else
-        nYValid = myYBlockSize;
+    for ( int myBlockNo = 0; myBlockNo < myNBlocks; )
+    {
+      emit drawingProgress( myBlockNo, myNBlocks );
 
-      // Collect the histogram counts.
-      for ( int iY = 0; iY < nYValid; iY++ )
+      QVector<QgsRasterStatsBlock> myBlocks;
+      for ( int i = 0; i < myBatch.size() && myBlockNo < myNBlocks; ++i, ++myBlockNo )
       {
-        for ( int iX = 0; iX < nXValid; iX++ )
-        {
-          double myValue = readValue( myData, myDataType, iX + ( iY * myXBlockSize ) );
-          //QgsDebugMsg ( QString ( "%1 %2 value %3" ).arg (iX).arg(iY).arg( myValue ) );
-
-          if ( mValidNoDataValue && ( qAbs( myValue - mNoDataValue ) <= TINY_VALUE || myValue != myValue ) )
-          {
-            continue; // NULL
-          }
-
-          myRasterBandStats.sum += myValue;
-          ++myRasterBandStats.elementCount;
-          //only use this element if we have a non null element
-          if ( myFirstIterationFlag )
-          {
-            //this is the first iteration so initialise vars
-            myFirstIterationFlag = false;
-            myRasterBandStats.minimumValue = myValue;
-            myRasterBandStats.maximumValue = myValue;
-          }               //end of true part for first iteration check
-          else
-          {
-            //this is done for all subsequent iterations
-            if ( myValue < myRasterBandStats.minimumValue )
-            {
-              myRasterBandStats.minimumValue = myValue;
-            }
-            if ( myValue > myRasterBandStats.maximumValue )
-            {
-              myRasterBandStats.maximumValue = myValue;
-            }
-          }               //end of false part for first iteration check
-        }
+        int iXBlock = myBlockNo % myNXBlocks;
+        int iYBlock = myBlockNo / myNXBlocks;
+        QgsRasterStatsBlock& myBlock = myBatch[i];
+        mDataProvider->readBlock( theBandNo, iXBlock, iYBlock, myBlock.data );
+
+        // Compute the portion of the block that is valid
+        // for partial edge blocks.
+        myBlock.width = qMin( myXBlockSize, myBandXSize - iXBlock * myXBlockSize );
+        myBlock.height = qMin( myYBlockSize, myBandYSize - iYBlock * myYBlockSize );
+        myBlocks.append( myBlock );
       }
-    }                       //end of column wise loop
-  }                           //end of row wise loop
-
-
-  //end of first pass through data now calculate the range
-  myRasterBandStats.range = myRasterBandStats.maximumValue - myRasterBandStats.minimumValue;
-  //calculate the mean
-  myRasterBandStats.mean = myRasterBandStats.sum / myRasterBandStats.elementCount;
-
-  //for the second pass we will get the sum of the squares / mean
-  for ( int iYBlock = 0; iYBlock < myNYBlocks; iYBlock++ )
-  {
-    emit drawingProgress( iYBlock + myNYBlocks, myNYBlocks * 2 );
-
-    for ( int iXBlock = 0; iXBlock < myNXBlocks; iXBlock++ )
-    {
-      int  nXValid, nYValid;
 
-      mDataProvider->readBlock( theBandNo, iXBlock, iYBlock, myData );
-
-      // Compute the portion of the block that is valid
-      // for partial edge blocks.
-      if (( iXBlock + 1 ) * myXBlockSize > myBandXSize )
-        nXValid = myBandXSize - iXBlock * myXBlockSize;
-      else
-        nXValid = myXBlockSize;
-
-      if (( iYBlock + 1 ) * myYBlockSize > myBandYSize )
-        nYValid = myBandYSize - iYBlock * myYBlockSize;
-      else
-        nYValid = myYBlockSize;
-
-      // Collect the histogram counts.
-      for ( int iY = 0; iY < nYValid; iY++ )
+      QtConcurrent::blockingMap( myBlocks, accumulateStatsBlock );
+      for ( int i = 0; i < myBlocks.size(); ++i )
       {
-        for ( int iX = 0; iX < nXValid; iX++ )
-        {
-          double myValue = readValue( myData, myDataType, iX + ( iY * myXBlockSize ) );
-          //QgsDebugMsg ( "myValue = " + QString::number(myValue) );
-
-          if ( mValidNoDataValue && ( qAbs( myValue - mNoDataValue ) <= TINY_VALUE || myValue != myValue ) )
-          {
-            continue; // NULL
-          }
-
-          myRasterBandStats.sumOfSquares += static_cast < double >
-                                            ( pow( myValue - myRasterBandStats.mean, 2 ) );
-        }
+        myStats.merge( myBlocks[i].stats );
       }
-    }                       //end of column wise loop
-  }                           //end of row wise loop
+    }
 
+    for ( int i = 0; i < myBatch.size(); ++i )
+    {
+      CPLFree( myBatch[i].data );
+    }
+  }
+
+  myRasterBandStats.elementCount = ( int ) myStats.count;
+  myRasterBandStats.minimumValue = myStats.minimum;
+  myRasterBandStats.maximumValue = myStats.maximum;
+  myRasterBandStats.range = myStats.maximum - myStats.minimum;
+  myRasterBandStats.mean = myStats.mean;
+  myRasterBandStats.sum = myStats.mean * myStats.count;
+  myRasterBandStats.sumOfSquares = myStats.m2;
   //divide result by sample size - 1 and get square root to get stdev
-  myRasterBandStats.stdDev = static_cast < double >( sqrt( myRasterBandStats.sumOfSquares /
-                             ( myRasterBandStats.elementCount - 1 ) ) );
+  myRasterBandStats.stdDev = myStats.count > 1 ? sqrt( myStats.m2 / ( myStats.count - 1 ) ) : 0.0;
 
 #ifdef QGISDEBUG
   QgsLogger::debug( "************ STATS **************", 1, __FILE__, __FUNCTION__, __LINE__ );
@@ -508,8 +596,13 @@ const QgsRasterBandStats QgsRasterLayer::bandStatistics( int theBandNo )
   QgsLogger::debug( "STDDEV", myRasterBandStats.stdDev, 1, __FILE__, __FUNCTION__, __LINE__ );
 #endif
 
-  CPLFree( myData );
   myRasterBandStats.statsGathered = true;
+  myRasterBandStats.statsEstimated = myEstimatedFlag;
+  // without valid cells minimum and maximum are not set, there is nothing to store
+  if ( myStoredStatsFlag && !myEstimatedFlag && myStats.count > 0 )
+  {
+    mDataProvider->writeStatistics( theBandNo, myRasterBandStats );
+  }
 
   QgsDebugMsg( "adding stats to stats collection at position " + QString::number( theBandNo - 1 ) );
   //add this band to the class stats map
@@ -545,6 +638,14 @@ QString QgsRasterLayer::buildPyramids( RasterPyramidList const & theRasterPyrami
   return mDataProvider->buildPyramids( theRasterPyramidList, theResamplingMethod, theTryInternalFlag );
 }
 
+void QgsRasterLayer::cancelBuildPyramids()
+{
+  if ( mDataProvider )
+  {
+    mDataProvider->cancelBuildPyramids();
+  }
+}
+
 
 QgsRasterLayer::RasterPyramidList  QgsRasterLayer::buildPyramidList()
 {
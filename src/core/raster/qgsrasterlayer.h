@@ -425,8 +425,10 @@ class CORE_EXPORT QgsRasterLayer : public QgsMapLayer
     *   If no matching band is found zero will be returned! */
     int bandNumber( const QString & theBandName );
 
-    /** \brief Get RasterBandStats for a band given its number (read only)  */
-    const  QgsRasterBandStats bandStatistics( int );
+    /** \brief Get RasterBandStats for a band given its number (read only)
+     * @param theApproximateFlag calculate the statistics from a sample of about one million cells
+     * (read at reduced resolution) instead of all cells. The result has statsEstimated set. Added in 1.7 */
+    const  QgsRasterBandStats bandStatistics( int, bool theApproximateFlag = false );
 
     /** \brief Get RasterBandStats for a band given its name (read only)  */
     const  QgsRasterBandStats bandStatistics( const QString & );
@@ -664,6 +666,10 @@ class CORE_EXPORT QgsRasterLayer : public QgsMapLayer
                            const QString &  theResamplingMethod = "NEAREST",
                            bool theTryInternalFlag = false );
 
+    /** \brief Stop building pyramid overviews
+     * @note added in 1.7 */
+    void cancelBuildPyramids();
+
     /** \brief Populate the histogram vector for a given band */
 
     void populateHistogram( int theBandNoInt,
@@ -46,7 +46,60 @@ class QgisVisitor : public SpatialIndex::IVisitor
 };
 
 
+// R-Tree parameters
+#define RTREE_FILL_FACTOR 0.7
+#define RTREE_INDEX_CAPACITY 10
+#define RTREE_LEAF_CAPACITY 10
+#define RTREE_DIMENSION 2
+
+// stream of the rectangles for bulk loading
+class QgisRectStream : public IDataStream
+{
+  public:
+    QgisRectStream( const QMap<int, QgsRectangle>& rects )
+        : mRects( rects ), mIt( rects.constBegin() ) {}
+
+    IData* getNext()
+    {
+      if ( mIt == mRects.constEnd() )
+        return 0;
+
+      double pt1[2], pt2[2];
+      pt1[0] = mIt.value().xMinimum();
+      pt1[1] = mIt.value().yMinimum();
+      pt2[0] = mIt.value().xMaximum();
+      pt2[1] = mIt.value().yMaximum();
+      Tools::Geometry::Region r( pt1, pt2, 2 );
+
+      // the bulk loader takes ownership of the data
+      RTree::Data* data = new RTree::Data( 0, 0, r, mIt.key() );
+      ++mIt;
+      return data;
+    }
+
+    bool hasNext() { return mIt != mRects.constEnd(); }
+
+    unsigned long size() { return mRects.size(); }
+
+    void rewind() { mIt = mRects.constBegin(); }
+
+  private:
+    const QMap<int, QgsRectangle>& mRects;
+    QMap<int, QgsRectangle>::const_iterator mIt;
+};
+
+
 QgsSpatialIndex::QgsSpatialIndex()
+{
+  initTree( 0 );
+}
+
+QgsSpatialIndex:: ~QgsSpatialIndex()
+{
+  deleteTree();
+}
+
+bool QgsSpatialIndex::initTree( const QMap<int, QgsRectangle>* rects )
 {
   // for now only memory manager
   mStorageManager = StorageManager::createNewMemoryStorageManager();
@@ -57,24 +110,58 @@ QgsSpatialIndex::QgsSpatialIndex()
   bool writeThrough = false;
   mStorage = StorageManager::createNewRandomEvictionsBuffer( *mStorageManager, capacity, writeThrough );
 
-  // R-Tree parameters
-  double fillFactor = 0.7;
-  unsigned long indexCapacity = 10;
-  unsigned long leafCapacity = 10;
-  unsigned long dimension = 2;
-  RTree::RTreeVariant variant = RTree::RV_RSTAR;
-
   // create R-tree
   long indexId;
-  mRTree = RTree::createNewRTree( *mStorage, fillFactor, indexCapacity,
-                                  leafCapacity, dimension, variant, indexId );
+  if ( rects && !rects->isEmpty() )
+  {
+    QgisRectStream stream( *rects );
+    try
+    {
+      mRTree = RTree::createAndBulkLoadNewRTree( RTree::BLM_STR, stream, *mStorage, RTREE_FILL_FACTOR, RTREE_INDEX_CAPACITY,
+               RTREE_LEAF_CAPACITY, RTREE_DIMENSION, RTree::RV_RSTAR, indexId );
+      return true;
+    }
+    catch ( Tools::Exception &e )
+    {
+      Q_UNUSED( e );
+      QgsDebugMsg( QString( "Tools::Exception caught: %1" ).arg( e.what().c_str() ) );
+    }
+    catch ( const std::exception &e )
+    {
+      Q_UNUSED( e );
+      QgsDebugMsg( QString( "std::exception caught: %1" ).arg( e.what() ) );
+    }
+    catch ( ... )
+    {
+      QgsDebugMsg( "unknown spatial index exception caught" );
+    }
+
+    // leave an empty (but usable) index behind
+    deleteTree();
+    initTree( 0 );
+    return false;
+  }
+
+  mRTree = RTree::createNewRTree( *mStorage, RTREE_FILL_FACTOR, RTREE_INDEX_CAPACITY,
+                                  RTREE_LEAF_CAPACITY, RTREE_DIMENSION, RTree::RV_RSTAR, indexId );
+  return true;
 }
 
-QgsSpatialIndex:: ~QgsSpatialIndex()
+void QgsSpatialIndex::deleteTree()
 {
   delete mRTree;
   delete mStorage;
   delete mStorageManager;
+  mRTree = 0;
+  mStorage = 0;
+  mStorageManager = 0;
+}
+
+bool QgsSpatialIndex::bulkLoad( const QMap<int, QgsRectangle>& rects )
+{
+  // start from fresh storage, the nodes of the old tree would stay in it otherwise
+  deleteTree();
+  return initTree( &rects );
 }
 
 Tools::Geometry::Region QgsSpatialIndex::rectToRegion( QgsRectangle rect )
@@ -40,6 +40,7 @@ class QgsFeature;
 class QgsRectangle;
 class QgsPoint;
 #include <QList>
+#include <QMap>
 
 class CORE_EXPORT QgsSpatialIndex
 {
@@ -69,6 +70,12 @@ class CORE_EXPORT QgsSpatialIndex
     /** remove feature from index */
     bool deleteFeature( QgsFeature& f );
 
+    /** replace the content of the index with the given bounding rectangles (keyed by feature id).
+      The tree is built at once (STR bulk loading), which is much faster than inserting
+      the features one by one and gives a tree with less overlap.
+      @note added in 1.7 */
+    bool bulkLoad( const QMap<int, QgsRectangle>& rects );
+
 
     /* queries */
 
@@ -81,6 +88,12 @@ class CORE_EXPORT QgsSpatialIndex
 
   protected:
 
+    /** create storage and R-tree, bulk loaded with rects if not 0 */
+    bool initTree( const QMap<int, QgsRectangle>* rects );
+
+    /** delete R-tree and storage */
+    void deleteTree();
+
     Tools::Geometry::Region rectToRegion( QgsRectangle rect );
 
     bool featureInfo( QgsFeature& f, Tools::Geometry::Region& r, long& id );
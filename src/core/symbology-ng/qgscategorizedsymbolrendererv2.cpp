@@ -13,6 +13,8 @@
 #include <QDomElement>
 #include <QSettings> // for legend
 
+#include <cmath>
+
 QgsRendererCategoryV2::QgsRendererCategoryV2( QVariant value, QgsSymbolV2* symbol, QString label )
     : mValue( value ), mSymbol( symbol ), mLabel( label )
 {
@@ -98,20 +100,64 @@ QgsCategorizedSymbolRendererV2::~QgsCategorizedSymbolRendererV2()
   delete mSourceColorRamp;
 }
 
+// integral doubles within this bound have the same string form as the integer
+#define MAX_INTEGRAL_DOUBLE 1e15
+
 void QgsCategorizedSymbolRendererV2::rebuildHash()
 {
   mSymbolHash.clear();
+  mIntSymbolHash.clear();
+  mDoubleSymbolHash.clear();
 
   for ( int i = 0; i < mCategories.count(); ++i )
   {
     QgsRendererCategoryV2& cat = mCategories[i];
-    mSymbolHash.insert( cat.value().toString(), cat.symbol() );
+    QString str = cat.value().toString();
+    mSymbolHash.insert( str, cat.symbol() );
+
+    // category values are strings when loaded from project, so the typed keys are
+    // derived from the string form: a numeric attribute matches a category exactly
+    // when its string conversion equals the category value
+    bool ok;
+    qlonglong intValue = str.toLongLong( &ok );
+    if ( ok && QString::number( intValue ) == str )
+    {
+      mIntSymbolHash.insert( intValue, cat.symbol() );
+      continue;
+    }
+    double doubleValue = str.toDouble( &ok );
+    if ( ok && QVariant( doubleValue ).toString() == str )
+      mDoubleSymbolHash.insert( QgsSymbolLayerV2Utils::doubleHashKey( doubleValue ), cat.symbol() );
   }
 }
 
 QgsSymbolV2* QgsCategorizedSymbolRendererV2::symbolForValue( QVariant value )
 {
-  // TODO: special case for int, double
+  // null values are converted to an empty string
+  switch ( value.isNull() ? QVariant::Invalid : value.type() )
+  {
+    case QVariant::Int:
+    case QVariant::UInt:
+    case QVariant::LongLong:
+      // the string form of an integer is canonical - no need to look further
+      return mIntSymbolHash.value( value.toLongLong(), NULL );
+
+    case QVariant::Double:
+    {
+      double d = value.toDouble();
+      if ( d == floor( d ) && fabs( d ) < MAX_INTEGRAL_DOUBLE )
+        return mIntSymbolHash.value(( qlonglong ) d, NULL );
+
+      QHash<quint64, QgsSymbolV2*>::const_iterator it = mDoubleSymbolHash.find( QgsSymbolLayerV2Utils::doubleHashKey( d ) );
+      if ( it != mDoubleSymbolHash.end() )
+        return *it;
+      // the value may still match by its string form (e.g. rounded to 15 digits)
+      break;
+    }
+
+    default:
+      break;
+  }
 
   QHash<QString, QgsSymbolV2*>::iterator it = mSymbolHash.find( value.toString() );
   if ( it == mSymbolHash.end() )
@@ -153,7 +199,7 @@ QgsSymbolV2* QgsCategorizedSymbolRendererV2::symbolForFeature( QgsFeature& featu
     sizeScale = attrMap[mSizeScaleFieldIdx].toDouble();
 
   // take a temporary symbol (or create it if doesn't exist)
-  QgsSymbolV2* tempSymbol = mTempSymbols[ita->toString()];
+  QgsSymbolV2* tempSymbol = mTempSymbols[symbol];
 
   // modify the temporary symbol and return it
   if ( tempSymbol->type() == QgsSymbolV2::Marker )
@@ -256,7 +302,7 @@ void QgsCategorizedSymbolRendererV2::startRender( QgsRenderContext& context, con
       tempSymbol->setRenderHints(( mRotationFieldIdx != -1 ? QgsSymbolV2::DataDefinedRotation : 0 ) |
                                  ( mSizeScaleFieldIdx != -1 ? QgsSymbolV2::DataDefinedSizeScale : 0 ) );
       tempSymbol->startRender( context );
-      mTempSymbols[ it->value().toString()] = tempSymbol;
+      mTempSymbols[ it->symbol()] = tempSymbol;
     }
   }
 
@@ -269,7 +315,11 @@ void QgsCategorizedSymbolRendererV2::stopRender( QgsRenderContext& context )
     it->symbol()->stopRender( context );
 
   // cleanup mTempSymbols
-  QHash<QString, QgsSymbolV2*>::iterator it2 = mTempSymbols.begin();
+#if QT_VERSION < 0x40600
+  QMap<QgsSymbolV2*, QgsSymbolV2*>::iterator it2 = mTempSymbols.begin();
+#else
+  QHash<QgsSymbolV2*, QgsSymbolV2*>::iterator it2 = mTempSymbols.begin();
+#endif
   for ( ; it2 != mTempSymbols.end(); ++it2 )
   {
     it2.value()->stopRender( context );
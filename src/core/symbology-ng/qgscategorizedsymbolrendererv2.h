@@ -121,9 +121,17 @@ class CORE_EXPORT QgsCategorizedSymbolRendererV2 : public QgsFeatureRendererV2
 
     //! hashtable for faster access to symbols
     QHash<QString, QgsSymbolV2*> mSymbolHash;
+    //! symbols of categories with integer values, avoids string conversion of numeric attributes
+    QHash<qlonglong, QgsSymbolV2*> mIntSymbolHash;
+    //! symbols of categories with non-integer numeric values, keyed by bit pattern of the double
+    QHash<quint64, QgsSymbolV2*> mDoubleSymbolHash;
 
     //! temporary symbols, used for data-defined rotation and scaling
-    QHash<QString, QgsSymbolV2*> mTempSymbols;
+#if QT_VERSION < 0x40600
+    QMap<QgsSymbolV2*, QgsSymbolV2*> mTempSymbols;
+#else
+    QHash<QgsSymbolV2*, QgsSymbolV2*> mTempSymbols;
+#endif
 
     void rebuildHash();
 
@@ -1,13 +1,13 @@
 #include "qgsfillsymbollayerv2.h"
 #include "qgsmarkersymbollayerv2.h"
 #include "qgssymbollayerv2utils.h"
+#include "qgssvgcache.h"
 
 #include "qgsrendercontext.h"
 #include "qgsproject.h"
 
 #include <QPainter>
 #include <QFile>
-#include <QSvgRenderer>
 
 QgsSimpleFillSymbolLayerV2::QgsSimpleFillSymbolLayerV2( QColor color, Qt::BrushStyle style, QColor borderColor, Qt::PenStyle borderStyle, double borderWidth )
     : mBrushStyle( style ), mBorderColor( borderColor ), mBorderStyle( borderStyle ), mBorderWidth( borderWidth )
@@ -200,23 +200,17 @@ void QgsSVGFillSymbolLayer::startRender( QgsSymbolV2RenderContext& context )
     return;
   }
 
-  //create QImage with appropriate dimensions
+  //get QImage with appropriate dimensions
   int pixelWidth = context.outputPixelSize( mPatternWidth );
   int pixelHeight = pixelWidth / mSvgViewBox.width() * mSvgViewBox.height();
 
-  QImage textureImage( pixelWidth, pixelHeight, QImage::Format_ARGB32_Premultiplied );
-  textureImage.fill( 0 ); // transparent background
-
-  //rasterise byte array to image
-  QPainter p( &textureImage );
-  QSvgRenderer r( mSvgData );
-  if ( !r.isValid() )
+  //rasterised byte array is shared with other symbol layers using the same svg
+  QImage textureImage = QgsSvgCache::instance()->svgAsImage( mSvgData, pixelWidth, pixelHeight );
+  if ( textureImage.isNull() )
   {
     return;
   }
 
-  r.render( &p );
-
   if ( context.alpha() < 1.0 )
   {
     QgsSymbolLayerV2Utils::multiplyImageOpacity( &textureImage, context.alpha() );
@@ -323,18 +317,7 @@ QgsSymbolLayerV2* QgsSVGFillSymbolLayer::clone() const
 
 void QgsSVGFillSymbolLayer::storeViewBox()
 {
-  if ( !mSvgData.isEmpty() )
-  {
-    QSvgRenderer r( mSvgData );
-    if ( r.isValid() )
-    {
-      mSvgViewBox = r.viewBoxF();
-      return;
-    }
-  }
-
-  mSvgViewBox = QRectF();
-  return;
+  mSvgViewBox = QgsSvgCache::instance()->svgViewBox( mSvgData );
 }
 
 bool QgsSVGFillSymbolLayer::setSubSymbol( QgsSymbolV2* symbol )
@@ -24,6 +24,7 @@ qgsgraduatedsymbolrendererv2.cpp - Graduated Symbol Renderer Version 2
 #include <QDomDocument>
 #include <QDomElement>
 #include <QSettings> // for legend
+#include <QtAlgorithms> // for range lookup
 #include <limits> // for jenks classification
 #include <cmath> // for pretty classification
 
@@ -116,6 +117,17 @@ QgsGraduatedSymbolRendererV2::~QgsGraduatedSymbolRendererV2()
 
 QgsSymbolV2* QgsGraduatedSymbolRendererV2::symbolForValue( double value )
 {
+  if ( !mRangeUpperValues.isEmpty() )
+  {
+    // ranges are sorted and do not overlap: the first range whose upper bound
+    // is not below the value is the only candidate (and on a shared bound it
+    // is the lower range, same as with the linear search)
+    int idx = qLowerBound( mRangeUpperValues.constBegin(), mRangeUpperValues.constEnd(), value ) - mRangeUpperValues.constBegin();
+    if ( idx < mRanges.count() && mRanges[idx].lowerValue() <= value )
+      return mRanges[idx].symbol();
+    return NULL;
+  }
+
   for ( QgsRangeList::iterator it = mRanges.begin(); it != mRanges.end(); ++it )
   {
     if ( it->lowerValue() <= value && it->upperValue() >= value )
@@ -180,6 +192,8 @@ void QgsGraduatedSymbolRendererV2::startRender( QgsRenderContext& context, const
   mRotationFieldIdx  = ( mRotationField.isEmpty()  ? -1 : vlayer->fieldNameIndex( mRotationField ) );
   mSizeScaleFieldIdx = ( mSizeScaleField.isEmpty() ? -1 : vlayer->fieldNameIndex( mSizeScaleField ) );
 
+  buildRangeIndex();
+
   QgsRangeList::iterator it = mRanges.begin();
   for ( ; it != mRanges.end(); ++it )
   {
@@ -214,6 +228,29 @@ void QgsGraduatedSymbolRendererV2::stopRender( QgsRenderContext& context )
     delete it2.value();
   }
   mTempSymbols.clear();
+
+  // ranges may be edited between renders
+  mRangeUpperValues.clear();
+}
+
+void QgsGraduatedSymbolRendererV2::buildRangeIndex()
+{
+  mRangeUpperValues.clear();
+
+  // binary search is only possible if the ranges are sorted in ascending order
+  // and do not overlap. Otherwise symbolForValue() falls back to linear search
+  for ( int i = 0; i < mRanges.count(); ++i )
+  {
+    const QgsRendererRangeV2& range = mRanges[i];
+    if ( !( range.lowerValue() <= range.upperValue() ) ||
+         ( i > 0 && !( mRanges[i-1].upperValue() <= range.lowerValue() ) ) )
+    {
+      QgsDebugMsg( "ranges are not sorted or overlap - using linear search" );
+      mRangeUpperValues.clear();
+      return;
+    }
+    mRangeUpperValues.append( range.upperValue() );
+  }
 }
 
 QList<QString> QgsGraduatedSymbolRendererV2::usedAttributes()
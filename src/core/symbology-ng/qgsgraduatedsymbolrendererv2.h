@@ -3,6 +3,8 @@
 
 #include "qgsrendererv2.h"
 
+#include <QVector>
+
 class CORE_EXPORT QgsRendererRangeV2
 {
   public:
@@ -140,7 +142,14 @@ class CORE_EXPORT QgsGraduatedSymbolRendererV2 : public QgsFeatureRendererV2
     QHash<QgsSymbolV2*, QgsSymbolV2*> mTempSymbols;
 #endif
 
+    //! upper bounds of the ranges for binary search (derived from ranges in startRender).
+    //! Empty if the ranges are not sorted or overlap
+    QVector<double> mRangeUpperValues;
+
     QgsSymbolV2* symbolForValue( double value );
+
+    //! fill mRangeUpperValues if the ranges allow binary search
+    void buildRangeIndex();
 };
 
 #endif // QGSGRADUATEDSYMBOLRENDERERV2_H
@@ -5,6 +5,7 @@
 #include "qgsrendercontext.h"
 
 #include <QPainter>
+#include <QPainterPath>
 
 #include <cmath>
 
@@ -122,6 +123,33 @@ void QgsSimpleLineSymbolLayerV2::renderPolyline( const QPolygonF& points, QgsSym
   }
 }
 
+void QgsSimpleLineSymbolLayerV2::renderPolylines( const QList<QPolygonF>& lines, QgsSymbolV2RenderContext& context )
+{
+  QPainter* p = context.renderContext().painter();
+  const QPen& pen = context.selected() ? mSelPen : mPen;
+
+  // stroking one path gives the same result as stroking the lines one by one only
+  // for opaque solid lines (dash patterns would not restart and overlaps would blend)
+  if ( !p || pen.style() != Qt::SolidLine || pen.color().alpha() != 255 ||
+       ( context.renderHints() & QgsSymbolV2::DataDefinedSizeScale ) )
+  {
+    QgsLineSymbolLayerV2::renderPolylines( lines, context );
+    return;
+  }
+
+  double scaledOffset = context.outputLineWidth( mOffset );
+
+  QPainterPath path;
+  for ( QList<QPolygonF>::const_iterator it = lines.constBegin(); it != lines.constEnd(); ++it )
+  {
+    path.addPolygon( mOffset == 0 ? *it : ::offsetLine( *it, scaledOffset ) );
+  }
+
+  p->setPen( pen );
+  p->setBrush( Qt::NoBrush );
+  p->drawPath( path );
+}
+
 QgsStringMap QgsSimpleLineSymbolLayerV2::properties() const
 {
   QgsStringMap map;
@@ -35,6 +35,8 @@ class CORE_EXPORT QgsSimpleLineSymbolLayerV2 : public QgsLineSymbolLayerV2
 
     void renderPolyline( const QPolygonF& points, QgsSymbolV2RenderContext& context );
 
+    void renderPolylines( const QList<QPolygonF>& lines, QgsSymbolV2RenderContext& context );
+
     QgsStringMap properties() const;
 
     QgsSymbolLayerV2* clone() const;
@@ -1,6 +1,7 @@
 
 #include "qgsmarkersymbollayerv2.h"
 #include "qgssymbollayerv2utils.h"
+#include "qgssvgcache.h"
 
 #include "qgsrendercontext.h"
 #include "qgsapplication.h"
@@ -8,7 +9,6 @@
 #include "qgsproject.h"
 
 #include <QPainter>
-#include <QSvgRenderer>
 #include <QFileInfo>
 #include <QDir>
 
@@ -404,6 +404,29 @@ void QgsSimpleMarkerSymbolLayerV2::renderPoint( const QPointF& point, QgsSymbolV
   }
 }
 
+void QgsSimpleMarkerSymbolLayerV2::renderPoints( const QPolygonF& points, QgsSymbolV2RenderContext& context )
+{
+  QPainter* p = context.renderContext().painter();
+  if ( !p || !mUsingCache )
+  {
+    QgsMarkerSymbolLayerV2::renderPoints( points, context );
+    return;
+  }
+
+  // everything but the position is the same for all markers: just blit the cached image
+  QPointF off( context.outputLineWidth( mOffset.x() ), context.outputLineWidth( mOffset.y() ) );
+  if ( mAngle )
+    off = _rotatedOffset( off, mAngle );
+
+  const QImage &img = context.selected() ? mSelCache : mCache;
+  double s = img.width() / context.renderContext().rasterScaleFactor();
+  off -= QPointF( s / 2.0, s / 2.0 );
+
+  for ( QPolygonF::const_iterator it = points.constBegin(); it != points.constEnd(); ++it )
+  {
+    p->drawImage( QRectF( it->x() + off.x(), it->y() + off.y(), s, s ), img );
+  }
+}
 
 QgsStringMap QgsSimpleMarkerSymbolLayerV2::properties() const
 {
@@ -446,6 +469,7 @@ QgsSvgMarkerSymbolLayerV2::QgsSvgMarkerSymbolLayerV2( QString name, double size,
   mSize = size;
   mAngle = angle;
   mOffset = QPointF( 0, 0 );
+  mUsingCache = false;
 }
 
 
@@ -476,9 +500,30 @@ QString QgsSvgMarkerSymbolLayerV2::layerType() const
 
 void QgsSvgMarkerSymbolLayerV2::startRender( QgsSymbolV2RenderContext& context )
 {
-  double pictureSize = 0;
   QgsRenderContext& rc = context.renderContext();
+  mOrigSize = mSize; // save in case the size would be data defined
+
+  // use the shared raster cache only when:
+  // - the size is not data-defined
+  // - drawing to screen (not printer)
+  bool hasDataDefinedSize = context.renderHints() & QgsSymbolV2::DataDefinedSizeScale;
+  mUsingCache = !hasDataDefinedSize && !rc.forceVectorOutput();
 
+  if ( mUsingCache )
+  {
+    int imageSize = ( int )( context.outputPixelSize( mSize ) + 0.5 );
+    mCache = QgsSvgCache::instance()->svgAsImage( mPath, imageSize );
+    mSelCache = QgsSvgCache::instance()->svgAsImage( mPath, imageSize, context.selectionColor() );
+    mUsingCache = !mCache.isNull() && !mSelCache.isNull();
+    if ( mUsingCache )
+    {
+      return;
+    }
+  }
+  mCache = QImage();
+  mSelCache = QImage();
+
+  double pictureSize = 0;
   if ( rc.painter() && rc.painter()->device() )
   {
     //correct QPictures DPI correction
@@ -489,21 +534,21 @@ void QgsSvgMarkerSymbolLayerV2::startRender( QgsSymbolV2RenderContext& context )
     pictureSize = context.outputLineWidth( mSize );
   }
   QRectF rect( QPointF( -pictureSize / 2.0, -pictureSize / 2.0 ), QSizeF( pictureSize, pictureSize ) );
-  QSvgRenderer renderer( mPath );
   QPainter painter( &mPicture );
-  renderer.render( &painter, rect );
+  QgsSvgCache::instance()->renderSvg( mPath, &painter, rect );
   QPainter selPainter( &mSelPicture );
   selPainter.setRenderHint( QPainter::Antialiasing );
   selPainter.setBrush( QBrush( context.selectionColor() ) );
   selPainter.setPen( Qt::NoPen );
   selPainter.drawEllipse( QPointF( 0, 0 ), pictureSize*0.6, pictureSize*0.6 );
-  renderer.render( &selPainter, rect );
-
-  mOrigSize = mSize; // save in case the size would be data defined
+  QgsSvgCache::instance()->renderSvg( mPath, &selPainter, rect );
 }
 
 void QgsSvgMarkerSymbolLayerV2::stopRender( QgsSymbolV2RenderContext& context )
 {
+  // release our references to the shared images
+  mCache = QImage();
+  mSelCache = QImage();
 }
 
 
@@ -530,8 +575,18 @@ void QgsSvgMarkerSymbolLayerV2::renderPoint( const QPointF& point, QgsSymbolV2Re
   if ( mAngle != 0 )
     p->rotate( mAngle );
 
-  QPicture &pct = context.selected() ? mSelPicture : mPicture;
-  p->drawPicture( 0, 0, pct );
+  if ( mUsingCache )
+  {
+    // we will use cached image
+    const QImage &img = context.selected() ? mSelCache : mCache;
+    double s = img.width() / context.renderContext().rasterScaleFactor();
+    p->drawImage( QRectF( -s / 2.0, -s / 2.0, s, s ), img );
+  }
+  else
+  {
+    QPicture &pct = context.selected() ? mSelPicture : mPicture;
+    p->drawPicture( 0, 0, pct );
+  }
 
   p->restore();
 }
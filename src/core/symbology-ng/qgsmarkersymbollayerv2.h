@@ -39,6 +39,8 @@ class CORE_EXPORT QgsSimpleMarkerSymbolLayerV2 : public QgsMarkerSymbolLayerV2
 
     void renderPoint( const QPointF& point, QgsSymbolV2RenderContext& context );
 
+    void renderPoints( const QPolygonF& points, QgsSymbolV2RenderContext& context );
+
     QgsStringMap properties() const;
 
     QgsSymbolLayerV2* clone() const;
@@ -122,6 +124,11 @@ class CORE_EXPORT QgsSvgMarkerSymbolLayerV2 : public QgsMarkerSymbolLayerV2
     QPicture mPicture;
     QPicture mSelPicture;
     double mOrigSize;
+
+    // images shared through QgsSvgCache, used when drawing to screen
+    bool mUsingCache;
+    QImage mCache;
+    QImage mSelCache;
 };
 
 
@@ -18,6 +18,9 @@
 #include <QDomDocument>
 #include <QPolygonF>
 
+// maximum number of vertices collected before a batch is drawn
+#define RENDERER_BATCH_SIZE 50000
+
 
 
 unsigned char* QgsFeatureRendererV2::_getPoint( QPointF& pt, QgsRenderContext& context, unsigned char* wkb )
@@ -171,7 +174,11 @@ unsigned char* QgsFeatureRendererV2::_getPolygon( QPolygonF& pts, QList<QPolygon
 QgsFeatureRendererV2::QgsFeatureRendererV2( QString type )
     : mType( type ), mUsingSymbolLevels( false ),
     mCurrentVertexMarkerType( QgsVectorLayer::Cross ),
-    mCurrentVertexMarkerSize( 3 )
+    mCurrentVertexMarkerSize( 3 ),
+    mBatchRendering( false ),
+    mBatchSymbol( NULL ),
+    mBatchLayer( -1 ),
+    mBatchVertexCount( 0 )
 {
 }
 
@@ -181,12 +188,116 @@ QgsFeatureRendererV2* QgsFeatureRendererV2::defaultRenderer( QGis::GeometryType
 }
 
 
+bool QgsFeatureRendererV2::batchFeature( QgsFeature& feature, QgsSymbolV2* symbol, QgsRenderContext& context, int layer, bool selected, bool drawVertexMarker )
+{
+  // drawing features layer by layer would change the stacking of multi-layer symbols.
+  // Symbols with data-defined properties are modified for each feature
+  if ( selected || drawVertexMarker || symbol->symbolLayerCount() != 1 || symbol->renderHints() != 0 )
+    return false;
+
+  QgsGeometry* geom = feature.geometry();
+  QGis::WkbType wkbType = geom->wkbType();
+  bool points = symbol->type() == QgsSymbolV2::Marker &&
+                ( wkbType == QGis::WKBPoint || wkbType == QGis::WKBPoint25D ||
+                  wkbType == QGis::WKBMultiPoint || wkbType == QGis::WKBMultiPoint25D );
+  bool lines = symbol->type() == QgsSymbolV2::Line &&
+               ( wkbType == QGis::WKBLineString || wkbType == QGis::WKBLineString25D ||
+                 wkbType == QGis::WKBMultiLineString || wkbType == QGis::WKBMultiLineString25D );
+  if ( !points && !lines )
+    return false;
+
+  if ( symbol != mBatchSymbol || layer != mBatchLayer )
+  {
+    flushBatch( context );
+    mBatchSymbol = symbol;
+    mBatchLayer = layer;
+  }
+
+  unsigned char* wkb = geom->asWkb();
+  QPointF pt;
+  QPolygonF pts;
+  switch ( wkbType )
+  {
+    case QGis::WKBPoint:
+    case QGis::WKBPoint25D:
+      _getPoint( pt, context, wkb );
+      mBatchPoints.append( pt );
+      mBatchVertexCount++;
+      break;
+
+    case QGis::WKBLineString:
+    case QGis::WKBLineString25D:
+      _getLineString( pts, context, wkb );
+      mBatchLines.append( pts );
+      mBatchVertexCount += pts.count();
+      break;
+
+    case QGis::WKBMultiPoint:
+    case QGis::WKBMultiPoint25D:
+    case QGis::WKBMultiLineString:
+    case QGis::WKBMultiLineString25D:
+    {
+      unsigned int num = *(( int* )( wkb + 5 ) );
+      unsigned char* ptr = wkb + 9;
+      for ( unsigned int i = 0; i < num; ++i )
+      {
+        if ( points )
+        {
+          ptr = _getPoint( pt, context, ptr );
+          mBatchPoints.append( pt );
+          mBatchVertexCount++;
+        }
+        else
+        {
+          ptr = _getLineString( pts, context, ptr );
+          mBatchLines.append( pts );
+          mBatchVertexCount += pts.count();
+        }
+      }
+    }
+    break;
+
+    default:
+      break;
+  }
+
+  if ( mBatchVertexCount >= RENDERER_BATCH_SIZE )
+    flushBatch( context );
+  return true;
+}
+
+void QgsFeatureRendererV2::flushBatch( QgsRenderContext& context )
+{
+  if ( mBatchSymbol )
+  {
+    if ( !mBatchPoints.isEmpty() )
+      static_cast<QgsMarkerSymbolV2*>( mBatchSymbol )->renderPoints( mBatchPoints, context, mBatchLayer );
+    if ( !mBatchLines.isEmpty() )
+      static_cast<QgsLineSymbolV2*>( mBatchSymbol )->renderPolylines( mBatchLines, context, mBatchLayer );
+  }
+
+  mBatchSymbol = NULL;
+  mBatchLayer = -1;
+  mBatchPoints.clear();
+  mBatchLines.clear();
+  mBatchVertexCount = 0;
+}
+
 void QgsFeatureRendererV2::renderFeature( QgsFeature& feature, QgsRenderContext& context, int layer, bool selected, bool drawVertexMarker )
 {
   QgsSymbolV2* symbol = symbolForFeature( feature );
   if ( symbol == NULL )
     return;
 
+  if ( mBatchRendering )
+  {
+    if ( batchFeature( feature, symbol, context, layer, selected, drawVertexMarker ) )
+      return;
+
+    // keep the drawing order
+    flushBatch( context );
+  }
+
   QgsSymbolV2::SymbolType symbolType = symbol->type();
 
   QgsGeometry* geom = feature.geometry();
@@ -9,6 +9,7 @@
 #include <QVariant>
 #include <QPair>
 #include <QPixmap>
+#include <QPolygonF>
 
 class QDomDocument;
 class QDomElement;
@@ -100,6 +101,18 @@ class CORE_EXPORT QgsFeatureRendererV2
     //! set type and size of editing vertex markers for subsequent rendering
     void setVertexMarkerAppearance( int type, int size );
 
+    //! collect consecutive features with the same simple symbol in renderFeature()
+    //! and draw them together. Pending features are drawn by flushBatch(),
+    //! which has to be called before stopRender()
+    //! @note added in 1.7
+    void setBatchRendering( bool enabled ) { mBatchRendering = enabled; }
+    //! @note added in 1.7
+    bool batchRendering() const { return mBatchRendering; }
+
+    //! draw features collected for batch rendering
+    //! @note added in 1.7
+    void flushBatch( QgsRenderContext& context );
+
   protected:
     QgsFeatureRendererV2( QString type );
 
@@ -114,6 +127,9 @@ class CORE_EXPORT QgsFeatureRendererV2
     static unsigned char* _getLineString( QPolygonF& pts, QgsRenderContext& context, unsigned char* wkb );
     static unsigned char* _getPolygon( QPolygonF& pts, QList<QPolygonF>& holes, QgsRenderContext& context, unsigned char* wkb );
 
+    //! add feature to the current batch if possible. Returns false if it has to be drawn directly
+    bool batchFeature( QgsFeature& feature, QgsSymbolV2* symbol, QgsRenderContext& context, int layer, bool selected, bool drawVertexMarker );
+
     QString mType;
 
     bool mUsingSymbolLevels;
@@ -122,6 +138,15 @@ class CORE_EXPORT QgsFeatureRendererV2
     int mCurrentVertexMarkerType;
     /** The current size of editing marker */
     int mCurrentVertexMarkerSize;
+
+    bool mBatchRendering;
+    //! symbol and symbol layer of the features in the batch (NULL if the batch is empty)
+    QgsSymbolV2* mBatchSymbol;
+    int mBatchLayer;
+    //! transformed geometries waiting to be drawn
+    QPolygonF mBatchPoints;
+    QList<QPolygonF> mBatchLines;
+    int mBatchVertexCount;
 };
 
 
@@ -22,6 +22,7 @@
 #include "qgslogger.h"
 
 #include <QSet>
+#include <QtAlgorithms>
 
 #include <QDomDocument>
 #include <QDomElement>
@@ -116,6 +117,86 @@ QgsRuleBasedRendererV2::Rule& QgsRuleBasedRendererV2::Rule::operator=( const Qgs
 
 /////////////////////
 
+// split the filter into conditions that all have to be true
+static void collectConditions( QgsSearchTreeNode* node, QList<QgsSearchTreeNode*>& conditions )
+{
+  if ( node->type() == QgsSearchTreeNode::tOperator && node->op() == QgsSearchTreeNode::opAND &&
+       node->Left() && node->Right() )
+  {
+    collectConditions( node->Left(), conditions );
+    collectConditions( node->Right(), conditions );
+  }
+  else
+  {
+    conditions.append( node );
+  }
+}
+
+// return key identifying the condition (same key = same result), null string if it can't be shared.
+// makeSearchString() can't be used: it strips quotes of strings and column names
+static QString conditionKey( QgsSearchTreeNode* node )
+{
+  if ( !node )
+    return "-";
+
+  switch ( node->type() )
+  {
+    case QgsSearchTreeNode::tNumber:
+      return "n" + QString::number( node->number(), 'g', 17 );
+
+    case QgsSearchTreeNode::tString:
+      if ( node->string().isNull() )
+        return "z";
+      return QString( "s%1:%2" ).arg( node->string().length() ).arg( node->string() );
+
+    case QgsSearchTreeNode::tColumnRef:
+      return QString( "c%1:%2" ).arg( node->columnRef().length() ).arg( node->columnRef() );
+
+    case QgsSearchTreeNode::tOperator:
+    {
+      QString left = conditionKey( node->Left() );
+      QString right = conditionKey( node->Right() );
+      if ( left.isNull() || right.isNull() )
+        return QString();
+      return QString( "o%1(%2,%3)" ).arg( node->op() ).arg( left ).arg( right );
+    }
+
+    default:
+      // node lists are not accessible
+      return QString();
+  }
+}
+
+// check whether the condition is "column" = literal (or literal = "column") with an existing column
+static bool isEqualityCondition( QgsSearchTreeNode* node, const QgsFieldMap& fields, int& attrIndex, QgsSearchTreeNode*& literal )
+{
+  if ( node->type() != QgsSearchTreeNode::tOperator || node->op() != QgsSearchTreeNode::opEQ ||
+       !node->Left() || !node->Right() )
+    return false;
+
+  QgsSearchTreeNode* column = node->Left();
+  literal = node->Right();
+  if ( column->type() != QgsSearchTreeNode::tColumnRef )
+    qSwap( column, literal );
+  if ( column->type() != QgsSearchTreeNode::tColumnRef )
+    return false;
+
+  if ( literal->type() != QgsSearchTreeNode::tNumber &&
+       !( literal->type() == QgsSearchTreeNode::tString && !literal->string().isNull() ) )
+    return false;
+
+  // same lookup as in QgsSearchTreeNode
+  for ( QgsFieldMap::const_iterator it = fields.begin(); it != fields.end(); ++it )
+  {
+    if ( QString::compare( it->name(), column->columnRef(), Qt::CaseInsensitive ) == 0 )
+    {
+      attrIndex = it.key();
+      return true;
+    }
+  }
+  return false;
+}
+
 QgsRuleBasedRendererV2::QgsRuleBasedRendererV2( QgsSymbolV2* defaultSymbol )
     : QgsFeatureRendererV2( "RuleRenderer" )
 {
@@ -137,18 +218,174 @@ void QgsRuleBasedRendererV2::renderFeature( QgsFeature& feature,
     bool selected,
     bool drawVertexMarker )
 {
-  for ( QList<Rule*>::iterator it = mCurrentRules.begin(); it != mCurrentRules.end(); ++it )
+  mPredicateResults.fill( -1 );
+
+  // rules that may match: the unindexed ones and those found by attribute value
+  QList<int> candidates = mUnindexedRules;
+  if ( !mEqualityIndexes.isEmpty() )
   {
-    Rule* rule = *it;
-    if ( rule->isFilterOK( mCurrentFields, feature ) )
+    const QgsAttributeMap& attrMap = feature.attributeMap();
+    for ( QList<EqualityIndex>::const_iterator it = mEqualityIndexes.constBegin(); it != mEqualityIndexes.constEnd(); ++it )
+    {
+      const EqualityIndex& index = *it;
+      QVariant val = attrMap.value( index.attrIndex );
+      if ( val.isNull() )
+        continue; // NULL values never match
+
+      // same conversions as in QgsSearchTreeNode: numbers are compared as numbers,
+      // strings compared to numbers are converted to numbers. NaN is not hashed, it
+      // compares equal to any number
+      double number;
+      if ( val.type() == QVariant::Bool || val.type() == QVariant::Int || val.type() == QVariant::Double )
+      {
+        number = val.toDouble();
+        if ( number != number )
+        {
+          candidates += index.rules;
+          continue;
+        }
+        candidates += index.stringNumberRules.values( QgsSymbolLayerV2Utils::doubleHashKey( number ) );
+        candidates += index.stringNanRules;
+      }
+      else
+      {
+        // strings are compared to string literals as strings
+        QString str = val.toString();
+        candidates += index.stringRules.values( str );
+        number = str.toDouble();
+      }
+
+      if ( number != number )
+        candidates += index.numberRules.values();
+      else
+        candidates += index.numberRules.values( QgsSymbolLayerV2Utils::doubleHashKey( number ) );
+      candidates += index.numberNanRules;
+    }
+
+    // keep the drawing order of the rules
+    qSort( candidates );
+  }
+
+  int lastRule = -1;
+  for ( QList<int>::const_iterator it = candidates.constBegin(); it != candidates.constEnd(); ++it )
+  {
+    int ruleIndex = *it;
+    if ( ruleIndex == lastRule )
+      continue;
+    lastRule = ruleIndex;
+
+    if ( checkRulePredicates( ruleIndex, feature ) )
     {
-      mCurrentSymbol = rule->symbol();
+      mCurrentSymbol = mCurrentRules[ruleIndex]->symbol();
       // will ask for mCurrentSymbol
       QgsFeatureRendererV2::renderFeature( feature, context, layer, selected, drawVertexMarker );
     }
   }
 }
 
+bool QgsRuleBasedRendererV2::checkRulePredicates( int ruleIndex, QgsFeature& feature )
+{
+  const QList<int>& predicates = mRulePredicates[ruleIndex];
+  for ( QList<int>::const_iterator it = predicates.constBegin(); it != predicates.constEnd(); ++it )
+  {
+    int& result = mPredicateResults[*it];
+    if ( result == -1 )
+      result = mPredicates[*it]->checkAgainst( mCurrentFields, feature ) ? 1 : 0;
+    if ( result == 0 )
+      return false;
+  }
+  return true;
+}
+
+void QgsRuleBasedRendererV2::buildEvaluationPlan()
+{
+  mEqualityIndexes.clear();
+  mUnindexedRules.clear();
+  mRulePredicates.clear();
+  mPredicates.clear();
+
+  QHash<QString, int> predicateKeys;
+
+  for ( int i = 0; i < mCurrentRules.count(); i++ )
+  {
+    QList<QgsSearchTreeNode*> conditions;
+    if ( mCurrentRules[i]->filterTree() )
+      collectConditions( mCurrentRules[i]->filterTree(), conditions );
+
+    bool indexed = false;
+    QList<int> predicates;
+    for ( QList<QgsSearchTreeNode*>::const_iterator it = conditions.constBegin(); it != conditions.constEnd(); ++it )
+    {
+      QgsSearchTreeNode* condition = *it;
+
+      // the first equality condition is used for lookup, the others are evaluated
+      int attrIndex;
+      QgsSearchTreeNode* literal;
+      if ( !indexed && isEqualityCondition( condition, mCurrentFields, attrIndex, literal ) )
+      {
+        int idx = 0;
+        while ( idx < mEqualityIndexes.count() && mEqualityIndexes[idx].attrIndex != attrIndex )
+          idx++;
+        if ( idx == mEqualityIndexes.count() )
+        {
+          EqualityIndex index;
+          index.attrIndex = attrIndex;
+          mEqualityIndexes.append( index );
+        }
+        EqualityIndex& index = mEqualityIndexes[idx];
+
+        // literals which are NaN as a number match every number, they are kept apart
+        if ( literal->type() == QgsSearchTreeNode::tNumber )
+        {
+          double number = literal->number();
+          if ( number != number )
+            index.numberNanRules.append( i );
+          else
+            index.numberRules.insert( QgsSymbolLayerV2Utils::doubleHashKey( number ), i );
+        }
+        else
+        {
+          index.stringRules.insert( literal->string(), i );
+          double number = literal->string().toDouble();
+          if ( number != number )
+            index.stringNanRules.append( i );
+          else
+            index.stringNumberRules.insert( QgsSymbolLayerV2Utils::doubleHashKey( number ), i );
+        }
+        index.rules.append( i );
+        indexed = true;
+        continue;
+      }
+
+      // share conditions which appear in several rules
+      QString key = conditionKey( condition );
+      int predicate;
+      if ( !key.isNull() && predicateKeys.contains( key ) )
+      {
+        predicate = predicateKeys.value( key );
+      }
+      else
+      {
+        predicate = mPredicates.count();
+        mPredicates.append( condition );
+        if ( !key.isNull() )
+          predicateKeys.insert( key, predicate );
+      }
+      predicates.append( predicate );
+    }
+
+    if ( !indexed )
+      mUnindexedRules.append( i );
+    mRulePredicates.append( predicates );
+  }
+
+  mPredicateResults.resize( mPredicates.count() );
+
+  QgsDebugMsg( QString( "%1 rules: %2 indexed by %3 attributes, %4 distinct conditions" )
+               .arg( mCurrentRules.count() ).arg( mCurrentRules.count() - mUnindexedRules.count() )
+               .arg( mEqualityIndexes.count() ).arg( mPredicates.count() ) );
+}
+
 
 void QgsRuleBasedRendererV2::startRender( QgsRenderContext& context, const QgsVectorLayer *vlayer )
 {
@@ -165,6 +402,8 @@ void QgsRuleBasedRendererV2::startRender( QgsRenderContext& context, const QgsVe
 
   mCurrentFields = vlayer->pendingFields();
 
+  buildEvaluationPlan();
+
   for ( QList<Rule*>::iterator it = mCurrentRules.begin(); it != mCurrentRules.end(); ++it )
   {
     Rule* rule = *it;
@@ -182,6 +421,12 @@ void QgsRuleBasedRendererV2::stopRender( QgsRenderContext& context )
 
   mCurrentRules.clear();
   mCurrentFields.clear();
+
+  mEqualityIndexes.clear();
+  mUnindexedRules.clear();
+  mRulePredicates.clear();
+  mPredicates.clear();
+  mPredicateResults.clear();
 }
 
 QList<QString> QgsRuleBasedRendererV2::usedAttributes()
@@ -21,6 +21,9 @@
 
 #include "qgsrendererv2.h"
 
+#include <QMultiHash>
+#include <QVector>
+
 class QgsCategorizedSymbolRendererV2;
 class QgsGraduatedSymbolRendererV2;
 
@@ -59,6 +62,9 @@ class CORE_EXPORT QgsRuleBasedRendererV2 : public QgsFeatureRendererV2
         QString filterExpression() const { return mFilterExp; }
         QString label() const { return mLabel; }
         QString description() const { return mDescription; }
+        //! parsed filter, NULL if the rule has no filter
+        //! @note added in 1.7
+        QgsSearchTreeNode* filterTree() const { return mFilterTree; }
 
         void setScaleMinDenom( int scaleMinDenom ) { mScaleMinDenom = scaleMinDenom; }
         void setScaleMaxDenom( int scaleMaxDenom ) { mScaleMaxDenom = scaleMaxDenom; }
@@ -147,6 +153,46 @@ class CORE_EXPORT QgsRuleBasedRendererV2 : public QgsFeatureRendererV2
     QList<Rule*> mCurrentRules;
     QgsFieldMap mCurrentFields;
     QgsSymbolV2* mCurrentSymbol;
+
+    /**
+      Rules with a condition of the form "column" = value are looked up by the
+      attribute value instead of evaluating the condition for every rule.
+      Values are the positions of the rules in mCurrentRules.
+      @note added in 1.7
+     */
+    struct EqualityIndex
+    {
+      int attrIndex;
+      //! rules comparing to a string, used for string attributes
+      QMultiHash<QString, int> stringRules;
+      //! rules comparing to a string, used for numeric attributes (string converted to number)
+      QMultiHash<quint64, int> stringNumberRules;
+      //! rules comparing to a string which is NaN as a number, they match any numeric attribute
+      QList<int> stringNanRules;
+      //! rules comparing to a number
+      QMultiHash<quint64, int> numberRules;
+      //! rules comparing to a NaN number, they match any attribute
+      QList<int> numberNanRules;
+      //! all rules of the index
+      QList<int> rules;
+    };
+
+    // evaluation plan (built in startRender)
+    //! indexes of rules by equality condition
+    QList<EqualityIndex> mEqualityIndexes;
+    //! rules (positions in mCurrentRules) that are not in any index and have to be checked for every feature
+    QList<int> mUnindexedRules;
+    //! remaining conditions of the rules (indexes to mPredicates), all of them have to match
+    QList< QList<int> > mRulePredicates;
+    //! conditions of the rules, identical conditions of several rules are shared
+    QList<QgsSearchTreeNode*> mPredicates;
+    //! results of conditions for current feature: -1 = not evaluated yet, 0 = false, 1 = true
+    QVector<int> mPredicateResults;
+
+    //! analyze current rules and build the evaluation plan
+    void buildEvaluationPlan();
+    //! return whether the remaining conditions of rule at position ruleIndex match the feature
+    bool checkRulePredicates( int ruleIndex, QgsFeature& feature );
 };
 
 #endif // QGSRULEBASEDRENDERERV2_H
@@ -0,0 +1,208 @@
+
+#include "qgssvgcache.h"
+
+#include "qgslogger.h"
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QSvgRenderer>
+
+#include <cmath>
+
+// default memory limits of the caches (in bytes)
+#define DEFAULT_SVG_DOCUMENT_CACHE_SIZE 10 * 1024 * 1024
+#define DEFAULT_SVG_IMAGE_CACHE_SIZE 20 * 1024 * 1024
+
+QgsSvgCache* QgsSvgCache::mInstance = NULL;
+
+QgsSvgCache* QgsSvgCache::instance()
+{
+  if ( !mInstance )
+    mInstance = new QgsSvgCache();
+  return mInstance;
+}
+
+QgsSvgCache::QgsSvgCache()
+    : mRenderers( DEFAULT_SVG_DOCUMENT_CACHE_SIZE )
+    , mImages( DEFAULT_SVG_IMAGE_CACHE_SIZE )
+{
+}
+
+QgsSvgCache::~QgsSvgCache()
+{
+}
+
+QString QgsSvgCache::dataKey( const QByteArray& svgData )
+{
+  return "data:" + QString( QCryptographicHash::hash( svgData, QCryptographicHash::Md5 ).toHex() );
+}
+
+QSvgRenderer* QgsSvgCache::renderer( const QString& key, const QString& file, const QByteArray& svgData, bool& owned )
+{
+  owned = false;
+  QSvgRenderer* r = mRenderers.object( key );
+  if ( r )
+    return r;
+
+  QByteArray data = svgData;
+  if ( !file.isEmpty() )
+  {
+    QFile svgFile( file );
+    if ( !svgFile.open( QIODevice::ReadOnly ) )
+    {
+      QgsDebugMsg( "could not open SVG file " + file );
+      return NULL;
+    }
+    data = svgFile.readAll();
+  }
+
+  r = new QSvgRenderer( data );
+  if ( !r->isValid() )
+  {
+    QgsDebugMsg( "invalid SVG document " + key );
+    delete r;
+    return NULL;
+  }
+
+  // the cache would delete a document bigger than its limit right away, it is used uncached
+  int cost = qMax( data.size(), 1 );
+  if ( cost > mRenderers.maxCost() )
+  {
+    QgsDebugMsg( "SVG document too big for the cache " + key );
+    owned = true;
+    return r;
+  }
+
+  mRenderers.insert( key, r, cost );
+  return r;
+}
+
+QImage QgsSvgCache::svgAsImage( const QString& file, int size, const QColor& selectionColor )
+{
+  if ( size <= 0 )
+    return QImage();
+
+  QString key = QString( "%1|%2|%3" ).arg( file ).arg( size )
+                .arg( selectionColor.isValid() ? QString::number( selectionColor.rgba() ) : QString() );
+
+  QMutexLocker locker( &mMutex );
+
+  QImage* cached = mImages.object( key );
+  if ( cached )
+    return *cached;
+
+  bool owned;
+  QSvgRenderer* r = renderer( file, file, QByteArray(), owned );
+  if ( !r )
+    return QImage();
+
+  // selected symbols are drawn on a circle with 1.2 times the symbol size
+  int imageSize = selectionColor.isValid() ? ( int ) ceil( size * 1.2 ) : size;
+  QImage img( imageSize, imageSize, QImage::Format_ARGB32_Premultiplied );
+  img.fill( 0 ); // transparent background
+
+  QPainter p( &img );
+  p.setRenderHint( QPainter::Antialiasing );
+  p.translate( imageSize / 2.0, imageSize / 2.0 );
+  if ( selectionColor.isValid() )
+  {
+    p.setBrush( QBrush( selectionColor ) );
+    p.setPen( Qt::NoPen );
+    p.drawEllipse( QPointF( 0, 0 ), imageSize / 2.0, imageSize / 2.0 );
+  }
+  r->render( &p, QRectF( -size / 2.0, -size / 2.0, size, size ) );
+  p.end();
+  if ( owned )
+    delete r;
+
+  mImages.insert( key, new QImage( img ), img.bytesPerLine() * img.height() );
+  return img;
+}
+
+QImage QgsSvgCache::svgAsImage( const QByteArray& svgData, int width, int height )
+{
+  if ( width <= 0 || height <= 0 )
+    return QImage();
+
+  QString docKey = dataKey( svgData );
+  QString key = QString( "%1|%2|%3" ).arg( docKey ).arg( width ).arg( height );
+
+  QMutexLocker locker( &mMutex );
+
+  QImage* cached = mImages.object( key );
+  if ( cached )
+    return *cached;
+
+  bool owned;
+  QSvgRenderer* r = renderer( docKey, QString(), svgData, owned );
+  if ( !r )
+    return QImage();
+
+  QImage img( width, height, QImage::Format_ARGB32_Premultiplied );
+  img.fill( 0 ); // transparent background
+
+  QPainter p( &img );
+  r->render( &p );
+  p.end();
+  if ( owned )
+    delete r;
+
+  mImages.insert( key, new QImage( img ), img.bytesPerLine() * img.height() );
+  return img;
+}
+
+QRectF QgsSvgCache::svgViewBox( const QByteArray& svgData )
+{
+  if ( svgData.isEmpty() )
+    return QRectF();
+
+  QString docKey = dataKey( svgData );
+
+  QMutexLocker locker( &mMutex );
+  bool owned;
+  QSvgRenderer* r = renderer( docKey, QString(), svgData, owned );
+  if ( !r )
+    return QRectF();
+
+  QRectF viewBox = r->viewBoxF();
+  if ( owned )
+    delete r;
+  return viewBox;
+}
+
+bool QgsSvgCache::renderSvg( const QString& file, QPainter* painter, const QRectF& bounds )
+{
+  if ( !painter )
+    return false;
+
+  QMutexLocker locker( &mMutex );
+  bool owned;
+  QSvgRenderer* r = renderer( file, file, QByteArray(), owned );
+  if ( !r )
+    return false;
+
+  r->render( painter, bounds );
+  if ( owned )
+    delete r;
+  return true;
+}
+
+void QgsSvgCache::setMaximumImageCacheSize( int bytes )
+{
+  QMutexLocker locker( &mMutex );
+  mImages.setMaxCost( bytes );
+}
+
+int QgsSvgCache::maximumImageCacheSize() const
+{
+  return mImages.maxCost();
+}
+
+void QgsSvgCache::clear()
+{
+  QMutexLocker locker( &mMutex );
+  mRenderers.clear();
+  mImages.clear();
+}
@@ -0,0 +1,76 @@
+
+#ifndef QGSSVGCACHE_H
+#define QGSSVGCACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QColor>
+#include <QImage>
+#include <QMutex>
+#include <QRectF>
+#include <QString>
+
+class QPainter;
+class QSvgRenderer;
+
+/**
+ Process-wide cache of parsed SVG documents and of their rasterized images.
+
+ Symbol layers used to parse their SVG file again for every symbol layer instance and
+ every render. The cache keeps the parsed documents keyed by file (or by content for
+ embedded SVG data) and the rendered images keyed by document, pixel size and selection
+ color. Both caches are bounded by memory and drop the least recently used entries first.
+
+ All methods are thread safe.
+ @note added in 1.7
+ */
+class CORE_EXPORT QgsSvgCache
+{
+  public:
+    static QgsSvgCache* instance();
+    ~QgsSvgCache();
+
+    /** return square image of the SVG file with the given size (in pixels). The view box is
+     scaled to fill the square, as SVG marker symbols are drawn. If selectionColor is valid, the
+     image is enlarged and the symbol is drawn on a circle of that color (as used for selected features).
+     Returns a null image if the file is not a valid SVG. */
+    QImage svgAsImage( const QString& file, int size, const QColor& selectionColor = QColor() );
+
+    /** return image of the SVG document with the given size (in pixels) */
+    QImage svgAsImage( const QByteArray& svgData, int width, int height );
+
+    /** return view box of the SVG document, or a null rectangle if the data is not valid SVG */
+    QRectF svgViewBox( const QByteArray& svgData );
+
+    /** render the SVG file with painter into bounds. Use for vector outputs where
+     a raster image is not acceptable. Returns false if the file is not a valid SVG */
+    bool renderSvg( const QString& file, QPainter* painter, const QRectF& bounds );
+
+    /** maximum memory used by rasterized images (in bytes) */
+    void setMaximumImageCacheSize( int bytes );
+    int maximumImageCacheSize() const;
+
+    /** drop all cached documents and images, e.g. when SVG files changed on disk */
+    void clear();
+
+  protected:
+    QgsSvgCache();
+
+    /** return parsed document for the key, parsing it from file or data if necessary.
+     Must be called with mMutex locked, the pointer is valid only until the next insertion.
+     A document too big for the cache is not cached: owned is set and the caller deletes it */
+    QSvgRenderer* renderer( const QString& key, const QString& file, const QByteArray& svgData, bool& owned );
+
+    static QString dataKey( const QByteArray& svgData );
+
+    static QgsSvgCache* mInstance;
+
+    /** parsed documents, cost is the size of the document in bytes */
+    QCache<QString, QSvgRenderer> mRenderers;
+    /** rasterized images, cost is the size of the image in bytes */
+    QCache<QString, QImage> mImages;
+
+    QMutex mMutex;
+};
+
+#endif // QGSSVGCACHE_H
@@ -45,6 +45,18 @@ void QgsLineSymbolLayerV2::drawPreviewIcon( QgsSymbolV2RenderContext& context, Q
   stopRender( context );
 }
 
+void QgsMarkerSymbolLayerV2::renderPoints( const QPolygonF& points, QgsSymbolV2RenderContext& context )
+{
+  for ( QPolygonF::const_iterator it = points.constBegin(); it != points.constEnd(); ++it )
+    renderPoint( *it, context );
+}
+
+void QgsLineSymbolLayerV2::renderPolylines( const QList<QPolygonF>& lines, QgsSymbolV2RenderContext& context )
+{
+  for ( QList<QPolygonF>::const_iterator it = lines.constBegin(); it != lines.constEnd(); ++it )
+    renderPolyline( *it, context );
+}
+
 void QgsLineSymbolLayerV2::renderPolygonOutline( const QPolygonF& points, QList<QPolygonF>* rings, QgsSymbolV2RenderContext& context )
 {
   renderPolyline( points, context );
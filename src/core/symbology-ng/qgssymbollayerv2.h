@@ -75,6 +75,10 @@ class CORE_EXPORT QgsMarkerSymbolLayerV2 : public QgsSymbolLayerV2
   public:
     virtual void renderPoint( const QPointF& point, QgsSymbolV2RenderContext& context ) = 0;
 
+    //! render markers at several points. Default implementation calls renderPoint() for each of them
+    //! @note added in v1.7
+    virtual void renderPoints( const QPolygonF& points, QgsSymbolV2RenderContext& context );
+
     void drawPreviewIcon( QgsSymbolV2RenderContext& context, QSize size );
 
     void setAngle( double angle ) { mAngle = angle; }
@@ -102,6 +106,10 @@ class CORE_EXPORT QgsLineSymbolLayerV2 : public QgsSymbolLayerV2
     //! @note added in v1.7
     virtual void renderPolygonOutline( const QPolygonF& points, QList<QPolygonF>* rings, QgsSymbolV2RenderContext& context );
 
+    //! render several polylines. Default implementation calls renderPolyline() for each of them
+    //! @note added in v1.7
+    virtual void renderPolylines( const QList<QPolygonF>& lines, QgsSymbolV2RenderContext& context );
+
     virtual void setWidth( double width ) { mWidth = width; }
     virtual double width() const { return mWidth; }
 
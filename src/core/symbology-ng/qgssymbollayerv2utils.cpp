@@ -15,6 +15,8 @@
 #include <QIcon>
 #include <QPainter>
 
+#include <cstring> // for memcpy
+
 QString QgsSymbolLayerV2Utils::encodeColor( QColor color )
 {
   return QString( "%1,%2,%3,%4" ).arg( color.red() ).arg( color.green() ).arg( color.blue() ).arg( color.alpha() );
@@ -765,3 +767,12 @@ void QgsSymbolLayerV2Utils::multiplyImageOpacity( QImage* image, qreal alpha )
     }
   }
 }
+
+quint64 QgsSymbolLayerV2Utils::doubleHashKey( double value )
+{
+  if ( value == 0.0 )
+    value = 0.0; // -0 and +0 are the same value
+  quint64 key;
+  memcpy( &key, &value, sizeof( key ) );
+  return key;
+}
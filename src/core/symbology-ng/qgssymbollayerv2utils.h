@@ -81,6 +81,11 @@ class CORE_EXPORT QgsSymbolLayerV2Utils
 
     /**Multiplies opacity of image pixel values with a (global) transparency value*/
     static void multiplyImageOpacity( QImage* image, qreal alpha );
+
+    /**Returns a key to hash a double by (Qt has no qHash for double): its bit pattern, -0 and +0
+      have the same key. NaN has several bit patterns and needs to be handled by the caller
+      @note added in 1.7 */
+    static quint64 doubleHashKey( double value );
 };
 
 class QPolygonF;
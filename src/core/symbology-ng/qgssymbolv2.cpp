@@ -419,6 +419,23 @@ void QgsMarkerSymbolV2::renderPoint( const QPointF& point, QgsRenderContext& con
   }
 }
 
+void QgsMarkerSymbolV2::renderPoints( const QPolygonF& points, QgsRenderContext& context, int layer, bool selected )
+{
+  QgsSymbolV2RenderContext symbolContext( context, mOutputUnit, mAlpha, selected, mRenderHints );
+  if ( layer != -1 )
+  {
+    if ( layer >= 0 && layer < mLayers.count() )
+      (( QgsMarkerSymbolLayerV2* ) mLayers[layer] )->renderPoints( points, symbolContext );
+    return;
+  }
+
+  for ( QgsSymbolLayerV2List::iterator it = mLayers.begin(); it != mLayers.end(); ++it )
+  {
+    QgsMarkerSymbolLayerV2* layer = ( QgsMarkerSymbolLayerV2* ) * it;
+    layer->renderPoints( points, symbolContext );
+  }
+}
+
 QgsSymbolV2* QgsMarkerSymbolV2::clone() const
 {
   QgsSymbolV2* cloneSymbol = new QgsMarkerSymbolV2( cloneLayers() );
@@ -489,6 +506,23 @@ void QgsLineSymbolV2::renderPolyline( const QPolygonF& points, QgsRenderContext&
 }
 
 
+void QgsLineSymbolV2::renderPolylines( const QList<QPolygonF>& lines, QgsRenderContext& context, int layer, bool selected )
+{
+  QgsSymbolV2RenderContext symbolContext( context, mOutputUnit, mAlpha, selected, mRenderHints );
+  if ( layer != -1 )
+  {
+    if ( layer >= 0 && layer < mLayers.count() )
+      (( QgsLineSymbolLayerV2* ) mLayers[layer] )->renderPolylines( lines, symbolContext );
+    return;
+  }
+
+  for ( QgsSymbolLayerV2List::iterator it = mLayers.begin(); it != mLayers.end(); ++it )
+  {
+    QgsLineSymbolLayerV2* layer = ( QgsLineSymbolLayerV2* ) * it;
+    layer->renderPolylines( lines, symbolContext );
+  }
+}
+
 QgsSymbolV2* QgsLineSymbolV2::clone() const
 {
   QgsSymbolV2* cloneSymbol = new QgsLineSymbolV2( cloneLayers() );
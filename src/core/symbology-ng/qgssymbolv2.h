@@ -186,6 +186,10 @@ class CORE_EXPORT QgsMarkerSymbolV2 : public QgsSymbolV2
 
     void renderPoint( const QPointF& point, QgsRenderContext& context, int layer = -1, bool selected = false );
 
+    //! render markers at all points, layer by layer
+    //! @note added in 1.7
+    void renderPoints( const QPolygonF& points, QgsRenderContext& context, int layer = -1, bool selected = false );
+
     virtual QgsSymbolV2* clone() const;
 };
 
@@ -207,6 +211,10 @@ class CORE_EXPORT QgsLineSymbolV2 : public QgsSymbolV2
 
     void renderPolyline( const QPolygonF& points, QgsRenderContext& context, int layer = -1, bool selected = false );
 
+    //! render all polylines, layer by layer
+    //! @note added in 1.7
+    void renderPolylines( const QList<QPolygonF>& lines, QgsRenderContext& context, int layer = -1, bool selected = false );
+
     virtual QgsSymbolV2* clone() const;
 };
 
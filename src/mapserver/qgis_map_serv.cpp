@@ -27,18 +27,34 @@ map service syntax for SOAP/HTTP POST
 #include "qgswmsserver.h"
 #include "qgsmaprenderer.h"
 #include "qgsmapserviceexception.h"
+#include "qgsmstiming.h"
+#include "qgsmsutils.h"
 #include "qgsprojectparser.h"
 #include "qgssldparser.h"
 #include <QDomDocument>
 #include <QImage>
 #include <QSettings>
 #include <QDateTime>
+#include <QSet>
+#include <QTime>
 
 //for CMAKE_INSTALL_PREFIX
 #include "qgsconfig.h"
 
 #include <fcgi_stdio.h>
 
+#ifndef Q_OS_WIN
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+//time limit for a request in seconds (QGIS_SERVER_REQUEST_TIMEOUT), 0 means no limit
+static int requestTimeout = 0;
+
 
 void dummyMessageHandler( QtMsgType type, const char *msg )
 {
@@ -129,16 +145,100 @@ QFileInfo defaultAdminSLD()
 
 int fcgi_accept()
 {
+  //log timing of the previous request (its response is complete at this point)
+  QgsMSTiming::instance()->finishRequest();
+
+#ifndef Q_OS_WIN
+  //no time limit while waiting for the next request
+  alarm( 0 );
+#endif
+
+  int result;
 #ifdef Q_OS_WIN
   if ( FCGX_IsCGI() )
-    return FCGI_Accept();
+    result = FCGI_Accept();
   else
-    return FCGX_Accept( &FCGI_stdin->fcgx_stream, &FCGI_stdout->fcgx_stream, &FCGI_stderr->fcgx_stream, &environ );
+    result = FCGX_Accept( &FCGI_stdin->fcgx_stream, &FCGI_stdout->fcgx_stream, &FCGI_stderr->fcgx_stream, &environ );
 #else
-  return FCGI_Accept();
+  result = FCGI_Accept();
+
+  //a request exceeding the time limit terminates the process (SIGALRM).
+  //The web server or the master process starts a new one
+  if ( result >= 0 && requestTimeout > 0 )
+  {
+    alarm( requestTimeout );
+  }
 #endif
+
+  if ( result >= 0 )
+  {
+    QgsMSTiming::instance()->startRequest();
+  }
+  return result;
+}
+
+#ifndef Q_OS_WIN
+static volatile sig_atomic_t terminateWorkers = 0;
+
+void terminateSignalHandler( int )
+{
+  terminateWorkers = 1;
 }
 
+/**Forks nWorkers worker processes which accept requests on the shared FastCGI socket and forks a new one
+  whenever a worker exits (e.g. after reaching the request limit or time limit). The workers inherit everything
+  loaded before this call (copy on write), so the configuration has to be loaded only once.
+  Returns in the worker processes only, the master process exits when it is terminated*/
+void runWorkerProcesses( int nWorkers )
+{
+  struct sigaction action;
+  memset( &action, 0, sizeof( action ) );
+  action.sa_handler = terminateSignalHandler;
+  sigemptyset( &action.sa_mask );
+  sigaction( SIGTERM, &action, 0 ); //no SA_RESTART, waitpid() has to return on termination
+  sigaction( SIGINT, &action, 0 );
+
+  QSet<pid_t> workers;
+  while ( !terminateWorkers )
+  {
+    while ( workers.size() < nWorkers )
+    {
+      pid_t pid = fork();
+      if ( pid == 0 )
+      {
+        signal( SIGTERM, SIG_DFL );
+        signal( SIGINT, SIG_DFL );
+        return;
+      }
+      else if ( pid < 0 )
+      {
+        fprintf( FCGI_stderr, "Could not start worker process: %s\n", strerror( errno ) );
+        sleep( 1 );
+        break;
+      }
+      workers.insert( pid );
+    }
+
+    int status;
+    pid_t pid = waitpid( -1, &status, 0 );
+    if ( pid > 0 )
+    {
+      workers.remove( pid );
+      if ( WIFSIGNALED( status ) )
+      {
+        fprintf( FCGI_stderr, "Worker process %d terminated by signal %d\n", ( int ) pid, WTERMSIG( status ) );
+      }
+    }
+  }
+
+  foreach( pid_t pid, workers )
+  {
+    kill( pid, SIGTERM );
+  }
+  exit( 0 );
+}
+#endif //Q_OS_WIN
+
 int main( int argc, char * argv[] )
 {
 #ifndef _MSC_VER
@@ -187,13 +287,33 @@ int main( int argc, char * argv[] )
     }
   }
 
+  requestTimeout = QgsMSUtils::environmentValue( "QGIS_SERVER_REQUEST_TIMEOUT", 0 );
+  //a worker exits after this number of requests (0: no limit) to release memory of long running processes
+  int maxRequests = QgsMSUtils::environmentValue( "QGIS_SERVER_MAX_REQUESTS", 0 );
+
   //create cache for capabilities XML
   QgsCapabilitiesCache capabilitiesCache;
 
   //creating QgsMapRenderer is expensive (access to srs.db), so we do it here before the fcgi loop
   QgsMapRenderer* theMapRenderer = new QgsMapRenderer();
 
-  while ( fcgi_accept() >= 0 )
+#ifndef Q_OS_WIN
+  //pool of worker processes sharing the parsed default configuration.
+  //Layers and their data source handles are loaded by each worker
+  int nWorkers = QgsMSUtils::environmentValue( "QGIS_SERVER_WORKERS", 0 );
+  if ( nWorkers > 0 && !FCGX_IsCGI() )
+  {
+    QgsConfigCache::instance()->setCheckModificationTime( true );
+    if ( !defaultConfigFilePath.isEmpty() )
+    {
+      QgsConfigCache::instance()->searchConfiguration( defaultConfigFilePath );
+    }
+    runWorkerProcesses( nWorkers );
+  }
+#endif //Q_OS_WIN
+
+  int nRequests = 0;
+  while (( maxRequests <= 0 || nRequests++ < maxRequests ) && fcgi_accept() >= 0 )
   {
     printRequestInfos(); //print request infos if in debug mode
 
@@ -240,7 +360,10 @@ int main( int argc, char * argv[] )
       configFilePath = mapFileIt->second;
     }
 
+    QTime configTime;
+    configTime.start();
     QgsConfigParser* adminConfigParser = QgsConfigCache::instance()->searchConfiguration( configFilePath );
+    QgsMSTiming::instance()->addPhaseTime( "config", configTime.elapsed() );
     if ( !adminConfigParser )
     {
       QgsDebugMsg( "parse error on config file " + configFilePath );
@@ -461,6 +584,8 @@ int main( int argc, char * argv[] )
     }
   }
 
+  QgsMSTiming::instance()->finishRequest();
+  FCGI_Finish(); //send the response of the last request before exit
   delete theMapRenderer;
   return 0;
 }
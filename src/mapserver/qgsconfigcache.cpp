@@ -21,6 +21,7 @@
 #include "qgsprojectparser.h"
 #include "qgssldparser.h"
 #include <QCoreApplication>
+#include <QFileInfo>
 
 QgsConfigCache* QgsConfigCache::mInstance = 0;
 
@@ -33,7 +34,7 @@ QgsConfigCache* QgsConfigCache::instance()
   return mInstance;
 }
 
-QgsConfigCache::QgsConfigCache()
+QgsConfigCache::QgsConfigCache(): mCheckModificationTime( false )
 {
   QObject::connect( &mFileSystemWatcher, SIGNAL( fileChanged( const QString& ) ), this, SLOT( removeChangedEntry( const QString& ) ) );
 }
@@ -57,6 +58,12 @@ QgsConfigParser* QgsConfigCache::searchConfiguration( const QString& filePath )
     QgsDebugMsg( "Create new configuration" );
     p = insertConfiguration( filePath );
   }
+  else if ( mCheckModificationTime && QFileInfo( filePath ).lastModified() != mModificationTimes.value( filePath ) )
+  {
+    QgsDebugMsg( "Configuration file changed, create new configuration" );
+    removeChangedEntry( filePath );
+    p = insertConfiguration( filePath );
+  }
   else
   {
     QgsDebugMsg( "Return configuration from cache" );
@@ -79,7 +86,14 @@ QgsConfigParser* QgsConfigCache::insertConfiguration( const QString& filePath )
     QHash<QString, QgsConfigParser*>::iterator configIt = mCachedConfigurations.begin();
     if ( configIt != mCachedConfigurations.end() )
     {
-      mFileSystemWatcher.removePath( configIt.key() );
+      if ( mCheckModificationTime )
+      {
+        mModificationTimes.remove( configIt.key() );
+      }
+      else
+      {
+        mFileSystemWatcher.removePath( configIt.key() );
+      }
       delete configIt.value();
       mCachedConfigurations.erase( configIt );
     }
@@ -126,7 +140,14 @@ QgsConfigParser* QgsConfigCache::insertConfiguration( const QString& filePath )
   }
 
   mCachedConfigurations.insert( filePath, configParser );
-  mFileSystemWatcher.addPath( filePath );
+  if ( mCheckModificationTime )
+  {
+    mModificationTimes.insert( filePath, QFileInfo( filePath ).lastModified() );
+  }
+  else
+  {
+    mFileSystemWatcher.addPath( filePath );
+  }
   delete configFile;
   return configParser;
 }
@@ -140,5 +161,12 @@ void QgsConfigCache::removeChangedEntry( const QString& path )
     delete configIt.value();
     mCachedConfigurations.erase( configIt );
   }
-  mFileSystemWatcher.removePath( path );
+  if ( mCheckModificationTime )
+  {
+    mModificationTimes.remove( path );
+  }
+  else
+  {
+    mFileSystemWatcher.removePath( path );
+  }
 }
@@ -18,6 +18,7 @@
 #ifndef QGSCONFIGCACHE_H
 #define QGSCONFIGCACHE_H
 
+#include <QDateTime>
 #include <QFileSystemWatcher>
 #include <QHash>
 #include <QObject>
@@ -36,6 +37,11 @@ class QgsConfigCache: public QObject
     /**Returns configuration for given config file path. The calling function does _not_ take ownership*/
     QgsConfigParser* searchConfiguration( const QString& filePath );
 
+    /**Detect changed configuration files by comparing their modification time on each access instead of
+      using a file system watcher. Must be set before the first configuration is loaded if the process
+      forks afterwards (the watcher runs a thread which does not exist in the forked processes)*/
+    void setCheckModificationTime( bool check ) { mCheckModificationTime = check; }
+
   protected:
     QgsConfigCache();
 
@@ -50,6 +56,10 @@ class QgsConfigCache: public QObject
     QHash<QString, QgsConfigParser*> mCachedConfigurations;
     /**Check for configuration file updates (remove entry from cache if file changes)*/
     QFileSystemWatcher mFileSystemWatcher;
+    /**Use modification times instead of the file system watcher*/
+    bool mCheckModificationTime;
+    /**Modification times of the cached configuration files (if mCheckModificationTime is set)*/
+    QHash<QString, QDateTime> mModificationTimes;
 
   private slots:
     /**Removes changed entry from this cache*/
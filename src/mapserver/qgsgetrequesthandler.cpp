@@ -1,15 +1,17 @@
 #include "qgsgetrequesthandler.h"
 #include "qgsftptransaction.h"
+#include "qgsimageencoder.h"
 #include "qgslogger.h"
 #include "qgsmapserviceexception.h"
+#include "qgsmstiming.h"
 #include "qgsremotedatasourcebuilder.h"
 #include "qgshttptransaction.h"
-#include <QBuffer>
 #include <QDomDocument>
 #include <QFile>
 #include <QTextStream>
 #include <QImage>
 #include <QStringList>
+#include <QTime>
 #include <QUrl>
 
 QgsGetRequestHandler::QgsGetRequestHandler(): QgsHttpRequestHandler()
@@ -107,6 +109,11 @@ std::map<QString, QString> QgsGetRequestHandler::parseInput()
       {
         formatString = "PNG";
       }
+      else if ( formatString.compare( "image/png; mode=8bit", Qt::CaseInsensitive ) == 0 || formatString.compare( "image/png8", Qt::CaseInsensitive ) == 0
+                || formatString.compare( "png8", Qt::CaseInsensitive ) == 0 )
+      {
+        formatString = "PNG8";
+      }
       else if ( formatString.compare( "image/jpeg", Qt::CaseInsensitive ) == 0 || formatString.compare( "image/jpg", Qt::CaseInsensitive ) == 0 \
                 || formatString.compare( "jpg", Qt::CaseInsensitive ) == 0 )
       {
@@ -133,17 +140,28 @@ void QgsGetRequestHandler::sendGetMapResponse( const QString& service, QImage* i
 {
   if ( img )
   {
-    if ( mFormat != "PNG" && mFormat != "JPG" )
+    //encode the image in a QByteArray and send it directly
+    QTime encodeTime;
+    encodeTime.start();
+    QByteArray ba;
+    if ( mFormat == "PNG" )
+    {
+      ba = QgsImageEncoder::encodePng( *img, QgsImageEncoder::defaultPngCompressionLevel(), QgsImageEncoder::defaultPngFilter() );
+    }
+    else if ( mFormat == "PNG8" )
+    {
+      ba = QgsImageEncoder::encodePng8( *img, QgsImageEncoder::defaultPngCompressionLevel(), QgsImageEncoder::defaultPng8Filter() );
+    }
+    else if ( mFormat == "JPG" )
+    {
+      ba = QgsImageEncoder::encodeJpeg( *img, QgsImageEncoder::defaultJpegQuality() );
+    }
+    else
     {
       sendServiceException( QgsMapServiceException( "InvalidFormat", "Output format '" + mFormat + "' is not supported in the GetMap request" ) );
       return;
     }
-
-    //store the image in a QByteArray and send it directly
-    QByteArray ba;
-    QBuffer buffer( &ba );
-    buffer.open( QIODevice::WriteOnly );
-    img->save( &buffer, mFormat.toLocal8Bit().data(), -1 );
+    QgsMSTiming::instance()->addPhaseTime( "encode", encodeTime.elapsed() );
 
     sendHttpResponse( &ba, formatToMimeType( mFormat ) );
   }
@@ -16,6 +16,7 @@
  ***************************************************************************/
 
 #include "qgshttprequesthandler.h"
+#include "qgsmstiming.h"
 #include <QByteArray>
 #include <fcgi_stdio.h>
 
@@ -45,13 +46,17 @@ void QgsHttpRequestHandler::sendHttpResponse( QByteArray* ba, const QString& for
   printf( format.toLocal8Bit() );
   printf( "\n" );
   printf( "Content-Length: %d\n", ba->size() );
+  if ( QgsMSTiming::instance()->headerEnabled() )
+  {
+    printf( "X-QGIS-Timing: %s\n", QgsMSTiming::instance()->timingString().toUtf8().constData() );
+  }
   printf( "\n" );
   fwrite( ba->data(), ba->size(), 1, FCGI_stdout );
 }
 
 QString QgsHttpRequestHandler::formatToMimeType( const QString& format ) const
 {
-  if ( format.compare( "png", Qt::CaseInsensitive ) == 0 )
+  if ( format.compare( "png", Qt::CaseInsensitive ) == 0 || format.compare( "png8", Qt::CaseInsensitive ) == 0 )
   {
     return "image/png";
   }
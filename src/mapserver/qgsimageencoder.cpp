@@ -0,0 +1,529 @@
+/***************************************************************************
+                              qgsimageencoder.cpp
+                              -------------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsimageencoder.h"
+#include "qgslogger.h"
+#include "qgsmsutils.h"
+#include <QBuffer>
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <QtAlgorithms>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+//number of colors of paletted images
+#define PNG8_MAX_COLORS 256
+
+//PNG color types
+#define PNG_COLOR_TYPE_PALETTE 3
+#define PNG_COLOR_TYPE_RGB 2
+#define PNG_COLOR_TYPE_RGBA 6
+
+//size of the IDAT chunks
+#define PNG_CHUNK_SIZE 65536
+
+static void appendUInt32( QByteArray& ba, quint32 value )
+{
+  ba.append(( char )( value >> 24 ) );
+  ba.append(( char )( value >> 16 ) );
+  ba.append(( char )( value >> 8 ) );
+  ba.append(( char ) value );
+}
+
+static void writeChunk( QByteArray& png, const char* type, const char* data, int len )
+{
+  appendUInt32( png, len );
+  int start = png.size();
+  png.append( type, 4 );
+  png.append( data, len );
+  appendUInt32( png, crc32( 0L, ( const Bytef* ) png.constData() + start, png.size() - start ) );
+}
+
+static void writeHeader( QByteArray& png, int width, int height, int colorType )
+{
+  png.append( "\x89PNG\r\n\x1a\n", 8 );
+
+  QByteArray ihdr;
+  appendUInt32( ihdr, width );
+  appendUInt32( ihdr, height );
+  ihdr.append(( char ) 8 ); //bit depth
+  ihdr.append(( char ) colorType );
+  ihdr.append(( char ) 0 ); //compression method
+  ihdr.append(( char ) 0 ); //filter method
+  ihdr.append(( char ) 0 ); //no interlace
+  writeChunk( png, "IHDR", ihdr.constData(), ihdr.size() );
+}
+
+/**Compresses the filtered rows as they are produced and writes the IDAT chunks,
+  so the filtered image is never held in memory as a whole*/
+class QgsPngDataWriter
+{
+  public:
+    QgsPngDataWriter( QByteArray& png, int compressionLevel ): mPng( png ), mBuffer( PNG_CHUNK_SIZE, 0 )
+    {
+      memset( &mStream, 0, sizeof( mStream ) );
+      if ( deflateInit( &mStream, compressionLevel ) != Z_OK )
+      {
+        QgsDebugMsg( "Could not initialize zlib stream" );
+      }
+      mStream.next_out = ( Bytef* ) mBuffer.data();
+      mStream.avail_out = mBuffer.size();
+    }
+
+    ~QgsPngDataWriter()
+    {
+      deflateEnd( &mStream );
+    }
+
+    /**Compresses a filtered row (filter type byte and row data)*/
+    void addRow( const uchar* data, int len )
+    {
+      mStream.next_in = ( Bytef* ) data;
+      mStream.avail_in = len;
+      while ( mStream.avail_in > 0 )
+      {
+        if ( deflate( &mStream, Z_NO_FLUSH ) == Z_STREAM_ERROR )
+        {
+          QgsDebugMsg( "Could not compress image data" );
+          return;
+        }
+        if ( mStream.avail_out == 0 )
+        {
+          writeData();
+        }
+      }
+    }
+
+    /**Ends the compressed stream and writes the IEND chunk*/
+    void finish()
+    {
+      int result = Z_OK;
+      while ( result == Z_OK )
+      {
+        result = deflate( &mStream, Z_FINISH );
+        if ( mStream.avail_out == 0 || result == Z_STREAM_END )
+        {
+          writeData();
+        }
+      }
+      if ( result != Z_STREAM_END )
+      {
+        QgsDebugMsg( "Could not compress image data" );
+      }
+      writeChunk( mPng, "IEND", 0, 0 );
+    }
+
+  private:
+    void writeData()
+    {
+      int len = mBuffer.size() - mStream.avail_out;
+      if ( len > 0 )
+      {
+        writeChunk( mPng, "IDAT", mBuffer.constData(), len );
+      }
+      mStream.next_out = ( Bytef* ) mBuffer.data();
+      mStream.avail_out = mBuffer.size();
+    }
+
+    QByteArray& mPng;
+    QByteArray mBuffer;
+    z_stream mStream;
+};
+
+static inline int paethPredictor( int a, int b, int c )
+{
+  int p = a + b - c;
+  int pa = abs( p - a );
+  int pb = abs( p - b );
+  int pc = abs( p - c );
+  if ( pa <= pb && pa <= pc )
+    return a;
+  if ( pb <= pc )
+    return b;
+  return c;
+}
+
+/**Writes filter type and filtered row (len bytes) to out*/
+static void filterRow( int filter, const uchar* row, const uchar* prev, int bpp, int len, uchar* out )
+{
+  *out++ = filter;
+  switch ( filter )
+  {
+    case QgsImageEncoder::FilterSub:
+      for ( int i = 0; i < len; ++i )
+        out[i] = row[i] - ( i >= bpp ? row[i - bpp] : 0 );
+      break;
+    case QgsImageEncoder::FilterUp:
+      for ( int i = 0; i < len; ++i )
+        out[i] = row[i] - prev[i];
+      break;
+    case QgsImageEncoder::FilterPaeth:
+      for ( int i = 0; i < len; ++i )
+        out[i] = row[i] - paethPredictor( i >= bpp ? row[i - bpp] : 0, prev[i], i >= bpp ? prev[i - bpp] : 0 );
+      break;
+    default:
+      memcpy( out, row, len );
+  }
+}
+
+/**Filters row into out (len + 1 bytes). The adaptive filter takes the filter with the smallest sum of absolute differences*/
+static void appendRow( QgsImageEncoder::PngFilter filter, const uchar* row, const uchar* prev, int bpp, int len, uchar* out, QByteArray& scratch )
+{
+  if ( filter != QgsImageEncoder::FilterAdaptive )
+  {
+    filterRow( filter, row, prev, bpp, len, out );
+    return;
+  }
+
+  static const int filters[] = { QgsImageEncoder::FilterNone, QgsImageEncoder::FilterSub, QgsImageEncoder::FilterUp, QgsImageEncoder::FilterPaeth };
+  scratch.resize( len + 1 );
+  uchar* candidate = ( uchar* ) scratch.data();
+  int bestCost = -1;
+  for ( int f = 0; f < 4; ++f )
+  {
+    filterRow( filters[f], row, prev, bpp, len, candidate );
+    int cost = 0;
+    for ( int i = 1; i <= len; ++i )
+      cost += abs(( signed char ) candidate[i] );
+    if ( bestCost < 0 || cost < bestCost )
+    {
+      bestCost = cost;
+      memcpy( out, candidate, len + 1 );
+    }
+  }
+}
+
+static inline QRgb unpremultiply( QRgb p )
+{
+  int a = qAlpha( p );
+  if ( a == 255 )
+    return p;
+  if ( a == 0 )
+    return 0;
+  return qRgba(( qRed( p ) * 255 + a / 2 ) / a, ( qGreen( p ) * 255 + a / 2 ) / a, ( qBlue( p ) * 255 + a / 2 ) / a, a );
+}
+
+/**Returns image in a 32 bit format. Only converts (copies) the image if it has another format*/
+static QImage image32( const QImage& image )
+{
+  if ( image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32
+       || image.format() == QImage::Format_ARGB32_Premultiplied )
+  {
+    return image;
+  }
+  return image.convertToFormat( QImage::Format_ARGB32 );
+}
+
+QByteArray QgsImageEncoder::encodePng( const QImage& image, int compressionLevel, PngFilter filter )
+{
+  const QImage img = image32( image ); //const: scanLine() must not detach
+  int width = img.width();
+  int height = img.height();
+  bool alpha = img.hasAlphaChannel();
+  bool premultiplied = img.format() == QImage::Format_ARGB32_Premultiplied;
+  int bpp = alpha ? 4 : 3;
+  int len = width * bpp;
+
+  QByteArray png;
+  writeHeader( png, width, height, alpha ? PNG_COLOR_TYPE_RGBA : PNG_COLOR_TYPE_RGB );
+  QgsPngDataWriter writer( png, compressionLevel );
+
+  QVector<uchar> row( len ), prev( len, 0 ), filtered( len + 1 );
+  QByteArray scratch;
+  for ( int y = 0; y < height; ++y )
+  {
+    const QRgb* line = ( const QRgb* ) img.scanLine( y );
+    uchar* d = row.data();
+    for ( int x = 0; x < width; ++x )
+    {
+      QRgb p = premultiplied ? unpremultiply( line[x] ) : line[x];
+      *d++ = qRed( p );
+      *d++ = qGreen( p );
+      *d++ = qBlue( p );
+      if ( alpha )
+        *d++ = qAlpha( p );
+    }
+    appendRow( filter, row.constData(), prev.constData(), bpp, len, filtered.data(), scratch );
+    writer.addRow( filtered.constData(), len + 1 );
+    qSwap( row, prev );
+  }
+
+  writer.finish();
+  return png;
+}
+
+/**Colors of one histogram bin*/
+struct QgsColorEntry
+{
+  int key;
+  quint32 count;
+  int color[4]; //average r, g, b, a
+  quint64 sum[4];
+};
+
+class QgsColorEntryLessThan
+{
+  public:
+    QgsColorEntryLessThan( int channel ): mChannel( channel ) {}
+    bool operator()( const QgsColorEntry& e1, const QgsColorEntry& e2 ) const { return e1.color[mChannel] < e2.color[mChannel]; }
+  private:
+    int mChannel;
+};
+
+/**Box of median cut: range of entries*/
+struct QgsColorBox
+{
+  int begin;
+  int end;
+  quint64 count;
+  int channel; //channel with the largest range
+  int range;
+};
+
+static QgsColorBox colorBox( const QVector<QgsColorEntry>& entries, int begin, int end, int nChannels )
+{
+  QgsColorBox box;
+  box.begin = begin;
+  box.end = end;
+  box.count = 0;
+  int minValue[4] = { 255, 255, 255, 255 };
+  int maxValue[4] = { 0, 0, 0, 0 };
+  for ( int i = begin; i < end; ++i )
+  {
+    const QgsColorEntry& e = entries[i];
+    box.count += e.count;
+    for ( int c = 0; c < nChannels; ++c )
+    {
+      minValue[c] = qMin( minValue[c], e.color[c] );
+      maxValue[c] = qMax( maxValue[c], e.color[c] );
+    }
+  }
+  box.channel = 0;
+  box.range = -1;
+  for ( int c = 0; c < nChannels; ++c )
+  {
+    if ( maxValue[c] - minValue[c] > box.range )
+    {
+      box.range = maxValue[c] - minValue[c];
+      box.channel = c;
+    }
+  }
+  return box;
+}
+
+QByteArray QgsImageEncoder::encodePng8( const QImage& image, int compressionLevel, PngFilter filter )
+{
+  const QImage img = image32( image ); //const: scanLine() must not detach
+  int width = img.width();
+  int height = img.height();
+  bool alpha = img.hasAlphaChannel();
+  bool premultiplied = img.format() == QImage::Format_ARGB32_Premultiplied;
+
+  //histogram with 5 bits per channel (or 4 bits if there is alpha)
+  int nChannels = alpha ? 4 : 3;
+  int nBins = alpha ? 65536 : 32768;
+#define COLOR_KEY(p) ( alpha ? ( ( qRed( p ) >> 4 ) << 12 | ( qGreen( p ) >> 4 ) << 8 | ( qBlue( p ) >> 4 ) << 4 | qAlpha( p ) >> 4 ) \
+                       : ( ( qRed( p ) >> 3 ) << 10 | ( qGreen( p ) >> 3 ) << 5 | qBlue( p ) >> 3 ) )
+
+  QVector<quint32> binCounts( nBins, 0 );
+  QVector<quint64> binSums( nBins * 4, 0 );
+  bool transparentPixels = false;
+  for ( int y = 0; y < height; ++y )
+  {
+    const QRgb* line = ( const QRgb* ) img.scanLine( y );
+    for ( int x = 0; x < width; ++x )
+    {
+      QRgb p = premultiplied ? unpremultiply( line[x] ) : line[x];
+      if ( alpha && qAlpha( p ) == 0 )
+      {
+        transparentPixels = true;
+        continue;
+      }
+      int key = COLOR_KEY( p );
+      binCounts[key]++;
+      quint64* sum = binSums.data() + 4 * key;
+      sum[0] += qRed( p );
+      sum[1] += qGreen( p );
+      sum[2] += qBlue( p );
+      sum[3] += qAlpha( p );
+    }
+  }
+
+  QVector<QgsColorEntry> entries;
+  for ( int key = 0; key < nBins; ++key )
+  {
+    quint32 count = binCounts[key];
+    if ( count == 0 )
+      continue;
+    QgsColorEntry e;
+    e.key = key;
+    e.count = count;
+    for ( int c = 0; c < 4; ++c )
+    {
+      e.sum[c] = binSums[4 * key + c];
+      e.color[c] = e.sum[c] / count;
+    }
+    entries.append( e );
+  }
+
+  //median cut: split the box with most pixels times color range until there are enough colors
+  int maxColors = transparentPixels ? PNG8_MAX_COLORS - 1 : PNG8_MAX_COLORS;
+  QList<QgsColorBox> boxes;
+  if ( !entries.isEmpty() )
+    boxes.append( colorBox( entries, 0, entries.size(), nChannels ) );
+  while ( boxes.size() < maxColors )
+  {
+    int splitIndex = -1;
+    quint64 maxScore = 0;
+    for ( int i = 0; i < boxes.size(); ++i )
+    {
+      const QgsColorBox& box = boxes[i];
+      quint64 score = box.count * box.range;
+      if ( box.end - box.begin > 1 && score > maxScore )
+      {
+        maxScore = score;
+        splitIndex = i;
+      }
+    }
+    if ( splitIndex < 0 )
+      break;
+
+    QgsColorBox box = boxes.takeAt( splitIndex );
+    qSort( entries.begin() + box.begin, entries.begin() + box.end, QgsColorEntryLessThan( box.channel ) );
+    int median = box.begin + 1;
+    quint64 count = entries[box.begin].count;
+    while ( median < box.end - 1 && count + entries[median].count <= box.count / 2 )
+    {
+      count += entries[median].count;
+      median++;
+    }
+    boxes.append( colorBox( entries, box.begin, median, nChannels ) );
+    boxes.append( colorBox( entries, median, box.end, nChannels ) );
+  }
+
+  //palette and lookup of palette index for each bin
+  QByteArray palette;
+  QByteArray transparency;
+  if ( transparentPixels )
+  {
+    palette.append( QByteArray( 3, 0 ) );
+    transparency.append(( char ) 0 );
+  }
+  QVector<uchar> binIndex( nBins, 0 );
+  for ( int i = 0; i < boxes.size(); ++i )
+  {
+    const QgsColorBox& box = boxes[i];
+    quint64 sum[4] = { 0, 0, 0, 0 };
+    for ( int j = box.begin; j < box.end; ++j )
+    {
+      for ( int c = 0; c < 4; ++c )
+        sum[c] += entries[j].sum[c];
+      binIndex[entries[j].key] = palette.size() / 3;
+    }
+    palette.append(( char )( sum[0] / box.count ) );
+    palette.append(( char )( sum[1] / box.count ) );
+    palette.append(( char )( sum[2] / box.count ) );
+    transparency.append(( char )( sum[3] / box.count ) );
+  }
+  if ( palette.isEmpty() ) //empty image
+  {
+    palette.append( QByteArray( 3, 0 ) );
+    transparency.append(( char ) 0 );
+  }
+
+  QByteArray png;
+  writeHeader( png, width, height, PNG_COLOR_TYPE_PALETTE );
+  writeChunk( png, "PLTE", palette.constData(), palette.size() );
+  if ( alpha )
+  {
+    writeChunk( png, "tRNS", transparency.constData(), transparency.size() );
+  }
+  QgsPngDataWriter writer( png, compressionLevel );
+
+  //write indices
+  QVector<uchar> row( width ), prev( width, 0 ), filtered( width + 1 );
+  QByteArray scratch;
+  for ( int y = 0; y < height; ++y )
+  {
+    const QRgb* line = ( const QRgb* ) img.scanLine( y );
+    uchar* d = row.data();
+    for ( int x = 0; x < width; ++x )
+    {
+      QRgb p = premultiplied ? unpremultiply( line[x] ) : line[x];
+      *d++ = ( alpha && qAlpha( p ) == 0 ) ? 0 : binIndex[COLOR_KEY( p )];
+    }
+    appendRow( filter, row.constData(), prev.constData(), 1, width, filtered.data(), scratch );
+    writer.addRow( filtered.constData(), width + 1 );
+    qSwap( row, prev );
+  }
+#undef COLOR_KEY
+
+  writer.finish();
+  return png;
+}
+
+QByteArray QgsImageEncoder::encodeJpeg( const QImage& image, int quality )
+{
+  QByteArray ba;
+  QBuffer buffer( &ba );
+  buffer.open( QIODevice::WriteOnly );
+  if ( !image.save( &buffer, "JPG", quality ) )
+  {
+    QgsDebugMsg( "Could not write JPEG image" );
+  }
+  return ba;
+}
+
+static QgsImageEncoder::PngFilter environmentFilter( QgsImageEncoder::PngFilter defaultFilter )
+{
+  QString name = QString( getenv( "QGIS_SERVER_PNG_FILTER" ) ).toLower();
+  if ( name == "none" )
+    return QgsImageEncoder::FilterNone;
+  else if ( name == "sub" )
+    return QgsImageEncoder::FilterSub;
+  else if ( name == "up" )
+    return QgsImageEncoder::FilterUp;
+  else if ( name == "paeth" )
+    return QgsImageEncoder::FilterPaeth;
+  else if ( name == "adaptive" )
+    return QgsImageEncoder::FilterAdaptive;
+  return defaultFilter;
+}
+
+int QgsImageEncoder::defaultPngCompressionLevel()
+{
+  static int level = qBound( -1, QgsMSUtils::environmentValue( "QGIS_SERVER_PNG_COMPRESSION", -1 ), 9 );
+  return level;
+}
+
+QgsImageEncoder::PngFilter QgsImageEncoder::defaultPngFilter()
+{
+  static PngFilter filter = environmentFilter( FilterSub );
+  return filter;
+}
+
+QgsImageEncoder::PngFilter QgsImageEncoder::defaultPng8Filter()
+{
+  //filters rarely help for palette indices
+  static PngFilter filter = environmentFilter( FilterNone );
+  return filter;
+}
+
+int QgsImageEncoder::defaultJpegQuality()
+{
+  static int quality = qBound( -1, QgsMSUtils::environmentValue( "QGIS_SERVER_JPEG_QUALITY", -1 ), 100 );
+  return quality;
+}
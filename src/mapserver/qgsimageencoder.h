@@ -0,0 +1,58 @@
+/***************************************************************************
+                              qgsimageencoder.h
+                              -----------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSIMAGEENCODER_H
+#define QGSIMAGEENCODER_H
+
+#include <QByteArray>
+
+class QImage;
+
+/**Encodes rendered images for the response. PNG is written directly from the scanlines of the image
+  (no conversion of the image, no image writer plugin) with configurable zlib level and row filter.
+  The paletted variant (PNG8) reduces the colors with median cut and is usually several times smaller.
+
+  The defaults can be set with environment variables:
+  QGIS_SERVER_PNG_COMPRESSION (zlib level 0-9), QGIS_SERVER_PNG_FILTER (none, sub, up, paeth, adaptive)
+  and QGIS_SERVER_JPEG_QUALITY (0-100)*/
+class QgsImageEncoder
+{
+  public:
+    /**PNG row filters. Adaptive chooses the best filter for each row*/
+    enum PngFilter
+    {
+      FilterNone = 0,
+      FilterSub = 1,
+      FilterUp = 2,
+      FilterPaeth = 4,
+      FilterAdaptive = 5
+    };
+
+    /**Writes a 24 bit (or 32 bit with alpha channel) PNG
+      @param compressionLevel zlib level 0-9, -1 for zlib default*/
+    static QByteArray encodePng( const QImage& image, int compressionLevel, PngFilter filter );
+    /**Writes an 8 bit paletted PNG with at most 256 colors (including transparency)*/
+    static QByteArray encodePng8( const QImage& image, int compressionLevel, PngFilter filter );
+    /**Writes a JPEG image
+      @param quality 0-100, -1 for default quality*/
+    static QByteArray encodeJpeg( const QImage& image, int quality );
+
+    /**Default settings (from environment variables)*/
+    static int defaultPngCompressionLevel();
+    static PngFilter defaultPngFilter();
+    static PngFilter defaultPng8Filter();
+    static int defaultJpegQuality();
+};
+
+#endif // QGSIMAGEENCODER_H
@@ -0,0 +1,112 @@
+/***************************************************************************
+                              qgsmstiming.cpp
+                              ---------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsmstiming.h"
+#include "qgsmsutils.h"
+#include <QRegExp>
+#include <fcgi_stdio.h>
+#include <stdlib.h>
+
+QgsMSTiming* QgsMSTiming::mInstance = 0;
+
+QgsMSTiming* QgsMSTiming::instance()
+{
+  if ( !mInstance )
+  {
+    mInstance = new QgsMSTiming();
+  }
+  return mInstance;
+}
+
+QgsMSTiming::QgsMSTiming(): mHeaderEnabled( false ), mSlowRequestThreshold( -1 ), mRequestActive( false )
+{
+  if ( QgsMSUtils::environmentValue( "QGIS_SERVER_TIMING", 0 ) > 0 )
+  {
+    mHeaderEnabled = true;
+    mSlowRequestThreshold = 0;
+  }
+
+  int threshold = QgsMSUtils::environmentValue( "QGIS_SERVER_SLOW_REQUEST_MS", -1 );
+  if ( threshold >= 0 )
+  {
+    mSlowRequestThreshold = threshold;
+  }
+}
+
+QgsMSTiming::~QgsMSTiming()
+{
+}
+
+void QgsMSTiming::startRequest()
+{
+  mPhaseTimes.clear();
+  mRequestActive = isEnabled();
+  if ( !mRequestActive )
+  {
+    return;
+  }
+
+  char* queryString = getenv( "QUERY_STRING" );
+  mRequestString = queryString ? QString( queryString ) : QString();
+  mRequestTime.start();
+}
+
+void QgsMSTiming::finishRequest()
+{
+  if ( !mRequestActive )
+  {
+    return;
+  }
+
+  if ( mSlowRequestThreshold >= 0 && mRequestTime.elapsed() >= mSlowRequestThreshold )
+  {
+    fprintf( FCGI_stderr, "QGIS Server request: %s query=\"%s\"\n", timingString().toUtf8().constData(), mRequestString.toUtf8().constData() );
+    fflush( FCGI_stderr );
+  }
+  mRequestActive = false;
+}
+
+void QgsMSTiming::addPhaseTime( const QString& phase, int msec )
+{
+  if ( !mRequestActive )
+  {
+    return;
+  }
+
+  QList< QPair<QString, int> >::iterator it = mPhaseTimes.begin();
+  for ( ; it != mPhaseTimes.end(); ++it )
+  {
+    if ( it->first == phase )
+    {
+      it->second += msec;
+      return;
+    }
+  }
+  mPhaseTimes.append( qMakePair( phase, msec ) );
+}
+
+QString QgsMSTiming::timingString() const
+{
+  QString result = QString( "total=%1" ).arg( mRequestActive ? mRequestTime.elapsed() : 0 );
+
+  QList< QPair<QString, int> >::const_iterator it = mPhaseTimes.constBegin();
+  for ( ; it != mPhaseTimes.constEnd(); ++it )
+  {
+    //layer names may contain characters separating the entries
+    QString name = it->first;
+    name.replace( QRegExp( "[\\s=,;\"]" ), "_" );
+    result.append( QString( " %1=%2" ).arg( name ).arg( it->second ) );
+  }
+  return result;
+}
@@ -0,0 +1,69 @@
+/***************************************************************************
+                              qgsmstiming.h
+                              -------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSMSTIMING_H
+#define QGSMSTIMING_H
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QTime>
+
+/**A singleton class that records the wall time of the phases of the current request
+  (configuration lookup, layer loading, drawing of each layer, labeling, encoding).
+
+  QGIS_SERVER_TIMING=1 adds the timings as 'X-QGIS-Timing' header to the responses and writes a log line
+  for every request to stderr (the error log of the web server).
+  QGIS_SERVER_SLOW_REQUEST_MS=n only logs requests which took at least n milliseconds*/
+class QgsMSTiming
+{
+  public:
+    static QgsMSTiming* instance();
+    ~QgsMSTiming();
+
+    /**Starts timing of a new request*/
+    void startRequest();
+    /**Writes the log line for the current request (if enabled) and stops timing*/
+    void finishRequest();
+
+    /**Adds time to a phase of the current request. Times of phases with the same name are summed up*/
+    void addPhaseTime( const QString& phase, int msec );
+
+    /**True if the timings are reported in a header or a log line*/
+    bool isEnabled() const { return mHeaderEnabled || mSlowRequestThreshold >= 0; }
+    /**True if responses should contain the timing header*/
+    bool headerEnabled() const { return mHeaderEnabled && mRequestActive; }
+
+    /**Timings of the current request as 'total=120 config=1 layers=15 draw:roads=80 ...' (milliseconds)*/
+    QString timingString() const;
+
+  protected:
+    /**Protected singleton constructor*/
+    QgsMSTiming();
+
+  private:
+    static QgsMSTiming* mInstance;
+
+    bool mHeaderEnabled;
+    /**Log requests which took at least this number of milliseconds (-1: no log)*/
+    int mSlowRequestThreshold;
+
+    bool mRequestActive;
+    QTime mRequestTime;
+    QString mRequestString;
+    /**Phase name and time in order of first occurence*/
+    QList< QPair<QString, int> > mPhaseTimes;
+};
+
+#endif //QGSMSTIMING_H
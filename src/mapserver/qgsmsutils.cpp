@@ -68,3 +68,15 @@ int QgsMSUtils::createTextFile( QString filePath, const QString& text )
     return 1;
   }
 }
+
+int QgsMSUtils::environmentValue( const char* name, int defaultValue )
+{
+  char* value = getenv( name );
+  if ( !value )
+  {
+    return defaultValue;
+  }
+  bool ok;
+  int number = QString( value ).toInt( &ok );
+  return ok ? number : defaultValue;
+}
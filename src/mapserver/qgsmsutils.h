@@ -12,6 +12,8 @@ namespace QgsMSUtils
   QString createTempFilePath();
   /**Stores the specified text in a temporary file. Returns 0 in case of success*/
   int createTextFile( QString filePath, const QString& text );
+  /**Returns the integer value of an environment variable or defaultValue if it is not set or not a number*/
+  int environmentValue( const char* name, int defaultValue );
 }
 
 #endif
@@ -32,6 +32,7 @@
 #include "qgsvectorlayer.h"
 #include "qgslogger.h"
 #include "qgsmapserviceexception.h"
+#include "qgsmstiming.h"
 #include "qgssldparser.h"
 #include "qgssymbol.h"
 #include "qgssymbolv2.h"
@@ -43,6 +44,7 @@
 #include <QPainter>
 #include <QStringList>
 #include <QTextStream>
+#include <QTime>
 #include <QDir>
 
 //for printing
@@ -162,6 +164,10 @@ QDomDocument QgsWMSServer::getCapabilities()
   QDomText pngFormatText = doc.createTextNode( "image/png" );
   pngFormatElement.appendChild( pngFormatText );
   getMapElement.appendChild( pngFormatElement );
+  QDomElement png8FormatElement = doc.createElement( "Format"/*wms:Format*/ );
+  QDomText png8FormatText = doc.createTextNode( "image/png; mode=8bit" );
+  png8FormatElement.appendChild( png8FormatText );
+  getMapElement.appendChild( png8FormatElement );
   QDomElement getMapDhcTypeElement = dcpTypeElement.cloneNode().toElement();//this is the same as for 'GetCapabilities'
   getMapElement.appendChild( getMapDhcTypeElement );
 
@@ -488,10 +494,42 @@ QImage* QgsWMSServer::getMap()
   mMapRenderer->render( &thePainter );
   restoreLayerFilters( originalLayerFilters );
 
+  if ( QgsMSTiming::instance()->isEnabled() )
+  {
+    addRenderTimes();
+  }
+
   QgsMapLayerRegistry::instance()->mapLayers().clear();
   return theImage;
 }
 
+void QgsWMSServer::addRenderTimes() const
+{
+  QgsMSTiming* timing = QgsMSTiming::instance();
+
+  const QList< QPair<QString, int> >& layerTimes = mMapRenderer->layerRenderTimes();
+  QList< QPair<QString, int> >::const_iterator layerIt = layerTimes.constBegin();
+  for ( ; layerIt != layerTimes.constEnd(); ++layerIt )
+  {
+    QgsMapLayer* layer = QgsMapLayerRegistry::instance()->mapLayer( layerIt->first );
+    timing->addPhaseTime( "draw:" + ( layer ? layer->name() : layerIt->first ), layerIt->second );
+  }
+
+  QgsPalLabeling* labeling = dynamic_cast<QgsPalLabeling*>( mMapRenderer->labelingEngine() );
+  if ( labeling )
+  {
+    int extractTime, solveTime, drawTime;
+    labeling->labelingTimes( extractTime, solveTime, drawTime );
+    timing->addPhaseTime( "labeling:extract", extractTime );
+    timing->addPhaseTime( "labeling:solve", solveTime );
+    timing->addPhaseTime( "labeling:draw", drawTime );
+  }
+  else
+  {
+    timing->addPhaseTime( "labeling", mMapRenderer->labelingRenderTime() );
+  }
+}
+
 int QgsWMSServer::getFeatureInfo( QDomDocument& result )
 {
   if ( !mMapRenderer || !mConfigParser )
@@ -746,7 +784,10 @@ QImage* QgsWMSServer::initializeRendering( QStringList& layersList, QStringList&
   {
     QgsDebugMsg( myLayer );
   }
+  QTime layerTime;
+  layerTime.start();
   layerIdList = layerSet( layersList, stylesList, mMapRenderer->destinationCrs() );
+  QgsMSTiming::instance()->addPhaseTime( "layers", layerTime.elapsed() );
 #ifdef QGISDEBUG
   QgsDebugMsg( QString( "Number of layers to be rendered. %1" ).arg( layerIdList.count() ) );
 #endif
@@ -1082,24 +1123,70 @@ int QgsWMSServer::featureInfoFromVectorLayer( QgsVectorLayer* layer,
 
   QgsFeature feature;
   QgsAttributeMap featureAttributes;
-  int featureCounter = 0;
   const QgsFieldMap& fields = provider->fields();
   bool addWktGeometry = mConfigParser && mConfigParser->featureInfoWithWktGeometry();
 
-  provider->select( provider->attributeIndexes(), searchRect, addWktGeometry, true );
+  //fetch only the published attributes
+  QgsAttributeList attributeIndexes;
+  for ( QgsFieldMap::const_iterator fieldIt = fields.constBegin(); fieldIt != fields.constEnd(); ++fieldIt )
+  {
+    if ( !hiddenAttributes.contains( fieldIt->name() ) )
+    {
+      attributeIndexes.append( fieldIt.key() );
+    }
+  }
+
+  //the provider does the bounding box search (using its spatial index). The candidates are tested
+  //against the search radius around the info point and the nearest nFeatures are kept, nearest first
+  int maxFeatures = qMax( nFeatures, 1 );
+  QgsGeometry* infoGeometry = QgsGeometry::fromPoint( infoPoint );
+  QList<double> hitDistances;
+  QList<QgsFeature> hits;
+
+  provider->select( attributeIndexes, searchRect, true, false );
   while ( provider->nextFeature( feature ) )
   {
-    if ( featureCounter > nFeatures )
+    QgsGeometry* geom = feature.geometry();
+    if ( !geom )
     {
-      break;
+      continue;
+    }
+
+    double distance = geom->distance( *infoGeometry );
+    if ( distance < 0 || distance > searchRadius )
+    {
+      continue;
+    }
+    if ( hits.size() >= maxFeatures && distance >= hitDistances.last() )
+    {
+      continue;
     }
 
+    int insertPos = 0;
+    while ( insertPos < hitDistances.size() && hitDistances.at( insertPos ) <= distance )
+    {
+      ++insertPos;
+    }
+    hitDistances.insert( insertPos, distance );
+    hits.insert( insertPos, feature );
+    if ( hits.size() > maxFeatures )
+    {
+      hitDistances.removeLast();
+      hits.removeLast();
+    }
+  }
+  delete infoGeometry;
+
+  QList<QgsFeature>::iterator hitIt = hits.begin();
+  for ( ; hitIt != hits.end(); ++hitIt )
+  {
+    QgsFeature& hit = *hitIt;
     QDomElement featureElement = infoDocument.createElement( "Feature" );
-    featureElement.setAttribute( "id", QString::number( feature.id() ) );
+    featureElement.setAttribute( "id", QString::number( hit.id() ) );
     layerElement.appendChild( featureElement );
 
     //read all attribute values from the feature
-    featureAttributes = feature.attributeMap();
+    featureAttributes = hit.attributeMap();
     for ( QgsAttributeMap::const_iterator it = featureAttributes.begin(); it != featureAttributes.end(); ++it )
     {
 
@@ -1126,7 +1213,7 @@ int QgsWMSServer::featureInfoFromVectorLayer( QgsVectorLayer* layer,
     //also append the wkt geometry as an attribute
     if ( addWktGeometry )
     {
-      QgsGeometry* geom = feature.geometry();
+      QgsGeometry* geom = hit.geometry();
       if ( geom )
       {
         QDomElement geometryElement = infoDocument.createElement( "Attribute" );
@@ -146,6 +146,8 @@ class QgsWMSServer
     /**Tests if a filter sql string is allowed (safe)
       @return true in case of success, false if string seems unsafe*/
     bool testFilterStringSafety( const QString& filter ) const;
+    /**Passes the draw times of the layers and the labeling times of the last render to the request timing*/
+    void addRenderTimes() const;
 
     /**Map containing the WMS parameters*/
     std::map<QString, QString> mParameterMap;
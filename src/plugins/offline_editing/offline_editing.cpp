@@ -33,6 +33,7 @@
 #include <QDomNode>
 #include <QFile>
 #include <QMessageBox>
+#include <QSet>
 
 extern "C"
 {
@@ -50,6 +51,9 @@ extern "C"
 #define PROJECT_ENTRY_SCOPE_OFFLINE "OfflineEditingPlugin"
 #define PROJECT_ENTRY_KEY_OFFLINE_DB_PATH "/OfflineDbPath"
 
+// number of features copied per provider transaction
+#define OFFLINE_BATCH_SIZE 10000
+
 QgsOfflineEditing::QgsOfflineEditing( QgsOfflineEditingProgressDialog* progressDialog )
 {
   mProgressDialog = progressDialog;
@@ -191,25 +195,27 @@ void QgsOfflineEditing::synchronize( QgsLegendInterface* legendInterface )
       {
         remoteLayer->startEditing();
 
-        // TODO: only get commitNos of this layer?
-        int commitNo = getCommitNo( db );
-        for ( int i = 0; i < commitNo; i++ )
-        {
-          // apply commits chronologically
-          applyAttributesAdded( remoteLayer, db, layerId, i );
-          applyAttributeValueChanges( offlineLayer, remoteLayer, db, layerId, i );
-          applyGeometryChanges( remoteLayer, db, layerId, i );
-        }
+        // load fid lookup once, instead of querying it for every logged change
+        QMap<int, int> fidLookup = remoteFidLookup( db, layerId );
+
+        // apply changes grouped by type, each group in commit order
+        // NOTE: added attributes only append columns, so adding all of them before replaying
+        //       the attribute value and geometry changes yields the same result as replaying
+        //       the commits one after another
+        applyAttributesAdded( remoteLayer, db, layerId );
+        applyAttributeValueChanges( offlineLayer, remoteLayer, db, layerId, fidLookup );
+        applyGeometryChanges( remoteLayer, db, layerId, fidLookup );
 
         applyFeaturesAdded( offlineLayer, remoteLayer, db, layerId );
-        applyFeaturesRemoved( remoteLayer, db, layerId );
+        applyFeaturesRemoved( remoteLayer, db, layerId, fidLookup );
 
         if ( remoteLayer->commitChanges() )
         {
           // update fid lookup
-          updateFidLookup( remoteLayer, db, layerId );
+          updateFidLookup( remoteLayer, db, layerId, fidLookup );
 
           // clear edit log for this layer
+          sqlExec( db, "BEGIN" );
           sql = QString( "DELETE FROM 'log_added_attrs' WHERE \"layer_id\" = %1" ).arg( layerId );
           sqlExec( db, sql );
           sql = QString( "DELETE FROM 'log_added_features' WHERE \"layer_id\" = %1" ).arg( layerId );
@@ -224,6 +230,7 @@ void QgsOfflineEditing::synchronize( QgsLegendInterface* legendInterface )
           // reset commitNo
           QString sql = QString( "UPDATE 'log_indices' SET 'last_index' = 0 WHERE \"name\" = 'commit_no'" );
           sqlExec( db, sql );
+          sqlExec( db, "COMMIT" );
         }
         else
         {
@@ -505,7 +512,10 @@ void QgsOfflineEditing::copyVectorLayer( QgsVectorLayer* layer, sqlite3* db, con
       // TODO: layer order
 
       // copy features
-      newLayer->startEditing();
+      // NOTE: features are written in batches directly through the provider, which inserts each batch
+      //       in a single transaction with a prepared statement. This bypasses the edit buffer of
+      //       newLayer, so the copied features are neither held in memory nor logged as added features.
+      QgsVectorDataProvider* newProvider = newLayer->dataProvider();
       QgsFeature f;
 
       // NOTE: force feature recount for PostGIS layer, else only visible features are counted, before iterating over all features (WORKAROUND)
@@ -517,6 +527,8 @@ void QgsOfflineEditing::copyVectorLayer( QgsVectorLayer* layer, sqlite3* db, con
       int featureCount = 1;
 
       QList<int> remoteFeatureIds;
+      QgsFeatureList batch;
+      bool copyOk = true;
       while ( layer->nextFeature( f ) )
       {
         remoteFeatureIds << f.id();
@@ -525,21 +537,35 @@ void QgsOfflineEditing::copyVectorLayer( QgsVectorLayer* layer, sqlite3* db, con
         // fill gap in QgsAttributeMap if geometry column is not last (WORKAROUND)
         int column = 0;
         QgsAttributeMap newAttrMap;
-        QgsAttributeMap attrMap = f.attributeMap();
+        const QgsAttributeMap& attrMap = f.attributeMap();
         for ( QgsAttributeMap::const_iterator it = attrMap.begin(); it != attrMap.end(); ++it )
         {
           newAttrMap.insert( column++, it.value() );
         }
         f.setAttributeMap( newAttrMap );
 
-        newLayer->addFeature( f, false );
+        batch << f;
+        if ( batch.size() >= OFFLINE_BATCH_SIZE )
+        {
+          // the remaining batches are written also after a failure
+          bool ok = newProvider->addFeatures( batch );
+          copyOk = copyOk && ok;
+          batch.clear();
+        }
 
         mProgressDialog->setProgressValue( featureCount++ );
       }
-      if ( newLayer->commitChanges() )
+      if ( !batch.isEmpty() )
+      {
+        bool ok = newProvider->addFeatures( batch );
+        copyOk = copyOk && ok;
+        batch.clear();
+      }
+      newLayer->updateExtents();
+
+      if ( copyOk )
       {
-        mProgressDialog->setupProgressBar( tr( "%v / %m features processed" ), layer->featureCount() );
-        featureCount = 1;
+        mProgressDialog->setupProgressBar( tr( "%v / %m features processed" ), remoteFeatureIds.size() );
 
         // update feature id lookup
         int layerId = getOrCreateLayerId( db, newLayer->id() );
@@ -550,19 +576,12 @@ void QgsOfflineEditing::copyVectorLayer( QgsVectorLayer* layer, sqlite3* db, con
           offlineFeatureIds << f.id();
         }
 
-        // NOTE: insert fids in this loop, as the db is locked during newLayer->nextFeature()
-        sqlExec( db, "BEGIN" );
-        for ( int i = 0; i < remoteFeatureIds.size(); i++ )
-        {
-          addFidLookup( db, layerId, offlineFeatureIds.at( i ), remoteFeatureIds.at( i ) );
-
-          mProgressDialog->setProgressValue( featureCount++ );
-        }
-        sqlExec( db, "COMMIT" );
+        // NOTE: insert fids after reading, as the db is locked during newLayer->nextFeature()
+        addFidLookups( db, layerId, offlineFeatureIds, remoteFeatureIds );
       }
       else
       {
-        showWarning( newLayer->commitErrors().join( "\n" ) );
+        showWarning( tr( "Could not copy all features of layer '%1' to the offline database" ).arg( layer->name() ) );
       }
 
       // remove remote layer
@@ -571,9 +590,9 @@ void QgsOfflineEditing::copyVectorLayer( QgsVectorLayer* layer, sqlite3* db, con
   }
 }
 
-void QgsOfflineEditing::applyAttributesAdded( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId, int commitNo )
+void QgsOfflineEditing::applyAttributesAdded( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId )
 {
-  QString sql = QString( "SELECT \"name\", \"type\", \"length\", \"precision\", \"comment\" FROM 'log_added_attrs' WHERE \"layer_id\" = %1 AND \"commit_no\" = %2" ).arg( layerId ).arg( commitNo );
+  QString sql = QString( "SELECT \"name\", \"type\", \"length\", \"precision\", \"comment\" FROM 'log_added_attrs' WHERE \"layer_id\" = %1 ORDER BY \"commit_no\"" ).arg( layerId );
   QList<QgsField> fields = sqlQueryAttributesAdded( db, sql );
 
   const QgsVectorDataProvider* provider = remoteLayer->dataProvider();
@@ -612,31 +631,53 @@ void QgsOfflineEditing::applyFeaturesAdded( QgsVectorLayer* offlineLayer, QgsVec
 {
   QString sql = QString( "SELECT \"fid\" FROM 'log_added_features' WHERE \"layer_id\" = %1" ).arg( layerId );
   QList<int> newFeatureIds = sqlQueryInts( db, sql );
+  if ( newFeatureIds.isEmpty() )
+  {
+    return;
+  }
 
   // get new features from offline layer
+  // NOTE: for many added features a single scan of the offline layer is far cheaper than one query per feature
   QgsFeatureList features;
-  for ( int i = 0; i < newFeatureIds.size(); i++ )
+  if ( newFeatureIds.size() < OFFLINE_BATCH_SIZE )
   {
+    for ( int i = 0; i < newFeatureIds.size(); i++ )
+    {
+      QgsFeature feature;
+      if ( offlineLayer->featureAtId( newFeatureIds.at( i ), feature, true, true ) )
+      {
+        features << feature;
+      }
+    }
+  }
+  else
+  {
+    QSet<int> newFeatureIdSet = newFeatureIds.toSet();
     QgsFeature feature;
-    if ( offlineLayer->featureAtId( newFeatureIds.at( i ), feature, true, true ) )
+    offlineLayer->select( offlineLayer->pendingAllAttributesList(), QgsRectangle(), true, false );
+    while ( offlineLayer->nextFeature( feature ) )
     {
-      features << feature;
+      if ( newFeatureIdSet.contains( feature.id() ) )
+      {
+        features << feature;
+      }
     }
   }
 
   // copy features to remote layer
   mProgressDialog->setupProgressBar( tr( "%v / %m features added" ), features.size() );
 
+  // NOTE: Spatialite provider ignores position of geometry column
+  // restore gap in QgsAttributeMap if geometry column is not last (WORKAROUND)
+  QMap<int, int> attrLookup = attributeLookup( offlineLayer, remoteLayer );
+
   int i = 1;
   for ( QgsFeatureList::iterator it = features.begin(); it != features.end(); ++it )
   {
-    QgsFeature f = *it;
+    QgsFeature& f = *it;
 
-    // NOTE: Spatialite provider ignores position of geometry column
-    // restore gap in QgsAttributeMap if geometry column is not last (WORKAROUND)
-    QMap<int, int> attrLookup = attributeLookup( offlineLayer, remoteLayer );
     QgsAttributeMap newAttrMap;
-    QgsAttributeMap attrMap = f.attributeMap();
+    const QgsAttributeMap& attrMap = f.attributeMap();
     for ( QgsAttributeMap::const_iterator it = attrMap.begin(); it != attrMap.end(); ++it )
     {
       newAttrMap.insert( attrLookup[ it.key()], it.value() );
@@ -649,7 +690,7 @@ void QgsOfflineEditing::applyFeaturesAdded( QgsVectorLayer* offlineLayer, QgsVec
   }
 }
 
-void QgsOfflineEditing::applyFeaturesRemoved( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId )
+void QgsOfflineEditing::applyFeaturesRemoved( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId, const QMap<int, int>& fidLookup )
 {
   QString sql = QString( "SELECT \"fid\" FROM 'log_removed_features' WHERE \"layer_id\" = %1" ).arg( layerId );
   QgsFeatureIds values = sqlQueryFeaturesRemoved( db, sql );
@@ -659,16 +700,17 @@ void QgsOfflineEditing::applyFeaturesRemoved( QgsVectorLayer* remoteLayer, sqlit
   int i = 1;
   for ( QgsFeatureIds::const_iterator it = values.begin(); it != values.end(); ++it )
   {
-    int fid = remoteFid( db, layerId, *it );
+    int fid = fidLookup.value( *it, -1 );
     remoteLayer->deleteFeature( fid );
 
     mProgressDialog->setProgressValue( i++ );
   }
 }
 
-void QgsOfflineEditing::applyAttributeValueChanges( QgsVectorLayer* offlineLayer, QgsVectorLayer* remoteLayer, sqlite3* db, int layerId, int commitNo )
+void QgsOfflineEditing::applyAttributeValueChanges( QgsVectorLayer* offlineLayer, QgsVectorLayer* remoteLayer, sqlite3* db, int layerId, const QMap<int, int>& fidLookup )
 {
-  QString sql = QString( "SELECT \"fid\", \"attr\", \"value\" FROM 'log_feature_updates' WHERE \"layer_id\" = %1 AND \"commit_no\" = %2 " ).arg( layerId ).arg( commitNo );
+  // NOTE: ROWID keeps the insertion order of the changes within a commit
+  QString sql = QString( "SELECT \"fid\", \"attr\", \"value\" FROM 'log_feature_updates' WHERE \"layer_id\" = %1 ORDER BY \"commit_no\", ROWID" ).arg( layerId );
   AttributeValueChanges values = sqlQueryAttributeValueChanges( db, sql );
 
   mProgressDialog->setupProgressBar( tr( "%v / %m feature updates" ), values.size() );
@@ -677,7 +719,7 @@ void QgsOfflineEditing::applyAttributeValueChanges( QgsVectorLayer* offlineLayer
 
   for ( int i = 0; i < values.size(); i++ )
   {
-    int fid = remoteFid( db, layerId, values.at( i ).fid );
+    int fid = fidLookup.value( values.at( i ).fid, -1 );
 
     remoteLayer->changeAttributeValue( fid, attrLookup[ values.at( i ).attr ], values.at( i ).value, false );
 
@@ -685,26 +727,33 @@ void QgsOfflineEditing::applyAttributeValueChanges( QgsVectorLayer* offlineLayer
   }
 }
 
-void QgsOfflineEditing::applyGeometryChanges( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId, int commitNo )
+void QgsOfflineEditing::applyGeometryChanges( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId, const QMap<int, int>& fidLookup )
 {
-  QString sql = QString( "SELECT \"fid\", \"geom_wkt\" FROM 'log_geometry_updates' WHERE \"layer_id\" = %1 AND \"commit_no\" = %2" ).arg( layerId ).arg( commitNo );
+  QString sql = QString( "SELECT \"fid\", \"geom_wkt\" FROM 'log_geometry_updates' WHERE \"layer_id\" = %1 ORDER BY \"commit_no\", ROWID" ).arg( layerId );
   GeometryChanges values = sqlQueryGeometryChanges( db, sql );
 
   mProgressDialog->setupProgressBar( tr( "%v / %m feature geometry updates" ), values.size() );
 
   for ( int i = 0; i < values.size(); i++ )
   {
-    int fid = remoteFid( db, layerId, values.at( i ).fid );
+    int fid = fidLookup.value( values.at( i ).fid, -1 );
     remoteLayer->changeGeometry( fid, QgsGeometry::fromWkt( values.at( i ).geom_wkt ) );
 
     mProgressDialog->setProgressValue( i + 1 );
   }
 }
 
-void QgsOfflineEditing::updateFidLookup( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId )
+void QgsOfflineEditing::updateFidLookup( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId, const QMap<int, int>& fidLookup )
 {
   // update fid lookup for added features
 
+  // remote fids already known before the sync
+  QSet<int> knownRemoteFids;
+  for ( QMap<int, int>::const_iterator it = fidLookup.begin(); it != fidLookup.end(); ++it )
+  {
+    knownRemoteFids.insert( it.value() );
+  }
+
   // get remote added fids
   // NOTE: use QMap for sorted fids
   QMap < int, bool /*dummy*/ > newRemoteFids;
@@ -716,7 +765,7 @@ void QgsOfflineEditing::updateFidLookup( QgsVectorLayer* remoteLayer, sqlite3* d
   int i = 1;
   while ( remoteLayer->nextFeature( f ) )
   {
-    if ( offlineFid( db, layerId, f.id() ) == -1 )
+    if ( !knownRemoteFids.contains( f.id() ) )
     {
       newRemoteFids[ f.id()] = true;
     }
@@ -736,13 +785,7 @@ void QgsOfflineEditing::updateFidLookup( QgsVectorLayer* remoteLayer, sqlite3* d
   else
   {
     // add new fid lookups
-    i = 0;
-    sqlExec( db, "BEGIN" );
-    for ( QMap<int, bool>::const_iterator it = newRemoteFids.begin(); it != newRemoteFids.end(); ++it )
-    {
-      addFidLookup( db, layerId, newOfflineFids.at( i++ ), it.key() );
-    }
-    sqlExec( db, "COMMIT" );
+    addFidLookups( db, layerId, newOfflineFids, newRemoteFids.keys() );
   }
 }
 
@@ -839,28 +882,63 @@ void QgsOfflineEditing::increaseCommitNo( sqlite3* db )
   sqlExec( db, sql );
 }
 
-void QgsOfflineEditing::addFidLookup( sqlite3* db, int layerId, int offlineFid, int remoteFid )
+void QgsOfflineEditing::addFidLookups( sqlite3* db, int layerId, const QList<int>& offlineFids, const QList<int>& remoteFids )
 {
-  QString sql = QString( "INSERT INTO 'log_fids' VALUES ( %1, %2, %3 )" ).arg( layerId ).arg( offlineFid ).arg( remoteFid );
-  sqlExec( db, sql );
-}
+  sqlite3_stmt* stmt = NULL;
+  if ( sqlite3_prepare_v2( db, "INSERT INTO 'log_fids' VALUES ( ?, ?, ? )", -1, &stmt, NULL ) != SQLITE_OK )
+  {
+    showWarning( sqlite3_errmsg( db ) );
+    return;
+  }
 
-int QgsOfflineEditing::remoteFid( sqlite3* db, int layerId, int offlineFid )
-{
-  QString sql = QString( "SELECT \"remote_fid\" FROM 'log_fids' WHERE \"layer_id\" = %1 AND \"offline_fid\" = %2" ).arg( layerId ).arg( offlineFid );
-  return sqlQueryInt( db, sql, -1 );
+  sqlExec( db, "BEGIN" );
+  int count = qMin( offlineFids.size(), remoteFids.size() );
+  for ( int i = 0; i < count; i++ )
+  {
+    sqlite3_reset( stmt );
+    sqlite3_bind_int( stmt, 1, layerId );
+    sqlite3_bind_int( stmt, 2, offlineFids.at( i ) );
+    sqlite3_bind_int( stmt, 3, remoteFids.at( i ) );
+    if ( sqlite3_step( stmt ) != SQLITE_DONE )
+    {
+      showWarning( sqlite3_errmsg( db ) );
+      break;
+    }
+
+    mProgressDialog->setProgressValue( i + 1 );
+  }
+  sqlite3_finalize( stmt );
+  sqlExec( db, "COMMIT" );
 }
 
-int QgsOfflineEditing::offlineFid( sqlite3* db, int layerId, int remoteFid )
+QMap<int, int> QgsOfflineEditing::remoteFidLookup( sqlite3* db, int layerId )
 {
-  QString sql = QString( "SELECT \"offline_fid\" FROM 'log_fids' WHERE \"layer_id\" = %1 AND \"remote_fid\" = %2" ).arg( layerId ).arg( remoteFid );
-  return sqlQueryInt( db, sql, -1 );
+  QMap < int /*offline fid*/, int /*remote fid*/ > lookup;
+
+  QString sql = QString( "SELECT \"offline_fid\", \"remote_fid\" FROM 'log_fids' WHERE \"layer_id\" = %1" ).arg( layerId );
+  sqlite3_stmt* stmt = NULL;
+  if ( sqlite3_prepare_v2( db, sql.toUtf8().constData(), -1, &stmt, NULL ) != SQLITE_OK )
+  {
+    showWarning( sqlite3_errmsg( db ) );
+    return lookup;
+  }
+
+  int ret = sqlite3_step( stmt );
+  while ( ret == SQLITE_ROW )
+  {
+    lookup.insert( sqlite3_column_int( stmt, 0 ), sqlite3_column_int( stmt, 1 ) );
+
+    ret = sqlite3_step( stmt );
+  }
+  sqlite3_finalize( stmt );
+
+  return lookup;
 }
 
-bool QgsOfflineEditing::isAddedFeature( sqlite3* db, int layerId, int fid )
+QSet<int> QgsOfflineEditing::addedFeatureIds( sqlite3* db, int layerId )
 {
-  QString sql = QString( "SELECT COUNT(\"fid\") FROM 'log_added_features' WHERE \"layer_id\" = %1 AND \"fid\" = %2" ).arg( layerId ).arg( fid );
-  return ( sqlQueryInt( db, sql, 0 ) > 0 );
+  QString sql = QString( "SELECT \"fid\" FROM 'log_added_features' WHERE \"layer_id\" = %1" ).arg( layerId );
+  return sqlQueryInts( db, sql ).toSet();
 }
 
 int QgsOfflineEditing::sqlExec( sqlite3* db, const QString& sql )
@@ -1053,21 +1131,35 @@ void QgsOfflineEditing::committedAttributesAdded( const QString& qgisLayerId, co
   int layerId = getOrCreateLayerId( db, qgisLayerId );
   int commitNo = getCommitNo( db );
 
+  sqlite3_stmt* stmt = NULL;
+  if ( sqlite3_prepare_v2( db, "INSERT INTO 'log_added_attrs' VALUES ( ?, ?, ?, ?, ?, ?, ? )", -1, &stmt, NULL ) != SQLITE_OK )
+  {
+    showWarning( sqlite3_errmsg( db ) );
+    sqlite3_close( db );
+    return;
+  }
+
+  sqlExec( db, "BEGIN" );
   for ( QList<QgsField>::const_iterator it = addedAttributes.begin(); it != addedAttributes.end(); ++it )
   {
-    QgsField field = *it;
-    QString sql = QString( "INSERT INTO 'log_added_attrs' VALUES ( %1, %2, '%3', %4, %5, %6, '%7' )" )
-                  .arg( layerId )
-                  .arg( commitNo )
-                  .arg( field.name() )
-                  .arg( field.type() )
-                  .arg( field.length() )
-                  .arg( field.precision() )
-                  .arg( field.comment() );
-    sqlExec( db, sql );
+    const QgsField& field = *it;
+    QByteArray name = field.name().toUtf8();
+    QByteArray comment = field.comment().toUtf8();
+
+    sqlite3_reset( stmt );
+    sqlite3_bind_int( stmt, 1, layerId );
+    sqlite3_bind_int( stmt, 2, commitNo );
+    sqlite3_bind_text( stmt, 3, name.constData(), name.size(), SQLITE_TRANSIENT );
+    sqlite3_bind_int( stmt, 4, field.type() );
+    sqlite3_bind_int( stmt, 5, field.length() );
+    sqlite3_bind_int( stmt, 6, field.precision() );
+    sqlite3_bind_text( stmt, 7, comment.constData(), comment.size(), SQLITE_TRANSIENT );
+    sqlite3_step( stmt );
   }
+  sqlite3_finalize( stmt );
 
   increaseCommitNo( db );
+  sqlExec( db, "COMMIT" );
   sqlite3_close( db );
 }
 
@@ -1089,13 +1181,25 @@ void QgsOfflineEditing::committedFeaturesAdded( const QString& qgisLayerId, cons
   // only store feature ids
   QString sql = QString( "SELECT ROWID FROM '%1' ORDER BY ROWID DESC LIMIT %2" ).arg( uri.table() ).arg( addedFeatures.size() );
   QList<int> newFeatureIds = sqlQueryInts( db, sql );
+
+  sqlite3_stmt* stmt = NULL;
+  if ( sqlite3_prepare_v2( db, "INSERT INTO 'log_added_features' VALUES ( ?, ? )", -1, &stmt, NULL ) != SQLITE_OK )
+  {
+    showWarning( sqlite3_errmsg( db ) );
+    sqlite3_close( db );
+    return;
+  }
+
+  sqlExec( db, "BEGIN" );
   for ( int i = newFeatureIds.size() - 1; i >= 0; i-- )
   {
-    QString sql = QString( "INSERT INTO 'log_added_features' VALUES ( %1, %2 )" )
-                  .arg( layerId )
-                  .arg( newFeatureIds.at( i ) );
-    sqlExec( db, sql );
+    sqlite3_reset( stmt );
+    sqlite3_bind_int( stmt, 1, layerId );
+    sqlite3_bind_int( stmt, 2, newFeatureIds.at( i ) );
+    sqlite3_step( stmt );
   }
+  sqlite3_finalize( stmt );
+  sqlExec( db, "COMMIT" );
 
   sqlite3_close( db );
 }
@@ -1110,23 +1214,33 @@ void QgsOfflineEditing::committedFeaturesRemoved( const QString& qgisLayerId, co
 
   // insert log
   int layerId = getOrCreateLayerId( db, qgisLayerId );
+  QSet<int> addedFids = addedFeatureIds( db, layerId );
 
+  sqlite3_stmt* removeAddedStmt = NULL;
+  sqlite3_stmt* insertStmt = NULL;
+  if ( sqlite3_prepare_v2( db, "DELETE FROM 'log_added_features' WHERE \"layer_id\" = ? AND \"fid\" = ?", -1, &removeAddedStmt, NULL ) != SQLITE_OK ||
+       sqlite3_prepare_v2( db, "INSERT INTO 'log_removed_features' VALUES ( ?, ? )", -1, &insertStmt, NULL ) != SQLITE_OK )
+  {
+    showWarning( sqlite3_errmsg( db ) );
+    sqlite3_finalize( removeAddedStmt );
+    sqlite3_finalize( insertStmt );
+    sqlite3_close( db );
+    return;
+  }
+
+  sqlExec( db, "BEGIN" );
   for ( QgsFeatureIds::const_iterator it = deletedFeatureIds.begin(); it != deletedFeatureIds.end(); ++it )
   {
-    if ( isAddedFeature( db, layerId, *it ) )
-    {
-      // remove from added features log
-      QString sql = QString( "DELETE FROM 'log_added_features' WHERE \"layer_id\" = %1 AND \"fid\" = %2" ).arg( layerId ).arg( *it );
-      sqlExec( db, sql );
-    }
-    else
-    {
-      QString sql = QString( "INSERT INTO 'log_removed_features' VALUES ( %1, %2)" )
-                    .arg( layerId )
-                    .arg( *it );
-      sqlExec( db, sql );
-    }
+    // remove from added features log or log as removed feature
+    sqlite3_stmt* stmt = addedFids.contains( *it ) ? removeAddedStmt : insertStmt;
+    sqlite3_reset( stmt );
+    sqlite3_bind_int( stmt, 1, layerId );
+    sqlite3_bind_int( stmt, 2, *it );
+    sqlite3_step( stmt );
   }
+  sqlite3_finalize( removeAddedStmt );
+  sqlite3_finalize( insertStmt );
+  sqlExec( db, "COMMIT" );
 
   sqlite3_close( db );
 }
@@ -1142,29 +1256,43 @@ void QgsOfflineEditing::committedAttributeValuesChanges( const QString& qgisLaye
   // insert log
   int layerId = getOrCreateLayerId( db, qgisLayerId );
   int commitNo = getCommitNo( db );
+  QSet<int> addedFids = addedFeatureIds( db, layerId );
 
+  sqlite3_stmt* stmt = NULL;
+  if ( sqlite3_prepare_v2( db, "INSERT INTO 'log_feature_updates' VALUES ( ?, ?, ?, ?, ? )", -1, &stmt, NULL ) != SQLITE_OK )
+  {
+    showWarning( sqlite3_errmsg( db ) );
+    sqlite3_close( db );
+    return;
+  }
+
+  sqlExec( db, "BEGIN" );
   for ( QgsChangedAttributesMap::const_iterator cit = changedAttrsMap.begin(); cit != changedAttrsMap.end(); ++cit )
   {
     int fid = cit.key();
-    if ( isAddedFeature( db, layerId, fid ) )
+    if ( addedFids.contains( fid ) )
     {
       // skip added features
       continue;
     }
-    QgsAttributeMap attrMap = cit.value();
+    const QgsAttributeMap& attrMap = cit.value();
     for ( QgsAttributeMap::const_iterator it = attrMap.begin(); it != attrMap.end(); ++it )
     {
-      QString sql = QString( "INSERT INTO 'log_feature_updates' VALUES ( %1, %2, %3, %4, '%5' )" )
-                    .arg( layerId )
-                    .arg( commitNo )
-                    .arg( fid )
-                    .arg( it.key() ) // attr
-                    .arg( it.value().toString() ); // value
-      sqlExec( db, sql );
+      QByteArray value = it.value().toString().toUtf8();
+
+      sqlite3_reset( stmt );
+      sqlite3_bind_int( stmt, 1, layerId );
+      sqlite3_bind_int( stmt, 2, commitNo );
+      sqlite3_bind_int( stmt, 3, fid );
+      sqlite3_bind_int( stmt, 4, it.key() ); // attr
+      sqlite3_bind_text( stmt, 5, value.constData(), value.size(), SQLITE_TRANSIENT ); // value
+      sqlite3_step( stmt );
     }
   }
+  sqlite3_finalize( stmt );
 
   increaseCommitNo( db );
+  sqlExec( db, "COMMIT" );
   sqlite3_close( db );
 }
 
@@ -1179,26 +1307,40 @@ void QgsOfflineEditing::committedGeometriesChanges( const QString& qgisLayerId,
   // insert log
   int layerId = getOrCreateLayerId( db, qgisLayerId );
   int commitNo = getCommitNo( db );
+  QSet<int> addedFids = addedFeatureIds( db, layerId );
 
+  sqlite3_stmt* stmt = NULL;
+  if ( sqlite3_prepare_v2( db, "INSERT INTO 'log_geometry_updates' VALUES ( ?, ?, ?, ? )", -1, &stmt, NULL ) != SQLITE_OK )
+  {
+    showWarning( sqlite3_errmsg( db ) );
+    sqlite3_close( db );
+    return;
+  }
+
+  sqlExec( db, "BEGIN" );
   for ( QgsGeometryMap::const_iterator it = changedGeometries.begin(); it != changedGeometries.end(); ++it )
   {
     int fid = it.key();
-    if ( isAddedFeature( db, layerId, fid ) )
+    if ( addedFids.contains( fid ) )
     {
       // skip added features
       continue;
     }
     QgsGeometry geom = it.value();
-    QString sql = QString( "INSERT INTO 'log_geometry_updates' VALUES ( %1, %2, %3, '%4' )" )
-                  .arg( layerId )
-                  .arg( commitNo )
-                  .arg( fid )
-                  .arg( geom.exportToWkt() );
-    sqlExec( db, sql );
+    QByteArray wkt = geom.exportToWkt().toUtf8();
+
+    sqlite3_reset( stmt );
+    sqlite3_bind_int( stmt, 1, layerId );
+    sqlite3_bind_int( stmt, 2, commitNo );
+    sqlite3_bind_int( stmt, 3, fid );
+    sqlite3_bind_text( stmt, 4, wkt.constData(), wkt.size(), SQLITE_TRANSIENT );
+    sqlite3_step( stmt );
 
     // TODO: use WKB instead of WKT?
   }
+  sqlite3_finalize( stmt );
 
   increaseCommitNo( db );
+  sqlExec( db, "COMMIT" );
   sqlite3_close( db );
 }
@@ -23,6 +23,7 @@
 #include <qgsvectorlayer.h>
 
 #include <QObject>
+#include <QSet>
 #include <QString>
 
 class QgsLegendInterface;
@@ -49,12 +50,12 @@ class QgsOfflineEditing : public QObject
     void createLoggingTables( sqlite3* db );
     void copyVectorLayer( QgsVectorLayer* layer, sqlite3* db, const QString& offlineDbPath );
 
-    void applyAttributesAdded( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId, int commitNo );
+    void applyAttributesAdded( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId );
     void applyFeaturesAdded( QgsVectorLayer* offlineLayer, QgsVectorLayer* remoteLayer, sqlite3* db, int layerId );
-    void applyFeaturesRemoved( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId );
-    void applyAttributeValueChanges( QgsVectorLayer* offlineLayer, QgsVectorLayer* remoteLayer, sqlite3* db, int layerId, int commitNo );
-    void applyGeometryChanges( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId, int commitNo );
-    void updateFidLookup( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId );
+    void applyFeaturesRemoved( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId, const QMap<int, int>& fidLookup );
+    void applyAttributeValueChanges( QgsVectorLayer* offlineLayer, QgsVectorLayer* remoteLayer, sqlite3* db, int layerId, const QMap<int, int>& fidLookup );
+    void applyGeometryChanges( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId, const QMap<int, int>& fidLookup );
+    void updateFidLookup( QgsVectorLayer* remoteLayer, sqlite3* db, int layerId, const QMap<int, int>& fidLookup );
     void copySymbology( const QgsVectorLayer* sourceLayer, QgsVectorLayer* targetLayer );
     QMap<int, int> attributeLookup( QgsVectorLayer* offlineLayer, QgsVectorLayer* remoteLayer );
 
@@ -64,10 +65,11 @@ class QgsOfflineEditing : public QObject
     int getOrCreateLayerId( sqlite3* db, const QString& qgisLayerId );
     int getCommitNo( sqlite3* db );
     void increaseCommitNo( sqlite3* db );
-    void addFidLookup( sqlite3* db, int layerId, int offlineFid, int remoteFid );
-    int remoteFid( sqlite3* db, int layerId, int offlineFid );
-    int offlineFid( sqlite3* db, int layerId, int remoteFid );
-    bool isAddedFeature( sqlite3* db, int layerId, int fid );
+    /** insert fid pairs into the lookup table in one transaction */
+    void addFidLookups( sqlite3* db, int layerId, const QList<int>& offlineFids, const QList<int>& remoteFids );
+    /** load the offline fid -> remote fid lookup of a layer */
+    QMap<int, int> remoteFidLookup( sqlite3* db, int layerId );
+    QSet<int> addedFeatureIds( sqlite3* db, int layerId );
 
     int sqlExec( sqlite3* db, const QString& sql );
     int sqlQueryInt( sqlite3* db, const QString& sql, int defaultValue );
@@ -16,23 +16,167 @@
  *                                                                         *
  ***************************************************************************/
 
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QFutureWatcher>
 #include <QMessageBox>
+#include <QThread>
+#include <QtConcurrentMap>
 
 #include "qgsvectordataprovider.h"
 #include "qgsfeature.h"
+#include "qgsgeoscontext.h"
 #include "qgsgeometrycoordinatetransform.h"
 #include "qgsspatialquery.h"
 
+// number of target features evaluated together (in parallel)
+#define QUERY_CHUNK_SIZE 512
+
+// Geometries shared by several worker threads must not be modified: GEOS computes the envelope
+// of a geometry lazily on first use. The envelope is computed by the job owning the geometry
+// (validation) before other jobs use it, prepared geometries are only used by the job creating them.
+
+struct QgsSpatialQuery::ReferenceFeature
+{
+  int id;
+  QgsGeometry *geometry;
+  // owned by geometry, converted in the main thread
+  const GEOSGeometry *geos;
+  bool valid;
+};
+
+struct QgsSpatialQuery::TargetFeature
+{
+  int id;
+  // transformed copy of the geometry (in the reference CRS)
+  QgsGeometry *geometry;
+  // owned by geometry, converted in the main thread
+  const GEOSGeometry *geos;
+  QList<const ReferenceFeature*> candidates;
+  int relation;
+  bool valid;
+  // a candidate fulfils the relation
+  bool found;
+  bool result;
+};
+
+struct QgsSpatialQuery::ReferenceJob
+{
+  const ReferenceFeature *reference;
+  int relation;
+  QList<TargetFeature*> targets;
+  // targets fulfilling the relation with the reference
+  QList<TargetFeature*> matches;
+};
+
+// Computes the cached envelope of a geometry, called by the job owning the geometry
+static void cacheEnvelope( const GEOSGeometry *geos )
+{
+#ifdef HAVE_GEOS_CONTEXT
+  GEOSContextHandle_t handle = QgsGeosContext::threadContext();
+  GEOSGeometry *envelope = GEOSEnvelope_r( handle, geos );
+  if ( envelope )
+  {
+    GEOSGeom_destroy_r( handle, envelope );
+  }
+#else
+  Q_UNUSED( geos );
+#endif
+}
+
+#ifdef HAVE_GEOS_CONTEXT
+// Relation of a target and a reference geometry, at most one of them is prepared
+static bool relationHolds( int relation,
+                           const GEOSGeometry *geosTarget, const GEOSPreparedGeometry *preparedTarget,
+                           const GEOSGeometry *geosReference, const GEOSPreparedGeometry *preparedReference )
+{
+  GEOSContextHandle_t handle = QgsGeosContext::threadContext();
+
+  // All relations (except disjoint) need the geometries to intersect, the prepared side answers quickly
+  bool intersects;
+  if ( preparedReference )
+  {
+    intersects = GEOSPreparedIntersects_r( handle, preparedReference, geosTarget ) == 1;
+  }
+  else if ( preparedTarget )
+  {
+    intersects = GEOSPreparedIntersects_r( handle, preparedTarget, geosReference ) == 1;
+  }
+  else
+  {
+    intersects = GEOSIntersects_r( handle, geosTarget, geosReference ) == 1;
+  }
+
+  if ( relation == Intersects || relation == Disjoint || !intersects )
+  {
+    return intersects;
+  }
+  if ( relation == Within && preparedReference )
+  {
+    return GEOSPreparedContains_r( handle, preparedReference, geosTarget ) == 1;
+  }
+  if ( relation == Contains && preparedTarget )
+  {
+    return GEOSPreparedContains_r( handle, preparedTarget, geosReference ) == 1;
+  }
+
+  switch ( relation )
+  {
+    case Equals:
+      return GEOSEquals_r( handle, geosTarget, geosReference ) == 1;
+    case Touches:
+      return GEOSTouches_r( handle, geosTarget, geosReference ) == 1;
+    case Overlaps:
+      return GEOSOverlaps_r( handle, geosTarget, geosReference ) == 1;
+    case Within:
+      return GEOSWithin_r( handle, geosTarget, geosReference ) == 1;
+    case Contains:
+      return GEOSContains_r( handle, geosTarget, geosReference ) == 1;
+    case Crosses:
+      return GEOSCrosses_r( handle, geosTarget, geosReference ) == 1;
+  }
+  return false;
+}
+#else
+// without the reentrant API the relations are evaluated in the main thread
+static bool relationHolds( int relation, const GEOSGeometry *geosTarget, const GEOSGeometry *geosReference )
+{
+  switch ( relation )
+  {
+    case Intersects:
+    case Disjoint: // Disjoint is the negation of the result for all candidates
+      return GEOSIntersects( geosTarget, geosReference ) == 1;
+    case Equals:
+      return GEOSEquals( geosTarget, geosReference ) == 1;
+    case Touches:
+      return GEOSTouches( geosTarget, geosReference ) == 1;
+    case Overlaps:
+      return GEOSOverlaps( geosTarget, geosReference ) == 1;
+    case Within:
+      return GEOSWithin( geosTarget, geosReference ) == 1;
+    case Contains:
+      return GEOSContains( geosTarget, geosReference ) == 1;
+    case Crosses:
+      return GEOSCrosses( geosTarget, geosReference ) == 1;
+  }
+  return false;
+}
+#endif
+
 QgsSpatialQuery::QgsSpatialQuery( MngProgressBar *pb )
 {
   mPb = pb;
   mUseTargetSelection = mUseReferenceSelection = false;
+  mPrepareReference = true;
+  mReaderFeaturesTarget = NULL;
+  mCanceled = 0;
 
 } // QgsSpatialQuery::QgsSpatialQuery(MngProgressBar *pb)
 
 QgsSpatialQuery::~QgsSpatialQuery()
 {
   delete mReaderFeaturesTarget;
+  clearReference();
 
 } // QgsSpatialQuery::~QgsSpatialQuery()
 
@@ -48,29 +192,47 @@ void QgsSpatialQuery::setSelectedFeaturesReference( bool useSelected )
 
 } // void QgsSpatialQuery::setSelectedFeaturesReference(bool useSelected)
 
-void QgsSpatialQuery::runQuery( QSet<int> & qsetIndexResult, QSet<int> & qsetIndexInvalidTarget, QSet<int> & qsetIndexInvalidReference,
+bool QgsSpatialQuery::runQuery( QSet<int> & qsetIndexResult, QSet<int> & qsetIndexInvalidTarget, QSet<int> & qsetIndexInvalidReference,
                                 int relation, QgsVectorLayer* lyrTarget, QgsVectorLayer* lyrReference )
 {
+  mCanceled = 0;
   setQuery( lyrTarget, lyrReference );
 
+  int totalReference = mUseReferenceSelection
+                       ? mLayerReference->selectedFeatureCount()
+                       : ( int )( mLayerReference->featureCount() );
+  int totalTarget = mUseTargetSelection
+                    ? mLayerTarget->selectedFeatureCount()
+                    : ( int )( mLayerTarget->featureCount() );
+  // Prepare the geometries of the smaller side, each one is tested against many candidates
+  mPrepareReference = totalReference <= totalTarget;
+
   // Create Spatial index for Reference - Set mIndexReference
   mPb->setFormat( QObject::tr( "Processing 1/2 - %p%" ) );
-  int totalStep = mUseReferenceSelection
-                  ? mLayerReference->selectedFeatureCount()
-                  : ( int )( mLayerReference->featureCount() );
-  mPb->init( 1, totalStep );
+  mPb->init( 1, totalReference );
   setSpatialIndexReference( qsetIndexInvalidReference ); // Need set mLayerReference before
 
   // Make Query
-  mPb->setFormat( QObject::tr( "Processing 2/2 - %p%" ) );
-  totalStep = mUseTargetSelection
-              ? mLayerTarget->selectedFeatureCount()
-              : ( int )( mLayerTarget->featureCount() );
-  mPb->init( 1, totalStep );
+  if ( !mCanceled )
+  {
+    // the targets are read and then evaluated
+    mPb->setFormat( QObject::tr( "Processing 2/2 - %p%" ) );
+    mPb->init( 1, 2 * totalTarget );
+
+    execQuery( qsetIndexResult, qsetIndexInvalidTarget, relation );
+  }
+  clearReference();
+
+  return !mCanceled;
+
+} // bool QgsSpatialQuery::runQuery( int relation)
 
-  execQuery( qsetIndexResult, qsetIndexInvalidTarget, relation );
+void QgsSpatialQuery::cancel()
+{
+  mCanceled = 1;
+  mFuture.cancel();
 
-} // QSet<int> QgsSpatialQuery::runQuery( int relation)
+} // void QgsSpatialQuery::cancel()
 
 QMap<QString, int>* QgsSpatialQuery::getTypesOperations( QgsVectorLayer* lyrTarget, QgsVectorLayer* lyrReference )
 {
@@ -161,36 +323,89 @@ short int QgsSpatialQuery::dimensionGeometry( QGis::GeometryType geomType )
 void QgsSpatialQuery::setQuery( QgsVectorLayer *layerTarget, QgsVectorLayer *layerReference )
 {
   mLayerTarget = layerTarget;
+  delete mReaderFeaturesTarget;
   mReaderFeaturesTarget = new QgsReaderFeatures( mLayerTarget, mUseTargetSelection );
   mLayerReference = layerReference;
 
 } // void QgsSpatialQuery::setQuery (QgsVectorLayer *layerTarget, QgsVectorLayer *layerReference)
 
-bool QgsSpatialQuery::hasValidGeometry( QgsFeature &feature )
+bool QgsSpatialQuery::hasValidGeometry( const GEOSGeometry *geos )
 {
-  if ( ! feature.isValid() )
+  if ( NULL == geos )
   {
     return false;
   }
 
-  QgsGeometry *geom = feature.geometry();
+#ifdef HAVE_GEOS_CONTEXT
+  GEOSContextHandle_t handle = QgsGeosContext::threadContext();
+  return GEOSisEmpty_r( handle, geos ) == 0 && GEOSisValid_r( handle, geos ) == 1;
+#else
+  return GEOSisEmpty( geos ) == 0 && GEOSisValid( geos ) == 1;
+#endif
+
+} // bool QgsSpatialQuery::hasValidGeometry(const GEOSGeometry *geos)
 
-  if ( NULL == geom )
+bool QgsSpatialQuery::waitForFuture( QFuture<void> future )
+{
+  mFuture = future;
+
+  // Keep the application responsive (progress bar, cancel button) while the worker threads run,
+  // no feature iteration is open at this point
+  QFutureWatcher<void> watcher;
+  QEventLoop loop;
+  QObject::connect( &watcher, SIGNAL( finished() ), &loop, SLOT( quit() ) );
+  watcher.setFuture( future );
+  if ( !watcher.isFinished() )
   {
-    return false;
+    loop.exec();
   }
+  future.waitForFinished();
+  mFuture = QFuture<void>();
 
-  if ( geom->isGeosEmpty() || !geom->isGeosValid() )
+  return !mCanceled;
+
+} // bool QgsSpatialQuery::waitForFuture(QFuture<void> future)
+
+void QgsSpatialQuery::clearReference()
+{
+  QHash<int, ReferenceFeature*>::iterator iterReference = mReferenceFeatures.begin();
+  for ( ; iterReference != mReferenceFeatures.end(); iterReference++ )
   {
-    return false;
+    ReferenceFeature *reference = iterReference.value();
+    delete reference->geometry;
+    delete reference;
+  }
+  mReferenceFeatures.clear();
+
+} // void QgsSpatialQuery::clearReference()
+
+void QgsSpatialQuery::validateReference( ReferenceFeature* &reference )
+{
+  reference->valid = hasValidGeometry( reference->geos );
+  if ( reference->valid )
+  {
+    // the geometry is shared by the jobs of its targets
+    cacheEnvelope( reference->geos );
   }
 
-  return true;
+} // void QgsSpatialQuery::validateReference(ReferenceFeature* &reference)
+
+void QgsSpatialQuery::validateTarget( TargetFeature &target )
+{
+  target.valid = hasValidGeometry( target.geos );
+  if ( target.valid )
+  {
+    // the geometry is shared by the jobs of its candidates
+    cacheEnvelope( target.geos );
+  }
 
-} // bool QgsSpatialQuery::hasValidGeometry(QgsFeature &feature)
+} // void QgsSpatialQuery::validateTarget(TargetFeature &target)
 
 void QgsSpatialQuery::setSpatialIndexReference( QSet<int> & qsetIndexInvalidReference )
 {
+  // Read all the features before processing any event: the provider is only used in this thread
+  // and an event (e.g. a canvas refresh) would reset the open iteration
+  QList<ReferenceFeature*> listReference;
   QgsReaderFeatures * readerFeaturesReference = new QgsReaderFeatures( mLayerReference, mUseReferenceSelection );
   QgsFeature feature;
   int step = 1;
@@ -198,46 +413,133 @@ void QgsSpatialQuery::setSpatialIndexReference( QSet<int> & qsetIndexInvalidRefe
   {
     mPb->step( step++ );
 
-    if ( ! hasValidGeometry( feature ) )
+    if ( ! feature.isValid() || NULL == feature.geometry() )
     {
       qsetIndexInvalidReference.insert( feature.id() );
       continue;
     }
 
-    mIndexReference.insertFeature( feature );
+    ReferenceFeature *reference = new ReferenceFeature;
+    reference->id = feature.id();
+    reference->geometry = feature.geometryAndOwnership();
+    // GEOS conversion uses the global GEOS handle, only in this thread
+    reference->geos = reference->geometry->asGeos();
+    reference->valid = false;
+    listReference.append( reference );
+    mReferenceFeatures.insert( reference->id, reference );
   }
   delete readerFeaturesReference;
 
+  // Validate the geometries in worker threads
+#ifdef HAVE_GEOS_CONTEXT
+  if ( !waitForFuture( QtConcurrent::map( listReference, validateReference ) ) )
+  {
+    return;
+  }
+#else
+  QList<ReferenceFeature*>::iterator iterValidate = listReference.begin();
+  for ( ; iterValidate != listReference.end(); iterValidate++ )
+  {
+    validateReference( *iterValidate );
+  }
+#endif
+
+  QMap<int, QgsRectangle> mapRectReference;
+  QList<ReferenceFeature*>::iterator iterReference = listReference.begin();
+  for ( ; iterReference != listReference.end(); iterReference++ )
+  {
+    ReferenceFeature *reference = *iterReference;
+    if ( ! reference->valid )
+    {
+      qsetIndexInvalidReference.insert( reference->id );
+      mReferenceFeatures.remove( reference->id );
+      delete reference->geometry;
+      delete reference;
+      continue;
+    }
+    mapRectReference.insert( reference->id, reference->geometry->boundingBox() );
+  }
+
+  mIndexReference.bulkLoad( mapRectReference );
+
 } // void QgsSpatialQuery::setSpatialIndexReference()
 
+void QgsSpatialQuery::evaluateTarget( TargetFeature &target )
+{
+  validateTarget( target );
+  if ( ! target.valid )
+  {
+    return;
+  }
+
+  // the target is only used by this job, the references are shared (read only)
+#ifdef HAVE_GEOS_CONTEXT
+  const GEOSPreparedGeometry *prepared = 0;
+  if ( !target.candidates.isEmpty() )
+  {
+    prepared = GEOSPrepare_r( QgsGeosContext::threadContext(), target.geos );
+  }
+#endif
+
+  target.found = false;
+  QList<const ReferenceFeature*>::const_iterator iterCandidate = target.candidates.constBegin();
+  for ( ; iterCandidate != target.candidates.constEnd() && !target.found; iterCandidate++ )
+  {
+#ifdef HAVE_GEOS_CONTEXT
+    target.found = relationHolds( target.relation, target.geos, prepared, ( *iterCandidate )->geos, 0 );
+#else
+    target.found = relationHolds( target.relation, target.geos, ( *iterCandidate )->geos );
+#endif
+  }
+  target.result = ( target.relation == Disjoint ) ? !target.found : target.found;
+
+#ifdef HAVE_GEOS_CONTEXT
+  if ( prepared )
+  {
+    GEOSPreparedGeom_destroy_r( QgsGeosContext::threadContext(), prepared );
+  }
+#endif
+
+} // void QgsSpatialQuery::evaluateTarget(TargetFeature &target)
+
+void QgsSpatialQuery::evaluateReference( ReferenceJob &job )
+{
+#ifdef HAVE_GEOS_CONTEXT
+  // each job prepares its own copy, the targets (and the reference geometry) are shared (read only)
+  GEOSContextHandle_t handle = QgsGeosContext::threadContext();
+  const GEOSPreparedGeometry *prepared = GEOSPrepare_r( handle, job.reference->geos );
+
+  QList<TargetFeature*>::const_iterator iterTarget = job.targets.constBegin();
+  for ( ; iterTarget != job.targets.constEnd(); iterTarget++ )
+  {
+    if ( relationHolds( job.relation, ( *iterTarget )->geos, 0, job.reference->geos, prepared ) )
+    {
+      job.matches.append( *iterTarget );
+    }
+  }
+
+  if ( prepared )
+  {
+    GEOSPreparedGeom_destroy_r( handle, prepared );
+  }
+#else
+  Q_UNUSED( job );
+#endif
+
+} // void QgsSpatialQuery::evaluateReference(ReferenceJob &job)
+
 void QgsSpatialQuery::execQuery( QSet<int> & qsetIndexResult, QSet<int> & qsetIndexInvalidTarget, int relation )
 {
-  bool ( QgsGeometry::* operation )( QgsGeometry * );
   switch ( relation )
   {
     case Disjoint:
-      operation = &QgsGeometry::disjoint;
-      break;
     case Equals:
-      operation = &QgsGeometry::equals;
-      break;
     case Touches:
-      operation = &QgsGeometry::touches;
-      break;
     case Overlaps:
-      operation = &QgsGeometry::overlaps;
-      break;
     case Within:
-      operation = &QgsGeometry::within;
-      break;
     case Contains:
-      operation = &QgsGeometry::contains;
-      break;
     case Crosses:
-      operation = &QgsGeometry::crosses;
-      break;
     case Intersects:
-      operation = &QgsGeometry::intersects;
       break;
     default:
       qWarning( "undefined operation" );
@@ -248,90 +550,181 @@ void QgsSpatialQuery::execQuery( QSet<int> & qsetIndexResult, QSet<int> & qsetIn
   QgsGeometryCoordinateTransform *coordinateTransform = new QgsGeometryCoordinateTransform();
   coordinateTransform->setCoordinateTransform( mLayerTarget, mLayerReference );
 
-  // Set function for populate result
-  void ( QgsSpatialQuery::* funcPopulateIndexResult )( QSet<int> &, int, QgsGeometry *, bool ( QgsGeometry::* )( QgsGeometry * ) );
-  funcPopulateIndexResult = ( relation == Disjoint )
-                            ? &QgsSpatialQuery::populateIndexResultDisjoint
-                            : &QgsSpatialQuery::populateIndexResult;
-
+  // All the targets are read, converted and looked up in the index in this thread before
+  // processing any event (provider, index and the global GEOS handle are not thread safe)
+  QList<TargetFeature> listTarget;
   QgsFeature featureTarget;
-  QgsGeometry * geomTarget;
   int step = 1;
   while ( mReaderFeaturesTarget->nextFeature( featureTarget ) )
   {
     mPb->step( step++ );
 
-    if ( ! hasValidGeometry( featureTarget ) )
+    if ( ! featureTarget.isValid() || NULL == featureTarget.geometry() )
     {
       qsetIndexInvalidTarget.insert( featureTarget.id() );
       continue;
     }
 
-    geomTarget = featureTarget.geometry();
-    coordinateTransform->transform( geomTarget );
-
-    ( this->*funcPopulateIndexResult )( qsetIndexResult, featureTarget.id(), geomTarget, operation );
+    TargetFeature target;
+    target.id = featureTarget.id();
+    target.geometry = featureTarget.geometryAndOwnership();
+    coordinateTransform->transform( target.geometry );
+    target.geos = target.geometry->asGeos();
+    target.relation = relation;
+    target.valid = false;
+    target.found = false;
+    target.result = false;
+
+    QList<int> listIdReference = mIndexReference.intersects( target.geometry->boundingBox() );
+    QList<int>::iterator iterIdReference = listIdReference.begin();
+    for ( ; iterIdReference != listIdReference.end(); iterIdReference++ )
+    {
+      target.candidates.append( mReferenceFeatures.value( *iterIdReference ) );
+    }
+    listTarget.append( target );
   }
   delete coordinateTransform;
+  // the invalid targets count as read and evaluated
+  step += qsetIndexInvalidTarget.count();
 
-} // QSet<int> QgsSpatialQuery::execQuery( QSet<int> & qsetIndexResult, int relation)
+#ifdef HAVE_GEOS_CONTEXT
+  if ( mPrepareReference )
+  {
+    execQueryByReference( listTarget, step );
+  }
+  else
+#endif
+  {
+    execQueryByTarget( listTarget, step );
+  }
 
-void QgsSpatialQuery::populateIndexResult(
-  QSet<int> &qsetIndexResult, int idTarget, QgsGeometry * geomTarget,
-  bool ( QgsGeometry::* op )( QgsGeometry * ) )
-{
-  QList<int> listIdReference;
-  listIdReference = mIndexReference.intersects( geomTarget->boundingBox() );
-  if ( listIdReference.count() == 0 )
+  QList<TargetFeature>::iterator iterTarget = listTarget.begin();
+  for ( ; iterTarget != listTarget.end(); iterTarget++ )
   {
-    return;
+    if ( ! iterTarget->valid )
+    {
+      qsetIndexInvalidTarget.insert( iterTarget->id );
+    }
+    else if ( iterTarget->result )
+    {
+      qsetIndexResult.insert( iterTarget->id );
+    }
+    delete iterTarget->geometry;
   }
-  QgsFeature featureReference;
-  QgsGeometry * geomReference;
-  QList<int>::iterator iterIdReference = listIdReference.begin();
-  for ( ; iterIdReference != listIdReference.end(); iterIdReference++ )
+
+} // void QgsSpatialQuery::execQuery( QSet<int> & qsetIndexResult, int relation)
+
+void QgsSpatialQuery::execQueryByTarget( QList<TargetFeature> &listTarget, int step )
+{
+  // The relations of each chunk are evaluated in worker threads, processing events in between
+  QList<TargetFeature>::iterator iterChunk = listTarget.begin();
+  while ( iterChunk != listTarget.end() && !mCanceled )
   {
-    mLayerReference->featureAtId( *iterIdReference, featureReference );
-    geomReference = featureReference.geometry();
-    if (( geomTarget->*op )( geomReference ) )
+    QList<TargetFeature>::iterator iterChunkEnd = iterChunk + qMin( QUERY_CHUNK_SIZE, ( int )( listTarget.end() - iterChunk ) );
+
+#ifdef HAVE_GEOS_CONTEXT
+    if ( !waitForFuture( QtConcurrent::map( iterChunk, iterChunkEnd, evaluateTarget ) ) )
     {
-      qsetIndexResult.insert( idTarget );
       break;
     }
+#else
+    for ( QList<TargetFeature>::iterator iterTarget = iterChunk; iterTarget != iterChunkEnd; iterTarget++ )
+    {
+      evaluateTarget( *iterTarget );
+    }
+    QCoreApplication::processEvents();
+#endif
+
+    for ( ; iterChunk != iterChunkEnd; iterChunk++ )
+    {
+      mPb->step( step++ );
+    }
   }
 
-} // void QgsSpatialQuery::populateIndexResult(...
+} // void QgsSpatialQuery::execQueryByTarget( QList<TargetFeature> &listTarget, int step )
 
-void QgsSpatialQuery::populateIndexResultDisjoint(
-  QSet<int> &qsetIndexResult, int idTarget, QgsGeometry * geomTarget,
-  bool ( QgsGeometry::* op )( QgsGeometry * ) )
+void QgsSpatialQuery::execQueryByReference( QList<TargetFeature> &listTarget, int step )
 {
-  QList<int> listIdReference;
-  listIdReference = mIndexReference.intersects( geomTarget->boundingBox() );
-  if ( listIdReference.count() == 0 )
+  // The targets are validated first, then they are shared by the jobs of their candidates
+  if ( !waitForFuture( QtConcurrent::map( listTarget, validateTarget ) ) )
   {
-    qsetIndexResult.insert( idTarget );
     return;
   }
-  QgsFeature featureReference;
-  QgsGeometry * geomReference;
-  QList<int>::iterator iterIdReference = listIdReference.begin();
-  bool addIndex = true;
-  for ( ; iterIdReference != listIdReference.end(); iterIdReference++ )
+
+  // One job per reference and chunk of its targets: the prepared reference is used by this job only
+  QHash<const ReferenceFeature*, QList<TargetFeature*> > targetsByReference;
+  int totalPairs = 0;
+  QList<TargetFeature>::iterator iterTarget = listTarget.begin();
+  for ( ; iterTarget != listTarget.end(); iterTarget++ )
+  {
+    if ( ! iterTarget->valid )
+    {
+      continue;
+    }
+    QList<const ReferenceFeature*>::const_iterator iterCandidate = iterTarget->candidates.constBegin();
+    for ( ; iterCandidate != iterTarget->candidates.constEnd(); iterCandidate++ )
+    {
+      targetsByReference[*iterCandidate].append( &( *iterTarget ) );
+      totalPairs++;
+    }
+  }
+
+  QList<ReferenceJob> listJob;
+  QHash<const ReferenceFeature*, QList<TargetFeature*> >::const_iterator iterReference = targetsByReference.constBegin();
+  for ( ; iterReference != targetsByReference.constEnd(); iterReference++ )
+  {
+    const QList<TargetFeature*> &targets = iterReference.value();
+    for ( int i = 0; i < targets.size(); i += QUERY_CHUNK_SIZE )
+    {
+      ReferenceJob job;
+      job.reference = iterReference.key();
+      job.relation = listTarget.first().relation;
+      job.targets = targets.mid( i, QUERY_CHUNK_SIZE );
+      listJob.append( job );
+    }
+  }
+  targetsByReference.clear();
+
+  // The jobs are evaluated in chunks of about QUERY_CHUNK_SIZE targets per thread, processing events in between
+  int chunkPairs = QUERY_CHUNK_SIZE * qMax( 1, QThread::idealThreadCount() );
+  int totalTarget = listTarget.size();
+  int firstStep = step;
+  int donePairs = 0;
+  QList<ReferenceJob>::iterator iterChunk = listJob.begin();
+  while ( iterChunk != listJob.end() && !mCanceled )
   {
-    mLayerReference->featureAtId( *iterIdReference, featureReference );
-    geomReference = featureReference.geometry();
+    QList<ReferenceJob>::iterator iterChunkEnd = iterChunk;
+    int pairs = 0;
+    while ( iterChunkEnd != listJob.end() && pairs < chunkPairs )
+    {
+      pairs += iterChunkEnd->targets.size();
+      iterChunkEnd++;
+    }
 
-    if ( !( geomTarget->*op )( geomReference ) )
+    if ( !waitForFuture( QtConcurrent::map( iterChunk, iterChunkEnd, evaluateReference ) ) )
     {
-      addIndex = false;
       break;
     }
+
+    for ( ; iterChunk != iterChunkEnd; iterChunk++ )
+    {
+      QList<TargetFeature*>::const_iterator iterMatch = iterChunk->matches.constBegin();
+      for ( ; iterMatch != iterChunk->matches.constEnd(); iterMatch++ )
+      {
+        ( *iterMatch )->found = true;
+      }
+    }
+
+    donePairs += pairs;
+    for ( ; step < firstStep + ( int )(( qint64 ) totalTarget * donePairs / totalPairs ); step++ )
+    {
+      mPb->step( step );
+    }
   }
-  if ( addIndex )
+
+  for ( iterTarget = listTarget.begin(); iterTarget != listTarget.end(); iterTarget++ )
   {
-    qsetIndexResult.insert( idTarget );
+    iterTarget->result = ( iterTarget->relation == Disjoint ) ? !iterTarget->found : iterTarget->found;
   }
 
-} // void QgsSpatialQuery::populateIndexResultDisjoint( ...
-
+} // void QgsSpatialQuery::execQueryByReference( QList<TargetFeature> &listTarget, int step )
@@ -18,7 +18,12 @@
 #ifndef SPATIALQUERY_H
 #define SPATIALQUERY_H
 
+#include <QAtomicInt>
+#include <QFuture>
+#include <QHash>
+
 #include <qgsvectorlayer.h>
+#include <qgsgeometry.h>
 #include <qgsspatialindex.h>
 
 #include "qgsmngprogressbar.h"
@@ -76,14 +81,21 @@ class QgsSpatialQuery
 
     /**
     * \brief Execute the query
+    * The features are read first, then the relations are evaluated in worker threads while events are processed.
     * \param qsetIndexResult    Reference to QSet contains the result query
     * \param relation           Enum Topologic Relation
     * \param lyrTarget          Pointer to Target Layer
     * \param lyrReference       Pointer to Reference Layer
+    * \returns bool             false if the query was canceled
     */
-    void runQuery( QSet<int> & qsetIndexResult, QSet<int> & qsetIndexInvalidTarget, QSet<int> & qsetIndexInvalidReference,
+    bool runQuery( QSet<int> & qsetIndexResult, QSet<int> & qsetIndexInvalidTarget, QSet<int> & qsetIndexInvalidReference,
                    int relation, QgsVectorLayer* lyrTarget, QgsVectorLayer* lyrReference );
 
+    /**
+    * \brief Cancel the running query
+    */
+    void cancel();
+
     /**
     * \brief Gets the possible topologic relations
     * \param lyrTarget          Pointer to Target Layer
@@ -101,6 +113,54 @@ class QgsSpatialQuery
 
   private:
 
+    /**
+    * \brief Reference feature with its geometry, shared read only by the worker threads
+    */
+    struct ReferenceFeature;
+
+    /**
+    * \brief Target feature with the candidates of the spatial index, evaluated in a worker thread
+    */
+    struct TargetFeature;
+
+    /**
+    * \brief Relations of one reference feature with a part of its targets, the job owns the prepared reference geometry
+    */
+    struct ReferenceJob;
+
+    /**
+    * \brief Validate the geometry of a reference feature (called in worker threads, reentrant GEOS API only)
+    */
+    static void validateReference( ReferenceFeature* &reference );
+
+    /**
+    * \brief Validate the geometry of a target feature (called in worker threads, reentrant GEOS API only)
+    */
+    static void validateTarget( TargetFeature &target );
+
+    /**
+    * \brief Evaluate the relation of a target feature with its candidates, preparing the target geometry
+    * (called in worker threads, reentrant GEOS API only)
+    */
+    static void evaluateTarget( TargetFeature &target );
+
+    /**
+    * \brief Evaluate the relation of the targets of a job with its reference, preparing the reference geometry
+    * (called in worker threads, reentrant GEOS API only)
+    */
+    static void evaluateReference( ReferenceJob &job );
+
+    /**
+    * \brief Wait for the worker threads, processing events
+    * \returns bool             false if the query was canceled
+    */
+    bool waitForFuture( QFuture<void> future );
+
+    /**
+    * \brief Delete the reference features
+    */
+    void clearReference();
+
     /**
     * \brief Sets the target layer and reference layer
     * \param layerTarget       Target Layer
@@ -109,13 +169,13 @@ class QgsSpatialQuery
     void setQuery( QgsVectorLayer *layerTarget, QgsVectorLayer *layerReference );
 
     /**
-    * \brief Verify has valid Geometry in feature
-    * \param QgsFeature       Feature
+    * \brief Verify has valid Geometry
+    * \param geos             GEOS geometry
     */
-    bool hasValidGeometry( QgsFeature &feature );
+    static bool hasValidGeometry( const GEOSGeometry *geos );
 
     /**
-    * \brief Build the Spatial Index
+    * \brief Build the Spatial Index (bulk loaded with the valid reference geometries)
     */
     void setSpatialIndexReference( QSet<int> & qsetIndexInvalidReference );
 
@@ -127,34 +187,36 @@ class QgsSpatialQuery
     void execQuery( QSet<int> & qsetIndexResult, QSet<int> & qsetIndexInvalidTarget, int relation );
 
     /**
-    * \brief Populate index Result
-    * \param qsetIndexResult    Reference to QSet contains the result query
-    * \param idTarget           Id of the feature Target
-    * \param geomTarget         Geometry the feature Target
-    * \param operation          Pointer to function of GEOS operation
+    * \brief Evaluate the targets in chunks of target features, each target is prepared by its job
+    * \param listTarget         Targets with their candidates
+    * \param step               Current step of the progress bar
     */
-    void populateIndexResult(
-      QSet<int> & qsetIndexResult, int idTarget, QgsGeometry * geomTarget,
-      bool ( QgsGeometry::* operation )( QgsGeometry * ) );
+    void execQueryByTarget( QList<TargetFeature> &listTarget, int step );
+
     /**
-    * \brief Populate index Result Disjoint
-    * \param qsetIndexResult    Reference to QSet contains the result query
-    * \param idTarget           Id of the feature Target
-    * \param geomTarget         Geometry the feature Target
-    * \param operation          Pointer to function of GEOS operation
+    * \brief Evaluate the targets in jobs per reference feature, each reference is prepared by its jobs
+    * \param listTarget         Targets with their candidates
+    * \param step               Current step of the progress bar
     */
-    void populateIndexResultDisjoint(
-      QSet<int> & qsetIndexResult, int idTarget, QgsGeometry * geomTarget,
-      bool ( QgsGeometry::* operation )( QgsGeometry * ) );
+    void execQueryByReference( QList<TargetFeature> &listTarget, int step );
 
     MngProgressBar *mPb;
     bool mUseReferenceSelection;
     bool mUseTargetSelection;
+    //! Prepare the geometries of the reference (smaller side) and split the work by reference feature,
+    //! else the target geometries are prepared and the work is split by target feature
+    bool mPrepareReference;
 
     QgsReaderFeatures * mReaderFeaturesTarget;
     QgsVectorLayer * mLayerTarget;
     QgsVectorLayer * mLayerReference;
     QgsSpatialIndex  mIndexReference;
+    //! Valid reference features, by id
+    QHash<int, ReferenceFeature*> mReferenceFeatures;
+
+    //! Work of the worker threads
+    QFuture<void> mFuture;
+    QAtomicInt mCanceled;
 };
 
 #endif // SPATIALQUERY_H
@@ -37,6 +37,7 @@ QgsSpatialQueryDialog::QgsSpatialQueryDialog( QWidget* parent, QgisInterface* if
   setupUi( this );
 
   mLayerReference = mLayerTarget = NULL;
+  mSpatialQuery = NULL;
   mIface = iface;
   mRubberSelectId = new QgsRubberSelectId( iface->mapCanvas() );
 
@@ -168,18 +169,27 @@ void QgsSpatialQueryDialog::evaluateCheckBoxLayer( bool isTarget )
 
 } // void QgsSpatialQueryDialog::evaluateCheckBoxLayer(bool isTarget)
 
-void QgsSpatialQueryDialog::runQuery()
+bool QgsSpatialQueryDialog::runQuery()
 {
-  bbMain->setEnabled( false );
+  // The query processes events while it runs: the Apply button becomes the cancel button
+  QPushButton *pbApply = bbMain->button( QDialogButtonBox::Apply );
+  QString textApply = pbApply->text();
+  pbApply->setText( tr( "Cancel" ) );
+  bbMain->button( QDialogButtonBox::Close )->setEnabled( false );
+  gbTarget->setEnabled( false );
+  gbReference->setEnabled( false );
+  cbOperation->setEnabled( false );
+  cbResultFor->setEnabled( false );
+
   MngProgressBar* pb = new MngProgressBar( pgbStatus );
-  QgsSpatialQuery* spatialQuery = new QgsSpatialQuery( pb );
+  mSpatialQuery = new QgsSpatialQuery( pb );
   if ( ckbUsingSelectedTarget->isChecked() )
   {
-    spatialQuery->setSelectedFeaturesTarget( true );
+    mSpatialQuery->setSelectedFeaturesTarget( true );
   }
   if ( ckbUsingSelectedReference->isChecked() )
   {
-    spatialQuery->setSelectedFeaturesReference( true );
+    mSpatialQuery->setSelectedFeaturesReference( true );
   }
   pgbStatus->setTextVisible( true );
   mFeatureResult.clear();
@@ -188,12 +198,26 @@ void QgsSpatialQueryDialog::runQuery()
 
   int currentItem = cbOperation->currentIndex();
   int operation = cbOperation->itemData( currentItem ).toInt();
-  spatialQuery->runQuery( mFeatureResult, mFeatureInvalidTarget, mFeatureInvalidReference, operation, mLayerTarget, mLayerReference );
-  delete spatialQuery;
+  bool finished = mSpatialQuery->runQuery( mFeatureResult, mFeatureInvalidTarget, mFeatureInvalidReference, operation, mLayerTarget, mLayerReference );
+  delete mSpatialQuery;
+  mSpatialQuery = NULL;
   delete pb;
 
-  bbMain->setEnabled( true );
-} // void QgsSpatialQueryDialog::runQuery()
+  pbApply->setText( textApply );
+  bbMain->button( QDialogButtonBox::Close )->setEnabled( true );
+  gbTarget->setEnabled( true );
+  gbReference->setEnabled( true );
+  cbOperation->setEnabled( true );
+  cbResultFor->setEnabled( true );
+
+  if ( ! finished )
+  {
+    mFeatureResult.clear();
+    mFeatureInvalidTarget.clear();
+    mFeatureInvalidReference.clear();
+  }
+  return finished;
+} // bool QgsSpatialQueryDialog::runQuery()
 
 void QgsSpatialQueryDialog::showResultQuery( QDateTime *datetimeStart, QDateTime *datetimeEnd )
 {
@@ -386,6 +410,13 @@ void QgsSpatialQueryDialog::disconnectAll()
 
 void QgsSpatialQueryDialog::reject()
 {
+  // Closing while the query runs only cancels it
+  if ( mSpatialQuery )
+  {
+    mSpatialQuery->cancel();
+    return;
+  }
+
   disconnectAll();
 
   mRubberSelectId->reset();
@@ -760,7 +791,12 @@ void QgsSpatialQueryDialog::apply()
   QDateTime datetimeStart = QDateTime::currentDateTime();
   mSourceSelected = cbResultFor->currentText();
   mIsSelectedOperator = true;
-  runQuery();
+  if ( ! runQuery() )
+  {
+    mIsSelectedOperator = false;
+    pgbStatus->setVisible( false );
+    return;
+  }
   QDateTime datetimeEnd = QDateTime::currentDateTime();
   if ( mFeatureResult.count() == 0 )
   {
@@ -794,7 +830,14 @@ void QgsSpatialQueryDialog::on_bbMain_clicked( QAbstractButton * button )
   switch ( bbMain->buttonRole( button ) )
   {
     case QDialogButtonBox::ApplyRole:
-      apply();
+      if ( mSpatialQuery )
+      {
+        mSpatialQuery->cancel();
+      }
+      else
+      {
+        apply();
+      }
       break;
     case QDialogButtonBox::DestructiveRole:
     case QDialogButtonBox::RejectRole:
@@ -1039,6 +1082,11 @@ void QgsSpatialQueryDialog::signal_qgis_layerWasAdded( QgsMapLayer* mapLayer )
 
 void QgsSpatialQueryDialog::signal_qgis_layerWillBeRemoved( QString idLayer )
 {
+  // The running query must not read the layer anymore
+  if ( mSpatialQuery )
+  {
+    mSpatialQuery->cancel();
+  }
   // If Frozen: the QGis can be: Exit, Add Project, New Project
   if ( mIface->mapCanvas()->isFrozen() )
   {
@@ -25,6 +25,8 @@
 #include "qgisinterface.h"
 #include "qgsvectorlayer.h"
 
+class QgsSpatialQuery;
+
 /**
 * \class QgsSpatialQueryDialog
 * \brief Spatial Query dialog
@@ -87,8 +89,8 @@ class QgsSpatialQueryDialog : public QDialog, private Ui::QgsSpatialQueryDialogB
     void setLayer( bool isTarget, int index );
     //! Evaluate status of selected features from layer (Target or Reference)
     void evaluateCheckBoxLayer( bool isTarget );
-    //! Run Query
-    void runQuery();
+    //! Run Query, returns false if the query was canceled
+    bool runQuery();
     //! Show result of query
     void showResultQuery( QDateTime *datetimeStart, QDateTime *datetimeEnd );
     //! Get string subset with selected FID
@@ -155,6 +157,8 @@ class QgsSpatialQueryDialog : public QDialog, private Ui::QgsSpatialQueryDialogB
     //! Text for source selected
     QString mSourceSelected;
     bool mIsSelectedOperator;
+    //! Query running (NULL if none), the Apply button cancels it
+    QgsSpatialQuery* mSpatialQuery;
 
     void MsgDEBUG( QString sMSg );
 };
@@ -40,6 +40,15 @@
 #include <QFile>
 #include <QHash>
 #include <QTime>
+#include <QThread>
+#include <QVector>
+#include <QEventLoop>
+#include <QFutureWatcher>
+#include <QPointer>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
+
+#include <algorithm>
 
 #include "gdalwarper.h"
 #include "ogr_spatialref.h"
@@ -56,10 +65,62 @@
 static QString PROVIDER_KEY = "gdal";
 static QString PROVIDER_DESCRIPTION = "GDAL provider";
 
+// copy the cells of a row selected by cols, data type T has the size of the raster data type
+template <class T>
+static void resampleRow( const char *src, char *dst, const int *cols, int width )
+{
+  const T *srcRow = reinterpret_cast<const T *>( src );
+  T *dstRow = reinterpret_cast<T *>( dst );
+  for ( int col = 0; col < width; col++ )
+  {
+    dstRow[col] = srcRow[cols[col]];
+  }
+}
+
+template <class T>
+static void fillBlock( char *dst, int count, const char *value )
+{
+  T v;
+  memcpy( &v, value, sizeof( T ) );
+  std::fill( reinterpret_cast<T *>( dst ), reinterpret_cast<T *>( dst ) + count, v );
+}
+
+// fill count cells with value of dataSize bytes
+static void fillBlock( char *dst, int count, const char *value, int dataSize )
+{
+  if ( count <= 0 )
+    return;
+
+  switch ( dataSize )
+  {
+    case 1:
+      memset( dst, *value, count );
+      break;
+    case 2:
+      fillBlock<quint16>( dst, count, value );
+      break;
+    case 4:
+      fillBlock<quint32>( dst, count, value );
+      break;
+    case 8:
+      fillBlock<quint64>( dst, count, value );
+      break;
+    default:
+      for ( int i = 0; i < count; i++ )
+      {
+        memcpy( dst + i * dataSize, value, dataSize );
+      }
+  }
+}
+
 struct QgsGdalProgress
 {
+  QgsGdalProgress( int theType, QgsGdalProvider *theProvider )
+      : type( theType ), provider( theProvider ), lastComplete( -1.0 ) {}
+
   int type;
   QgsGdalProvider *provider;
+  double lastComplete; // per call, the pyramids are built while histograms may be computed
 };
 //
 // global callback function
@@ -68,28 +129,234 @@ int CPL_STDCALL progressCallback( double dfComplete,
                                   const char * pszMessage,
                                   void * pProgressArg )
 {
-  static double dfLastComplete = -1.0;
-
   QgsGdalProgress *prog = static_cast<QgsGdalProgress *>( pProgressArg );
   QgsGdalProvider *mypProvider = prog->provider;
 
-  if ( dfLastComplete > dfComplete )
+  if ( prog->lastComplete > dfComplete )
   {
-    if ( dfLastComplete >= 1.0 )
-      dfLastComplete = -1.0;
+    if ( prog->lastComplete >= 1.0 )
+      prog->lastComplete = -1.0;
     else
-      dfLastComplete = dfComplete;
+      prog->lastComplete = dfComplete;
   }
 
-  if ( floor( dfLastComplete*10 ) != floor( dfComplete*10 ) )
+  if ( floor( prog->lastComplete*10 ) != floor( dfComplete*10 ) )
   {
     mypProvider->emitProgress( prog->type, dfComplete * 100, QString( pszMessage ) );
   }
-  dfLastComplete = dfComplete;
+  prog->lastComplete = dfComplete;
 
-  return true;
+  // returning false makes GDAL stop (only pyramid building can be canceled)
+  return prog->type != QgsRasterDataProvider::ProgressPyramids || !mypProvider->buildPyramidsCanceled();
+}
+
+// edge length of the overview tiles computed in parallel (in overview pixels)
+#define PYRAMID_TILE_SIZE 256
+
+// a tile of an overview and the source cells it is computed from
+struct QgsPyramidTile
+{
+  int dstXOff, dstYOff, dstWidth, dstHeight;
+  int srcXOff, srcYOff, srcWidth, srcHeight;
+  // source cells per overview cell
+  double xRatio, yRatio;
+  bool average;
+  bool hasNoData;
+  double noData;
+  QVector<double> src;
+  QVector<double> dst;
+};
+
+static void computePyramidTile( QgsPyramidTile &tile )
+{
+  tile.dst.resize( tile.dstWidth * tile.dstHeight );
+  const double *src = tile.src.constData();
+  double *dst = tile.dst.data();
+
+  for ( int row = 0; row < tile.dstHeight; row++ )
+  {
+    int y = tile.dstYOff + row;
+    int srcRow0 = qBound( 0, ( int )( y * tile.yRatio ) - tile.srcYOff, tile.srcHeight - 1 );
+    int srcRow1 = qBound( srcRow0 + 1, ( int )(( y + 1 ) * tile.yRatio ) - tile.srcYOff, tile.srcHeight );
+
+    for ( int col = 0; col < tile.dstWidth; col++ )
+    {
+      int x = tile.dstXOff + col;
+      int srcCol0 = qBound( 0, ( int )( x * tile.xRatio ) - tile.srcXOff, tile.srcWidth - 1 );
+      int srcCol1 = qBound( srcCol0 + 1, ( int )(( x + 1 ) * tile.xRatio ) - tile.srcXOff, tile.srcWidth );
+
+      double value;
+      if ( !tile.average )
+      {
+        // nearest neighbour, the cell in the center
+        value = src[(( srcRow0 + srcRow1 ) / 2 ) * tile.srcWidth + ( srcCol0 + srcCol1 ) / 2];
+      }
+      else
+      {
+        double sum = 0;
+        int count = 0;
+        for ( int srcRow = srcRow0; srcRow < srcRow1; srcRow++ )
+        {
+          const double *srcValue = src + srcRow * tile.srcWidth + srcCol0;
+          for ( int srcCol = srcCol0; srcCol < srcCol1; srcCol++, srcValue++ )
+          {
+            if ( tile.hasNoData && *srcValue == tile.noData )
+              continue;
+            sum += *srcValue;
+            count++;
+          }
+        }
+        value = count > 0 ? sum / count : tile.noData;
+      }
+      dst[row * tile.dstWidth + col] = value;
+    }
+  }
+
+  // the source cells are not needed any more
+  tile.src = QVector<double>();
 }
 
+// compute an overview band from a band with a finer resolution
+static CPLErr computePyramidLevel( GDALRasterBandH theSrcBand, GDALRasterBandH theDstBand, bool theAverage,
+                                   bool theHasNoData, double theNoData,
+                                   QgsGdalProgress *theProg, double &theDone, double theTotal )
+{
+  int mySrcXSize = GDALGetRasterBandXSize( theSrcBand );
+  int mySrcYSize = GDALGetRasterBandYSize( theSrcBand );
+  int myDstXSize = GDALGetRasterBandXSize( theDstBand );
+  int myDstYSize = GDALGetRasterBandYSize( theDstBand );
+  double myXRatio = ( double ) mySrcXSize / myDstXSize;
+  double myYRatio = ( double ) mySrcYSize / myDstYSize;
+
+  // tiles are read and written in batches (GDAL handles are not thread safe) and computed in parallel
+  int myBatchSize = qMax( 1, QThread::idealThreadCount() ) * 2;
+
+  for ( int myTileY = 0; myTileY < myDstYSize; myTileY += PYRAMID_TILE_SIZE )
+  {
+    QList<QgsPyramidTile> myTiles;
+    for ( int myTileX = 0; myTileX < myDstXSize; myTileX += PYRAMID_TILE_SIZE )
+    {
+      QgsPyramidTile myTile;
+      myTile.dstXOff = myTileX;
+      myTile.dstYOff = myTileY;
+      myTile.dstWidth = qMin( PYRAMID_TILE_SIZE, myDstXSize - myTileX );
+      myTile.dstHeight = qMin( PYRAMID_TILE_SIZE, myDstYSize - myTileY );
+      myTile.srcXOff = qMin(( int )( myTileX * myXRatio ), mySrcXSize - 1 );
+      myTile.srcYOff = qMin(( int )( myTileY * myYRatio ), mySrcYSize - 1 );
+      myTile.srcWidth = qBound( 1, ( int ) ceil(( myTileX + myTile.dstWidth ) * myXRatio ), mySrcXSize ) - myTile.srcXOff;
+      myTile.srcHeight = qBound( 1, ( int ) ceil(( myTileY + myTile.dstHeight ) * myYRatio ), mySrcYSize ) - myTile.srcYOff;
+      myTile.xRatio = myXRatio;
+      myTile.yRatio = myYRatio;
+      myTile.average = theAverage;
+      myTile.hasNoData = theHasNoData;
+      myTile.noData = theNoData;
+      myTiles << myTile;
+    }
+
+    for ( int i = 0; i < myTiles.size(); i += myBatchSize )
+    {
+      if ( theProg->provider->buildPyramidsCanceled() )
+      {
+        return CE_Failure;
+      }
+
+      QList<QgsPyramidTile> myBatch = myTiles.mid( i, myBatchSize );
+      for ( QList<QgsPyramidTile>::iterator it = myBatch.begin(); it != myBatch.end(); ++it )
+      {
+        it->src.resize( it->srcWidth * it->srcHeight );
+        if ( GDALRasterIO( theSrcBand, GF_Read, it->srcXOff, it->srcYOff, it->srcWidth, it->srcHeight,
+                           it->src.data(), it->srcWidth, it->srcHeight, GDT_Float64, 0, 0 ) != CE_None )
+        {
+          return CE_Failure;
+        }
+      }
+
+      QtConcurrent::blockingMap( myBatch, computePyramidTile );
+
+      for ( QList<QgsPyramidTile>::iterator it = myBatch.begin(); it != myBatch.end(); ++it )
+      {
+        if ( GDALRasterIO( theDstBand, GF_Write, it->dstXOff, it->dstYOff, it->dstWidth, it->dstHeight,
+                           it->dst.data(), it->dstWidth, it->dstHeight, GDT_Float64, 0, 0 ) != CE_None )
+        {
+          return CE_Failure;
+        }
+
+        double myLastPercent = floor( theDone / theTotal * 100 );
+        theDone += it->dstWidth * it->dstHeight;
+        if ( floor( theDone / theTotal * 100 ) != myLastPercent )
+        {
+          theProg->provider->emitProgress( theProg->type, theDone / theTotal * 100, QString() );
+        }
+      }
+    }
+  }
+
+  return CE_None;
+}
+
+// compute the overviews of all bands level by level, each from the previous level
+static CPLErr computePyramids( GDALDatasetH theDataset, const QList<int> &theLevels, bool theAverage, QgsGdalProgress *theProg )
+{
+  int myBandCount = GDALGetRasterCount( theDataset );
+  int myXSize = GDALGetRasterXSize( theDataset );
+  int myYSize = GDALGetRasterYSize( theDataset );
+
+  double myTotal = 0;
+  foreach( int myLevel, theLevels )
+  {
+    myTotal += ( double )(( myXSize + myLevel - 1 ) / myLevel ) * (( myYSize + myLevel - 1 ) / myLevel ) * myBandCount;
+  }
+  double myDone = 0;
+
+  for ( int myBandNo = 1; myBandNo <= myBandCount; myBandNo++ )
+  {
+    GDALRasterBandH myBand = GDALGetRasterBand( theDataset, myBandNo );
+    int myHasNoData = 0;
+    double myNoData = GDALGetRasterNoDataValue( myBand, &myHasNoData );
+
+    GDALRasterBandH mySrcBand = myBand;
+    int mySrcLevel = 1;
+    foreach( int myLevel, theLevels )
+    {
+      // the overview created for this level (GDAL rounds the size up)
+      GDALRasterBandH myDstBand = 0;
+      for ( int i = 0; i < GDALGetOverviewCount( myBand ); i++ )
+      {
+        GDALRasterBandH myOverview = GDALGetOverview( myBand, i );
+        if ( GDALGetRasterBandXSize( myOverview ) == ( myXSize + myLevel - 1 ) / myLevel &&
+             GDALGetRasterBandYSize( myOverview ) == ( myYSize + myLevel - 1 ) / myLevel )
+        {
+          myDstBand = myOverview;
+          break;
+        }
+      }
+      if ( !myDstBand )
+      {
+        QgsDebugMsg( QString( "overview for level %1 not found" ).arg( myLevel ) );
+        return CE_Failure;
+      }
+
+      // cascade from the previous level if the levels are multiples, otherwise from the full resolution
+      if ( myLevel % mySrcLevel != 0 )
+      {
+        mySrcBand = myBand;
+      }
+
+      QgsDebugMsg( QString( "computing band %1 level %2" ).arg( myBandNo ).arg( myLevel ) );
+      if ( computePyramidLevel( mySrcBand, myDstBand, theAverage, myHasNoData, myNoData, theProg, myDone, myTotal ) != CE_None )
+      {
+        return CE_Failure;
+      }
+
+      mySrcBand = myDstBand;
+      mySrcLevel = myLevel;
+    }
+  }
+
+  return CE_None;
+}
+
+
 
 QgsGdalProvider::QgsGdalProvider( QString const & uri )
     : QgsRasterDataProvider( uri )
@@ -376,6 +643,12 @@ bool QgsGdalProvider::crsFromWkt( const char *wkt )
 QgsGdalProvider::~QgsGdalProvider()
 {
   QgsDebugMsg( "QgsGdalProvider: deconstructing." );
+  // the worker thread building pyramids uses this provider
+  if ( mBuildPyramidsFuture.isRunning() )
+  {
+    cancelBuildPyramids();
+    mBuildPyramidsFuture.waitForFinished();
+  }
   if ( mGdalBaseDataset )
   {
     GDALDereferenceDataset( mGdalBaseDataset );
@@ -564,21 +837,14 @@ void QgsGdalProvider::readBlock( int theBandNo, QgsRectangle  const & theExtent,
   }
 
   int dataSize = dataTypeSize( theBandNo ) / 8;
-
-  // fill with null values
-  QByteArray ba = noValueBytes( theBandNo );
-  char *nodata = ba.data();
+  QByteArray nodata = noValueBytes( theBandNo );
   char *block = ( char * ) theBlock;
-  for ( int i = 0; i < thePixelWidth * thePixelHeight; i++ )
-  {
-    memcpy( block, nodata, dataSize );
-    block += dataSize;
-  }
 
   QgsRectangle myRasterExtent = theExtent.intersect( &mExtent );
   if ( myRasterExtent.isEmpty() )
   {
     QgsDebugMsg( "draw request outside view extent." );
+    fillBlock( block, thePixelWidth * thePixelHeight, nodata.constData(), dataSize );
     return;
   }
   QgsDebugMsg( "mExtent: " + mExtent.toString() );
@@ -613,100 +879,122 @@ void QgsGdalProvider::readBlock( int theBandNo, QgsRectangle  const & theExtent,
   }
   QgsDebugMsg( QString( "top = %1 bottom = %2 left = %3 right = %4" ).arg( top ).arg( bottom ).arg( left ).arg( right ) );
 
-  // We want to avoid another resampling, so we read data approximately with
-  // the same resolution as requested and exactly the width/height we need.
-
-  // Calculate rows/cols limits in raster grid space
-
-  // Set readable names
-  double srcXRes = mGeoTransform[1];
-  double srcYRes = mGeoTransform[5]; // may be negative?
-  QgsDebugMsg( QString( "xRes = %1 yRes = %2 srcXRes = %3 srcYRes = %4" ).arg( xRes ).arg( yRes ).arg( srcXRes ).arg( srcYRes ) );
-
   // target size in pizels
   int width = right - left + 1;
   int height = bottom - top + 1;
 
-
-  int srcLeft = 0; // source raster x offset
-  int srcTop = 0; // source raster x offset
-  int srcBottom = ySize() - 1;
-  int srcRight = xSize() - 1;
-
-  QTime time;
-  time.start();
-  // Note: original approach for xRes < srcXRes || yRes < qAbs( srcYRes ) was to avoid
-  // second resampling and read with GDALRasterIO to another temporary data block
-  // extended to fit src grid. The problem was that with src resolution much bigger
-  // than dst res, the target could become very large
-  // in theory it was going to infinity when zooming in ...
-
-  // Note: original approach for xRes > srcXRes, yRes > srcYRes was to read directly with GDALRasterIO
-  // but we would face this problem:
-  // If the edge of the source is greater than the edge of destination:
-  // src:        | | | | | | | | |
-  // dst:     |      |     |     |
-  // We have 2 options for resampling:
-  //  a) 'Stretch' the src and align the start edge of src to the start edge of dst.
-  //     That means however, that to the target cells may be assigned values of source
-  //     which are not nearest to the center of dst cells. Usualy probably not a problem
-  //     but we are not precise. The shift is in maximum ... TODO
-  //  b) We could cut the first destination column and left only the second one which is
-  //     completely covered by src. No (significant) stretching is applied in that
-  //     case, but the first column may be rendered as without values event if its center
-  //     is covered by src column. That could result in wrongly rendered (missing) edges
-  //     which could be easily noticed by user
-
-  // Because of problems mentioned above we read to another temporary block and do i
-  // another resampling here which appeares to be quite fast
-
-  // Get necessary src extent aligned to src resolution
-  if ( mExtent.xMinimum() < myRasterExtent.xMinimum() )
-  {
-    srcLeft = static_cast<int>( floor(( myRasterExtent.xMinimum() - mExtent.xMinimum() ) / srcXRes ) );
-  }
-  if ( mExtent.xMaximum() > myRasterExtent.xMaximum() )
+  // only the cells outside of the raster get null values, the others are all written below
+  fillBlock( block, top * thePixelWidth, nodata.constData(), dataSize );
+  fillBlock( block + dataSize * ( bottom + 1 ) * thePixelWidth, ( thePixelHeight - bottom - 1 ) * thePixelWidth, nodata.constData(), dataSize );
+  if ( left > 0 || right < thePixelWidth - 1 )
   {
-    srcRight = static_cast<int>( floor(( myRasterExtent.xMaximum() - mExtent.xMinimum() ) / srcXRes ) );
+    for ( int row = top; row <= bottom; row++ )
+    {
+      char *rowBlock = block + dataSize * row * thePixelWidth;
+      fillBlock( rowBlock, left, nodata.constData(), dataSize );
+      fillBlock( rowBlock + dataSize * ( right + 1 ), thePixelWidth - right - 1, nodata.constData(), dataSize );
+    }
   }
 
-  // GDAL states that mGeoTransform[3] is top, may it also be bottom and mGeoTransform[5] positive?
-  if ( mExtent.yMaximum() > myRasterExtent.yMaximum() )
+  if ( width <= 0 || height <= 0 )
   {
-    srcTop = static_cast<int>( floor( -1. * ( mExtent.yMaximum() - myRasterExtent.yMaximum() ) / srcYRes ) );
+    return;
   }
-  if ( mExtent.yMinimum() < myRasterExtent.yMinimum() )
-  {
-    srcBottom = static_cast<int>( floor( -1. * ( mExtent.yMaximum() - myRasterExtent.yMinimum() ) / srcYRes ) );
+
+  // Set readable names
+  double srcXRes = mGeoTransform[1];
+  double srcYRes = mGeoTransform[5]; // may be negative?
+  QgsDebugMsg( QString( "xRes = %1 yRes = %2 srcXRes = %3 srcYRes = %4" ).arg( xRes ).arg( yRes ).arg( srcXRes ).arg( srcYRes ) );
+
+  // Read from the overview with the coarsest resolution that is still at least as fine as
+  // the requested one. Zoomed out views thus read about as many cells as they display.
+  GDALRasterBandH baseBand = GDALGetRasterBand( mGdalDataset, theBandNo );
+  GDALRasterBandH gdalBand = baseBand;
+  int bandXSize = GDALGetRasterBandXSize( gdalBand );
+  int bandYSize = GDALGetRasterBandYSize( gdalBand );
+  for ( int i = 0; i < GDALGetOverviewCount( baseBand ); i++ )
+  {
+    GDALRasterBandH overview = GDALGetOverview( baseBand, i );
+    int overviewXSize = GDALGetRasterBandXSize( overview );
+    int overviewYSize = GDALGetRasterBandYSize( overview );
+    if ( overviewXSize < bandXSize &&
+         srcXRes * xSize() / overviewXSize <= xRes &&
+         fabs( srcYRes ) * ySize() / overviewYSize <= yRes )
+    {
+      gdalBand = overview;
+      bandXSize = overviewXSize;
+      bandYSize = overviewYSize;
+    }
   }
+  double bandXRes = srcXRes * xSize() / bandXSize;
+  double bandYRes = srcYRes * ySize() / bandYSize; // negative
+  QgsDebugMsg( QString( "band size = %1 x %2 bandXRes = %3 bandYRes = %4" ).arg( bandXSize ).arg( bandYSize ).arg( bandXRes ).arg( bandYRes ) );
 
-  QgsDebugMsg( QString( "srcTop = %1 srcBottom = %2 srcLeft = %3 srcRight = %4" ).arg( srcTop ).arg( srcBottom ).arg( srcLeft ).arg( srcRight ) );
+  // Get necessary src extent aligned to src resolution
+  // GDAL states that mGeoTransform[3] is top, may it also be bottom and mGeoTransform[5] positive?
+  int srcLeft = qBound( 0, static_cast<int>( floor(( myRasterExtent.xMinimum() - mExtent.xMinimum() ) / bandXRes ) ), bandXSize - 1 );
+  int srcRight = qBound( 0, static_cast<int>( floor(( myRasterExtent.xMaximum() - mExtent.xMinimum() ) / bandXRes ) ), bandXSize - 1 );
+  int srcTop = qBound( 0, static_cast<int>( floor( -1. * ( mExtent.yMaximum() - myRasterExtent.yMaximum() ) / bandYRes ) ), bandYSize - 1 );
+  int srcBottom = qBound( 0, static_cast<int>( floor( -1. * ( mExtent.yMaximum() - myRasterExtent.yMinimum() ) / bandYRes ) ), bandYSize - 1 );
 
   int srcWidth = srcRight - srcLeft + 1;
   int srcHeight = srcBottom - srcTop + 1;
 
-  QgsDebugMsg( QString( "width = %1 height = %2 srcWidth = %3 srcHeight = %4" ).arg( width ).arg( height ).arg( srcWidth ).arg( srcHeight ) );
-
   int tmpWidth = srcWidth;
   int tmpHeight = srcHeight;
 
-  if ( xRes > srcXRes )
+  if ( xRes > 2 * bandXRes || yRes > 2 * fabs( bandYRes ) )
   {
-    tmpWidth = static_cast<int>( qRound( srcWidth * srcXRes / xRes ) ) ;
+    // No overview close to the requested resolution, let GDAL decimate while reading
+    tmpWidth = qMax( 1, qMin( srcWidth, qRound( srcWidth * bandXRes / xRes ) ) );
+    tmpHeight = qMax( 1, qMin( srcHeight, qRound( -1. * srcHeight * bandYRes / yRes ) ) );
   }
-  if ( yRes > fabs( srcYRes ) )
+  else
   {
-    tmpHeight = static_cast<int>( qRound( -1.*srcHeight * srcYRes / yRes ) ) ;
+    // Read at the resolution of the band in windows aligned to its blocks, partial blocks
+    // would have to be decoded again for the neighbouring views. Not for strips or
+    // large blocks that would make the window much bigger than needed.
+    int blockXSize, blockYSize;
+    GDALGetBlockSize( gdalBand, &blockXSize, &blockYSize );
+    if ( blockXSize > 0 && blockYSize > 0 )
+    {
+      int alignedLeft = srcLeft / blockXSize * blockXSize;
+      int alignedTop = srcTop / blockYSize * blockYSize;
+      int alignedRight = qMin( bandXSize - 1, ( srcRight / blockXSize + 1 ) * blockXSize - 1 );
+      int alignedBottom = qMin( bandYSize - 1, ( srcBottom / blockYSize + 1 ) * blockYSize - 1 );
+      if (( double )( alignedRight - alignedLeft + 1 ) * ( alignedBottom - alignedTop + 1 ) <= 4. * srcWidth * srcHeight )
+      {
+        srcLeft = alignedLeft;
+        srcTop = alignedTop;
+        srcRight = alignedRight;
+        srcBottom = alignedBottom;
+        srcWidth = srcRight - srcLeft + 1;
+        srcHeight = srcBottom - srcTop + 1;
+        tmpWidth = srcWidth;
+        tmpHeight = srcHeight;
+      }
+    }
   }
 
-  double tmpXMin = mExtent.xMinimum() + srcLeft * srcXRes;
-  double tmpYMax = mExtent.yMaximum() + srcTop * srcYRes;
-  QgsDebugMsg( QString( "tmpXMin = %1 tmpYMax = %2 tmpWidth = %3 tmpHeight = %4" ).arg( tmpXMin ).arg( tmpYMax ).arg( tmpWidth ).arg( tmpHeight ) );
+  QgsDebugMsg( QString( "srcTop = %1 srcBottom = %2 srcLeft = %3 srcRight = %4" ).arg( srcTop ).arg( srcBottom ).arg( srcLeft ).arg( srcRight ) );
+  QgsDebugMsg( QString( "width = %1 height = %2 srcWidth = %3 srcHeight = %4 tmpWidth = %5 tmpHeight = %6" )
+               .arg( width ).arg( height ).arg( srcWidth ).arg( srcHeight ).arg( tmpWidth ).arg( tmpHeight ) );
+
+  double tmpXMin = mExtent.xMinimum() + srcLeft * bandXRes;
+  double tmpYMax = mExtent.yMaximum() + srcTop * bandYRes;
+
+  QTime time;
+  time.start();
 
   // Allocate temporary block
   char *tmpBlock = ( char * )malloc( dataSize * tmpWidth * tmpHeight );
+  if ( !tmpBlock )
+  {
+    QgsDebugMsg( QString( "Couldn't allocate temporary block of %1 x %2" ).arg( tmpWidth ).arg( tmpHeight ) );
+    fillBlock( block, thePixelWidth * thePixelHeight, nodata.constData(), dataSize );
+    return;
+  }
 
-  GDALRasterBandH gdalBand = GDALGetRasterBand( mGdalDataset, theBandNo );
   GDALDataType type = ( GDALDataType )mGdalDataType[theBandNo-1];
   CPLErrorReset();
   CPLErr err = GDALRasterIO( gdalBand, GF_Read,
@@ -720,31 +1008,51 @@ void QgsGdalProvider::readBlock( int theBandNo, QgsRectangle  const & theExtent,
     QgsLogger::warning( "RasterIO error: " + QString::fromUtf8( CPLGetLastErrorMsg() ) );
     QgsDebugMsg( "RasterIO error: " + QString::fromUtf8( CPLGetLastErrorMsg() ) );
     free( tmpBlock );
+    fillBlock( block, thePixelWidth * thePixelHeight, nodata.constData(), dataSize );
     return;
   }
 
   QgsDebugMsg( QString( "GDALRasterIO time (ms): %1" ).arg( time.elapsed() ) );
   time.start();
 
-  double tmpXRes = srcWidth * srcXRes / tmpWidth;
-  double tmpYRes = srcHeight * srcYRes / tmpHeight; // negative
+  double tmpXRes = srcWidth * bandXRes / tmpWidth;
+  double tmpYRes = srcHeight * bandYRes / tmpHeight; // negative
+
+  // nearest neighbour resampling, the source column of each target column is the same for all rows
+  QVector<int> tmpCols( width );
+  for ( int col = 0; col < width; col++ )
+  {
+    // cell center
+    double x = myRasterExtent.xMinimum() + ( col + 0.5 ) * xRes;
+    tmpCols[col] = qBound( 0, static_cast<int>( floor(( x - tmpXMin ) / tmpXRes ) ), tmpWidth - 1 );
+  }
 
   for ( int row = 0; row < height; row++ )
   {
     double y = myRasterExtent.yMaximum() - ( row + 0.5 ) * yRes;
-    int tmpRow = static_cast<int>( floor( -1. * ( tmpYMax - y ) / tmpYRes ) );
+    int tmpRow = qBound( 0, static_cast<int>( floor( -1. * ( tmpYMax - y ) / tmpYRes ) ), tmpHeight - 1 );
 
-    char *srcRowBlock = tmpBlock + dataSize * tmpRow * tmpWidth;
-    char *dstRowBlock = ( char * )theBlock + dataSize * ( top + row ) * thePixelWidth;
-    for ( int col = 0; col < width; col++ )
+    const char *srcRowBlock = tmpBlock + dataSize * tmpRow * tmpWidth;
+    char *dstRowBlock = block + dataSize * (( top + row ) * thePixelWidth + left );
+    switch ( dataSize )
     {
-      // cell center
-      double x = myRasterExtent.xMinimum() + ( col + 0.5 ) * xRes;
-      // floor() is quite slow! Use just cast to int.
-      int tmpCol = static_cast<int>(( x - tmpXMin ) / tmpXRes ) ;
-      char *src = srcRowBlock + dataSize * tmpCol;
-      char *dst = dstRowBlock + dataSize * ( left + col );
-      memcpy( dst, src, dataSize );
+      case 1:
+        resampleRow<quint8>( srcRowBlock, dstRowBlock, tmpCols.constData(), width );
+        break;
+      case 2:
+        resampleRow<quint16>( srcRowBlock, dstRowBlock, tmpCols.constData(), width );
+        break;
+      case 4:
+        resampleRow<quint32>( srcRowBlock, dstRowBlock, tmpCols.constData(), width );
+        break;
+      case 8:
+        resampleRow<quint64>( srcRowBlock, dstRowBlock, tmpCols.constData(), width );
+        break;
+      default:
+        for ( int col = 0; col < width; col++ )
+        {
+          memcpy( dstRowBlock + dataSize * col, srcRowBlock + dataSize * tmpCols[col], dataSize );
+        }
     }
   }
 
@@ -1313,9 +1621,7 @@ void QgsGdalProvider::populateHistogram( int theBandNo,   QgsRasterBandStats & t
      *          )
      */
 
-    QgsGdalProgress myProg;
-    myProg.type = ProgressHistogram;
-    myProg.provider = this;
+    QgsGdalProgress myProg( ProgressHistogram, this );
     double myerval = ( theBandStats.maximumValue - theBandStats.minimumValue ) / theBinCount;
     GDALGetRasterHistogram( myGdalBand, theBandStats.minimumValue - 0.1*myerval,
                             theBandStats.maximumValue + 0.1*myerval, theBinCount, myHistogramArray,
@@ -1333,6 +1639,55 @@ void QgsGdalProvider::populateHistogram( int theBandNo,   QgsRasterBandStats & t
                " elements" );
 }
 
+bool QgsGdalProvider::readStatistics( int theBandNo, QgsRasterBandStats & theBandStats )
+{
+  GDALRasterBandH myGdalBand = GDALGetRasterBand( mGdalDataset, theBandNo );
+  if ( !myGdalBand )
+  {
+    return false;
+  }
+
+  //only statistics written by writeStatistics have the number of valid cells
+  const char* myCount = GDALGetMetadataItem( myGdalBand, "QGIS_STATISTICS_COUNT", NULL );
+  if ( !myCount )
+  {
+    return false;
+  }
+
+  //bForce = FALSE: return the stored statistics (band metadata or .aux.xml), never calculate them
+  double myMin, myMax, myMean, myStdDev;
+  if ( GDALGetRasterStatistics( myGdalBand, FALSE, FALSE, &myMin, &myMax, &myMean, &myStdDev ) != CE_None )
+  {
+    return false;
+  }
+
+  theBandStats.elementCount = QString( myCount ).toInt();
+  theBandStats.minimumValue = myMin;
+  theBandStats.maximumValue = myMax;
+  theBandStats.range = myMax - myMin;
+  theBandStats.mean = myMean;
+  theBandStats.stdDev = myStdDev;
+  theBandStats.sum = myMean * theBandStats.elementCount;
+  theBandStats.sumOfSquares = myStdDev * myStdDev * qMax( theBandStats.elementCount - 1, 0 );
+  QgsDebugMsg( QString( "stored statistics found for band %1" ).arg( theBandNo ) );
+  return true;
+}
+
+void QgsGdalProvider::writeStatistics( int theBandNo, const QgsRasterBandStats & theBandStats )
+{
+  GDALRasterBandH myGdalBand = GDALGetRasterBand( mGdalDataset, theBandNo );
+  if ( !myGdalBand )
+  {
+    return;
+  }
+
+  //GDAL keeps the statistics in the band metadata, which is written to the .aux.xml side car file
+  //(or into the file for formats supporting it) when the dataset is closed
+  GDALSetRasterStatistics( myGdalBand, theBandStats.minimumValue, theBandStats.maximumValue,
+                           theBandStats.mean, theBandStats.stdDev );
+  GDALSetMetadataItem( myGdalBand, "QGIS_STATISTICS_COUNT", QString::number( theBandStats.elementCount ).toLocal8Bit().constData(), NULL );
+}
+
 /*
  * This will speed up performance at the expense of hard drive space.
  * Also, write access to the file is required for creating internal pyramids,
@@ -1350,17 +1705,12 @@ QString QgsGdalProvider::buildPyramids( QList<QgsRasterPyramid> const & theRaste
   //without requiring the user to rebuild the pyramid list to get the updated infomation
 
   //
-  // Note: Make sure the raster is not opened in write mode
-  // in order to force overviews to be written to a separate file.
-  // Otherwise reoopen it in read/write mode to stick overviews
-  // into the same file (if supported)
+  // Note: The overviews are built with a separate dataset handle. If it is opened
+  // read only, overviews are written to a separate file (.ovr). Otherwise they
+  // go into the same file (if supported)
   //
 
-
-  // TODO add signal and connect from rasterlayer
-  //emit drawingProgress( 0, 0 );
   //first test if the file is writable
-  //QFileInfo myQFile( mDataSource );
   QFileInfo myQFile( dataSourceUri() );
 
   if ( !myQFile.isWritable() )
@@ -1389,30 +1739,12 @@ QString QgsGdalProvider::buildPyramids( QList<QgsRasterPyramid> const & theRaste
         return "ERROR_JPEG_COMPRESSION";
       }
     }
-
-    //close the gdal dataset and reopen it in read / write mode
-    GDALClose( mGdalDataset );
-    //mGdalBaseDataset = GDALOpen( QFile::encodeName( dataSourceUri() ).constData(), GA_Update );
-    mGdalBaseDataset = GDALOpen( TO8F( dataSourceUri() ), GA_Update );
-
-    // if the dataset couldn't be opened in read / write mode, tell the user
-    if ( !mGdalBaseDataset )
-    {
-      //mGdalBaseDataset = GDALOpen( QFile::encodeName( mDataSource ).constData(), GA_ReadOnly );
-      //mGdalBaseDataset = GDALOpen( QFile::encodeName( dataSourceUri()).constData(), GA_ReadOnly );
-      mGdalBaseDataset = GDALOpen( TO8F( dataSourceUri() ), GA_ReadOnly );
-      //Since we are not a virtual warped dataset, mGdalDataSet and mGdalBaseDataset are supposed to be the same
-      mGdalDataset = mGdalBaseDataset;
-      return "ERROR_WRITE_FORMAT";
-    }
   }
 
   //
-  // Iterate through the Raster Layer Pyramid Vector, building any pyramid
-  // marked as exists in eaxh RasterPyramid struct.
+  // Collect the levels of the pyramids marked to be built
   //
-  CPLErr myError; //in case anything fails
-  int myCount = 1;
+  QList<int> myLevels;
   QList<QgsRasterPyramid>::const_iterator myRasterPyramidIterator;
   for ( myRasterPyramidIterator = theRasterPyramidList.begin();
         myRasterPyramidIterator != theRasterPyramidList.end();
@@ -1426,88 +1758,162 @@ QString QgsGdalProvider::buildPyramids( QList<QgsRasterPyramid> const & theRaste
 #endif
     if (( *myRasterPyramidIterator ).build )
     {
-      QgsDebugMsg( "Building....." );
-      //emit drawingProgress( myCount, myTotal );
-      int myOverviewLevelsArray[1] = {( *myRasterPyramidIterator ).level };
-      /* From : http://remotesensing.org/gdal/classGDALDataset.html#a23
-       * pszResampling : one of "NEAREST", "AVERAGE" or "MODE" controlling the downsampling method applied.
-       * nOverviews : number of overviews to build.
-       * panOverviewList : the list of overview decimation factors to build.
-       * nBand : number of bands to build overviews for in panBandList. Build for all bands if this is 0.
-       * panBandList : list of band numbers.
-       * pfnProgress : a function to call to report progress, or NULL.
-       * pProgressData : application data to pass to the progress function.
-       */
-      //build the pyramid and show progress to console
-      try
-      {
+      myLevels << ( *myRasterPyramidIterator ).level;
+    }
+  }
+  qSort( myLevels );
 
-        //build the pyramid and show progress to console
-        //NOTE this (magphase) is disabled in the gui since it tends
-        //to create corrupted images. The images can be repaired
-        //by running one of the other resampling strategies below.
-        //see ticket #284
-        QgsGdalProgress myProg;
-        myProg.type = ProgressPyramids;
-        myProg.provider = this;
-        if ( theResamplingMethod == tr( "Average Magphase" ) )
-        {
-          myError = GDALBuildOverviews( mGdalBaseDataset, "MODE", 1, myOverviewLevelsArray, 0, NULL,
-                                        progressCallback, &myProg ); //this is the arg for the gdal progress callback
-        }
-        else if ( theResamplingMethod == tr( "Average" ) )
+  if ( myLevels.isEmpty() )
+  {
+    return NULL;
+  }
 
-        {
-          myError = GDALBuildOverviews( mGdalBaseDataset, "AVERAGE", 1, myOverviewLevelsArray, 0, NULL,
-                                        progressCallback, &myProg ); //this is the arg for the gdal progress callback
-        }
-        else // fall back to nearest neighbor
-        {
-          myError = GDALBuildOverviews( mGdalBaseDataset, "NEAREST", 1, myOverviewLevelsArray, 0, NULL,
-                                        progressCallback, &myProg ); //this is the arg for the gdal progress callback
-        }
+  //NOTE Average Magphase (MODE) is disabled in the gui since it tends
+  //to create corrupted images. The images can be repaired
+  //by running one of the other resampling strategies.
+  //see ticket #284
+  QString myMethod = "NEAREST"; // fall back to nearest neighbor
+  if ( theResamplingMethod == tr( "Average Magphase" ) )
+  {
+    myMethod = "MODE";
+  }
+  else if ( theResamplingMethod == tr( "Average" ) )
+  {
+    myMethod = "AVERAGE";
+  }
 
-        if ( myError == CE_Failure || CPLGetLastErrorNo() == CPLE_NotSupported )
-        {
-          //something bad happenend
-          //QString myString = QString (CPLGetLastError());
-          GDALClose( mGdalBaseDataset );
-          //mGdalBaseDataset = GDALOpen( QFile::encodeName( mDataSource ).constData(), GA_ReadOnly );
-          //mGdalBaseDataset = GDALOpen( QFile::encodeName( dataSourceUri() ).constData(), GA_ReadOnly );
-          mGdalBaseDataset = GDALOpen( TO8F( dataSourceUri() ), GA_ReadOnly );
-          //Since we are not a virtual warped dataset, mGdalDataSet and mGdalBaseDataset are supposed to be the same
-          mGdalDataset = mGdalBaseDataset;
-
-          //emit drawingProgress( 0, 0 );
-          return "FAILED_NOT_SUPPORTED";
-        }
-        else
-        {
-          //make sure the raster knows it has pyramids
-          mHasPyramids = true;
-        }
-        myCount++;
+  // Build in a worker thread and keep the application responsive (progress, cancel) meanwhile
+  mCancelBuildPyramids = 0;
+  QFuture<QString> myFuture = QtConcurrent::run( this, &QgsGdalProvider::buildPyramidsInThread,
+                              myLevels, myMethod, theTryInternalFlag );
+  mBuildPyramidsFuture = myFuture;
+  QPointer<QgsGdalProvider> myThis( this );
+  QFutureWatcher<QString> myWatcher;
+  QEventLoop myLoop;
+  connect( &myWatcher, SIGNAL( finished() ), &myLoop, SLOT( quit() ) );
+  myWatcher.setFuture( myFuture );
+  if ( !myWatcher.isFinished() )
+  {
+    myLoop.exec();
+  }
+  QString myResult = myFuture.result();
+  if ( !myThis )
+  {
+    // the provider was deleted meanwhile (its destructor canceled the build and waited for it)
+    return myResult;
+  }
+  mBuildPyramidsFuture = QFuture<QString>();
+  mCancelBuildPyramids = 0;
 
-      }
-      catch ( CPLErr )
+  QgsDebugMsg( "Pyramid overviews built: " + ( myResult.isNull() ? QString( "OK" ) : myResult ) );
+
+  // reopen the dataset to see the new overviews
+  GDALClose( mGdalBaseDataset );
+  mGdalBaseDataset = GDALOpen( TO8F( dataSourceUri() ), GA_ReadOnly );
+  //Since we are not a virtual warped dataset, mGdalDataSet and mGdalBaseDataset are supposed to be the same
+  mGdalDataset = mGdalBaseDataset;
+  if ( mGdalDataset )
+  {
+    //make sure the raster knows if it has pyramids
+    mHasPyramids = GDALGetOverviewCount( GDALGetRasterBand( mGdalDataset, 1 ) ) > 0;
+  }
+
+  return myResult;
+}
+
+void QgsGdalProvider::cancelBuildPyramids()
+{
+  mCancelBuildPyramids = 1;
+}
+
+bool QgsGdalProvider::buildPyramidsCanceled() const
+{
+  return mCancelBuildPyramids != 0;
+}
+
+QString QgsGdalProvider::buildPyramidsInThread( QList<int> theLevels, QString theMethod, bool theTryInternalFlag )
+{
+  // own handle, the dataset of the provider may be used for rendering meanwhile
+  GDALDatasetH myDataset = GDALOpen( TO8F( dataSourceUri() ), theTryInternalFlag ? GA_Update : GA_ReadOnly );
+  if ( !myDataset )
+  {
+    return theTryInternalFlag ? "ERROR_WRITE_FORMAT" : "FAILED_NOT_SUPPORTED";
+  }
+
+  // levels of the overviews built before, a canceled build restores them
+  QVector<int> myExistingLevels;
+  if ( GDALGetRasterCount( myDataset ) > 0 )
+  {
+    GDALRasterBandH myBand = GDALGetRasterBand( myDataset, 1 );
+    for ( int i = 0; i < GDALGetOverviewCount( myBand ); i++ )
+    {
+      int myXSize = GDALGetRasterBandXSize( GDALGetOverview( myBand, i ) );
+      if ( myXSize > 0 )
       {
-        QgsLogger::warning( "Pyramid overview building failed!" );
+        myExistingLevels << qRound(( double ) GDALGetRasterXSize( myDataset ) / myXSize );
       }
     }
   }
 
-  QgsDebugMsg( "Pyramid overviews built" );
-  if ( theTryInternalFlag )
+  QVector<int> myLevels = theLevels.toVector();
+  QgsGdalProgress myProg( ProgressPyramids, this );
+
+  CPLErrorReset();
+  CPLErr myError = CE_Failure;
+  if ( theMethod == "NEAREST" || theMethod == "AVERAGE" )
   {
-    //close the gdal dataset and reopen it in read only mode
-    GDALClose( mGdalBaseDataset );
-    mGdalBaseDataset = GDALOpen( TO8F( dataSourceUri() ), GA_ReadOnly );
-    //Since we are not a virtual warped dataset, mGdalDataSet and mGdalBaseDataset are supposed to be the same
-    mGdalDataset = mGdalBaseDataset;
+    // create the overviews without computing them, they are computed level by level below
+    myError = GDALBuildOverviews( myDataset, "NONE", myLevels.size(), myLevels.data(), 0, NULL, NULL, NULL );
+    if ( myError == CE_None && CPLGetLastErrorNo() != CPLE_NotSupported )
+    {
+      myError = computePyramids( myDataset, theLevels, theMethod == "AVERAGE", &myProg );
+    }
+    else
+    {
+      // GDAL without support for empty overviews
+      CPLErrorReset();
+      myError = GDALBuildOverviews( myDataset, TO8F( theMethod ), myLevels.size(), myLevels.data(), 0, NULL,
+                                    progressCallback, &myProg );
+    }
+  }
+  else
+  {
+    myError = GDALBuildOverviews( myDataset, TO8F( theMethod ), myLevels.size(), myLevels.data(), 0, NULL,
+                                  progressCallback, &myProg );
+  }
+
+  QString myResult;
+  if ( buildPyramidsCanceled() )
+  {
+    // partially computed overviews would be drawn. GDAL can only remove all of them,
+    // the levels built before are computed again afterwards (this can't be canceled).
+    CPLErrorReset();
+    myError = GDALBuildOverviews( myDataset, "NONE", 0, NULL, 0, NULL, NULL, NULL );
+    if ( myError == CE_None && CPLGetLastErrorNo() != CPLE_NotSupported && !myExistingLevels.isEmpty() )
+    {
+      QgsDebugMsg( QString( "Pyramid building canceled, restoring %1 overviews" ).arg( myExistingLevels.size() ) );
+      myError = GDALBuildOverviews( myDataset, TO8F( theMethod ), myExistingLevels.size(), myExistingLevels.data(), 0, NULL,
+                                    NULL, NULL );
+    }
+    if ( myError == CE_Failure || CPLGetLastErrorNo() == CPLE_NotSupported )
+    {
+      QgsLogger::warning( "Pyramid overviews could not be removed or restored after cancel: " + QString::fromUtf8( CPLGetLastErrorMsg() ) );
+      myResult = "CANCELED_INCOMPLETE";
+    }
+    else
+    {
+      myResult = "CANCELED";
+    }
+  }
+  else if ( myError == CE_Failure || CPLGetLastErrorNo() == CPLE_NotSupported )
+  {
+    QgsLogger::warning( "Pyramid overview building failed: " + QString::fromUtf8( CPLGetLastErrorMsg() ) );
+    myResult = "FAILED_NOT_SUPPORTED";
   }
 
-  //emit drawingProgress( 0, 0 );
-  return NULL; // returning null on success
+  GDALClose( myDataset );
+  emitProgress( ProgressPyramids, 0, QString() );
+  return myResult;
 }
 
 QList<QgsRasterPyramid> QgsGdalProvider::buildPyramidList()
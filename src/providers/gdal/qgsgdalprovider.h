@@ -30,6 +30,8 @@
 #include <QString>
 #include <QStringList>
 #include <QDomElement>
+#include <QAtomicInt>
+#include <QFuture>
 #include <QMap>
 #include <QVector>
 
@@ -227,11 +229,26 @@ class QgsGdalProvider : public QgsRasterDataProvider
                             bool theThoroughBandScanFlag = false
                           );
 
+    bool readStatistics( int theBandNo, QgsRasterBandStats & theBandStats );
+    void writeStatistics( int theBandNo, const QgsRasterBandStats & theBandStats );
+
+    /** \brief Create pyramid overviews. The overviews are built in a worker thread while the
+     * calling thread keeps processing events. Nearest neighbour and average overviews are
+     * computed level by level, each level from the previous one, in tiles computed in parallel.
+     * @return null string on success, "CANCELED" if canceled, "CANCELED_INCOMPLETE" if canceled and
+     * the overviews could not be restored, or an error code */
     QString buildPyramids( const QList<QgsRasterPyramid> &,
                            const QString &  theResamplingMethod = "NEAREST",
                            bool theTryInternalFlag = false );
     QList<QgsRasterPyramid> buildPyramidList();
 
+    /** \brief Stop building pyramids. The overviews of the build are removed and the overviews
+     * the raster had before are computed again */
+    void cancelBuildPyramids();
+
+    /** \brief True if the running pyramid build was canceled */
+    bool buildPyramidsCanceled() const;
+
     /** \brief Close data set and release related data */
     void closeDataset();
 
@@ -242,6 +259,15 @@ class QgsGdalProvider : public QgsRasterDataProvider
     // initialize CRS from wkt
     bool crsFromWkt( const char *wkt );
 
+    /** Builds the overviews with a separate dataset handle, runs in a worker thread */
+    QString buildPyramidsInThread( QList<int> theLevels, QString theMethod, bool theTryInternalFlag );
+
+    /** Set from the GUI thread to stop the worker thread building pyramids */
+    QAtomicInt mCancelBuildPyramids;
+
+    /** The running pyramid build, the destructor waits for it */
+    QFuture<QString> mBuildPyramidsFuture;
+
     /**
     * Flag indicating if the layer data source is a valid layer
     */
@@ -64,6 +64,9 @@ static const QString TEXT_PROVIDER_DESCRIPTION =
 #define FROM8(x) QString::fromLocal8Bit(x)
 #endif
 
+// number of edited rows after which the progress of a batch is reported (editProgress signal)
+#define OGR_EDIT_PROGRESS_INTERVAL 10000
+
 class QgsCPLErrorHandler
 {
     static void CPL_STDCALL showError( CPLErr errClass, int errNo, const char *msg )
@@ -888,20 +891,41 @@ bool QgsOgrProvider::addFeatures( QgsFeatureList & flist )
 {
   setRelevantFields( true, mAttributeFields.keys() );
 
+  bool inTransaction = startTransaction();
+
   bool returnvalue = true;
+  int added = 0;
+  int count = 0;
   for ( QgsFeatureList::iterator it = flist.begin(); it != flist.end(); ++it )
   {
-    if ( !addFeature( *it ) )
+    reportEditProgress( ++count, flist.size() );
+
+    if ( addFeature( *it ) )
+    {
+      added++;
+    }
+    else
     {
       returnvalue = false;
     }
   }
 
+  if ( !commitTransaction( inTransaction ) )
+  {
+    returnvalue = false;
+  }
+
   if ( !syncToDisc() )
   {
     returnvalue = false;
   }
-  recalculateFeatureCount();
+
+  // without subset the new features can be counted instead of asking OGR
+  // to count all features again
+  if ( mSubsetString.isEmpty() && featuresCounted >= 0 )
+    featuresCounted += added;
+  else
+    recalculateFeatureCount();
 
   if ( returnvalue )
     clearMinMaxCache();
@@ -958,8 +982,13 @@ bool QgsOgrProvider::changeAttributeValues( const QgsChangedAttributesMap & attr
 
   setRelevantFields( true, mAttributeFields.keys() );
 
+  bool inTransaction = startTransaction();
+  int count = 0;
+
   for ( QgsChangedAttributesMap::const_iterator it = attr_map.begin(); it != attr_map.end(); ++it )
   {
+    reportEditProgress( ++count, attr_map.size() );
+
     long fid = ( long ) it.key();
 
     OGRFeatureH of = OGR_L_GetFeature( ogrLayer, fid );
@@ -967,6 +996,8 @@ bool QgsOgrProvider::changeAttributeValues( const QgsChangedAttributesMap & attr
     if ( !of )
     {
       QgsLogger::warning( "QgsOgrProvider::changeAttributeValues, Cannot read feature, cannot change attributes" );
+      commitTransaction( inTransaction );
+      reportEditProgress( attr_map.size(), attr_map.size() );
       return false;
     }
 
@@ -1015,10 +1046,14 @@ bool QgsOgrProvider::changeAttributeValues( const QgsChangedAttributesMap & attr
     {
       QgsLogger::warning( "QgsOgrProvider::changeAttributeValues, setting the feature failed: " + QString::number( res ) );
     }
+
+    OGR_F_Destroy( of );
   }
 
+  bool returnvalue = commitTransaction( inTransaction );
+
   OGR_L_SyncToDisk( ogrLayer );
-  return true;
+  return returnvalue;
 }
 
 bool QgsOgrProvider::changeGeometryValues( QgsGeometryMap & geometry_map )
@@ -1029,8 +1064,13 @@ bool QgsOgrProvider::changeGeometryValues( QgsGeometryMap & geometry_map )
 
   setRelevantFields( true, mAttributeFields.keys() );
 
+  bool inTransaction = startTransaction();
+  int count = 0;
+
   for ( QgsGeometryMap::iterator it = geometry_map.begin(); it != geometry_map.end(); ++it )
   {
+    reportEditProgress( ++count, geometry_map.size() );
+
     theOGRFeature = OGR_L_GetFeature( ogrLayer, it.key() );
     if ( !theOGRFeature )
     {
@@ -1076,7 +1116,10 @@ bool QgsOgrProvider::changeGeometryValues( QgsGeometryMap & geometry_map )
 
     OGR_F_Destroy( theOGRFeature );
   }
-  return syncToDisc();
+
+  bool returnvalue = commitTransaction( inTransaction );
+
+  return syncToDisc() && returnvalue;
 }
 
 bool QgsOgrProvider::createSpatialIndex()
@@ -1113,15 +1156,30 @@ bool QgsOgrProvider::deleteFeatures( const QgsFeatureIds & id )
 {
   QgsCPLErrorHandler handler;
 
+  bool inTransaction = startTransaction();
+
   bool returnvalue = true;
+  int deleted = 0;
+  int count = 0;
   for ( QgsFeatureIds::const_iterator it = id.begin(); it != id.end(); ++it )
   {
-    if ( !deleteFeature( *it ) )
+    reportEditProgress( ++count, id.size() );
+
+    if ( deleteFeature( *it ) )
+    {
+      deleted++;
+    }
+    else
     {
       returnvalue = false;
     }
   }
 
+  if ( !commitTransaction( inTransaction ) )
+  {
+    returnvalue = false;
+  }
+
   if ( !syncToDisc() )
   {
     returnvalue = false;
@@ -1133,7 +1191,10 @@ bool QgsOgrProvider::deleteFeatures( const QgsFeatureIds & id )
   QgsDebugMsg( QString( "SQL: %1" ).arg( sql ) );
   OGR_DS_ExecuteSQL( ogrDataSource, TO8( sql ), NULL, NULL );
 
-  recalculateFeatureCount();
+  if ( mSubsetString.isEmpty() && featuresCounted >= 0 )
+    featuresCounted -= deleted;
+  else
+    recalculateFeatureCount();
 
   clearMinMaxCache();
 
@@ -2106,6 +2167,43 @@ bool QgsOgrProvider::syncToDisc()
   return true;
 }
 
+void QgsOgrProvider::reportEditProgress( int theDone, int theTotal )
+{
+  if ( theDone % OGR_EDIT_PROGRESS_INTERVAL == 0 ||
+       ( theDone == theTotal && theTotal > OGR_EDIT_PROGRESS_INTERVAL ) )
+  {
+    emit editProgress( theDone, theTotal );
+  }
+}
+
+bool QgsOgrProvider::startTransaction()
+{
+  if ( !OGR_L_TestCapability( ogrLayer, OLCTransactions ) )
+    return false;
+
+  if ( OGR_L_StartTransaction( ogrLayer ) != OGRERR_NONE )
+  {
+    QgsLogger::warning( QString( "QgsOgrProvider: starting transaction failed: %1" ).arg( CPLGetLastErrorMsg() ) );
+    return false;
+  }
+
+  return true;
+}
+
+bool QgsOgrProvider::commitTransaction( bool started )
+{
+  if ( !started )
+    return true;
+
+  if ( OGR_L_CommitTransaction( ogrLayer ) != OGRERR_NONE )
+  {
+    QgsLogger::warning( QString( "QgsOgrProvider: committing transaction failed: %1" ).arg( CPLGetLastErrorMsg() ) );
+    return false;
+  }
+
+  return true;
+}
+
 void QgsOgrProvider::recalculateFeatureCount()
 {
   OGRGeometryH filter = OGR_L_GetSpatialFilter( ogrLayer );
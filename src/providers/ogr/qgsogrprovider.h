@@ -302,6 +302,16 @@ class QgsOgrProvider : public QgsVectorDataProvider
 
     /**Calls OGR_L_SyncToDisk and recreates the spatial index if present*/
     bool syncToDisc();
+
+    /**Starts a transaction if the driver supports them (e.g. SQLite), so that
+     the rows of an edit batch are not written as separate implicit transactions.
+     Returns true if a transaction was started*/
+    bool startTransaction();
+    /**Commits the transaction started by startTransaction()*/
+    bool commitTransaction( bool started );
+    /**Emits editProgress() every OGR_EDIT_PROGRESS_INTERVAL rows of an edit batch and
+     for its last row (called before each row is written)*/
+    void reportEditProgress( int theDone, int theTotal );
 };
 
 class QgsOgrLayerItem : public QgsLayerItem
@@ -32,10 +32,134 @@
 #define COMMIT_AFTER_TAGS 300000
 
 
+OsmNodeStore::OsmNodeStore()
+    : mSorted( true )
+{
+}
+
+
+void OsmNodeStore::addNode( int id, double lat, double lon )
+{
+  if ( !mNodes.isEmpty() && id <= mNodes.last().id )
+    mSorted = false;
+
+  Node node;
+  node.id = id;
+  node.usage = 0;
+  node.lat = lat;
+  node.lon = lon;
+  mNodes.append( node );
+}
+
+
+void OsmNodeStore::finish()
+{
+  if ( !mSorted )
+  {
+    qSort( mNodes.begin(), mNodes.end() );
+    mSorted = true;
+  }
+  mNodes.squeeze();
+}
+
+
+int OsmNodeStore::indexOf( int id ) const
+{
+  Node node;
+  node.id = id;
+
+  QVector<Node>::const_iterator it = qLowerBound( mNodes.constBegin(), mNodes.constEnd(), node );
+  if ( it == mNodes.constEnd() || it->id != id )
+    return -1;
+
+  return it - mNodes.constBegin();
+}
+
+
+OsmNodeHandler::OsmNodeHandler( OsmNodeStore *nodes )
+    : mNodes( nodes )
+    , mNodesFinished( false )
+{
+}
+
+
+QString OsmNodeHandler::errorString()
+{
+  return mError;
+}
+
+
+bool OsmNodeHandler::startElement( const QString & pUri, const QString & pLocalName, const QString & pName, const QXmlAttributes & pAttrs )
+{
+  Q_UNUSED( pUri );
+  Q_UNUSED( pName );
+
+  if ( pLocalName == "node" )
+  {
+    // nodes come before ways in OSM files; if not, usage of the nodes
+    // by the preceding ways is not counted
+    mNodesFinished = false;
+    mNodes->addNode( pAttrs.value( "id" ).toInt(), pAttrs.value( "lat" ).toDouble(), pAttrs.value( "lon" ).toDouble() );
+  }
+  else if ( pLocalName == "way" )
+  {
+    if ( !mNodesFinished )
+    {
+      mNodes->finish();
+      mNodesFinished = true;
+    }
+    mWayNodes.clear();
+  }
+  else if ( pLocalName == "nd" )
+  {
+    int index = mNodes->indexOf( pAttrs.value( "ref" ).toInt() );
+    if ( index >= 0 )
+      mWayNodes.append( index );
+  }
+  else if ( pLocalName == "osm" )
+  {
+    if ( pAttrs.value( "version" ) != "0.6" )
+    {
+      mError = "Invalid OSM version. Only files of v0.6 are supported.";
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool OsmNodeHandler::endElement( const QString & pURI, const QString & pLocalName, const QString & pName )
+{
+  Q_UNUSED( pURI );
+  Q_UNUSED( pName );
+
+  if ( pLocalName == "way" )
+  {
+    // each way counts once for each of its nodes
+    qSort( mWayNodes.begin(), mWayNodes.end() );
+    for ( int i = 0; i < mWayNodes.size(); i++ )
+    {
+      if ( i == 0 || mWayNodes[i] != mWayNodes[i-1] )
+        mNodes->addUsage( mWayNodes[i] );
+    }
+    mWayNodes.clear();
+  }
+  return true;
+}
+
+
+bool OsmNodeHandler::endDocument()
+{
+  mNodes->finish();
+  return true;
+}
+
+
 // object construction
-OsmHandler::OsmHandler( QFile *f, sqlite3 *database )
+OsmHandler::OsmHandler( QFile *f, sqlite3 *database, OsmNodeStore *nodes )
 {
   mDatabase = database;
+  mNodes = nodes;
   mCnt = 0;
   mPointCnt = mLineCnt = mPolygonCnt = 0;
   mPosId = 1;
@@ -44,13 +168,13 @@ OsmHandler::OsmHandler( QFile *f, sqlite3 *database )
   firstWayMemberId = "";
   mFirstMemberAppeared = 0;
 
-  char sqlInsertNode[] = "INSERT INTO node ( id, lat, lon, timestamp, user, usage ) VALUES (?,?,?,?,?,'0');";
+  char sqlInsertNode[] = "INSERT INTO node ( id, lat, lon, timestamp, user, usage ) VALUES (?,?,?,?,?,?);";
   if ( sqlite3_prepare_v2( mDatabase, sqlInsertNode, sizeof( sqlInsertNode ), &mStmtInsertNode, 0 ) != SQLITE_OK )
   {
     QgsDebugMsg( "failed to prepare sqlInsertNode!!!" );
   }
 
-  char sqlInsertWay[] = "INSERT INTO way ( id, timestamp, user, closed ) VALUES (?,?,?,?);";
+  char sqlInsertWay[] = "INSERT INTO way ( id, timestamp, user, closed, wkb, membercnt, min_lat, min_lon, max_lat, max_lon ) VALUES (?,?,?,?,?,?,?,?,?,?);";
   if ( sqlite3_prepare_v2( mDatabase, sqlInsertWay, sizeof( sqlInsertWay ), &mStmtInsertWay, 0 ) != SQLITE_OK )
   {
     QgsDebugMsg( "failed to prepare sqlInsertWay!!!" );
@@ -131,7 +255,7 @@ bool OsmHandler::startElement( const QString & pUri, const QString & pLocalName,
     mObjectId = pAttrs.value( "id" );
     mObjectType = "node";
 
-    double id = pAttrs.value( "id" ).toInt();
+    int id = pAttrs.value( "id" ).toInt();
     double lat = pAttrs.value( "lat" ).toDouble();
     double lon = pAttrs.value( "lon" ).toDouble();
     QString timestamp = pAttrs.value( "timestamp" );
@@ -148,6 +272,10 @@ bool OsmHandler::startElement( const QString & pUri, const QString & pLocalName,
     sqlite3_bind_text( mStmtInsertNode, 4, timestamp.toUtf8(), -1, SQLITE_TRANSIENT ); // TODO: maybe static?
     sqlite3_bind_text( mStmtInsertNode, 5, user.toUtf8(), -1, SQLITE_TRANSIENT ); // TODO: maybe static?
 
+    // number of ways using the node was counted in the first pass
+    int nodeIndex = mNodes->indexOf( id );
+    sqlite3_bind_int( mStmtInsertNode, 6, nodeIndex >= 0 ? mNodes->usage( nodeIndex ) : 0 );
+
     if ( sqlite3_step( mStmtInsertNode ) != SQLITE_DONE )
     {
       QgsDebugMsg( "Storing node information into database failed." );
@@ -177,12 +305,15 @@ bool OsmHandler::startElement( const QString & pUri, const QString & pLocalName,
     mObjectType = "way";
     mPosId = 1;
     mFirstMemberAppeared = 0;
+    firstWayMemberId = "";
 
     //todo: test if pAttrs.value("visible").toUtf8() is "true" -> if not, way has to be ignored!
 
-    sqlite3_bind_text( mStmtInsertWay, 1, mObjectId.toUtf8(), -1, SQLITE_TRANSIENT );
-    sqlite3_bind_text( mStmtInsertWay, 2, pAttrs.value( "timestamp" ).toUtf8(), -1, SQLITE_TRANSIENT );
-    sqlite3_bind_text( mStmtInsertWay, 3, pAttrs.value( "user" ).toUtf8(), -1, SQLITE_TRANSIENT );
+    // way is stored when it ends, together with its members and tags
+    mWayTimestamp = pAttrs.value( "timestamp" );
+    mWayUser = pAttrs.value( "user" );
+    mWayNodes.clear();
+    mWayTags.clear();
 
     // store version number of this object
     sqlite3_bind_text( mStmtInsertVersion, 1, pAttrs.value( "id" ).toUtf8(), -1, SQLITE_TRANSIENT );
@@ -210,16 +341,7 @@ bool OsmHandler::startElement( const QString & pUri, const QString & pLocalName,
 
     if (( firstWayMemberId != lastWayMemberId ) || ( mFirstMemberAppeared < 2 ) )
     {
-      sqlite3_bind_text( mStmtInsertWayMember, 1, mObjectId.toUtf8(), -1, SQLITE_TRANSIENT ); // TODO: maybe static?
-      sqlite3_bind_int( mStmtInsertWayMember, 2, mPosId );
-      sqlite3_bind_text( mStmtInsertWayMember, 3, pAttrs.value( "ref" ).toUtf8(), -1, SQLITE_TRANSIENT );
-
-      if ( sqlite3_step( mStmtInsertWayMember ) != SQLITE_DONE )
-      {
-        QgsDebugMsg( "Storing way-node relationship into database failed." );
-        return false;
-      };
-      sqlite3_reset( mStmtInsertWayMember );
+      mWayNodes.append( pAttrs.value( "ref" ).toInt() );
     }
     mPosId++;
   }
@@ -275,18 +397,15 @@ bool OsmHandler::startElement( const QString & pUri, const QString & pLocalName,
     }
     mCnt++;
 
-    sqlite3_bind_text( mStmtInsertTag, 1, pAttrs.value( "k" ).toUtf8(), -1, SQLITE_TRANSIENT );
-    sqlite3_bind_text( mStmtInsertTag, 2, pAttrs.value( "v" ).toUtf8(), -1, SQLITE_TRANSIENT );
-    sqlite3_bind_text( mStmtInsertTag, 3, mObjectId.toUtf8(), -1, SQLITE_TRANSIENT );
-    sqlite3_bind_text( mStmtInsertTag, 4, mObjectType.toUtf8(), -1, SQLITE_TRANSIENT );
-
-    // we've got node parameters -> let's create new database record
-    if ( sqlite3_step( mStmtInsertTag ) != SQLITE_DONE )
+    if ( mObjectType == "way" )
+    {
+      // tags of a way are stored only if the way itself is stored
+      mWayTags.append( qMakePair( pAttrs.value( "k" ), pAttrs.value( "v" ) ) );
+    }
+    else if ( !insertTag( pAttrs.value( "k" ), pAttrs.value( "v" ) ) )
     {
-      QgsDebugMsg( QString( "Storing tag into database failed. K:%1, V:%2." ).arg( pAttrs.value( "k" ) ).arg( pAttrs.value( "v" ) ) );
       return false;
     }
-    sqlite3_reset( mStmtInsertTag );
 
     // if we are under xml tag <relation> and we reach xml tag <tag k="type" v="...">, lets insert prepared relation into DB
     if (( mObjectType == "relation" ) && ( pAttrs.value( "k" ) == "type" ) )
@@ -312,58 +431,157 @@ bool OsmHandler::endElement( const QString & pURI, const QString & pLocalName, c
   QString name = pLocalName;
   if ( name == "way" )
   {
-    int isPolygon = false;
-    int cntMembers = mPosId - 1;
+    if ( !storeWay() )
+      return false;
 
-    if ( firstWayMemberId == lastWayMemberId )
-      isPolygon = true;
+    // make variables ready for next way parsing
+    firstWayMemberId = "";
+    mWayNodes.clear();
+    mWayTags.clear();
+  }
+  else if ( name == "relation" )
+  {
+    sqlite3_bind_text( mStmtInsertRelation, 4, mRelationType.toUtf8(), -1, SQLITE_TRANSIENT );
 
-    // test if polygon is correct; it should have >2 member points
-    if (( isPolygon ) && ( cntMembers < 4 ) )
+    if ( sqlite3_step( mStmtInsertRelation ) != SQLITE_DONE )
     {
-      sqlite3_reset( mStmtInsertWay );
-      return true;
+      QgsDebugMsg( QString( "Storing relation into database failed." ) );
+      return false;
     }
+    sqlite3_reset( mStmtInsertRelation );
+  }
+  return true;
+}
 
-    // test if way is correct; it should have more then 1 member point
-    if ( cntMembers < 2 )
-    {
-      sqlite3_reset( mStmtInsertWay );
-      return true;
-    }
 
-    // we should bind the last information needed for way insertion -> if the way is closed (polygon) or not
-    sqlite3_bind_int( mStmtInsertWay, 4, ( isPolygon ? 1 : 0 ) );
+bool OsmHandler::insertTag( const QString& key, const QString& val )
+{
+  sqlite3_bind_text( mStmtInsertTag, 1, key.toUtf8(), -1, SQLITE_TRANSIENT );
+  sqlite3_bind_text( mStmtInsertTag, 2, val.toUtf8(), -1, SQLITE_TRANSIENT );
+  sqlite3_bind_text( mStmtInsertTag, 3, mObjectId.toUtf8(), -1, SQLITE_TRANSIENT );
+  sqlite3_bind_text( mStmtInsertTag, 4, mObjectType.toUtf8(), -1, SQLITE_TRANSIENT );
 
-    // well, insert new way
-    if ( sqlite3_step( mStmtInsertWay ) != SQLITE_DONE )
-    {
-      QgsDebugMsg( "Storing way information into database failed." );
-      return false;
-    };
+  // we've got tag parameters -> let's create new database record
+  if ( sqlite3_step( mStmtInsertTag ) != SQLITE_DONE )
+  {
+    QgsDebugMsg( QString( "Storing tag into database failed. K:%1, V:%2." ).arg( key ).arg( val ) );
+    return false;
+  }
+  sqlite3_reset( mStmtInsertTag );
+  return true;
+}
 
-    // make statement ready for next insert
-    sqlite3_reset( mStmtInsertWay );
 
-    if ( isPolygon )
-      mPolygonCnt++;
-    else
-      mLineCnt++;
+bool OsmHandler::storeWay()
+{
+  int isPolygon = false;
+  int cntMembers = mPosId - 1;
 
-    // make variables ready for next way parsing
-    firstWayMemberId = "";
+  if ( firstWayMemberId == lastWayMemberId )
+    isPolygon = true;
+
+  // test if polygon is correct; it should have >2 member points
+  if (( isPolygon ) && ( cntMembers < 4 ) )
+    return true;
+
+  // test if way is correct; it should have more then 1 member point
+  if ( cntMembers < 2 )
+    return true;
+
+  // ways with nodes that are not included in loaded data are not stored at all
+  int memberCnt = mWayNodes.size();
+  QVector<int> nodeIndexes( memberCnt );
+  for ( int i = 0; i < memberCnt; i++ )
+  {
+    nodeIndexes[i] = mNodes->indexOf( mWayNodes[i] );
+    if ( nodeIndexes[i] < 0 )
+      return true;
   }
-  else if ( name == "relation" )
+
+  // create wkb of the way (if way is closed then it's polygon and it's geometry is different)
+  int pointCnt = isPolygon ? memberCnt + 1 : memberCnt;
+  int headerLen = isPolygon ? 13 : 9;
+  int geolen = headerLen + 16 * pointCnt;
+  QByteArray geo( geolen, 0 );
+  char *wkb = geo.data();
+
+  wkb[0] = QgsApplication::endian();
+  wkb[wkb[0] == QgsApplication::NDR ? 1 : 4] = isPolygon ? QGis::WKBPolygon : QGis::WKBLineString;
+  if ( isPolygon )
   {
-    sqlite3_bind_text( mStmtInsertRelation, 4, mRelationType.toUtf8(), -1, SQLITE_TRANSIENT );
+    int ringsCnt = 1;
+    memcpy( wkb + 5, &ringsCnt, 4 );
+    memcpy( wkb + 9, &pointCnt, 4 );
+  }
+  else
+  {
+    memcpy( wkb + 5, &pointCnt, 4 );
+  }
 
-    if ( sqlite3_step( mStmtInsertRelation ) != SQLITE_DONE )
+  double minLat = 1000.0, minLon = 1000.0;
+  double maxLat = -1000.0, maxLon = -1000.0;
+  for ( int i = 0; i < pointCnt; i++ )
+  {
+    // the last point of a polygon closes the ring
+    int index = nodeIndexes[ i < memberCnt ? i : 0 ];
+    double lat = mNodes->lat( index );
+    double lon = mNodes->lon( index );
+
+    if ( lat < minLat ) minLat = lat;
+    if ( lon < minLon ) minLon = lon;
+    if ( lat > maxLat ) maxLat = lat;
+    if ( lon > maxLon ) maxLon = lon;
+
+    memcpy( wkb + headerLen + 16 * i, &lon, sizeof( double ) );
+    memcpy( wkb + headerLen + 16 * i + 8, &lat, sizeof( double ) );
+  }
+
+  sqlite3_bind_text( mStmtInsertWay, 1, mObjectId.toUtf8(), -1, SQLITE_TRANSIENT );
+  sqlite3_bind_text( mStmtInsertWay, 2, mWayTimestamp.toUtf8(), -1, SQLITE_TRANSIENT );
+  sqlite3_bind_text( mStmtInsertWay, 3, mWayUser.toUtf8(), -1, SQLITE_TRANSIENT );
+  sqlite3_bind_int( mStmtInsertWay, 4, ( isPolygon ? 1 : 0 ) );
+  sqlite3_bind_blob( mStmtInsertWay, 5, wkb, geolen, SQLITE_TRANSIENT );
+  sqlite3_bind_int( mStmtInsertWay, 6, pointCnt );
+  sqlite3_bind_double( mStmtInsertWay, 7, minLat );
+  sqlite3_bind_double( mStmtInsertWay, 8, minLon );
+  sqlite3_bind_double( mStmtInsertWay, 9, maxLat );
+  sqlite3_bind_double( mStmtInsertWay, 10, maxLon );
+
+  // well, insert new way
+  if ( sqlite3_step( mStmtInsertWay ) != SQLITE_DONE )
+  {
+    QgsDebugMsg( "Storing way information into database failed." );
+    return false;
+  }
+
+  // make statement ready for next insert
+  sqlite3_reset( mStmtInsertWay );
+
+  for ( int i = 0; i < memberCnt; i++ )
+  {
+    sqlite3_bind_text( mStmtInsertWayMember, 1, mObjectId.toUtf8(), -1, SQLITE_TRANSIENT );
+    sqlite3_bind_int( mStmtInsertWayMember, 2, i + 1 );
+    sqlite3_bind_int( mStmtInsertWayMember, 3, mWayNodes[i] );
+
+    if ( sqlite3_step( mStmtInsertWayMember ) != SQLITE_DONE )
     {
-      QgsDebugMsg( QString( "Storing relation into database failed." ) );
+      QgsDebugMsg( "Storing way-node relationship into database failed." );
       return false;
     }
-    sqlite3_reset( mStmtInsertRelation );
+    sqlite3_reset( mStmtInsertWayMember );
+  }
+
+  for ( int i = 0; i < mWayTags.size(); i++ )
+  {
+    if ( !insertTag( mWayTags[i].first, mWayTags[i].second ) )
+      return false;
   }
+
+  if ( isPolygon )
+    mPolygonCnt++;
+  else
+    mLineCnt++;
+
   return true;
 }
 
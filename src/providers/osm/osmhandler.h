@@ -13,14 +13,92 @@
  ***************************************************************************/
 
 #include <QFile>
+#include <QList>
+#include <QPair>
 #include <QProgressDialog>
 #include <QString>
+#include <QVector>
 #include <QXmlDefaultHandler>
 #include <QXmlAttributes>
 
 #include <sqlite3.h>
 
 
+/**
+ * Compact in-memory store of node coordinates, sorted by node id.
+ * It is filled by OsmNodeHandler in the first pass over the OSM file and lets
+ * OsmHandler build way geometries while parsing, without querying the database.
+ */
+class OsmNodeStore
+{
+  public:
+    OsmNodeStore();
+
+    /**
+     * Adds node. Nodes should come in increasing id order (as in OSM files),
+     * otherwise they are sorted by finish().
+     */
+    void addNode( int id, double lat, double lon );
+
+    /**
+     * Sorts nodes by their ids. Must be called after the last node was added.
+     */
+    void finish();
+
+    /**
+     * Returns index of node with specified id or -1 if there's no such node.
+     */
+    int indexOf( int id ) const;
+
+    double lat( int index ) const { return mNodes[index].lat; }
+    double lon( int index ) const { return mNodes[index].lon; }
+
+    /**
+     * Number of ways that use the node.
+     */
+    int usage( int index ) const { return mNodes[index].usage; }
+    void addUsage( int index ) { mNodes[index].usage++; }
+
+    int count() const { return mNodes.size(); }
+
+  private:
+    struct Node
+    {
+      int id;
+      int usage;
+      double lat;
+      double lon;
+
+      bool operator<( const Node& other ) const { return id < other.id; }
+    };
+
+    QVector<Node> mNodes;
+    bool mSorted;
+};
+
+
+/**
+ * The SAX handler used for the first pass over input OSM XML file.
+ * It stores node coordinates into node store and counts the ways using each node.
+ */
+class OsmNodeHandler: public QXmlDefaultHandler
+{
+  public:
+    OsmNodeHandler( OsmNodeStore *nodes );
+
+    bool startElement( const QString & pUri, const QString & pLocalName, const QString & pName, const QXmlAttributes & pAttrs );
+    bool endElement( const QString & pURI, const QString & pLocalName, const QString & pName );
+    bool endDocument();
+    QString errorString();
+
+  private:
+    OsmNodeStore *mNodes;
+    bool mNodesFinished;
+    QVector<int> mWayNodes;   // indexes of nodes of the way being parsed
+    QString mError;
+};
+
+
 /**
  * The SAX handler used for parsing input OSM XML file.
  * While processing XML file it stores data to specified sqlite database.
@@ -32,8 +110,9 @@ class OsmHandler: public QXmlDefaultHandler
      * Construction.
      * @param f input file with OSM data
      * @param database opened sqlite3 database with OSM db schema to store data in
+     * @param nodes node coordinates collected by the first pass over the file
      */
-    OsmHandler( QFile *f, sqlite3 *database );
+    OsmHandler( QFile *f, sqlite3 *database, OsmNodeStore *nodes );
 
     /**
      * Destruction.
@@ -93,6 +172,17 @@ class OsmHandler: public QXmlDefaultHandler
     double xMin, xMax, yMin, yMax;
 
   private:
+    /**
+     * Stores the way parsed last with its members and tags. Ways with
+     * missing nodes are not stored.
+     */
+    bool storeWay();
+
+    /**
+     * Inserts a tag of current object.
+     */
+    bool insertTag( const QString& key, const QString& val );
+
     sqlite3_stmt *mStmtInsertNode;
     sqlite3_stmt *mStmtInsertWay;
     sqlite3_stmt *mStmtInsertTag;
@@ -112,6 +202,13 @@ class OsmHandler: public QXmlDefaultHandler
     QString mObjectId;         //last node, way or relation id while parsing file
     QString mObjectType;       //one of "node", "way", "relation"
     QString mRelationType;
+
+    OsmNodeStore *mNodes;
+    // way being parsed: its attributes, node ids and tags are kept until the way ends
+    QString mWayTimestamp;
+    QString mWayUser;
+    QVector<int> mWayNodes;
+    QList< QPair<QString, QString> > mWayTags;
 };
 
 
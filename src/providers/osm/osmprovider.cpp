@@ -1133,179 +1133,21 @@ bool QgsOSMDataProvider::updateWayWKB( int wayId, int isClosed, char **geo, int
 }
 
 
-bool QgsOSMDataProvider::updateNodes()
-{
-  char sqlUpdateNodes[] = "update node set usage=(select count(distinct way_id) from way_member wm where wm.node_id=id);";
-  if ( sqlite3_exec( mDatabase, sqlUpdateNodes, 0, 0, 0 ) != SQLITE_OK )
-  {
-    QgsDebugMsg( "Failed to update node table!!!" );
-    return false;
-  }
-  return true;
-}
-
-
-bool QgsOSMDataProvider::removeIncorrectWays()
-{
-  sqlite3_exec( mDatabase, "BEGIN;", 0, 0, 0 );
-  int wayId;
-
-  char sqlRemoveWay[] = "delete from way where id=?";
-  sqlite3_stmt *stmtRemoveWay;
-  if ( sqlite3_prepare_v2( mDatabase, sqlRemoveWay, sizeof( sqlRemoveWay ), &stmtRemoveWay, 0 ) != SQLITE_OK )
-  {
-    QgsDebugMsg( "failed to prepare stmtRemoveWay!!!" );
-  }
-
-  char sqlRemoveWayMembers[] = "delete from way_member where way_id=?";
-  sqlite3_stmt *stmtRemoveWayMembers;
-  if ( sqlite3_prepare_v2( mDatabase, sqlRemoveWayMembers, sizeof( sqlRemoveWayMembers ), &stmtRemoveWayMembers, 0 ) != SQLITE_OK )
-  {
-    QgsDebugMsg( "failed to prepare stmtRemoveWayMembers!!!" );
-  }
-
-  char sqlRemoveWayTags[] = "delete from tag where object_id=? and object_type='way'";
-  sqlite3_stmt *stmtRemoveWayTags;
-  if ( sqlite3_prepare_v2( mDatabase, sqlRemoveWayTags, sizeof( sqlRemoveWayTags ), &stmtRemoveWayTags, 0 ) != SQLITE_OK )
-  {
-    QgsDebugMsg( "failed to prepare stmtRemoveWayTags!!!" );
-  }
-
-  char sqlSelectWays[] = "select distinct way_id wid from way_member wm where not exists(select 1 from node n where wm.node_id=n.id);";
-  sqlite3_stmt *stmtSelectWays;
-  if ( sqlite3_prepare_v2( mDatabase, sqlSelectWays, sizeof( sqlSelectWays ), &stmtSelectWays, 0 ) != SQLITE_OK )
-  {
-    QgsDebugMsg( "failed to prepare stmtSelectWays!!!" );
-  }
-
-  int i = 0;
-  while ( sqlite3_step( stmtSelectWays ) == SQLITE_ROW )
-  {
-    // remove both way, tag records, way_member records
-    wayId = sqlite3_column_int( stmtSelectWays, 0 );
-
-    sqlite3_bind_int( stmtRemoveWay, 1, wayId );
-    sqlite3_bind_int( stmtRemoveWayMembers, 1, wayId );
-    sqlite3_bind_int( stmtRemoveWayTags, 1, wayId );
-
-    // run steps
-    if ( sqlite3_step( stmtRemoveWay ) != SQLITE_DONE )
-    {
-      QgsDebugMsg( "Removing way failed." );
-      sqlite3_exec( mDatabase, "ROLLBACK;", 0, 0, 0 );
-      return false;
-    }
-    if ( sqlite3_step( stmtRemoveWayMembers ) != SQLITE_DONE )
-    {
-      QgsDebugMsg( "Removing way members failed." );
-      sqlite3_exec( mDatabase, "ROLLBACK;", 0, 0, 0 );
-      return false;
-    }
-    if ( sqlite3_step( stmtRemoveWayTags ) != SQLITE_DONE )
-    {
-      QgsDebugMsg( "Removing way tags failed." );
-      sqlite3_exec( mDatabase, "ROLLBACK;", 0, 0, 0 );
-      return false;
-    }
-
-    // make statements ready for the next run
-    sqlite3_reset( stmtRemoveWay );
-    sqlite3_reset( stmtRemoveWayMembers );
-    sqlite3_reset( stmtRemoveWayTags );
-    i++;
-  }
-  // destroy database statements
-  sqlite3_finalize( stmtRemoveWay );
-  sqlite3_finalize( stmtRemoveWayMembers );
-  sqlite3_finalize( stmtRemoveWayTags );
-  sqlite3_finalize( stmtSelectWays );
-
-  // commit actions
-  sqlite3_exec( mDatabase, "COMMIT;", 0, 0, 0 );
-
-  return true;
-}
-
-
-bool QgsOSMDataProvider::postparsing()
-{
-  if ( mInitObserver ) mInitObserver->setProperty( "osm_status", QVariant( "Post-parsing: Nodes." ) );
-  if ( mInitObserver ) mInitObserver->setProperty( "osm_max", QVariant( 3 ) );
-  if ( mInitObserver ) mInitObserver->setProperty( "osm_value", QVariant( 0 ) );
-
-  // update node table
-  updateNodes();
-
-  if ( mInitObserver ) mInitObserver->setProperty( "osm_status", QVariant( "Post-parsing: Removing incorrect ways." ) );
-  if ( mInitObserver ) mInitObserver->setProperty( "osm_max", QVariant( 3 ) );
-  if ( mInitObserver ) mInitObserver->setProperty( "osm_value", QVariant( 1 ) );
-
-  removeIncorrectWays();
-
-  if ( mInitObserver ) mInitObserver->setProperty( "osm_status", QVariant( "Post-parsing: Caching ways geometries." ) );
-  if ( mInitObserver ) mInitObserver->setProperty( "osm_max", QVariant( 3 ) );
-  if ( mInitObserver ) mInitObserver->setProperty( "osm_value", QVariant( 2 ) );
-
-  // select ways, for each of them compute its wkb and store it into database
-  sqlite3_exec( mDatabase, "BEGIN;", 0, 0, 0 );
-
-  int wayId, isClosed;
-  // prepare select: get information about one specified point
-  QString cmd = QString( "SELECT id, closed FROM way;" );
-  QByteArray cmd_bytes = cmd.toAscii();
-  const char *ptr = cmd_bytes.data();
-
-  sqlite3_stmt *databaseStmt;
-  if ( sqlite3_prepare_v2( mDatabase, ptr, cmd_bytes.size(), &databaseStmt, 0 ) != SQLITE_OK )
-  {
-    QgsDebugMsg( QString( "Creating BLOBs in postprocessing failed." ) );
-    sqlite3_exec( mDatabase, "ROLLBACK;", 0, 0, 0 );
-    return false;
-  }
-
-  while ( sqlite3_step( databaseStmt ) == SQLITE_ROW )
-  {
-    if (( mInitObserver ) && ( mInitObserver->property( "osm_stop_parsing" ).toInt() == 1 ) )
-    {
-      QgsDebugMsg( QString( "Loading the OSM data was stopped." ) );
-      sqlite3_exec( mDatabase, "ROLLBACK;", 0, 0, 0 );
-      return false;
-    }
-    wayId = sqlite3_column_int( databaseStmt, 0 );
-    isClosed = sqlite3_column_int( databaseStmt, 1 );
-    char *geo;
-    int geolen;
-    updateWayWKB( wayId, isClosed, &geo, &geolen );   // todo: return value!
-  }
-
-  // destroy database statements
-  sqlite3_finalize( databaseStmt );
-
-  // commit our actions
-  sqlite3_exec( mDatabase, "COMMIT;", 0, 0, 0 );
-
-  if ( mInitObserver ) mInitObserver->setProperty( "osm_max", QVariant( 3 ) );
-  if ( mInitObserver ) mInitObserver->setProperty( "osm_value", QVariant( 3 ) );
-
-  return true;
-}
-
-
-bool QgsOSMDataProvider::loadOsmFile( QString osm_filename )
+bool QgsOSMDataProvider::parseOsmFile( QString osm_filename, QXmlDefaultHandler *handler, QString status )
 {
   QFile f( osm_filename );
   if ( !f.exists() )
     return false;
 
-  if ( mInitObserver ) mInitObserver->setProperty( "osm_status", QVariant( "Parsing the OSM file." ) );
+  if ( mInitObserver ) mInitObserver->setProperty( "osm_status", QVariant( status ) );
 
-  OsmHandler *handler = new OsmHandler( &f, mDatabase );
   QXmlSimpleReader reader;
   reader.setContentHandler( handler );
 
   const int sectorSize = 8192;
   int cntSectors = f.size() / sectorSize;
   if ( mInitObserver ) mInitObserver->setProperty( "osm_max", QVariant( cntSectors ) );
+  if ( mInitObserver ) mInitObserver->setProperty( "osm_value", QVariant( 0 ) );
 
   if ( !f.open( QIODevice::ReadOnly ) )
   {
@@ -1324,7 +1166,6 @@ bool QgsOSMDataProvider::loadOsmFile( QString osm_filename )
     if (( mInitObserver ) && ( mInitObserver->property( "osm_stop_parsing" ).toInt() == 1 ) )
     {
       QgsDebugMsg( QString( "Parsing the OSM XML was stopped." ) );
-      sqlite3_exec( mDatabase, "ROLLBACK;", 0, 0, 0 );
       return false;
     }
     if (( !res ) && ( sector < cntSectors - 2 ) )
@@ -1341,14 +1182,37 @@ bool QgsOSMDataProvider::loadOsmFile( QString osm_filename )
   f.close();
 
   QgsDebugMsg( "Parsing complete. Result: " + QString::number( res ) );
+  return true;
+}
+
 
+bool QgsOSMDataProvider::loadOsmFile( QString osm_filename )
+{
+  // first pass: collect coordinates of all nodes and count ways using them,
+  // so that the second pass can store way geometries right away
+  OsmNodeStore nodes;
+  OsmNodeHandler nodeHandler( &nodes );
+  if ( !parseOsmFile( osm_filename, &nodeHandler, "Reading OSM nodes." ) )
+    return false;
+
+  QgsDebugMsg( QString( "%1 nodes read." ).arg( nodes.count() ) );
+
+  // second pass: store everything into database
+  QFile f( osm_filename );
+  OsmHandler handler( &f, mDatabase, &nodes );
+  if ( !parseOsmFile( osm_filename, &handler, "Parsing the OSM file." ) )
+  {
+    sqlite3_exec( mDatabase, "ROLLBACK;", 0, 0, 0 );
+    return false;
+  }
+
+  // indexes are built only when all data is stored
   QgsDebugMsg( "Creating indexes..." );
   if ( mInitObserver ) mInitObserver->setProperty( "osm_status", QVariant( "Creating indexes." ) );
   createIndexes();
 
   sqlite3_exec( mDatabase, "COMMIT;", 0, 0, 0 );
 
-  QgsDebugMsg( "Starting postprocessing..." );
   if (( mInitObserver ) && ( mInitObserver->property( "osm_stop_parsing" ).toInt() == 1 ) )
   {
     QgsDebugMsg( QString( "Loading the OSM data was stopped." ) );
@@ -1356,9 +1220,6 @@ bool QgsOSMDataProvider::loadOsmFile( QString osm_filename )
     return false;
   }
 
-  postparsing();
-  QgsDebugMsg( "Postprocessing complete." );
-
   QgsDebugMsg( "Creating triggers..." );
   if ( mInitObserver ) mInitObserver->setProperty( "osm_status", QVariant( "Creating triggers." ) );
   createTriggers();
@@ -1391,10 +1252,10 @@ bool QgsOSMDataProvider::loadOsmFile( QString osm_filename )
   }
 
   // store information got with handler into provider member variables
-  xMin = handler->xMin;    // boundaries defining the area of all features
-  xMax = handler->xMax;
-  yMin = handler->yMin;
-  yMax = handler->yMax;
+  xMin = handler.xMin;    // boundaries defining the area of all features
+  xMax = handler.xMax;
+  yMin = handler.yMin;
+  yMax = handler.yMax;
 
   // storing boundary information into database
   QString cmd3 = QString( "INSERT INTO meta ( key, val ) VALUES ('default-area-boundaries','%1:%2:%3:%4');" )
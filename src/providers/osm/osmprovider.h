@@ -18,6 +18,7 @@
 #include <QFile>
 
 class QgsVectorLayer;
+class QXmlDefaultHandler;
 
 /**
  * Quantum GIS provider for OpenStreetMap data.
@@ -301,26 +302,13 @@ class QgsOSMDataProvider: public QgsVectorDataProvider
     bool updateWayWKB( int wayId, int isClosed, char **geo, int *geolen );
 
     /**
-     * Function performs all necessary postparsing manipulations with node records.
+     * Runs one pass of SAX parsing over the OSM file, reporting progress to init observer.
+     * @param osm_filename name of file with OSM data
+     * @param handler handler that processes the file
+     * @param status status text of this pass
+     * @return true in case of success and false in case of failure or if loading was stopped
      */
-    bool updateNodes();
-
-    /**
-     * Function removes all ways that are not correct. This is called after parsing input file is completed.
-     * The main purpose is removing ways that contain nodes that are not included in loaded data.
-     */
-    bool removeIncorrectWays();
-
-    /**
-     * This function performs postprocessing after OSM file parsing.
-     *
-     * Parsing has stored all information into database, but such database schema is not optimal e.g. for way selection,
-     * that must be done very often. It should be better to have way members (with their coordinates) stored directly
-     * in way table - in WKB (well known binary) format. Also some other redundant/cached information can be useful.
-     *
-     * @return true in case of success and false in case of failure
-     */
-    bool postparsing();
+    bool parseOsmFile( QString osm_filename, QXmlDefaultHandler *handler, QString status );
 
     /**
      * Gets first free feature id in database. Searching for the biggest
@@ -47,6 +47,10 @@ QgsWFSData::QgsWFSData(
     mThematicAttributes( thematicAttributes ),
     mWkbType( wkbType ),
     mFinished( false ),
+    mExtentFromServer( false ),
+    mExtentInitialised( false ),
+    mParser( 0 ),
+    mReply( 0 ),
     mFeatureCount( 0 )
 {
   //find out mTypeName from uri
@@ -72,29 +76,25 @@ QgsWFSData::QgsWFSData(
 
 QgsWFSData::~QgsWFSData()
 {
-
+  if ( mReply )
+  {
+    disconnect( mReply, 0, this, 0 );
+    mReply->abort();
+    mReply->deleteLater();
+  }
+  if ( mParser )
+  {
+    XML_ParserFree( mParser );
+  }
 }
 
 int QgsWFSData::getWFSData()
 {
-  XML_Parser p = XML_ParserCreateNS( NULL, NS_SEPARATOR );
-  XML_SetUserData( p, this );
-  XML_SetElementHandler( p, QgsWFSData::start, QgsWFSData::end );
-  XML_SetCharacterDataHandler( p, QgsWFSData::chars );
-
-  //start with empty extent
-  if ( mExtent )
+  if ( startWFSData() != 0 )
   {
-    mExtent->set( 0, 0, 0, 0 );
+    return 1;
   }
 
-  //QUrl requestUrl( mUri );
-  QNetworkRequest request( mUri );
-  QNetworkReply* reply = QgsNetworkAccessManager::instance()->get( request );
-
-  connect( reply, SIGNAL( finished() ), this, SLOT( setFinished() ) );
-  connect( reply, SIGNAL( downloadProgress( qint64, qint64 ) ), this, SLOT( handleProgressEvent( qint64, qint64 ) ) );
-
   //find out if there is a QGIS main window. If yes, display a progress dialog
   QProgressDialog* progressDialog = 0;
   QWidget* mainWindow = findMainWindow();
@@ -105,44 +105,93 @@ int QgsWFSData::getWFSData()
     progressDialog->setWindowModality( Qt::ApplicationModal );
     connect( this, SIGNAL( dataReadProgress( int ) ), progressDialog, SLOT( setValue( int ) ) );
     connect( this, SIGNAL( totalStepsUpdate( int ) ), progressDialog, SLOT( setMaximum( int ) ) );
-    connect( progressDialog, SIGNAL( canceled() ), this, SLOT( setFinished() ) );
+    connect( progressDialog, SIGNAL( canceled() ), this, SLOT( abort() ) );
     progressDialog->show();
   }
 
-  int atEnd = 0;
-  while ( !atEnd )
+  while ( !mFinished )
   {
-    if ( mFinished )
-    {
-      atEnd = 1;
-    }
-    QByteArray readData = reply->readAll();
-    if ( readData.size() > 0 )
-    {
-      XML_Parse( p, readData.constData(), readData.size(), atEnd );
-    }
-    QCoreApplication::processEvents();
+    QCoreApplication::processEvents( QEventLoop::WaitForMoreEvents );
   }
 
-  delete reply;
   delete progressDialog;
+  return 0;
+}
+
+int QgsWFSData::startWFSData()
+{
+  if ( mParser )
+  {
+    return 1; //request already running
+  }
 
+  mParser = XML_ParserCreateNS( NULL, NS_SEPARATOR );
+  XML_SetUserData( mParser, this );
+  XML_SetElementHandler( mParser, QgsWFSData::start, QgsWFSData::end );
+  XML_SetCharacterDataHandler( mParser, QgsWFSData::chars );
+
+  mFinished = false;
+  mExtentFromServer = false;
+  mExtentInitialised = false;
+
+  //start with empty extent
   if ( mExtent )
   {
-    if ( mExtent->isEmpty() )
-    {
-      //reading of bbox from the server failed, so we calculate it less efficiently by evaluating the features
-      calculateExtentFromFeatures();
-    }
+    mExtent->set( 0, 0, 0, 0 );
   }
 
-  XML_ParserFree( p );
+  //QUrl requestUrl( mUri );
+  QNetworkRequest request( mUri );
+  mReply = QgsNetworkAccessManager::instance()->get( request );
+
+  connect( mReply, SIGNAL( readyRead() ), this, SLOT( readData() ) );
+  connect( mReply, SIGNAL( finished() ), this, SLOT( setFinished() ) );
+  connect( mReply, SIGNAL( downloadProgress( qint64, qint64 ) ), this, SLOT( handleProgressEvent( qint64, qint64 ) ) );
   return 0;
 }
 
+void QgsWFSData::readData()
+{
+  if ( !mReply || !mParser )
+  {
+    return;
+  }
+
+  //parse whatever has arrived, completed feature members are handed out immediately
+  QByteArray readData = mReply->readAll();
+  if ( readData.size() > 0 )
+  {
+    XML_Parse( mParser, readData.constData(), readData.size(), 0 );
+  }
+}
+
+void QgsWFSData::abort()
+{
+  if ( mReply && !mFinished )
+  {
+    //triggers setFinished
+    mReply->abort();
+  }
+}
+
 void QgsWFSData::setFinished( )
 {
+  if ( mFinished || !mReply )
+  {
+    return;
+  }
+
+  //parse the remaining data and tell expat that the document is complete
+  QByteArray readData = mReply->readAll();
+  XML_Parse( mParser, readData.constData(), readData.size(), 1 );
+
+  mReply->deleteLater();
+  mReply = 0;
+  XML_ParserFree( mParser );
+  mParser = 0;
+
   mFinished = true;
+  emit dataFinished();
 }
 
 void QgsWFSData::handleProgressEvent( qint64 progress, qint64 totalSteps )
@@ -294,6 +343,10 @@ void QgsWFSData::endElement( const XML_Char* el )
     {
       QgsDebugMsg( "creation of bounding box failed" );
     }
+    else
+    {
+      mExtentFromServer = !mExtent->isEmpty();
+    }
 
     if ( !mParseModeStack.empty() )
     {
@@ -323,8 +376,14 @@ void QgsWFSData::endElement( const XML_Char* el )
     {
       mIdMap.insert( mCurrentFeature->id(), mCurrentFeatureId );
     }
+    if ( !mExtentFromServer )
+    {
+      extendExtent( mCurrentFeature );
+    }
     ++mFeatureCount;
     mParseModeStack.pop();
+
+    emit featureAdded( mCurrentFeature );
   }
   else if ( elementName == GML_NAMESPACE + NS_SEPARATOR + "Point" )
   {
@@ -838,39 +897,26 @@ QWidget* QgsWFSData::findMainWindow() const
   return mainWindow;
 }
 
-void QgsWFSData::calculateExtentFromFeatures() const
+void QgsWFSData::extendExtent( QgsFeature* feature )
 {
-  if ( mFeatures.size() < 1 )
+  if ( !mExtent || !feature )
   {
     return;
   }
 
-  QgsRectangle bbox;
-
-  QgsFeature* currentFeature = 0;
-  QgsGeometry* currentGeometry = 0;
-  bool bboxInitialised = false; //gets true once bbox has been set to the first geometry
+  QgsGeometry* currentGeometry = feature->geometry();
+  if ( !currentGeometry )
+  {
+    return;
+  }
 
-  for ( int i = 0; i < mFeatures.size(); ++i )
+  if ( !mExtentInitialised )
   {
-    currentFeature = mFeatures[i];
-    if ( !currentFeature )
-    {
-      continue;
-    }
-    currentGeometry = currentFeature->geometry();
-    if ( currentGeometry )
-    {
-      if ( !bboxInitialised )
-      {
-        bbox = currentGeometry->boundingBox();
-        bboxInitialised = true;
-      }
-      else
-      {
-        bbox.unionRect( currentGeometry->boundingBox() );
-      }
-    }
+    ( *mExtent ) = currentGeometry->boundingBox();
+    mExtentInitialised = true;
+  }
+  else
+  {
+    mExtent->unionRect( currentGeometry->boundingBox() );
   }
-  ( *mExtent ) = bbox;
 }
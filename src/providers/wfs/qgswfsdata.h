@@ -28,9 +28,10 @@
 #include <QPair>
 class QgsRectangle;
 class QgsCoordinateReferenceSystem;
+class QNetworkReply;
 
 
-/**This class reads data from a WFS server or alternatively from a GML file. It uses the expat XML parser and an event based model to keep performance high. The parsing starts when the first data arrives, it does not wait until the request is finished*/
+/**This class reads data from a WFS server or alternatively from a GML file. It uses the expat XML parser and an event based model to keep performance high. The parsing starts when the first data arrives, it does not wait until the request is finished. Each feature is handed out with featureAdded as soon as its featureMember element has been parsed*/
 class QgsWFSData: public QObject
 {
     Q_OBJECT
@@ -45,7 +46,7 @@ class QgsWFSData: public QObject
       QGis::WkbType* wkbType );
     ~QgsWFSData();
 
-    /**Does the Http GET request to the wfs server
+    /**Does the Http GET request to the wfs server and waits until the response has been parsed
        @param query string (to define the requested typename)
        @param extent the extent of the WFS layer
        @param srs the reference system of the layer
@@ -53,9 +54,32 @@ class QgsWFSData: public QObject
     @return 0 in case of success*/
     int getWFSData();
 
+    /**Starts the Http GET request to the wfs server and returns immediately. The response is parsed
+       as it arrives, featureAdded is emitted for every parsed feature member and dataFinished once
+       the response is complete.
+       @return 0 in case of success
+       @note added in 1.7*/
+    int startWFSData();
+
+    /**True if the response has been completely parsed (or the request has been aborted)
+       @note added in 1.7*/
+    bool isFinished() const { return mFinished; }
+
+    /**True if the layer extent has been read from the boundedBy element of the response
+       @note added in 1.7*/
+    bool isExtentFromServer() const { return mExtentFromServer; }
+
+  public slots:
+    /**Aborts a running request. Features parsed so far are kept
+       @note added in 1.7*/
+    void abort();
+
   private slots:
     void setFinished();
 
+    /**Feeds the data available from the network reply to the parser*/
+    void readData();
+
     /**Takes progress value and total steps and emit signals 'dataReadProgress' and 'totalStepUpdate'*/
     void handleProgressEvent( qint64 progress, qint64 totalSteps );
 
@@ -64,6 +88,12 @@ class QgsWFSData: public QObject
     void totalStepsUpdate( int totalSteps );
     //also emit signal with progress and totalSteps together (this is better for the status message)
     void dataProgressAndSteps( int progress, int totalSteps );
+    /**Emitted after a feature member has been parsed and inserted into the feature map
+      @note added in 1.7*/
+    void featureAdded( QgsFeature* feature );
+    /**Emitted once the response has been completely parsed
+      @note added in 1.7*/
+    void dataFinished();
 
   private:
 
@@ -134,10 +164,9 @@ class QgsWFSData: public QObject
 
     /**Returns pointer to main window or 0 if it does not exist*/
     QWidget* findMainWindow() const;
-    /**This function evaluates the layer bounding box from the features and sets it to mExtent.
-    Less efficient compared to reading the bbox from the provider, so it is only done if the wfs server \
-    does not provider extent information.*/
-    void calculateExtentFromFeatures() const;
+    /**Extends mExtent by the bounding box of a feature. Less efficient compared to reading the bbox \
+    from the provider, so it is only done if the wfs server does not provide extent information.*/
+    void extendExtent( QgsFeature* feature );
 
     QString mUri;
     //results are members such that handler routines are able to manipulate them
@@ -153,6 +182,14 @@ class QgsWFSData: public QObject
     QGis::WkbType* mWkbType;
     /**True if the request is finished*/
     bool mFinished;
+    /**True if the extent has been read from the response instead of being calculated from the features*/
+    bool mExtentFromServer;
+    /**True once mExtent has been set to the bounding box of the first feature*/
+    bool mExtentInitialised;
+    /**The expat parser, exists while a request is running*/
+    XML_Parser mParser;
+    /**The network reply of the running request*/
+    QNetworkReply* mReply;
     /**Keep track about the most important nested elements*/
     std::stack<parseMode> mParseModeStack;
     /**This contains the character data if an important element has been encountered*/
@@ -16,6 +16,7 @@
  ***************************************************************************/
 
 #define WFS_THRESHOLD 200
+#define WFS_REDRAW_INTERVAL 2000 // minimum time in ms between redraws while features are arriving
 
 #include "qgsapplication.h"
 #include "qgsfeature.h"
@@ -50,7 +51,8 @@ QgsWFSProvider::QgsWFSProvider( const QString& uri )
     mUseIntersect( false ),
     mSourceCRS( 0 ),
     mFeatureCount( 0 ),
-    mValid( true )
+    mValid( true ),
+    mDataReader( 0 )
 {
   mSpatialIndex = 0;
   reloadData();
@@ -76,12 +78,16 @@ void QgsWFSProvider::reloadData()
 
 void QgsWFSProvider::deleteData()
 {
+  //stop a running download first, it inserts into mFeatures
+  delete mDataReader;
+  mDataReader = 0;
+  mRedrawTime = QTime();
+
   mSelectedFeatures.clear();
-  for ( int i = 0; i < mFeatures.size(); i++ )
-  {
-    delete mFeatures[i];
-  }
+  qDeleteAll( mFeatures );
   mFeatures.clear();
+  mIdMap.clear();
+  mFeatureCount = 0;
 }
 
 void QgsWFSProvider::copyFeature( QgsFeature* f, QgsFeature& feature, bool fetchGeometry, QgsAttributeList fetchAttributes )
@@ -651,10 +657,10 @@ int QgsWFSProvider::getFeatureGET( const QString& uri, const QString& geometryAt
   //the new and faster method with the expat SAX parser
 
   //allows fast searchings with attribute name. Also needed is attribute Index and type infos
-  QMap<QString, QPair<int, QgsField> > thematicAttributes;
+  mThematicAttributes.clear();
   for ( QgsFieldMap::const_iterator it = mFields.begin(); it != mFields.end(); ++it )
   {
-    thematicAttributes.insert( it.value().name(), qMakePair( it.key(), it.value() ) );
+    mThematicAttributes.insert( it.value().name(), qMakePair( it.key(), it.value() ) );
   }
 
   //create mSourceCRS from url if possible
@@ -664,8 +670,11 @@ int QgsWFSProvider::getFeatureGET( const QString& uri, const QString& geometryAt
     mSourceCRS.createFromOgcWmsCrs( srsname );
   }
 
-  QgsWFSData dataReader( uri, &mExtent, mFeatures, mIdMap, geometryAttribute, thematicAttributes, &mWKBType );
-  QObject::connect( &dataReader, SIGNAL( dataProgressAndSteps( int , int ) ), this, SLOT( handleWFSProgressMessage( int, int ) ) );
+  //the reader stays alive while the response is downloading and hands out every parsed feature
+  mDataReader = new QgsWFSData( uri, &mExtent, mFeatures, mIdMap, geometryAttribute, mThematicAttributes, &mWKBType );
+  QObject::connect( mDataReader, SIGNAL( dataProgressAndSteps( int , int ) ), this, SLOT( handleWFSProgressMessage( int, int ) ) );
+  QObject::connect( mDataReader, SIGNAL( featureAdded( QgsFeature* ) ), this, SLOT( featureReceived( QgsFeature* ) ) );
+  QObject::connect( mDataReader, SIGNAL( dataFinished() ), this, SLOT( dataReaderFinished() ) );
 
   //also connect to statusChanged signal of qgisapp (if it exists)
   QWidget* mainWindow = 0;
@@ -685,24 +694,59 @@ int QgsWFSProvider::getFeatureGET( const QString& uri, const QString& geometryAt
     QObject::connect( this, SIGNAL( dataReadProgressMessage( QString ) ), mainWindow, SLOT( showStatusMessage( QString ) ) );
   }
 
-  if ( dataReader.getWFSData() != 0 )
+  if ( mDataReader->startWFSData() != 0 )
   {
-    QgsDebugMsg( "getWFSData returned with error" );
+    QgsDebugMsg( "startWFSData returned with error" );
     return 1;
   }
 
-  QgsDebugMsg( QString( "feature count after request is: %1" ).arg( mFeatures.size() ) );
-  QgsDebugMsg( QString( "mExtent after request is: %1" ).arg( mExtent.toString() ) );
+  //Wait until the layer extent and geometry type are known. That is the case once the first feature arrived
+  //after the bounding box of the collection. If the server does not send a bounding box, the extent can
+  //only be calculated from all the features and we have to wait for the complete response.
+  //The remaining features are added in the background and the layer is redrawn from time to time.
+  while ( !mDataReader->isFinished() && ( mFeatureCount < 1 || !mDataReader->isExtentFromServer() ) )
+  {
+    QCoreApplication::processEvents( QEventLoop::ExcludeUserInputEvents, WFS_THRESHOLD );
+  }
+  mRedrawTime.start();
+
+  QgsDebugMsg( QString( "feature count after initial request is: %1" ).arg( mFeatureCount ) );
+  QgsDebugMsg( QString( "mExtent after initial request is: %1" ).arg( mExtent.toString() ) );
+
+  return 0;
+}
+
+void QgsWFSProvider::featureReceived( QgsFeature* f )
+{
+  if ( !f )
+  {
+    return;
+  }
+
+  //the feature is immediately available for spatial queries
+  mSpatialIndex->insertFeature( *f );
+  mFeatureCount = mFeatures.size();
 
-  for ( QMap<int, QgsFeature*>::iterator it = mFeatures.begin(); it != mFeatures.end(); ++it )
+  //redraw with the features received so far, but not too often
+  if ( !mRedrawTime.isNull() && mRedrawTime.elapsed() > WFS_REDRAW_INTERVAL )
   {
-    QgsDebugMsg( "feature " + QString::number(( *it )->id() ) );
-    mSpatialIndex->insertFeature( *( it.value() ) );
+    mRedrawTime.restart();
+    emit dataChanged();
   }
+}
+
+void QgsWFSProvider::dataReaderFinished()
+{
+  QgsDebugMsg( QString( "feature count after request is: %1" ).arg( mFeatures.size() ) );
+  QgsDebugMsg( QString( "mExtent after request is: %1" ).arg( mExtent.toString() ) );
 
   mFeatureCount = mFeatures.size();
 
-  return 0;
+  //the provider constructor is still waiting for the data, no need to redraw
+  if ( !mRedrawTime.isNull() )
+  {
+    emit dataChanged();
+  }
 }
 
 int QgsWFSProvider::getFeatureFILE( const QString& uri, const QString& geometryAttribute )
@@ -2002,6 +2046,11 @@ QString QgsWFSProvider::description() const
 
 int QgsWFSProvider::capabilities() const
 {
+  //no editing while features are still arriving, new feature ids could clash with the downloaded ones
+  if ( mDataReader && !mDataReader->isFinished() )
+  {
+    return 0;
+  }
   return mCapabilities;
 }
 
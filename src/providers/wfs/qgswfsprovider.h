@@ -19,6 +19,7 @@
 #define QGSWFSPROVIDER_H
 
 #include <QDomElement>
+#include <QTime>
 #include "qgis.h"
 #include "qgsrectangle.h"
 #include "qgscoordinatereferencesystem.h"
@@ -26,6 +27,7 @@
 
 class QgsRectangle;
 class QgsSpatialIndex;
+class QgsWFSData;
 
 /**A provider reading features from a WFS server*/
 class QgsWFSProvider: public QgsVectorDataProvider
@@ -151,6 +153,13 @@ class QgsWFSProvider: public QgsVectorDataProvider
     /**Sets mNetworkRequestFinished flag to true*/
     void networkRequestFinished();
 
+    /**Inserts a feature parsed by QgsWFSData into the spatial index and triggers
+      a redraw from time to time while the response is still arriving*/
+    void featureReceived( QgsFeature* f );
+
+    /**Called when QgsWFSData has parsed the complete response*/
+    void dataReaderFinished();
+
   private:
     bool mNetworkRequestFinished;
 
@@ -188,6 +197,13 @@ class QgsWFSProvider: public QgsVectorDataProvider
     QString mWfsNamespace;
     /**Server capabilities for this layer (generated from capabilities document)*/
     int mCapabilities;
+    /**Reader of the GetFeature response (0 for a GML file). It is kept after the download finished and
+      deleted with the data, isFinished() tells if the features are still arriving*/
+    QgsWFSData* mDataReader;
+    /**Thematic attributes by name, used by mDataReader*/
+    QMap<QString, QPair<int, QgsField> > mThematicAttributes;
+    /**Time since the last redraw during download, null while the provider is being constructed*/
+    QTime mRedrawTime;
 
 
     /**Collects information about the field types. Is called internally from QgsWFSProvider::getFeature. The method delegates the work to request specific ones and gives back the name of the geometry attribute and the thematic attributes with their types*/
@@ -22,6 +22,8 @@
 #include <typeinfo>
 
 #define WMS_THRESHOLD 200  // time to wait for an answer without emitting dataChanged() 
+#define WMS_MAX_TILE_REQUESTS 6 // default number of concurrent tile requests
+#define WMS_TILE_CACHE_SIZE ( 64 * 1024 * 1024 ) // memory for decoded tiles (in bytes)
 
 #include "qgslogger.h"
 #include "qgswmsprovider.h"
@@ -56,6 +58,7 @@
 #include <QEventLoop>
 #include <QCoreApplication>
 #include <QTime>
+#include <QTimer>
 
 #ifdef _MSC_VER
 #include <float.h>
@@ -72,6 +75,8 @@ static QString WMS_DESCRIPTION = "OGC Web Map Service version 1.3 data provider"
 
 static QString DEFAULT_LATLON_CRS = "CRS:84";
 
+QCache<QString, QImage> QgsWmsProvider::mTileCache( WMS_TILE_CACHE_SIZE );
+
 
 QgsWmsProvider::QgsWmsProvider( QString const &uri )
     : QgsRasterDataProvider( uri )
@@ -85,12 +90,15 @@ QgsWmsProvider::QgsWmsProvider( QString const &uri )
     , extentDirty( true )
     , mGetFeatureInfoUrlBase( "" )
     , mLayerCount( -1 )
+    , mWaiting( false )
     , mTileReqNo( 0 )
     , mCacheHits( 0 )
     , mCacheMisses( 0 )
     , mErrors( 0 )
     , mUserName( QString::null )
     , mPassword( QString::null )
+    , mTileChangeXY( false )
+    , mDataChangedScheduled( false )
 {
   // URL may contain username/password information for a WMS
   // requiring authentication. In this case the URL is prefixed
@@ -556,6 +564,7 @@ QImage *QgsWmsProvider::draw( QgsRectangle  const &viewExtent, int pixelWidth, i
 
     double tres = vres;
     int i;
+    int resolutionIndex = -1;
     if ( mResolutions.size() > 0 )
     {
 
@@ -571,22 +580,11 @@ QImage *QgsWmsProvider::draw( QgsRectangle  const &viewExtent, int pixelWidth, i
       }
 
       tres = mResolutions[i];
+      resolutionIndex = i;
     }
 
-    // clip view extent to layer extent
-    double xmin = qMax( viewExtent.xMinimum(), layerExtent.xMinimum() );
-    double ymin = qMax( viewExtent.yMinimum(), layerExtent.yMinimum() );
-    double xmax = qMin( viewExtent.xMaximum(), layerExtent.xMaximum() );
-    double ymax = qMin( viewExtent.yMaximum(), layerExtent.yMaximum() );
-
-    // snap to tile coordinates
-    double x0 = floor(( xmin - layerExtent.xMinimum() ) / mTileWidth / tres ) * mTileWidth * tres + layerExtent.xMinimum() + mTileWidth * tres * 0.001;
-    double y0 = floor(( ymin - layerExtent.yMinimum() ) / mTileHeight / tres ) * mTileHeight * tres + layerExtent.yMinimum() + mTileHeight * tres * 0.001;
-
-#ifdef QGISDEBUG
-    // calculate number of tiles
-    int n = ceil(( xmax - xmin ) / mTileWidth / tres ) * ceil(( ymax - ymin ) / mTileHeight / tres );
-#endif
+    int col0, col1, row0, row1;
+    tileRange( viewExtent, tres, col0, col1, row0, row1 );
 
     QgsDebugMsg( QString( "layer extent: %1,%2 %3x%4" )
                  .arg( layerExtent.xMinimum(), 0, 'f' )
@@ -601,94 +599,125 @@ QImage *QgsWmsProvider::draw( QgsRectangle  const &viewExtent, int pixelWidth, i
                  .arg( viewExtent.height() )
                  .arg( vres, 0, 'f' )
                );
-    QgsDebugMsg( QString( "tile extent: %1,%2 %3x%4 pixel:%5x%6 res:%7" )
-                 .arg( x0, 0, 'f' ).arg( y0, 0, 'f' )
-                 .arg( mTileWidth * tres, 0, 'f' ).arg( mTileHeight * tres, 0, 'f' )
+    QgsDebugMsg( QString( "tiles: columns %1-%2 rows %3-%4 pixel:%5x%6 res:%7" )
+                 .arg( col0 ).arg( col1 ).arg( row0 ).arg( row1 )
                  .arg( mTileWidth ).arg( mTileHeight )
                  .arg( tres, 0, 'f' )
                );
-    QgsDebugMsg( QString( "tile number: %1x%2 = %3" )
-                 .arg( ceil(( xmax - xmin ) / mTileWidth / tres ) )
-                 .arg( ceil(( ymax - ymin ) / mTileHeight / tres ) )
-                 .arg( n )
-               );
-
-#if 0
-    if ( n > 100 )
-    {
-      emit statusChanged( QString( "current view would need %1 tiles. tile request per draw limited to 100." ).arg( n ) );
-      return cachedImage;
-    }
-#endif
 
     // add WMS request
-    url += QString( "SERVICE=WMS&VERSION=%1&REQUEST=GetMap" ).arg( mCapabilities.version );
+    mTileUrl = url + QString( "SERVICE=WMS&VERSION=%1&REQUEST=GetMap" ).arg( mCapabilities.version );
+    mTileChangeXY = changeXY;
 
     // compose static request arguments.
-    QString urlargs;
-    urlargs += QString( "&%1=%2" ).arg( crsKey ).arg( imageCrs );
-    urlargs += QString( "&WIDTH=%1" ).arg( mTileWidth );
-    urlargs += QString( "&HEIGHT=%1" ).arg( mTileHeight );
-    urlargs += QString( "&LAYERS=%1" ).arg( activeSubLayers.join( "," ) );
-    urlargs += QString( "&STYLES=%1" ).arg( activeSubStyles.join( "," ) );
-    urlargs += QString( "&FORMAT=%1" ).arg( imageMimeType );
-    urlargs += QString( "&TILED=true" );
-
-    i = 0;
-    int j = 0;
-    double y = y0;
-    while ( y < ymax )
-    {
-      int k = 0;
-      double x = x0;
-      while ( x < xmax )
-      {
-        QString turl;
-        turl += url;
-        turl += QString( changeXY ? "&BBOX=%2,%1,%4,%3" : "&BBOX=%1,%2,%3,%4" )
-                .arg( x, 0, 'f' )
-                .arg( y, 0, 'f' )
-                .arg( x + mTileWidth * tres, 0, 'f' )
-                .arg( y + mTileHeight * tres, 0, 'f' );
-        turl += urlargs;
-
-        QNetworkRequest request( turl );
-        setAuthorization( request );
-        QgsDebugMsg( QString( "tileRequest %1 %2/%3: %4" ).arg( mTileReqNo ).arg( i++ ).arg( n ).arg( turl ) );
-        request.setAttribute( QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferCache );
-        request.setAttribute( QNetworkRequest::CacheSaveControlAttribute, true );
-        request.setAttribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 0 ), mTileReqNo );
-        request.setAttribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 1 ), i );
-        request.setAttribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 2 ), QRectF( x, y, mTileWidth * tres, mTileHeight * tres ) );
+    mTileUrlArgs = QString();
+    mTileUrlArgs += QString( "&%1=%2" ).arg( crsKey ).arg( imageCrs );
+    mTileUrlArgs += QString( "&WIDTH=%1" ).arg( mTileWidth );
+    mTileUrlArgs += QString( "&HEIGHT=%1" ).arg( mTileHeight );
+    mTileUrlArgs += QString( "&LAYERS=%1" ).arg( activeSubLayers.join( "," ) );
+    mTileUrlArgs += QString( "&STYLES=%1" ).arg( activeSubStyles.join( "," ) );
+    mTileUrlArgs += QString( "&FORMAT=%1" ).arg( imageMimeType );
+    mTileUrlArgs += QString( "&TILED=true" );
+
+    // requests of previous views that did not start yet are obsolete
+    mTileRequestQueue.clear();
+    mQueuedTileKeys.clear();
+    mVisibleTileKeys.clear();
+    mMissingVisibleTileKeys.clear();
+
+    // draw the tiles of the next coarser resolution as placeholders for missing tiles
+    if ( resolutionIndex >= 0 && resolutionIndex + 1 < mResolutions.size() )
+    {
+      drawCachedTiles( mResolutions[resolutionIndex + 1] );
+    }
+
+    // draw what is already in memory and request the rest
+    QPainter p( cachedImage );
+    for ( int row = row0; row <= row1; ++row )
+    {
+      for ( int col = col0; col <= col1; ++col )
+      {
+        QString key = tileKey( tres, col, row );
+        mVisibleTileKeys << key;
 
-        QgsDebugMsg( QString( "gettile: %1" ).arg( turl ) );
-        QNetworkReply *reply = QgsNetworkAccessManager::instance()->get( request );
-        tileReplies << reply;
-        connect( reply, SIGNAL( finished() ), this, SLOT( tileReplyFinished() ) );
+        QImage *tile = mTileCache.object( key );
+        if ( tile )
+        {
+          p.drawImage( tileTargetRect( tileRect( tres, col, row ) ), *tile );
+          continue;
+        }
 
-        x = x0 + ++k * mTileWidth * tres;
+        mMissingVisibleTileKeys << key;
+        queueTileRequest( tres, col, row, false );
       }
-      y = y0 + ++j * mTileHeight * tres;
     }
+    p.end();
 
-    emit statusChanged( tr( "Getting tiles via WMS." ) );
+    // prefetch the ring of tiles around the view and the tiles of the next finer resolution
+    if ( s.value( "/qgis/wms_prefetch_tiles", true ).toBool() )
+    {
+      int prefetchCol0, prefetchCol1, prefetchRow0, prefetchRow1;
+      tileRange( QgsRectangle( viewExtent.xMinimum() - mTileWidth * tres, viewExtent.yMinimum() - mTileHeight * tres,
+                               viewExtent.xMaximum() + mTileWidth * tres, viewExtent.yMaximum() + mTileHeight * tres ),
+                 tres, prefetchCol0, prefetchCol1, prefetchRow0, prefetchRow1 );
+      for ( int row = prefetchRow0; row <= prefetchRow1; ++row )
+      {
+        for ( int col = prefetchCol0; col <= prefetchCol1; ++col )
+        {
+          if ( col < col0 || col > col1 || row < row0 || row > row1 )
+          {
+            queueTileRequest( tres, col, row, true );
+          }
+        }
+      }
 
-    mWaiting = true;
+      if ( resolutionIndex > 0 )
+      {
+        double finerRes = mResolutions[resolutionIndex - 1];
+        tileRange( viewExtent, finerRes, prefetchCol0, prefetchCol1, prefetchRow0, prefetchRow1 );
+        for ( int row = prefetchRow0; row <= prefetchRow1; ++row )
+        {
+          for ( int col = prefetchCol0; col <= prefetchCol1; ++col )
+          {
+            queueTileRequest( finerRes, col, row, true );
+          }
+        }
+      }
+    }
 
-    QTime t;
-    t.start();
+    startTileRequests();
+
+    QgsDebugMsg( QString( "tiles: %1 visible, %2 missing, %3 queued, %4 running" )
+                 .arg( mVisibleTileKeys.size() ).arg( mMissingVisibleTileKeys.size() )
+                 .arg( mTileRequestQueue.size() ).arg( tileReplies.size() ) );
 
-    // draw everything that is retrieved within a second
-    // and the rest asynchronously
-    while ( !tileReplies.isEmpty() && ( !bkLayerCaching || t.elapsed() < WMS_THRESHOLD ) )
+    if ( !mMissingVisibleTileKeys.isEmpty() )
     {
-      QCoreApplication::processEvents( QEventLoop::ExcludeUserInputEvents, WMS_THRESHOLD );
+      emit statusChanged( tr( "Getting tiles via WMS." ) );
     }
 
-    mWaiting = false;
+    // With render caching the partial image is returned right away and the layer is redrawn
+    // as the missing tiles arrive. Otherwise (e.g. composer prints) all visible tiles are needed now.
+    // The wait ends when the last visible tile arrived or after the network timeout.
+    if ( !bkLayerCaching && !mMissingVisibleTileKeys.isEmpty() )
+    {
+      mWaiting = true;
+
+      QEventLoop loop;
+      connect( this, SIGNAL( visibleTilesFinished() ), &loop, SLOT( quit() ) );
+      QTimer::singleShot( s.value( "/qgis/networkAndProxy/networkTimeout", "60000" ).toInt(), &loop, SLOT( quit() ) );
+      loop.exec( QEventLoop::ExcludeUserInputEvents );
+
+      if ( !mMissingVisibleTileKeys.isEmpty() )
+      {
+        QgsDebugMsg( QString( "timeout: %1 visible tiles missing" ).arg( mMissingVisibleTileKeys.size() ) );
+      }
+
+      mWaiting = false;
+    }
 
 #ifdef QGISDEBUG
-    emit statusChanged( tr( "%n tile requests in background", "tile request count", tileReplies.count() )
+    emit statusChanged( tr( "%n tile requests in background", "tile request count", tileReplies.count() + mTileRequestQueue.count() )
                         + tr( ", %n cache hits", "tile cache hits", mCacheHits )
                         + tr( ", %n cache misses.", "tile cache missed", mCacheMisses )
                         + tr( ", %n errors.", "errors", mErrors )
@@ -749,6 +778,7 @@ void QgsWmsProvider::tileReplyFinished()
   int tileReqNo = reply->request().attribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 0 ) ).toInt();
   int tileNo = reply->request().attribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 1 ) ).toInt();
   QRectF r = reply->request().attribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 2 ) ).toRectF();
+  QString key = reply->request().attribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 3 ) ).toString();
 
 #if QT_VERSION >= 0x40500
   QgsDebugMsg( QString( "tile reply %1 (%2) tile:%3 rect:%4,%5 %6x%7) fromcache:%8 error:%9" )
@@ -765,6 +795,9 @@ void QgsWmsProvider::tileReplyFinished()
              );
 #endif
 
+  tileReplies.removeOne( reply );
+  reply->deleteLater();
+
   if ( reply->error() == QNetworkReply::NoError )
   {
     QVariant redirect = reply->attribute( QNetworkRequest::RedirectionTargetAttribute );
@@ -774,12 +807,11 @@ void QgsWmsProvider::tileReplyFinished()
       setAuthorization( request );
       request.setAttribute( QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferCache );
       request.setAttribute( QNetworkRequest::CacheSaveControlAttribute, true );
-      request.setAttribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 0 ), tileReqNo );
-      request.setAttribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 1 ), tileNo );
-      request.setAttribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 2 ), r );
-
-      tileReplies.removeOne( reply );
-      reply->deleteLater();
+      for ( int i = 0; i < 5; i++ )
+      {
+        QNetworkRequest::Attribute attribute = static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + i );
+        request.setAttribute( attribute, reply->request().attribute( attribute ) );
+      }
 
       QgsDebugMsg( QString( "redirected gettile: %1" ).arg( redirect.toString() ) );
       reply = QgsNetworkAccessManager::instance()->get( request );
@@ -791,21 +823,16 @@ void QgsWmsProvider::tileReplyFinished()
     }
 
     QVariant status = reply->attribute( QNetworkRequest::HttpStatusCodeAttribute );
+    QString contentType = reply->header( QNetworkRequest::ContentTypeHeader ).toString();
+    QgsDebugMsg( "contentType: " + contentType );
     if ( !status.isNull() && status.toInt() >= 400 )
     {
       QVariant phrase = reply->attribute( QNetworkRequest::HttpReasonPhraseAttribute );
 
       showMessageBox( tr( "Tile request error" ), tr( "Status: %1\nReason phrase: %2" ).arg( status.toInt() ).arg( phrase.toString() ) );
-
-      tileReplies.removeOne( reply );
-      reply->deleteLater();
-
-      return;
+      mErrors++;
     }
-
-    QString contentType = reply->header( QNetworkRequest::ContentTypeHeader ).toString();
-    QgsDebugMsg( "contentType: " + contentType );
-    if ( !contentType.startsWith( "image/" ) )
+    else if ( !contentType.startsWith( "image/" ) )
     {
       QByteArray text = reply->readAll();
       if ( contentType == "text/xml" && parseServiceExceptionReportDom( text ) )
@@ -816,59 +843,62 @@ void QgsWmsProvider::tileReplyFinished()
       {
         showMessageBox( "Tile request error", tr( "response: %1" ).arg( QString::fromUtf8( text ) ) );
       }
-
-      tileReplies.removeOne( reply );
-      reply->deleteLater();
-
-      return;
+      mErrors++;
     }
-
-    // only take results from current request number
-    if ( mTileReqNo == tileReqNo )
+    else
     {
-      double cr = cachedViewExtent.width() / cachedViewWidth;
-
-      QRectF dst(( r.left() - cachedViewExtent.xMinimum() ) / cr,
-                 ( cachedViewExtent.yMaximum() - r.bottom() ) / cr,
-                 r.width() / cr,
-                 r.height() / cr );
-
       QgsDebugMsg( QString( "tile reply: %1" ).arg( reply->bytesAvailable() ) );
-      QImage myLocalImage = QImage::fromData( reply->readAll() );
-
-      // myLocalImage.save( QString( "%1/%2-tile-%3.png" ).arg( QDir::tempPath() ).arg( mTileReqNo ).arg( tileNo ) );
+      QImage *tile = new QImage( QImage::fromData( reply->readAll() ) );
+      if ( tile->isNull() )
+      {
+        // not cached, the tile is requested again when it is needed
+        QgsDebugMsg( QString( "tile %1 could not be decoded" ).arg( key ) );
+        delete tile;
+        mErrors++;
+      }
+      else
+      {
+        // tile->save( QString( "%1/%2-tile-%3.png" ).arg( QDir::tempPath() ).arg( mTileReqNo ).arg( tileNo ) );
 
-      QPainter p( cachedImage );
-      p.drawImage( dst, myLocalImage );
+        // draw tiles of the current view, also if they were requested for a previous view or prefetched
+        if ( mVisibleTileKeys.contains( key ) && cachedImage )
+        {
+          QRectF dst = tileTargetRect( r );
+          QPainter p( cachedImage );
+          p.drawImage( dst, *tile );
 
 #if 0
-      p.drawRect( dst ); // show tile bounds
-      p.drawText( dst, Qt::AlignCenter, QString( "(%1)\n%2,%3\n%4,%5\n%6x%7" )
-                  .arg( tileNo )
-                  .arg( r.left() ).arg( r.bottom() )
-                  .arg( r.right() ).arg( r.top() )
-                  .arg( r.width() ).arg( r.height() ) );
+          p.drawRect( dst ); // show tile bounds
+          p.drawText( dst, Qt::AlignCenter, QString( "(%1)\n%2,%3\n%4,%5\n%6x%7" )
+                      .arg( tileNo )
+                      .arg( r.left() ).arg( r.bottom() )
+                      .arg( r.right() ).arg( r.top() )
+                      .arg( r.width() ).arg( r.height() ) );
 #endif
-    }
 
-    tileReplies.removeOne( reply );
-    reply->deleteLater();
+          scheduleDataChanged();
+        }
 
-    if ( !mWaiting )
-    {
-      QgsDebugMsg( "emit dataChanged()" );
-      emit dataChanged();
+        mTileCache.insert( key, tile, tile->bytesPerLine() * tile->height() );
+      }
     }
   }
   else
   {
-    tileReplies.removeOne( reply );
-    reply->deleteLater();
     mErrors++;
   }
 
+  mRunningTileKeys.remove( key );
+  mMissingVisibleTileKeys.remove( key );
+  startTileRequests();
+
+  if ( mWaiting && mMissingVisibleTileKeys.isEmpty() )
+  {
+    emit visibleTilesFinished();
+  }
+
 #ifdef QGISDEBUG
-  emit statusChanged( tr( "%n tile requests in background", "tile request count", tileReplies.count() )
+  emit statusChanged( tr( "%n tile requests in background", "tile request count", tileReplies.count() + mTileRequestQueue.count() )
                       + tr( ", %n cache hits", "tile cache hits", mCacheHits )
                       + tr( ", %n cache misses.", "tile cache missed", mCacheMisses )
                       + tr( ", %n errors.", "errors", mErrors )
@@ -876,6 +906,156 @@ void QgsWmsProvider::tileReplyFinished()
 #endif
 }
 
+QString QgsWmsProvider::tileKey( double tres, int col, int row ) const
+{
+  return QString( "%1|%2|%3|%4|%5|%6|%7|%8" )
+         .arg( mBaseUrl )
+         .arg( activeSubLayers.join( "," ) )
+         .arg( activeSubStyles.join( "," ) )
+         .arg( imageCrs )
+         .arg( imageMimeType )
+         .arg( tres, 0, 'g', 17 )
+         .arg( col )
+         .arg( row );
+}
+
+QRectF QgsWmsProvider::tileRect( double tres, int col, int row ) const
+{
+  // tile coordinates are moved by a small fraction of the tile size into the tile
+  // (servers snapping the requests to their tile grid would otherwise get rounding issues)
+  double w = mTileWidth * tres;
+  double h = mTileHeight * tres;
+  return QRectF( layerExtent.xMinimum() + col * w + w * 0.001, layerExtent.yMinimum() + row * h + h * 0.001, w, h );
+}
+
+QRectF QgsWmsProvider::tileTargetRect( const QRectF& r ) const
+{
+  double cr = cachedViewExtent.width() / cachedViewWidth;
+
+  return QRectF(( r.left() - cachedViewExtent.xMinimum() ) / cr,
+                ( cachedViewExtent.yMaximum() - r.bottom() ) / cr,
+                r.width() / cr,
+                r.height() / cr );
+}
+
+void QgsWmsProvider::tileRange( const QgsRectangle& viewExtent, double tres, int& col0, int& col1, int& row0, int& row1 ) const
+{
+  // clip view extent to layer extent
+  double xmin = qMax( viewExtent.xMinimum(), layerExtent.xMinimum() );
+  double ymin = qMax( viewExtent.yMinimum(), layerExtent.yMinimum() );
+  double xmax = qMin( viewExtent.xMaximum(), layerExtent.xMaximum() );
+  double ymax = qMin( viewExtent.yMaximum(), layerExtent.yMaximum() );
+
+  double w = mTileWidth * tres;
+  double h = mTileHeight * tres;
+
+  col0 = ( int ) floor(( xmin - layerExtent.xMinimum() ) / w );
+  row0 = ( int ) floor(( ymin - layerExtent.yMinimum() ) / h );
+  col1 = xmax > xmin ? qMax( col0, ( int ) ceil(( xmax - layerExtent.xMinimum() ) / w ) - 1 ) : col0 - 1;
+  row1 = ymax > ymin ? qMax( row0, ( int ) ceil(( ymax - layerExtent.yMinimum() ) / h ) - 1 ) : row0 - 1;
+}
+
+void QgsWmsProvider::drawCachedTiles( double tres )
+{
+  int col0, col1, row0, row1;
+  tileRange( cachedViewExtent, tres, col0, col1, row0, row1 );
+
+  QPainter p( cachedImage );
+  p.setRenderHint( QPainter::SmoothPixmapTransform );
+  for ( int row = row0; row <= row1; ++row )
+  {
+    for ( int col = col0; col <= col1; ++col )
+    {
+      QImage *tile = mTileCache.object( tileKey( tres, col, row ) );
+      if ( tile )
+      {
+        p.drawImage( tileTargetRect( tileRect( tres, col, row ) ), *tile );
+      }
+    }
+  }
+}
+
+void QgsWmsProvider::queueTileRequest( double tres, int col, int row, bool prefetch )
+{
+  QString key = tileKey( tres, col, row );
+  if ( mTileCache.contains( key ) || mRunningTileKeys.contains( key ) || mQueuedTileKeys.contains( key ) )
+  {
+    return;
+  }
+
+  QRectF r = tileRect( tres, col, row );
+
+  QString turl;
+  turl += mTileUrl;
+  turl += QString( mTileChangeXY ? "&BBOX=%2,%1,%4,%3" : "&BBOX=%1,%2,%3,%4" )
+          .arg( r.left(), 0, 'f' )
+          .arg( r.top(), 0, 'f' )
+          .arg( r.right(), 0, 'f' )
+          .arg( r.bottom(), 0, 'f' );
+  turl += mTileUrlArgs;
+
+  QNetworkRequest request( turl );
+  setAuthorization( request );
+  request.setAttribute( QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferCache );
+  request.setAttribute( QNetworkRequest::CacheSaveControlAttribute, true );
+  request.setAttribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 0 ), mTileReqNo );
+  request.setAttribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 1 ), mTileRequestQueue.size() );
+  request.setAttribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 2 ), r );
+  request.setAttribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 3 ), key );
+  request.setAttribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 4 ), prefetch );
+
+  QgsDebugMsgLevel( QString( "tileRequest %1 %2%3: %4" ).arg( mTileReqNo ).arg( mTileRequestQueue.size() )
+                    .arg( prefetch ? " (prefetch)" : "" ).arg( turl ), 3 );
+
+  mTileRequestQueue << request;
+  mQueuedTileKeys << key;
+}
+
+void QgsWmsProvider::startTileRequests()
+{
+  QSettings s;
+  int maxRequests = qMax( 1, s.value( "/qgis/wms_max_tile_requests", WMS_MAX_TILE_REQUESTS ).toInt() );
+
+  while ( tileReplies.size() < maxRequests && !mTileRequestQueue.isEmpty() )
+  {
+    QNetworkRequest request = mTileRequestQueue.takeFirst();
+    QString key = request.attribute( static_cast<QNetworkRequest::Attribute>( QNetworkRequest::User + 3 ) ).toString();
+    mQueuedTileKeys.remove( key );
+
+    // may have arrived in the meantime as a redirected or duplicate request
+    if ( mTileCache.contains( key ) )
+    {
+      mMissingVisibleTileKeys.remove( key );
+      continue;
+    }
+
+    QgsDebugMsg( QString( "gettile: %1" ).arg( request.url().toString() ) );
+    QNetworkReply *reply = QgsNetworkAccessManager::instance()->get( request );
+    tileReplies << reply;
+    mRunningTileKeys << key;
+    connect( reply, SIGNAL( finished() ), this, SLOT( tileReplyFinished() ) );
+  }
+}
+
+void QgsWmsProvider::scheduleDataChanged()
+{
+  // tiles arriving together are drawn with one refresh of the layer
+  if ( mWaiting || mDataChangedScheduled )
+  {
+    return;
+  }
+
+  mDataChangedScheduled = true;
+  QTimer::singleShot( WMS_THRESHOLD, this, SLOT( emitDataChanged() ) );
+}
+
+void QgsWmsProvider::emitDataChanged()
+{
+  mDataChangedScheduled = false;
+  QgsDebugMsg( "emit dataChanged()" );
+  emit dataChanged();
+}
+
 void QgsWmsProvider::cacheReplyFinished()
 {
   if ( cacheReply->error() == QNetworkReply::NoError )
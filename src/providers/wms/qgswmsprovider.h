@@ -27,7 +27,11 @@
 #include <QString>
 #include <QStringList>
 #include <QDomElement>
+#include <QCache>
+#include <QImage>
 #include <QMap>
+#include <QNetworkRequest>
+#include <QSet>
 #include <QVector>
 
 class QgsCoordinateTransform;
@@ -650,6 +654,9 @@ class QgsWmsProvider : public QgsRasterDataProvider
 
     void dataChanged();
 
+    /** \brief emitted when the last missing tile of the view arrived (or failed) while draw() waits for it */
+    void visibleTilesFinished();
+
   private slots:
     void cacheReplyFinished();
     void cacheReplyProgress( qint64, qint64 );
@@ -657,6 +664,7 @@ class QgsWmsProvider : public QgsRasterDataProvider
     void capabilitiesReplyProgress( qint64, qint64 );
     void identifyReplyFinished();
     void tileReplyFinished();
+    void emitDataChanged();
 
   private:
     void showMessageBox( const QString& title, const QString& text );
@@ -963,6 +971,54 @@ class QgsWmsProvider : public QgsRasterDataProvider
 
     //! supported formats for GetFeatureInfo in order of preference
     QStringList mSupportedGetFeatureFormats;
+
+    //! GetMap url and static arguments of the tile requests of the current view
+    QString mTileUrl;
+    QString mTileUrlArgs;
+    bool mTileChangeXY;
+
+    //! tile requests waiting for a free connection, visible tiles first, prefetched tiles last
+    QList<QNetworkRequest> mTileRequestQueue;
+    QSet<QString> mQueuedTileKeys;
+    QSet<QString> mRunningTileKeys;
+
+    //! tiles of the current view and those of them that did not arrive yet
+    QSet<QString> mVisibleTileKeys;
+    QSet<QString> mMissingVisibleTileKeys;
+
+    //! set while a dataChanged() signal is pending
+    bool mDataChangedScheduled;
+
+    /**
+     * Decoded tiles of all WMS layers, keyed by server, layers, styles, CRS, format, resolution
+     * and tile index. The cost is the size of the image in bytes. The encoded tiles are also kept
+     * in the disk cache of the network access manager.
+     */
+    static QCache<QString, QImage> mTileCache;
+
+    //! key of a tile in the tile cache
+    QString tileKey( double tres, int col, int row ) const;
+
+    //! extent of a tile in map coordinates
+    QRectF tileRect( double tres, int col, int row ) const;
+
+    //! pixel rectangle of a map rectangle in the cached image
+    QRectF tileTargetRect( const QRectF& r ) const;
+
+    //! tiles of a resolution covering the view extent (clipped to the layer extent)
+    void tileRange( const QgsRectangle& viewExtent, double tres, int& col0, int& col1, int& row0, int& row1 ) const;
+
+    //! draw the tiles of a resolution that are in the tile cache into the cached image
+    void drawCachedTiles( double tres );
+
+    //! queue request for a tile unless it is cached or already requested
+    void queueTileRequest( double tres, int col, int row, bool prefetch );
+
+    //! start queued tile requests up to the maximum number of concurrent requests
+    void startTileRequests();
+
+    //! emit dataChanged() after WMS_THRESHOLD ms to draw tiles arriving together in one go
+    void scheduleDataChanged();
 };
 
 class QgsWMSConnectionItem : public QgsDataCollectionItem
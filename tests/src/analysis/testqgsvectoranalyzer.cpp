@@ -16,8 +16,13 @@ Email                : sherman at mrcc dot com
 
 //header for class being tested
 #include <qgsgeometryanalyzer.h>
+#include <qgsoverlayanalyzer.h>
 #include <qgsapplication.h>
 #include <qgsproviderregistry.h>
+#include <qgsgeometry.h>
+#include <qgsvectordataprovider.h>
+#include <qgsvectorfilewriter.h>
+#include <qgsvectorlayer.h>
 
 class TestQgsVectorAnalyzer: public QObject
 {
@@ -36,7 +41,25 @@ class TestQgsVectorAnalyzer: public QObject
     void simplifyGeometry(  );
     void polygonCentroids(  );
     void layerExtent(  );
+    void dissolve(  );
+    void bufferDissolve(  );
+    void overlayIntersection(  );
+    void overlayUnion(  );
+    void overlayClip(  );
+    void overlayDifference(  );
+    void overlaySymDifference(  );
   private:
+    /** Runs an overlay operation of two small layers and returns the areas of the output features */
+    QList<double> overlayAreas( bool ( QgsOverlayAnalyzer::*operation )( QgsVectorLayer*, QgsVectorLayer*, const QString&, bool, QProgressDialog* ),
+                                const QString& fileName );
+    /** True if the areas are equal to the expected ones */
+    bool compareAreas( const QList<double>& areas, const QList<double>& expected );
+
+    /** Memory layer with a polygon for each WKT and a class attribute */
+    QgsVectorLayer* polygonLayer( const QStringList& wkts, const QStringList& classes );
+    /** Areas of the features of a shapefile, sorted */
+    QList<double> featureAreas( const QString& fileName );
+
     QgsGeometryAnalyzer mAnalyzer;
     QgsVectorLayer * mpLineLayer;
     QgsVectorLayer * mpPolyLayer;
@@ -133,6 +156,182 @@ void TestQgsVectorAnalyzer::layerExtent(  )
   QVERIFY( mAnalyzer.extent( mpPointLayer, myFileName ) );
 }
 
+void TestQgsVectorAnalyzer::dissolve(  )
+{
+  QStringList wkts;
+  wkts << "POLYGON((0 0,1 0,1 1,0 1,0 0))"
+  << "POLYGON((1 0,2 0,2 1,1 1,1 0))"
+  << "POLYGON((5 5,6 5,6 6,5 6,5 5))"
+  << "POLYGON((0 1,1 1,1 2,0 2,0 1))";
+  QStringList classes;
+  classes << "a" << "a" << "b" << "a";
+  QgsVectorLayer* layer = polygonLayer( wkts, classes );
+
+  QString myFileName = QDir::tempPath() + QDir::separator() + "dissolve_layer.shp";
+  QgsVectorFileWriter::deleteShapeFile( myFileName );
+  QVERIFY( mAnalyzer.dissolve( layer, myFileName, false, 0 ) );
+  delete layer;
+
+  //one feature for each class, the adjacent squares are merged
+  QList<double> areas = featureAreas( myFileName );
+  QCOMPARE( areas.size(), 2 );
+  QVERIFY( qAbs( areas[0] - 1.0 ) < 1e-9 );
+  QVERIFY( qAbs( areas[1] - 3.0 ) < 1e-9 );
+}
+
+void TestQgsVectorAnalyzer::bufferDissolve(  )
+{
+  QStringList wkts;
+  wkts << "POLYGON((0 0,1 0,1 1,0 1,0 0))"
+  << "POLYGON((1.5 0,2.5 0,2.5 1,1.5 1,1.5 0))";
+  QStringList classes;
+  classes << "a" << "b";
+  QgsVectorLayer* layer = polygonLayer( wkts, classes );
+
+  QString myTmpDir = QDir::tempPath() + QDir::separator();
+  QString mySeparateFileName = myTmpDir + "buffer_layer.shp";
+  QgsVectorFileWriter::deleteShapeFile( mySeparateFileName );
+  QVERIFY( mAnalyzer.buffer( layer, mySeparateFileName, 0.5, false, false ) );
+  QString myDissolveFileName = myTmpDir + "buffer_dissolve_layer.shp";
+  QgsVectorFileWriter::deleteShapeFile( myDissolveFileName );
+  QVERIFY( mAnalyzer.buffer( layer, myDissolveFileName, 0.5, false, true ) );
+  delete layer;
+
+  QList<double> separateAreas = featureAreas( mySeparateFileName );
+  QCOMPARE( separateAreas.size(), 2 );
+
+  //the buffers overlap, the dissolved buffer is one feature smaller than the sum of the buffers
+  QList<double> dissolveAreas = featureAreas( myDissolveFileName );
+  QCOMPARE( dissolveAreas.size(), 1 );
+  QVERIFY( dissolveAreas[0] < separateAreas[0] + separateAreas[1] - 0.1 );
+  QVERIFY( dissolveAreas[0] > separateAreas[1] );
+}
+
+// layer A: a 2x2 square overlapping the square of layer B by 1x1 and a unit square apart
+// layer B: a 2x2 square
+void TestQgsVectorAnalyzer::overlayIntersection(  )
+{
+  QString myFileName = QDir::tempPath() + QDir::separator() + "intersection_layer.shp";
+  QList<double> expected;
+  expected << 1.0;
+  QVERIFY( compareAreas( overlayAreas( &QgsOverlayAnalyzer::intersection, myFileName ), expected ) );
+
+  //the intersection has the attributes of both layers
+  QgsVectorLayer layer( myFileName, "result", "ogr" );
+  QVERIFY( layer.isValid() );
+  layer.select( layer.pendingAllAttributesList(), QgsRectangle(), true, false );
+  QgsFeature feature;
+  QVERIFY( layer.nextFeature( feature ) );
+  QCOMPARE( feature.attributeMap().value( 0 ).toString(), QString( "a1" ) );
+  QCOMPARE( feature.attributeMap().value( 1 ).toString(), QString( "b1" ) );
+}
+
+void TestQgsVectorAnalyzer::overlayUnion(  )
+{
+  QString myFileName = QDir::tempPath() + QDir::separator() + "union_layer.shp";
+  //intersection, A1 without B, A2, B without A1
+  QList<double> expected;
+  expected << 1.0 << 1.0 << 3.0 << 3.0;
+  QVERIFY( compareAreas( overlayAreas( &QgsOverlayAnalyzer::combine, myFileName ), expected ) );
+}
+
+void TestQgsVectorAnalyzer::overlayClip(  )
+{
+  QString myFileName = QDir::tempPath() + QDir::separator() + "clip_layer.shp";
+  //A2 is outside of B
+  QList<double> expected;
+  expected << 1.0;
+  QVERIFY( compareAreas( overlayAreas( &QgsOverlayAnalyzer::clip, myFileName ), expected ) );
+}
+
+void TestQgsVectorAnalyzer::overlayDifference(  )
+{
+  QString myFileName = QDir::tempPath() + QDir::separator() + "difference_layer.shp";
+  QList<double> expected;
+  expected << 1.0 << 3.0;
+  QVERIFY( compareAreas( overlayAreas( &QgsOverlayAnalyzer::difference, myFileName ), expected ) );
+}
+
+void TestQgsVectorAnalyzer::overlaySymDifference(  )
+{
+  QString myFileName = QDir::tempPath() + QDir::separator() + "symdifference_layer.shp";
+  QList<double> expected;
+  expected << 1.0 << 3.0 << 3.0;
+  QVERIFY( compareAreas( overlayAreas( &QgsOverlayAnalyzer::symDifference, myFileName ), expected ) );
+}
+
+QList<double> TestQgsVectorAnalyzer::overlayAreas( bool ( QgsOverlayAnalyzer::*operation )( QgsVectorLayer*, QgsVectorLayer*, const QString&, bool, QProgressDialog* ),
+    const QString& fileName )
+{
+  QStringList wktsA;
+  wktsA << "POLYGON((0 0,2 0,2 2,0 2,0 0))" << "POLYGON((10 10,11 10,11 11,10 11,10 10))";
+  QStringList classesA;
+  classesA << "a1" << "a2";
+  QgsVectorLayer* layerA = polygonLayer( wktsA, classesA );
+  QStringList wktsB;
+  wktsB << "POLYGON((1 1,3 1,3 3,1 3,1 1))";
+  QStringList classesB;
+  classesB << "b1";
+  QgsVectorLayer* layerB = polygonLayer( wktsB, classesB );
+
+  QgsVectorFileWriter::deleteShapeFile( fileName );
+  QgsOverlayAnalyzer analyzer;
+  bool ok = ( analyzer.*operation )( layerA, layerB, fileName, false, 0 );
+  delete layerA;
+  delete layerB;
+  return ok ? featureAreas( fileName ) : QList<double>();
+}
+
+bool TestQgsVectorAnalyzer::compareAreas( const QList<double>& areas, const QList<double>& expected )
+{
+  if ( areas.size() != expected.size() )
+  {
+    return false;
+  }
+  for ( int i = 0; i < areas.size(); ++i )
+  {
+    if ( qAbs( areas[i] - expected[i] ) > 1e-9 )
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+QgsVectorLayer* TestQgsVectorAnalyzer::polygonLayer( const QStringList& wkts, const QStringList& classes )
+{
+  QgsVectorLayer* layer = new QgsVectorLayer( "Polygon?field=class:string", "polygons", "memory" );
+  QgsFeatureList features;
+  for ( int i = 0; i < wkts.size(); ++i )
+  {
+    QgsFeature feature;
+    feature.setGeometry( QgsGeometry::fromWkt( wkts[i] ) );
+    feature.addAttribute( 0, classes.value( i ) );
+    features << feature;
+  }
+  layer->dataProvider()->addFeatures( features );
+  layer->updateExtents();
+  return layer;
+}
+
+QList<double> TestQgsVectorAnalyzer::featureAreas( const QString& fileName )
+{
+  QList<double> areas;
+  QgsVectorLayer layer( fileName, "result", "ogr" );
+  if ( !layer.isValid() )
+  {
+    return areas;
+  }
+  layer.select( QgsAttributeList(), QgsRectangle(), true, false );
+  QgsFeature feature;
+  while ( layer.nextFeature( feature ) )
+  {
+    areas << ( feature.geometry() ? feature.geometry()->area() : 0.0 );
+  }
+  qSort( areas );
+  return areas;
+}
+
 QTEST_MAIN( TestQgsVectorAnalyzer )
 #include "moc_testqgsvectoranalyzer.cxx"
 
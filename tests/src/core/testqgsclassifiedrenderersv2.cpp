@@ -0,0 +1,190 @@
+/***************************************************************************
+                              testqgsclassifiedrenderersv2.cpp
+                              -----------------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QString>
+#include <QImage>
+#include <QPainter>
+#include <QVariant>
+
+//qgis includes...
+#include <qgsapplication.h>
+#include <qgsfeature.h>
+#include <qgsproviderregistry.h>
+#include <qgsrendercontext.h>
+#include <qgsvectorlayer.h>
+#include <qgssymbolv2.h>
+#include <qgscategorizedsymbolrendererv2.h>
+#include <qgsgraduatedsymbolrendererv2.h>
+
+/** \ingroup UnitTests
+ * This is a unit test for the symbol lookup of the categorized and graduated
+ * renderers. The results are compared with a plain search through the classes.
+ */
+class TestQgsClassifiedRenderersV2: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {};// will be called before each testfunction is executed.
+    void cleanup() {};// will be called after every testfunction.
+
+    void graduatedSortedRanges();
+    void graduatedOverlappingRanges();
+    void categorizedValues();
+  private:
+    /** Compares the symbols of the renderer for the values with the first range containing the value */
+    void checkGraduated( QgsGraduatedSymbolRendererV2* renderer, const QList<double>& values );
+    /** Feature with the value as the only attribute */
+    QgsFeature feature( const QVariant& value );
+
+    QgsVectorLayer* mpLayer;
+    QImage mImage;
+    QPainter* mpPainter;
+    QgsRenderContext mContext;
+};
+
+void TestQgsClassifiedRenderersV2::initTestCase()
+{
+  // init QGIS's paths - true means that all path will be inited from prefix
+  QgsApplication::setPrefixPath( INSTALL_PREFIX, true );
+  QgsApplication::showSettings();
+  // Instantiate the plugin directory so that providers are loaded
+  QgsProviderRegistry::instance( QgsApplication::pluginPath() );
+
+  // the renderers only take the attribute index from the layer
+  mpLayer = new QgsVectorLayer( "Point?field=value:string", "points", "memory" );
+
+  mImage = QImage( 10, 10, QImage::Format_ARGB32 );
+  mpPainter = new QPainter( &mImage );
+  mContext.setPainter( mpPainter );
+}
+
+void TestQgsClassifiedRenderersV2::cleanupTestCase()
+{
+  delete mpPainter;
+  delete mpLayer;
+}
+
+QgsFeature TestQgsClassifiedRenderersV2::feature( const QVariant& value )
+{
+  QgsFeature f;
+  f.addAttribute( 0, value );
+  return f;
+}
+
+void TestQgsClassifiedRenderersV2::checkGraduated( QgsGraduatedSymbolRendererV2* renderer, const QList<double>& values )
+{
+  renderer->startRender( mContext, mpLayer );
+  const QgsRangeList& ranges = renderer->ranges();
+  for ( int i = 0; i < values.size(); ++i )
+  {
+    double value = values[i];
+    QgsSymbolV2* expected = 0;
+    for ( int j = 0; j < ranges.size() && !expected; ++j )
+    {
+      if ( ranges[j].lowerValue() <= value && ranges[j].upperValue() >= value )
+        expected = ranges[j].symbol();
+    }
+
+    QgsFeature f = feature( value );
+    QCOMPARE( renderer->symbolForFeature( f ), expected );
+  }
+  renderer->stopRender( mContext );
+}
+
+void TestQgsClassifiedRenderersV2::graduatedSortedRanges()
+{
+  // many adjacent classes: looked up by binary search
+  QgsRangeList ranges;
+  for ( int i = 0; i < 200; ++i )
+  {
+    ranges << QgsRendererRangeV2( i * 5.0, ( i + 1 ) * 5.0, QgsSymbolV2::defaultSymbol( QGis::Point ), QString::number( i ) );
+  }
+  // a gap between the last two classes
+  ranges << QgsRendererRangeV2( 1010, 1020, QgsSymbolV2::defaultSymbol( QGis::Point ), "gap" );
+  QgsGraduatedSymbolRendererV2 renderer( "value", ranges );
+
+  QList<double> values;
+  values << -1 << 0 << 0.5 << 5 << 5.000001 << 499.99 << 500 << 999 << 1000 << 1000.5 << 1005 << 1010 << 1015 << 1020 << 1021;
+  for ( int i = 0; i < 1000; ++i )
+  {
+    values << i * 1.03;
+  }
+  checkGraduated( &renderer, values );
+
+  // a value on a shared bound belongs to the lower class
+  renderer.startRender( mContext, mpLayer );
+  QgsFeature f = feature( 5.0 );
+  QCOMPARE( renderer.symbolForFeature( f ), renderer.ranges()[0].symbol() );
+  renderer.stopRender( mContext );
+}
+
+void TestQgsClassifiedRenderersV2::graduatedOverlappingRanges()
+{
+  // unsorted and overlapping classes: the first matching class wins
+  QgsRangeList ranges;
+  ranges << QgsRendererRangeV2( 50, 100, QgsSymbolV2::defaultSymbol( QGis::Point ), "a" );
+  ranges << QgsRendererRangeV2( 0, 60, QgsSymbolV2::defaultSymbol( QGis::Point ), "b" );
+  ranges << QgsRendererRangeV2( 80, 200, QgsSymbolV2::defaultSymbol( QGis::Point ), "c" );
+  QgsGraduatedSymbolRendererV2 renderer( "value", ranges );
+
+  QList<double> values;
+  for ( int i = -10; i < 220; ++i )
+  {
+    values << i;
+  }
+  checkGraduated( &renderer, values );
+}
+
+void TestQgsClassifiedRenderersV2::categorizedValues()
+{
+  QgsCategoryList categories;
+  categories << QgsRendererCategoryV2( 1, QgsSymbolV2::defaultSymbol( QGis::Point ), "int" );
+  categories << QgsRendererCategoryV2( "2", QgsSymbolV2::defaultSymbol( QGis::Point ), "int string" );
+  categories << QgsRendererCategoryV2( 2.5, QgsSymbolV2::defaultSymbol( QGis::Point ), "double" );
+  categories << QgsRendererCategoryV2( "1.50", QgsSymbolV2::defaultSymbol( QGis::Point ), "non canonical double string" );
+  categories << QgsRendererCategoryV2( "abc", QgsSymbolV2::defaultSymbol( QGis::Point ), "string" );
+  categories << QgsRendererCategoryV2( "", QgsSymbolV2::defaultSymbol( QGis::Point ), "empty" );
+  QgsCategorizedSymbolRendererV2 renderer( "value", categories );
+
+  QList<QVariant> values;
+  values << QVariant( 1 ) << QVariant(( qlonglong ) 1 ) << QVariant( 1.0 ) << QVariant( "1" ) << QVariant( "1.0" )
+  << QVariant( 2 ) << QVariant( 2.0 ) << QVariant( "2" ) << QVariant( -2 )
+  << QVariant( 2.5 ) << QVariant( "2.5" ) << QVariant( 2.50000001 )
+  << QVariant( 1.5 ) << QVariant( "1.50" )
+  << QVariant( "abc" ) << QVariant( "ABC" ) << QVariant( 7 )
+  << QVariant( QVariant::String ) << QVariant( QVariant::Int ) << QVariant( "" );
+
+  renderer.startRender( mContext, mpLayer );
+  const QgsCategoryList& cats = renderer.categories();
+  for ( int i = 0; i < values.size(); ++i )
+  {
+    // the categories match by the string form of the value
+    QgsSymbolV2* expected = 0;
+    for ( int j = 0; j < cats.size() && !expected; ++j )
+    {
+      if ( cats[j].value().toString() == values[i].toString() )
+        expected = cats[j].symbol();
+    }
+
+    QgsFeature f = feature( values[i] );
+    QCOMPARE( renderer.symbolForFeature( f ), expected );
+  }
+  renderer.stopRender( mContext );
+}
+
+QTEST_MAIN( TestQgsClassifiedRenderersV2 )
+#include "moc_testqgsclassifiedrenderersv2.cxx"
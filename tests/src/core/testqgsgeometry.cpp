@@ -55,6 +55,7 @@ class TestQgsGeometry: public QObject
     void differenceCheck1();
     void differenceCheck2();
     void bufferCheck();
+    void chainedOperationsCheck();
   private:
     /** A helper method to do a render check to see if the geometry op is as expected */
     bool renderCheck( QString theTestName, QString theComment = "" );
@@ -306,6 +307,34 @@ void TestQgsGeometry::bufferCheck()
   delete mypBufferGeometry;
   QVERIFY( renderCheck( "geometry_bufferCheck", "Checking buffer(10,10) of B" ) );
 }
+void TestQgsGeometry::chainedOperationsCheck()
+{
+  // results of GEOS operations are used directly by the next operation
+  QgsGeometry * mypBufferGeometry = mpPolygonGeometryA->buffer( 10, 10 );
+  QgsGeometry * mypIntersectionGeometry = mypBufferGeometry->intersection( mpPolygonGeometryB );
+  QVERIFY( mypIntersectionGeometry->wkbType() == QGis::WKBPolygon );
+  QVERIFY( mypIntersectionGeometry->isMultipart() == false );
+  QVERIFY( mypIntersectionGeometry->asPolygon().size() > 0 );
+  delete mypIntersectionGeometry;
+  delete mypBufferGeometry;
+
+  // an edited vertex must not be ignored by a cached GEOS geometry
+  QVERIFY( mpPolygonGeometryC->intersects( mpPolygonGeometryA ) == false );
+  QVERIFY( mpPolygonGeometryC->moveVertex( 50, 50, 0 ) );
+  mypIntersectionGeometry = mpPolygonGeometryC->intersection( mpPolygonGeometryA );
+  QVERIFY( mypIntersectionGeometry->wkbType() == QGis::WKBPolygon );
+  QVERIFY( mypIntersectionGeometry->asPolygon().size() > 0 );
+  delete mypIntersectionGeometry;
+
+  // multi part WKB converted to GEOS and back
+  QgsGeometry * mypMultiLine = QgsGeometry::fromWkt( "MULTILINESTRING((0 0, 10 10),(20 20, 30 30, 40 20))" );
+  QgsGeometry * mypMultiLineBuffer = mypMultiLine->buffer( 1, 8 );
+  QVERIFY( mypMultiLineBuffer->wkbType() == QGis::WKBMultiPolygon );
+  QVERIFY( mypMultiLineBuffer->asMultiPolygon().size() == 2 );
+  delete mypMultiLineBuffer;
+  delete mypMultiLine;
+}
+
 bool TestQgsGeometry::renderCheck( QString theTestName, QString theComment )
 {
   mReport += "<h2>" + theTestName + "</h2>\n";
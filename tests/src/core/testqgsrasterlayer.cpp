@@ -25,6 +25,10 @@
 #include <QSettings>
 #include <QTime>
 #include <QDesktopServices>
+#include <QTextStream>
+#include <QVector>
+
+#include <cmath>
 
 
 //qgis includes...
@@ -59,9 +63,14 @@ class TestQgsRasterLayer: public QObject
     void checkDimensions();
     void buildExternalOverviews();
     void registry();
+    void statistics();
+    void emptyStatistics();
+    void approximateStatistics();
   private:
     bool render( QString theFileName );
     bool setQml( QString theType );
+    /** Writes an ESRI ASCII grid with -9999 as no data value, returns the file name */
+    QString writeAsciiGrid( QString theName, int theColumns, int theRows, const QVector<double>& theValues );
     QString mTestDataDir;
     QgsRasterLayer * mpRasterLayer;
     QgsRasterLayer * mpLandsatRasterLayer;
@@ -223,10 +232,122 @@ void TestQgsRasterLayer::registry()
   //delete mypLayer;
 }
 
+void TestQgsRasterLayer::statistics()
+{
+  // one block per row: the statistics of the rows are merged
+  const int myColumns = 7, myRows = 5;
+  QVector<double> myValues;
+  double mySum = 0.0;
+  int myCount = 0;
+  for ( int i = 0; i < myColumns * myRows; i++ )
+  {
+    double myValue = i % 6 == 0 ? -9999 : 1000.0 + i * 0.5 - ( i % 3 ) * 7.25;
+    myValues << myValue;
+    if ( myValue != -9999 )
+    {
+      mySum += myValue;
+      myCount++;
+    }
+  }
+  double myMean = mySum / myCount;
+  double mySumOfSquares = 0.0;
+  double myMinimum = myValues.last(), myMaximum = myValues.last();
+  for ( int i = 0; i < myValues.size(); i++ )
+  {
+    if ( myValues[i] == -9999 )
+      continue;
+    mySumOfSquares += ( myValues[i] - myMean ) * ( myValues[i] - myMean );
+    myMinimum = qMin( myMinimum, myValues[i] );
+    myMaximum = qMax( myMaximum, myValues[i] );
+  }
+
+  QString myFileName = writeAsciiGrid( "statistics", myColumns, myRows, myValues );
+  QgsRasterLayer * mypLayer = new QgsRasterLayer( myFileName, "statistics" );
+  QVERIFY( mypLayer->isValid() );
+
+  QgsRasterBandStats myStats = mypLayer->bandStatistics( 1 );
+  QVERIFY( myStats.statsGathered );
+  QVERIFY( !myStats.statsEstimated );
+  QCOMPARE( myStats.elementCount, myCount );
+  QCOMPARE( myStats.minimumValue, myMinimum );
+  QCOMPARE( myStats.maximumValue, myMaximum );
+  QVERIFY( qAbs( myStats.mean - myMean ) < 1e-9 );
+  QVERIFY( qAbs( myStats.sumOfSquares - mySumOfSquares ) < 1e-6 );
+  QVERIFY( qAbs( myStats.stdDev - sqrt( mySumOfSquares / ( myCount - 1 ) ) ) < 1e-9 );
+  delete mypLayer;
+}
+
+void TestQgsRasterLayer::emptyStatistics()
+{
+  QString myFileName = writeAsciiGrid( "nodata", 4, 3, QVector<double>( 12, -9999 ) );
+  QgsRasterLayer * mypLayer = new QgsRasterLayer( myFileName, "nodata" );
+  QVERIFY( mypLayer->isValid() );
+
+  QgsRasterBandStats myStats = mypLayer->bandStatistics( 1 );
+  QCOMPARE( myStats.elementCount, 0 );
+  delete mypLayer;
+
+  // no statistics are stored with the dataset
+  QVERIFY( !QFile::exists( myFileName + ".aux.xml" ) );
+}
+
+void TestQgsRasterLayer::approximateStatistics()
+{
+  // more cells than are read for approximate statistics
+  const int myColumns = 1200, myRows = 1000;
+  QVector<double> myValues( myColumns * myRows );
+  for ( int i = 0; i < myValues.size(); i++ )
+  {
+    myValues[i] = i % 10;
+  }
+  QString myFileName = writeAsciiGrid( "approximate", myColumns, myRows, myValues );
+  QgsRasterLayer * mypLayer = new QgsRasterLayer( myFileName, "approximate" );
+  QVERIFY( mypLayer->isValid() );
+
+  QgsRasterBandStats myStats = mypLayer->bandStatistics( 1, true );
+  QVERIFY( myStats.statsGathered );
+  QVERIFY( myStats.statsEstimated );
+  QVERIFY( myStats.elementCount > 0 );
+  QVERIFY( myStats.elementCount < myColumns * myRows );
+  QCOMPARE( myStats.minimumValue, 0.0 );
+  QCOMPARE( myStats.maximumValue, 9.0 );
+  QVERIFY( qAbs( myStats.mean - 4.5 ) < 0.1 );
+
+  // exact statistics replace the estimated ones
+  myStats = mypLayer->bandStatistics( 1 );
+  QVERIFY( !myStats.statsEstimated );
+  QCOMPARE( myStats.elementCount, myColumns * myRows );
+  QVERIFY( qAbs( myStats.mean - 4.5 ) < 1e-9 );
+  delete mypLayer;
+}
+
 //
 // Helper methods
 //
 
+QString TestQgsRasterLayer::writeAsciiGrid( QString theName, int theColumns, int theRows, const QVector<double>& theValues )
+{
+  QString myFileName = QDir::tempPath() + QDir::separator() + theName + ".asc";
+  QFile::remove( myFileName + ".aux.xml" );
+  QFile myFile( myFileName );
+  if ( myFile.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+  {
+    QTextStream myStream( &myFile );
+    myStream << "ncols " << theColumns << "\n"
+    << "nrows " << theRows << "\n"
+    << "xllcorner 0\n"
+    << "yllcorner 0\n"
+    << "cellsize 1\n"
+    << "NODATA_value -9999\n";
+    myStream.setRealNumberPrecision( 17 );
+    for ( int i = 0; i < theValues.size(); i++ )
+    {
+      myStream << theValues[i] << (( i + 1 ) % theColumns == 0 ? "\n" : " " );
+    }
+  }
+  return myFileName;
+}
+
 
 bool TestQgsRasterLayer::render( QString theTestType )
 {
@@ -0,0 +1,177 @@
+/***************************************************************************
+                              testqgsrulebasedrendererv2.cpp
+                              -----------------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QImage>
+#include <QPainter>
+#include <QVariant>
+
+#include <limits>
+
+//qgis includes...
+#include <qgsapplication.h>
+#include <qgsfeature.h>
+#include <qgsproviderregistry.h>
+#include <qgsrendercontext.h>
+#include <qgsvectorlayer.h>
+#include <qgssymbolv2.h>
+#include <qgsrulebasedrendererv2.h>
+
+/** \ingroup UnitTests
+ * Rule-based renderer which records the symbols of the matching rules
+ * instead of drawing them.
+ */
+class TestRuleBasedRenderer : public QgsRuleBasedRendererV2
+{
+  public:
+    TestRuleBasedRenderer() : QgsRuleBasedRendererV2( QgsSymbolV2::defaultSymbol( QGis::Point ) ) {}
+
+    virtual QgsSymbolV2* symbolForFeature( QgsFeature& feature )
+    {
+      mDrawnSymbols << QgsRuleBasedRendererV2::symbolForFeature( feature );
+      return NULL;
+    }
+
+    QList<QgsSymbolV2*> mDrawnSymbols;
+};
+
+/** \ingroup UnitTests
+ * This is a unit test for the evaluation plan of the rule-based renderer.
+ * The rules drawn for each feature are compared with the rules whose scale
+ * range and filter match, in the order of the rule list.
+ */
+class TestQgsRuleBasedRendererV2: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {};// will be called before each testfunction is executed.
+    void cleanup() {};// will be called after every testfunction.
+
+    void rules_data();
+    void rules();
+  private:
+    QgsVectorLayer* mpLayer;
+    QImage mImage;
+    QPainter* mpPainter;
+};
+
+void TestQgsRuleBasedRendererV2::initTestCase()
+{
+  // init QGIS's paths - true means that all path will be inited from prefix
+  QgsApplication::setPrefixPath( INSTALL_PREFIX, true );
+  QgsApplication::showSettings();
+  // Instantiate the plugin directory so that providers are loaded
+  QgsProviderRegistry::instance( QgsApplication::pluginPath() );
+
+  // the renderer only takes the fields from the layer
+  mpLayer = new QgsVectorLayer( "Point?field=type:string&field=lanes:integer&field=width:double", "roads", "memory" );
+
+  mImage = QImage( 10, 10, QImage::Format_ARGB32 );
+  mpPainter = new QPainter( &mImage );
+}
+
+void TestQgsRuleBasedRendererV2::cleanupTestCase()
+{
+  delete mpPainter;
+  delete mpLayer;
+}
+
+void TestQgsRuleBasedRendererV2::rules_data()
+{
+  QTest::addColumn<double>( "scale" );
+
+  QTest::newRow( "small scale" ) << 1000.0;
+  QTest::newRow( "large scale" ) << 50000.0;
+}
+
+void TestQgsRuleBasedRendererV2::rules()
+{
+  QFETCH( double, scale );
+
+  TestRuleBasedRenderer renderer;
+  QStringList filters;
+  filters << "type = 'road'"
+  << "type = 'river'"
+  << "type = 'road' AND lanes > 2"
+  << "lanes > 2"
+  << "lanes > 2 AND width < 10"
+  << "lanes = 2"
+  << "lanes = '3'"
+  << "type = 'road' OR lanes = 1"
+  << "width = 7.5 AND type = 'road'"
+  << "type = 3"
+  << "type != 'road'"
+  << "type = 'nan'"
+  << "width = 'nan'"
+  << "";
+  for ( int i = 0; i < filters.size(); ++i )
+  {
+    renderer.addRule( QgsRuleBasedRendererV2::Rule( QgsSymbolV2::defaultSymbol( QGis::Point ), 0, 0, filters[i] ) );
+  }
+  // culled at the large scale
+  renderer.addRule( QgsRuleBasedRendererV2::Rule( QgsSymbolV2::defaultSymbol( QGis::Point ), 500, 10000, "type = 'road'" ) );
+  renderer.addRule( QgsRuleBasedRendererV2::Rule( QgsSymbolV2::defaultSymbol( QGis::Point ), 500, 10000, "lanes = 2" ) );
+
+  // type, lanes, width
+  QList< QList<QVariant> > values;
+  values << ( QList<QVariant>() << "road" << 1 << 7.5 )
+  << ( QList<QVariant>() << "road" << 3 << 12.0 )
+  << ( QList<QVariant>() << "road" << 2 << 7.5 )
+  << ( QList<QVariant>() << "river" << 2 << 30.0 )
+  << ( QList<QVariant>() << "river" << 3 << 5.0 )
+  << ( QList<QVariant>() << "path" << 1 << 1.5 )
+  << ( QList<QVariant>() << "3" << 0 << 0.0 )
+  << ( QList<QVariant>() << "Road" << 2 << 7.5 )
+  << ( QList<QVariant>() << QVariant( QVariant::String ) << 3 << 7.5 )
+  << ( QList<QVariant>() << "road" << QVariant( QVariant::Int ) << QVariant( QVariant::Double ) )
+  // strings and numbers which are NaN as a number
+  << ( QList<QVariant>() << "nan" << 2 << 30.0 )
+  << ( QList<QVariant>() << "road" << 3 << std::numeric_limits<double>::quiet_NaN() );
+
+  QgsRenderContext context;
+  context.setPainter( mpPainter );
+  context.setRendererScale( scale );
+  renderer.startRender( context, mpLayer );
+
+  QgsFieldMap fields = mpLayer->pendingFields();
+  for ( int i = 0; i < values.size(); ++i )
+  {
+    QgsFeature f( i );
+    for ( int j = 0; j < values[i].size(); ++j )
+    {
+      f.addAttribute( j, values[i][j] );
+    }
+
+    QList<QgsSymbolV2*> expected;
+    for ( int j = 0; j < renderer.ruleCount(); ++j )
+    {
+      QgsRuleBasedRendererV2::Rule& rule = renderer.ruleAt( j );
+      if ( rule.isScaleOK( scale ) && rule.isFilterOK( fields, f ) )
+        expected << rule.symbol();
+    }
+
+    renderer.mDrawnSymbols.clear();
+    renderer.renderFeature( f, context );
+    QCOMPARE( renderer.mDrawnSymbols, expected );
+  }
+
+  renderer.stopRender( context );
+}
+
+QTEST_MAIN( TestQgsRuleBasedRendererV2 )
+#include "moc_testqgsrulebasedrendererv2.cxx"
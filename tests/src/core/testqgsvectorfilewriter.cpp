@@ -28,6 +28,8 @@
 #include <qgspoint.h> //we will use point geometry
 #include <qgscoordinatereferencesystem.h> //needed for creating a srs
 #include <qgsapplication.h> //search path for srs.db
+#include <qgsproviderregistry.h> //memory and ogr provider for the read back test
+#include <qgsvectordataprovider.h>
 #include <qgsfield.h>
 #include <qgis.h> //defines GEOWkt
 
@@ -70,6 +72,9 @@ class TestQgsVectorFileWriter: public QObject
     void polygonGridTest();
     /** As above but using a projected CRS*/
     void projectedPlygonGridTest();
+    /** This method tests writing a layer (more features than the writer queue holds)
+     * with writeAsVectorFormat and reading it back */
+    void writeAsVectorFormatReadBack();
 
   private:
     // a little util fn used by all tests
@@ -95,6 +100,8 @@ void TestQgsVectorFileWriter::initTestCase()
   QString qgisPath = QCoreApplication::applicationDirPath();
   QgsApplication::setPrefixPath( INSTALL_PREFIX, true );
   QgsApplication::showSettings();
+  // Instantiate the plugin directory so that providers are loaded
+  QgsProviderRegistry::instance( QgsApplication::pluginPath() );
   //create some objects that will be used in all tests...
 
   mEncoding = "UTF-8";
@@ -389,6 +396,55 @@ void TestQgsVectorFileWriter::projectedPlygonGridTest()
   }
 }
 
+void TestQgsVectorFileWriter::writeAsVectorFormatReadBack()
+{
+  QString myFileName = QDir::tempPath() + "/testreadback.shp";
+  QVERIFY( QgsVectorFileWriter::deleteShapeFile( myFileName ) );
+
+  // a grid of points, numbered row by row
+  QgsVectorLayer mySourceLayer( "Point?field=id:integer&field=name:string", "points", "memory" );
+  QVERIFY( mySourceLayer.isValid() );
+  const int myCount = 2500;
+  QgsFeatureList myFeatures;
+  for ( int i = 0; i < myCount; i++ )
+  {
+    QgsFeature myFeature;
+    myFeature.setGeometry( QgsGeometry::fromPoint( QgsPoint( i % 50, i / 50 ) ) );
+    myFeature.addAttribute( 0, i );
+    myFeature.addAttribute( 1, QString( "point %1" ).arg( i ) );
+    myFeatures << myFeature;
+  }
+  QVERIFY( mySourceLayer.dataProvider()->addFeatures( myFeatures ) );
+
+  QString myErrorMessage;
+  mError = QgsVectorFileWriter::writeAsVectorFormat( &mySourceLayer, myFileName, mEncoding, 0,
+           "ESRI Shapefile", false, &myErrorMessage );
+  QVERIFY( mError == QgsVectorFileWriter::NoError );
+  QVERIFY( myErrorMessage.isEmpty() );
+
+  QgsVectorLayer myLayer( myFileName, "readback", "ogr" );
+  QVERIFY( myLayer.isValid() );
+  QCOMPARE(( int ) myLayer.featureCount(), myCount );
+
+  int myIdIndex = myLayer.fieldNameIndex( "id" );
+  int myNameIndex = myLayer.fieldNameIndex( "name" );
+  QVERIFY( myIdIndex >= 0 );
+  QVERIFY( myNameIndex >= 0 );
+
+  QSet<int> myIds;
+  QgsFeature myFeature;
+  myLayer.select( myLayer.pendingAllAttributesList() );
+  while ( myLayer.nextFeature( myFeature ) )
+  {
+    int myId = myFeature.attributeMap()[ myIdIndex ].toInt();
+    myIds << myId;
+    QCOMPARE( myFeature.attributeMap()[ myNameIndex ].toString(), QString( "point %1" ).arg( myId ) );
+    QVERIFY( myFeature.geometry() );
+    QCOMPARE( myFeature.geometry()->asPoint(), QgsPoint( myId % 50, myId / 50 ) );
+  }
+  QCOMPARE( myIds.size(), myCount );
+}
+
 QTEST_MAIN( TestQgsVectorFileWriter )
 #include "moc_testqgsvectorfilewriter.cxx"
 
@@ -0,0 +1,243 @@
+/***************************************************************************
+                              testqgswfsprovider.cpp
+                              -----------------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTime>
+#include <QUrl>
+
+//qgis includes...
+#include <qgsapplication.h>
+#include <qgsfeature.h>
+#include <qgsgeometry.h>
+#include <qgsproviderregistry.h>
+#include <qgsvectordataprovider.h>
+#include <qgsvectorlayer.h>
+
+#define FEATURE_COUNT 1000 //features in the GetFeature response, on a grid of 100 x 10
+#define FIRST_PART_COUNT 10 //features sent before the response is stalled
+
+/** \ingroup UnitTests
+ * Local stand-in for a WFS server. The GetFeature response is sent in two parts:
+ * the collection bounding box with the first features right away and the rest
+ * only when sendRest() is called.
+ */
+class TestWfsServer : public QTcpServer
+{
+    Q_OBJECT;
+  public:
+    TestWfsServer() : mGetFeatureSocket( 0 ), mGetFeatureRequests( 0 )
+    {
+      connect( this, SIGNAL( newConnection() ), this, SLOT( acceptConnection() ) );
+    }
+
+    QString url() const
+    {
+      return QString( "http://127.0.0.1:%1/wfs?SERVICE=WFS&VERSION=1.0.0&REQUEST=GetFeature&TYPENAME=test:points&SRSNAME=EPSG:4326" ).arg( serverPort() );
+    }
+    int getFeatureRequests() const { return mGetFeatureRequests; }
+
+    /**Sends the remaining features of the GetFeature response*/
+    void sendRest()
+    {
+      if ( !mGetFeatureSocket )
+        return;
+      mGetFeatureSocket->write( mRest );
+      mGetFeatureSocket->disconnectFromHost();
+      mGetFeatureSocket = 0;
+    }
+
+  private slots:
+    void acceptConnection()
+    {
+      while ( hasPendingConnections() )
+      {
+        QTcpSocket *socket = nextPendingConnection();
+        connect( socket, SIGNAL( readyRead() ), this, SLOT( readRequest() ) );
+        connect( socket, SIGNAL( disconnected() ), socket, SLOT( deleteLater() ) );
+      }
+    }
+
+    void readRequest()
+    {
+      QTcpSocket *socket = qobject_cast<QTcpSocket*>( sender() );
+      mRequests[socket] += socket->readAll();
+      if ( !mRequests[socket].contains( "\r\n\r\n" ) )
+        return; // header not complete yet
+
+      // GET <path> HTTP/1.1
+      QByteArray path = mRequests.take( socket ).split( ' ' ).value( 1 );
+      QString request = QUrl::fromEncoded( path ).queryItemValue( "REQUEST" );
+
+      QByteArray body;
+      if ( request == "DescribeFeatureType" )
+      {
+        // on one line: the provider looks at the column of the first complexType
+        body = "<?xml version=\"1.0\"?>"
+               "<xsd:schema xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\" xmlns:gml=\"http://www.opengis.net/gml\""
+               " xmlns:test=\"http://test\" targetNamespace=\"http://test\" elementFormDefault=\"qualified\">"
+               "<xsd:complexType name=\"pointsType\"><xsd:complexContent><xsd:extension base=\"gml:AbstractFeatureType\"><xsd:sequence>"
+               "<xsd:element name=\"name\" type=\"xsd:string\"/>"
+               "<xsd:element name=\"the_geom\" type=\"gml:PointPropertyType\"/>"
+               "</xsd:sequence></xsd:extension></xsd:complexContent></xsd:complexType>"
+               "<xsd:element name=\"points\" type=\"test:pointsType\" substitutionGroup=\"gml:_Feature\"/>"
+               "</xsd:schema>";
+      }
+      else if ( request == "GetCapabilities" )
+      {
+        body = "<?xml version=\"1.0\"?>"
+               "<WFS_Capabilities version=\"1.0.0\" xmlns=\"http://www.opengis.net/wfs\">"
+               "<FeatureTypeList><Operations><Insert/></Operations>"
+               "<FeatureType><Name>test:points</Name></FeatureType>"
+               "</FeatureTypeList></WFS_Capabilities>";
+      }
+      else if ( request == "GetFeature" )
+      {
+        mGetFeatureRequests++;
+
+        QByteArray first = "<?xml version=\"1.0\"?>"
+                           "<wfs:FeatureCollection xmlns:wfs=\"http://www.opengis.net/wfs\" xmlns:gml=\"http://www.opengis.net/gml\" xmlns:test=\"http://test\">"
+                           "<gml:boundedBy><gml:Box srsName=\"EPSG:4326\">"
+                           "<gml:coordinates decimal=\".\" cs=\",\" ts=\" \">0,0 99,9</gml:coordinates>"
+                           "</gml:Box></gml:boundedBy>";
+        mRest.clear();
+        for ( int i = 0; i < FEATURE_COUNT; ++i )
+        {
+          QByteArray member = QString( "<gml:featureMember><test:points fid=\"points.%1\">"
+                                       "<test:name>feature %1</test:name>"
+                                       "<test:the_geom><gml:Point srsName=\"EPSG:4326\">"
+                                       "<gml:coordinates decimal=\".\" cs=\",\" ts=\" \">%2,%3</gml:coordinates>"
+                                       "</gml:Point></test:the_geom>"
+                                       "</test:points></gml:featureMember>" ).arg( i ).arg( i % 100 ).arg( i / 100 ).toUtf8();
+          if ( i < FIRST_PART_COUNT )
+            first += member;
+          else
+            mRest += member;
+        }
+        mRest += "</wfs:FeatureCollection>";
+
+        // the length of the complete response, but only the first part is sent for now
+        socket->write( "HTTP/1.1 200 OK\r\nContent-Type: text/xml\r\nContent-Length: " +
+                       QByteArray::number( first.size() + mRest.size() ) +
+                       "\r\nConnection: close\r\n\r\n" + first );
+        mGetFeatureSocket = socket;
+        return;
+      }
+
+      socket->write( "HTTP/1.1 200 OK\r\nContent-Type: text/xml\r\nContent-Length: " +
+                     QByteArray::number( body.size() ) +
+                     "\r\nConnection: close\r\n\r\n" + body );
+      socket->disconnectFromHost();
+    }
+
+  private:
+    QTcpSocket* mGetFeatureSocket;
+    QByteArray mRest;
+    int mGetFeatureRequests;
+    QHash<QTcpSocket*, QByteArray> mRequests;
+};
+
+/** \ingroup UnitTests
+ * This is a unit test for the streaming GetFeature download of the WFS provider.
+ */
+class TestQgsWfsProvider: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase() {};// will be called after the last testfunction was executed.
+    void init() {};// will be called before each testfunction is executed.
+    void cleanup() {};// will be called after every testfunction.
+
+    void streamedGetFeature();
+  private:
+    /** Ids of the features the provider returns for an extent */
+    QList<int> selectedIds( QgsVectorDataProvider* provider, const QgsRectangle& rect );
+};
+
+void TestQgsWfsProvider::initTestCase()
+{
+  // init QGIS's paths - true means that all path will be inited from prefix
+  QgsApplication::setPrefixPath( INSTALL_PREFIX, true );
+  QgsApplication::showSettings();
+  // Instantiate the plugin directory so that providers are loaded
+  QgsProviderRegistry::instance( QgsApplication::pluginPath() );
+}
+
+QList<int> TestQgsWfsProvider::selectedIds( QgsVectorDataProvider* provider, const QgsRectangle& rect )
+{
+  QList<int> ids;
+  QgsFeature feature;
+  provider->select( QgsAttributeList(), rect, true, true );
+  while ( provider->nextFeature( feature ) )
+  {
+    ids << feature.id();
+  }
+  qSort( ids );
+  return ids;
+}
+
+void TestQgsWfsProvider::streamedGetFeature()
+{
+  TestWfsServer server;
+  QVERIFY( server.listen( QHostAddress::LocalHost ) );
+
+  // the layer is created as soon as the extent and the first features have arrived
+  QgsVectorLayer* layer = new QgsVectorLayer( server.url(), "wfs test", "WFS" );
+  QVERIFY( layer->isValid() );
+  QgsVectorDataProvider* provider = layer->dataProvider();
+  QCOMPARE( provider->extent(), QgsRectangle( 0, 0, 99, 9 ) );
+  QCOMPARE( provider->geometryType(), QGis::WKBPoint );
+  QVERIFY( provider->featureCount() >= 1 );
+  QVERIFY( provider->featureCount() <= FIRST_PART_COUNT );
+  // no editing while the download is running
+  QCOMPARE( provider->capabilities(), 0 );
+
+  // the features received so far can be queried
+  QList<int> ids = selectedIds( provider, QgsRectangle( -0.5, -0.5, 0.5, 0.5 ) );
+  QCOMPARE( ids, QList<int>() << 0 );
+
+  // the rest of the response arrives in the background
+  server.sendRest();
+  QTime t;
+  t.start();
+  while ( provider->featureCount() < FEATURE_COUNT && t.elapsed() < 10000 )
+  {
+    QCoreApplication::processEvents( QEventLoop::WaitForMoreEvents, 100 );
+  }
+  QCOMPARE(( int ) provider->featureCount(), FEATURE_COUNT );
+  QCOMPARE( provider->capabilities(), ( int ) QgsVectorDataProvider::AddFeatures );
+
+  QgsFeature feature;
+  QVERIFY( provider->featureAtId( 523, feature, true, QgsAttributeList() << 0 ) );
+  QCOMPARE( feature.attributeMap()[0].toString(), QString( "feature 523" ) );
+  QCOMPARE( feature.geometry()->asPoint(), QgsPoint( 23, 5 ) );
+
+  // extent queries are answered from the local spatial index
+  for ( int i = 0; i < 3; ++i )
+  {
+    ids = selectedIds( provider, QgsRectangle( 9.5, 1.5, 12.5, 3.5 ) );
+    QCOMPARE( ids, QList<int>() << 110 << 111 << 112 << 210 << 211 << 212 );
+  }
+  QCOMPARE( selectedIds( provider, QgsRectangle( 0, 0, 99, 9 ) ).size(), FEATURE_COUNT );
+  QCOMPARE( server.getFeatureRequests(), 1 );
+
+  delete layer;
+}
+
+QTEST_MAIN( TestQgsWfsProvider )
+#include "moc_testqgswfsprovider.cxx"
@@ -0,0 +1,202 @@
+/***************************************************************************
+                              testqgswmsprovider.cpp
+                              -----------------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QBuffer>
+#include <QColor>
+#include <QHash>
+#include <QImage>
+#include <QSettings>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTime>
+#include <QUrl>
+
+//qgis includes...
+#include <qgsrasterlayer.h>
+#include <qgsrasterdataprovider.h>
+#include <qgsapplication.h>
+#include <qgsproviderregistry.h>
+
+/** \ingroup UnitTests
+ * Local stand-in for a WMS-C server: answers GetCapabilities with one tile set
+ * of 2x2 tiles and GetMap with red tiles (or never, to test the timeout).
+ */
+class TestWmsServer : public QTcpServer
+{
+    Q_OBJECT;
+  public:
+    TestWmsServer( bool answerTiles ) : mAnswerTiles( answerTiles ), mTileRequests( 0 )
+    {
+      connect( this, SIGNAL( newConnection() ), this, SLOT( acceptConnection() ) );
+    }
+
+    QString url() const { return QString( "http://127.0.0.1:%1/wms" ).arg( serverPort() ); }
+    int tileRequests() const { return mTileRequests; }
+
+  private slots:
+    void acceptConnection()
+    {
+      while ( hasPendingConnections() )
+      {
+        QTcpSocket *socket = nextPendingConnection();
+        connect( socket, SIGNAL( readyRead() ), this, SLOT( readRequest() ) );
+        connect( socket, SIGNAL( disconnected() ), socket, SLOT( deleteLater() ) );
+      }
+    }
+
+    void readRequest()
+    {
+      QTcpSocket *socket = qobject_cast<QTcpSocket*>( sender() );
+      mRequests[socket] += socket->readAll();
+      if ( !mRequests[socket].contains( "\r\n\r\n" ) )
+        return; // header not complete yet
+
+      // GET <path> HTTP/1.1
+      QByteArray path = mRequests.take( socket ).split( ' ' ).value( 1 );
+      QString request = QUrl::fromEncoded( path ).queryItemValue( "REQUEST" );
+
+      QByteArray contentType, body;
+      if ( request == "GetCapabilities" )
+      {
+        contentType = "application/vnd.ogc.wms_xml";
+        body = "<?xml version=\"1.0\"?>"
+               "<WMT_MS_Capabilities version=\"1.1.1\">"
+               "<Service><Name>OGC:WMS</Name><Title>test</Title></Service>"
+               "<Capability><VendorSpecificCapabilities><TileSet>"
+               "<SRS>EPSG:4326</SRS>"
+               "<BoundingBox SRS=\"EPSG:4326\" minx=\"0\" miny=\"0\" maxx=\"2\" maxy=\"2\"/>"
+               "<Resolutions>0.0078125 0.00390625</Resolutions>"
+               "<Width>256</Width><Height>256</Height>"
+               "<Format>image/png</Format><Layers>test</Layers><Styles></Styles>"
+               "</TileSet></VendorSpecificCapabilities></Capability>"
+               "</WMT_MS_Capabilities>";
+      }
+      else
+      {
+        mTileRequests++;
+        if ( !mAnswerTiles )
+          return; // keep the request open
+
+        QImage tile( 256, 256, QImage::Format_ARGB32 );
+        tile.fill( QColor( Qt::red ).rgba() );
+        QBuffer buffer( &body );
+        buffer.open( QIODevice::WriteOnly );
+        tile.save( &buffer, "PNG" );
+        contentType = "image/png";
+      }
+
+      socket->write( "HTTP/1.1 200 OK\r\nContent-Type: " + contentType +
+                     "\r\nContent-Length: " + QByteArray::number( body.size() ) +
+                     "\r\nConnection: close\r\n\r\n" + body );
+      socket->disconnectFromHost();
+    }
+
+  private:
+    bool mAnswerTiles;
+    int mTileRequests;
+    QHash<QTcpSocket*, QByteArray> mRequests;
+};
+
+/** \ingroup UnitTests
+ * This is a unit test for the tiled (WMS-C) drawing of the WMS provider.
+ */
+class TestQgsWmsProvider: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {};// will be called before each testfunction is executed.
+    void cleanup() {};// will be called after every testfunction.
+
+    void drawWaitsForTiles();
+    void drawTimeout();
+  private:
+    QgsRasterLayer* tiledLayer( const TestWmsServer& server );
+};
+
+void TestQgsWmsProvider::initTestCase()
+{
+  // init QGIS's paths - true means that all path will be inited from prefix
+  QgsApplication::setPrefixPath( INSTALL_PREFIX, true );
+  QgsApplication::showSettings();
+  // Instantiate the plugin directory so that providers are loaded
+  QgsProviderRegistry::instance( QgsApplication::pluginPath() );
+
+  // draw() has to deliver the complete image without render caching
+  QSettings s;
+  s.setValue( "/qgis/enable_render_caching", false );
+}
+
+void TestQgsWmsProvider::cleanupTestCase()
+{
+  QSettings s;
+  s.remove( "/qgis/networkAndProxy/networkTimeout" );
+}
+
+QgsRasterLayer* TestQgsWmsProvider::tiledLayer( const TestWmsServer& server )
+{
+  return new QgsRasterLayer( 0, "wms test", "tiled=256;256;0.0078125;0.00390625,url=" + server.url(), "wms",
+                             QStringList() << "test", QStringList() << "", "image/png", "EPSG:4326" );
+}
+
+void TestQgsWmsProvider::drawWaitsForTiles()
+{
+  TestWmsServer server( true );
+  QVERIFY( server.listen( QHostAddress::LocalHost ) );
+
+  QgsRasterLayer* layer = tiledLayer( server );
+  QVERIFY( layer->isValid() );
+
+  // the view is the layer extent at the finest resolution: 2x2 tiles
+  QImage* image = layer->dataProvider()->draw( QgsRectangle( 0, 0, 2, 2 ), 512, 512 );
+  QVERIFY( image );
+  QCOMPARE( server.tileRequests(), 4 );
+  QCOMPARE( QColor( image->pixel( 128, 128 ) ), QColor( Qt::red ) );
+  QCOMPARE( QColor( image->pixel( 384, 128 ) ), QColor( Qt::red ) );
+  QCOMPARE( QColor( image->pixel( 128, 384 ) ), QColor( Qt::red ) );
+  QCOMPARE( QColor( image->pixel( 384, 384 ) ), QColor( Qt::red ) );
+
+  delete layer;
+}
+
+void TestQgsWmsProvider::drawTimeout()
+{
+  TestWmsServer server( false );
+  QVERIFY( server.listen( QHostAddress::LocalHost ) );
+
+  QSettings s;
+  s.setValue( "/qgis/networkAndProxy/networkTimeout", 1000 );
+
+  QgsRasterLayer* layer = tiledLayer( server );
+  QVERIFY( layer->isValid() );
+
+  // the tiles never arrive, draw() gives up after the timeout
+  QTime t;
+  t.start();
+  QImage* image = layer->dataProvider()->draw( QgsRectangle( 0, 0, 2, 2 ), 512, 512 );
+  QVERIFY( image );
+  QVERIFY( t.elapsed() >= 1000 );
+  QVERIFY( t.elapsed() < 10000 );
+  QCOMPARE( server.tileRequests(), 4 );
+  QCOMPARE( qAlpha( image->pixel( 128, 128 ) ), 0 );
+
+  delete layer;
+}
+
+QTEST_MAIN( TestQgsWmsProvider )
+#include "moc_testqgswmsprovider.cxx"
@@ -0,0 +1,256 @@
+/***************************************************************************
+                              testqgsspatialquery.cpp
+                              -----------------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QProgressBar>
+#include <cmath>
+
+//header for class being tested
+#include <qgsspatialquery.h>
+#include <qgsapplication.h>
+#include <qgsproviderregistry.h>
+#include <qgsgeometry.h>
+#include <qgsvectordataprovider.h>
+#include <qgsvectorlayer.h>
+
+class TestQgsSpatialQuery: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+    void init() {};// will be called before each testfunction is executed.
+    void cleanup() {};// will be called after every testfunction.
+    /** Our tests proper begin here */
+    void relations_data();
+    void relations();
+    void manyTargets_data();
+    void manyTargets();
+  private:
+    /** Memory layer with a polygon for each WKT */
+    QgsVectorLayer* polygonLayer( const QStringList& wkts );
+    /** Ids of the target features matching the relation, checking every pair */
+    QSet<int> expectedResult( int relation, QgsVectorLayer* target, QgsVectorLayer* reference );
+    /** Checks the query result against the result of checking every pair */
+    void checkQuery( int relation, QgsVectorLayer* target, QgsVectorLayer* reference );
+    /** Relation of two geometries with the QgsGeometry predicates */
+    bool relation( int relation, QgsGeometry* target, QgsGeometry* reference );
+
+    // the larger layer, its geometries are prepared when it is the target
+    QgsVectorLayer * mpManyLayer;
+    // the smaller layer, its geometries are prepared when it is the reference
+    QgsVectorLayer * mpFewLayer;
+    // a few large zones overlapping a grid of many small buildings
+    QgsVectorLayer * mpZonesLayer;
+    QgsVectorLayer * mpBuildingsLayer;
+};
+
+void TestQgsSpatialQuery::initTestCase()
+{
+  // init QGIS's paths - true means that all path will be inited from prefix
+  QgsApplication::setPrefixPath( INSTALL_PREFIX, true );
+  QgsApplication::showSettings();
+  // Instantiate the plugin directory so that providers are loaded
+  QgsProviderRegistry::instance( QgsApplication::pluginPath() );
+
+  mpManyLayer = polygonLayer( QStringList()
+                              << "POLYGON((0 0,10 0,10 10,0 10,0 0))"
+                              << "POLYGON((2 2,4 2,4 4,2 4,2 2))"
+                              << "POLYGON((10 0,12 0,12 2,10 2,10 0))"
+                              << "POLYGON((8 8,12 8,12 12,8 12,8 8))"
+                              << "POLYGON((20 20,21 20,21 21,20 21,20 20))" );
+  mpFewLayer = polygonLayer( QStringList()
+                             << "POLYGON((0 0,10 0,10 10,0 10,0 0))"
+                             << "POLYGON((3 3,5 3,5 5,3 5,3 3))" );
+
+  // two zones with many vertices: a circle and a ring around its center
+  QString circle, outerRing, innerRing;
+  for ( int i = 0; i <= 256; ++i )
+  {
+    double angle = 2 * M_PI * ( i % 256 ) / 256;
+    QString sep = i > 0 ? "," : "";
+    circle += sep + QString( "%1 %2" ).arg( 30 + 25 * cos( angle ) ).arg( 30 + 25 * sin( angle ) );
+    outerRing += sep + QString( "%1 %2" ).arg( 50 + 45 * cos( angle ) ).arg( 50 + 45 * sin( angle ) );
+    innerRing += sep + QString( "%1 %2" ).arg( 50 + 35 * cos( -angle ) ).arg( 50 + 35 * sin( -angle ) );
+  }
+  mpZonesLayer = polygonLayer( QStringList()
+                               << QString( "POLYGON((%1))" ).arg( circle )
+                               << QString( "POLYGON((%1),(%2))" ).arg( outerRing ).arg( innerRing ) );
+
+  // 50 x 50 buildings of 1.5 x 1.5 every 2 units
+  QStringList buildings;
+  for ( int y = 0; y < 50; ++y )
+  {
+    for ( int x = 0; x < 50; ++x )
+    {
+      double x0 = 2 * x, y0 = 2 * y, x1 = x0 + 1.5, y1 = y0 + 1.5;
+      buildings << QString( "POLYGON((%1 %2,%3 %2,%3 %4,%1 %4,%1 %2))" ).arg( x0 ).arg( y0 ).arg( x1 ).arg( y1 );
+    }
+  }
+  mpBuildingsLayer = polygonLayer( buildings );
+}
+
+void TestQgsSpatialQuery::cleanupTestCase()
+{
+  delete mpManyLayer;
+  delete mpFewLayer;
+  delete mpZonesLayer;
+  delete mpBuildingsLayer;
+}
+
+void TestQgsSpatialQuery::relations_data()
+{
+  QTest::addColumn<int>( "relation" );
+  QTest::addColumn<bool>( "manyIsTarget" );
+
+  QList< QPair<int, QString> > relations;
+  relations << qMakePair( ( int ) Intersects, QString( "intersects" ) )
+  << qMakePair( ( int ) Disjoint, QString( "disjoint" ) )
+  << qMakePair( ( int ) Touches, QString( "touches" ) )
+  << qMakePair( ( int ) Crosses, QString( "crosses" ) )
+  << qMakePair( ( int ) Within, QString( "within" ) )
+  << qMakePair( ( int ) Equals, QString( "equals" ) )
+  << qMakePair( ( int ) Overlaps, QString( "overlaps" ) )
+  << qMakePair( ( int ) Contains, QString( "contains" ) );
+
+  for ( int i = 0; i < relations.size(); ++i )
+  {
+    // prepared reference geometries
+    QTest::newRow(( relations[i].second + " prepared reference" ).toLocal8Bit().constData() ) << relations[i].first << true;
+    // prepared target geometries
+    QTest::newRow(( relations[i].second + " prepared target" ).toLocal8Bit().constData() ) << relations[i].first << false;
+  }
+}
+
+void TestQgsSpatialQuery::relations()
+{
+  QFETCH( int, relation );
+  QFETCH( bool, manyIsTarget );
+
+  QgsVectorLayer* target = manyIsTarget ? mpManyLayer : mpFewLayer;
+  QgsVectorLayer* reference = manyIsTarget ? mpFewLayer : mpManyLayer;
+  checkQuery( relation, target, reference );
+}
+
+void TestQgsSpatialQuery::manyTargets_data()
+{
+  QTest::addColumn<int>( "relation" );
+  QTest::addColumn<bool>( "buildingsAreTarget" );
+
+  // each zone is the candidate of many buildings: evaluated in parallel by reference
+  // (prepared zones) and by target (the zones share the building geometries)
+  QTest::newRow( "intersects prepared reference" ) << ( int ) Intersects << true;
+  QTest::newRow( "within prepared reference" ) << ( int ) Within << true;
+  QTest::newRow( "disjoint prepared reference" ) << ( int ) Disjoint << true;
+  QTest::newRow( "intersects prepared target" ) << ( int ) Intersects << false;
+  QTest::newRow( "contains prepared target" ) << ( int ) Contains << false;
+  QTest::newRow( "overlaps prepared target" ) << ( int ) Overlaps << false;
+}
+
+void TestQgsSpatialQuery::manyTargets()
+{
+  QFETCH( int, relation );
+  QFETCH( bool, buildingsAreTarget );
+
+  QgsVectorLayer* target = buildingsAreTarget ? mpBuildingsLayer : mpZonesLayer;
+  QgsVectorLayer* reference = buildingsAreTarget ? mpZonesLayer : mpBuildingsLayer;
+  // repeated, races of the worker threads show up as wrong results or crashes
+  for ( int i = 0; i < 5; ++i )
+  {
+    checkQuery( relation, target, reference );
+  }
+}
+
+void TestQgsSpatialQuery::checkQuery( int relation, QgsVectorLayer* target, QgsVectorLayer* reference )
+{
+  QProgressBar progressBar;
+  MngProgressBar pb( &progressBar );
+  QgsSpatialQuery spatialQuery( &pb );
+  spatialQuery.setSelectedFeaturesTarget( false );
+  spatialQuery.setSelectedFeaturesReference( false );
+
+  QSet<int> result, invalidTarget, invalidReference;
+  QVERIFY( spatialQuery.runQuery( result, invalidTarget, invalidReference, relation, target, reference ) );
+  QVERIFY( invalidTarget.isEmpty() );
+  QVERIFY( invalidReference.isEmpty() );
+  QCOMPARE( result, expectedResult( relation, target, reference ) );
+}
+
+QgsVectorLayer* TestQgsSpatialQuery::polygonLayer( const QStringList& wkts )
+{
+  QgsVectorLayer* layer = new QgsVectorLayer( "Polygon", "polygons", "memory" );
+  QgsFeatureList features;
+  for ( int i = 0; i < wkts.size(); ++i )
+  {
+    QgsFeature feature;
+    feature.setGeometry( QgsGeometry::fromWkt( wkts[i] ) );
+    features << feature;
+  }
+  layer->dataProvider()->addFeatures( features );
+  layer->updateExtents();
+  return layer;
+}
+
+QSet<int> TestQgsSpatialQuery::expectedResult( int relation, QgsVectorLayer* target, QgsVectorLayer* reference )
+{
+  QgsFeatureList referenceFeatures;
+  QgsFeature feature;
+  reference->select( QgsAttributeList() );
+  while ( reference->nextFeature( feature ) )
+  {
+    referenceFeatures << feature;
+  }
+
+  QSet<int> result;
+  target->select( QgsAttributeList() );
+  while ( target->nextFeature( feature ) )
+  {
+    bool found = false;
+    for ( int i = 0; i < referenceFeatures.size() && !found; ++i )
+    {
+      // disjoint: no reference intersects the target
+      found = this->relation( relation == Disjoint ? ( int ) Intersects : relation,
+                              feature.geometry(), referenceFeatures[i].geometry() );
+    }
+    if ( relation == Disjoint ? !found : found )
+    {
+      result.insert( feature.id() );
+    }
+  }
+  return result;
+}
+
+bool TestQgsSpatialQuery::relation( int relation, QgsGeometry* target, QgsGeometry* reference )
+{
+  switch ( relation )
+  {
+    case Intersects:
+      return target->intersects( reference );
+    case Equals:
+      return target->equals( reference );
+    case Touches:
+      return target->touches( reference );
+    case Overlaps:
+      return target->overlaps( reference );
+    case Within:
+      return target->within( reference );
+    case Contains:
+      return target->contains( reference );
+    case Crosses:
+      return target->crosses( reference );
+  }
+  return false;
+}
+
+QTEST_MAIN( TestQgsSpatialQuery )
+#include "moc_testqgsspatialquery.cxx"
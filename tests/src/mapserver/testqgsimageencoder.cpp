@@ -0,0 +1,225 @@
+/***************************************************************************
+                              testqgsimageencoder.cpp
+                              -----------------------
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QColor>
+#include <QImage>
+#include <QSet>
+
+//header for class being tested
+#include "qgsimageencoder.h"
+
+/** \ingroup UnitTests
+ * This is a unit test for the image encoder of the map server. The encoded
+ * images are decoded with Qt and compared with the originals.
+ */
+class TestQgsImageEncoder: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase() {};// will be called before the first testfunction is executed.
+    void cleanupTestCase() {};// will be called after the last testfunction was executed.
+    void init() {};// will be called before each testfunction is executed.
+    void cleanup() {};// will be called after every testfunction.
+
+    void png_data();
+    void png();
+    void pngPremultiplied();
+    void pngSeveralChunks();
+    void png8_data();
+    void png8();
+    void png8ManyColors();
+    void jpeg();
+  private:
+    /** Image with random pixels, alpha values only if the format has an alpha channel */
+    QImage noiseImage( int width, int height, QImage::Format format );
+    /** Image with a few colors and a transparent border */
+    QImage fewColorsImage();
+    /** Compares the pixels of two images */
+    bool samePixels( const QImage& image1, const QImage& image2, int tolerance = 0 );
+};
+
+QImage TestQgsImageEncoder::noiseImage( int width, int height, QImage::Format format )
+{
+  qsrand( 42 );
+  QImage image( width, height, QImage::Format_ARGB32 );
+  bool alpha = format != QImage::Format_RGB32;
+  for ( int y = 0; y < height; ++y )
+  {
+    for ( int x = 0; x < width; ++x )
+    {
+      image.setPixel( x, y, qRgba( qrand() % 256, qrand() % 256, qrand() % 256, alpha ? qrand() % 256 : 255 ) );
+    }
+  }
+  return image.convertToFormat( format );
+}
+
+QImage TestQgsImageEncoder::fewColorsImage()
+{
+  QImage image( 40, 30, QImage::Format_ARGB32 );
+  image.fill( qRgba( 0, 0, 0, 0 ) );
+  for ( int y = 5; y < 25; ++y )
+  {
+    for ( int x = 5; x < 35; ++x )
+    {
+      if ( x < 15 )
+        image.setPixel( x, y, qRgb( 255, 0, 0 ) );
+      else if ( x < 25 )
+        image.setPixel( x, y, qRgb( 0, 128, 0 ) );
+      else
+        image.setPixel( x, y, qRgba( 0, 0, 255, 128 ) );
+    }
+  }
+  return image;
+}
+
+bool TestQgsImageEncoder::samePixels( const QImage& image1, const QImage& image2, int tolerance )
+{
+  if ( image1.size() != image2.size() )
+  {
+    qWarning( "Size differs: %dx%d and %dx%d", image1.width(), image1.height(), image2.width(), image2.height() );
+    return false;
+  }
+  QImage i1 = image1.convertToFormat( QImage::Format_ARGB32 );
+  QImage i2 = image2.convertToFormat( QImage::Format_ARGB32 );
+  for ( int y = 0; y < i1.height(); ++y )
+  {
+    for ( int x = 0; x < i1.width(); ++x )
+    {
+      QRgb p1 = i1.pixel( x, y );
+      QRgb p2 = i2.pixel( x, y );
+      if ( qAbs( qRed( p1 ) - qRed( p2 ) ) > tolerance || qAbs( qGreen( p1 ) - qGreen( p2 ) ) > tolerance
+           || qAbs( qBlue( p1 ) - qBlue( p2 ) ) > tolerance || qAbs( qAlpha( p1 ) - qAlpha( p2 ) ) > tolerance )
+      {
+        qWarning( "Pixel %d/%d differs: %08x and %08x", x, y, p1, p2 );
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void TestQgsImageEncoder::png_data()
+{
+  QTest::addColumn<int>( "format" );
+  QTest::addColumn<int>( "filter" );
+
+  QList< QPair<int, QString> > filters;
+  filters << qMakePair(( int ) QgsImageEncoder::FilterNone, QString( "none" ) )
+  << qMakePair(( int ) QgsImageEncoder::FilterSub, QString( "sub" ) )
+  << qMakePair(( int ) QgsImageEncoder::FilterUp, QString( "up" ) )
+  << qMakePair(( int ) QgsImageEncoder::FilterPaeth, QString( "paeth" ) )
+  << qMakePair(( int ) QgsImageEncoder::FilterAdaptive, QString( "adaptive" ) );
+
+  for ( int i = 0; i < filters.size(); ++i )
+  {
+    QTest::newRow(( "rgb " + filters[i].second ).toLocal8Bit().constData() ) << ( int ) QImage::Format_RGB32 << filters[i].first;
+    QTest::newRow(( "argb " + filters[i].second ).toLocal8Bit().constData() ) << ( int ) QImage::Format_ARGB32 << filters[i].first;
+  }
+}
+
+void TestQgsImageEncoder::png()
+{
+  QFETCH( int, format );
+  QFETCH( int, filter );
+
+  QImage image = noiseImage( 53, 37, ( QImage::Format ) format );
+  QByteArray png = QgsImageEncoder::encodePng( image, 6, ( QgsImageEncoder::PngFilter ) filter );
+
+  QImage decoded;
+  QVERIFY( decoded.loadFromData( png, "PNG" ) );
+  QCOMPARE( decoded.hasAlphaChannel(), image.hasAlphaChannel() );
+  QVERIFY( samePixels( decoded, image ) );
+}
+
+void TestQgsImageEncoder::pngPremultiplied()
+{
+  // the encoder unpremultiplies the pixels like Qt does
+  QImage image = noiseImage( 53, 37, QImage::Format_ARGB32_Premultiplied );
+  QByteArray png = QgsImageEncoder::encodePng( image, 6, QgsImageEncoder::FilterAdaptive );
+
+  QImage decoded;
+  QVERIFY( decoded.loadFromData( png, "PNG" ) );
+  QVERIFY( decoded.hasAlphaChannel() );
+  QVERIFY( samePixels( decoded.convertToFormat( QImage::Format_ARGB32_Premultiplied ), image, 1 ) );
+}
+
+void TestQgsImageEncoder::pngSeveralChunks()
+{
+  // noise does not compress, the data is split in several IDAT chunks
+  QImage image = noiseImage( 600, 400, QImage::Format_ARGB32 );
+  QByteArray png = QgsImageEncoder::encodePng( image, 0, QgsImageEncoder::FilterNone );
+  QVERIFY( png.count( "IDAT" ) > 1 );
+
+  QImage decoded;
+  QVERIFY( decoded.loadFromData( png, "PNG" ) );
+  QVERIFY( samePixels( decoded, image ) );
+}
+
+void TestQgsImageEncoder::png8_data()
+{
+  QTest::addColumn<int>( "filter" );
+  QTest::newRow( "none" ) << ( int ) QgsImageEncoder::FilterNone;
+  QTest::newRow( "adaptive" ) << ( int ) QgsImageEncoder::FilterAdaptive;
+}
+
+void TestQgsImageEncoder::png8()
+{
+  QFETCH( int, filter );
+
+  // few colors (and the transparent border) are kept exactly
+  QImage image = fewColorsImage();
+  QByteArray png = QgsImageEncoder::encodePng8( image, 6, ( QgsImageEncoder::PngFilter ) filter );
+
+  QImage decoded;
+  QVERIFY( decoded.loadFromData( png, "PNG" ) );
+  QVERIFY( decoded.hasAlphaChannel() );
+  QVERIFY( samePixels( decoded, image ) );
+}
+
+void TestQgsImageEncoder::png8ManyColors()
+{
+  QImage image = noiseImage( 100, 100, QImage::Format_RGB32 );
+  QByteArray png = QgsImageEncoder::encodePng8( image, 6, QgsImageEncoder::FilterNone );
+
+  QImage decoded;
+  QVERIFY( decoded.loadFromData( png, "PNG" ) );
+  QCOMPARE( decoded.size(), image.size() );
+  QVERIFY( !decoded.hasAlphaChannel() );
+
+  QSet<QRgb> colors;
+  for ( int y = 0; y < decoded.height(); ++y )
+  {
+    for ( int x = 0; x < decoded.width(); ++x )
+    {
+      colors.insert( decoded.pixel( x, y ) );
+    }
+  }
+  QVERIFY( colors.size() <= 256 );
+  QVERIFY( colors.size() > 128 );
+}
+
+void TestQgsImageEncoder::jpeg()
+{
+  QImage image( 64, 48, QImage::Format_RGB32 );
+  image.fill( qRgb( 0, 0, 255 ) );
+  QByteArray jpeg = QgsImageEncoder::encodeJpeg( image, 90 );
+
+  QImage decoded;
+  QVERIFY( decoded.loadFromData( jpeg, "JPG" ) );
+  QVERIFY( samePixels( decoded, image, 8 ) );
+}
+
+QTEST_MAIN( TestQgsImageEncoder )
+#include "moc_testqgsimageencoder.cxx"